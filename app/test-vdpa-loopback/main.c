@@ -0,0 +1,882 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright (c) 2024 NVIDIA Corporation & Affiliates
+ */
+
+/*
+ * Loopback test of vDPA devices through virtio-user.
+ *
+ * The process plays the guest: a net_virtio_user port is attached either to
+ * the vhost-user socket of a VF served by vfe-vhostd, or to a
+ * /dev/vhost-vdpa-N device such as vdpa_sim_net. Packets sent on the port
+ * come back on the same port (vdpa_sim_net, VF with a hairpin) or on a peer
+ * port given with --peer. The datapath and the control path of the backend
+ * are then measured without a VM:
+ *
+ * - throughput: bursts are sent at full rate, looped packets are counted.
+ * - latency: one packet at a time, each send is a doorbell, so relay mode
+ *   doorbells show up here.
+ * - memtbl: hugepage memory is added and removed, each change goes to the
+ *   backend as a memory table update with the queues paused, the time until
+ *   packets loop again is measured.
+ * - restart: the port is stopped and started, which closes and configures
+ *   the vDPA device and sets up its notifiers again.
+ *
+ * One JSON object per line is printed for each case and test.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_bus_vdev.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_memory.h>
+#include <rte_memzone.h>
+#include <rte_string_fns.h>
+
+#define MAX_LIST		16
+#define MAX_QUEUES		8
+#define MAX_BURST		512
+#define MAX_LAT_SAMPLES		(1 << 20)
+#define MAX_ITERATIONS		1024
+
+#define DEF_PKTS		(1 << 22)
+#define DEF_PINGS		10000
+#define DEF_ITERATIONS		10
+#define DEF_QUEUE_SIZE		256
+#define DEF_PKT_SIZE		64
+#define DEF_BURST		32
+#define DEF_MEMTBL_MB		64
+#define NB_MBUF			65535
+#define MBUF_CACHE		256
+
+/* vfe-vhostd configures the VF before link comes up */
+#define READY_TIMEOUT_MS	30000
+#define PING_TIMEOUT_MS		10
+#define TX_STALL_MS		1000
+#define DRAIN_MS		100
+#define PROBE_INTERVAL_US	100
+
+#define LB_ETHER_TYPE		0x88B5 /* Local experimental */
+#define LB_MAGIC		0x76646c62 /* "vdlb" */
+#define LB_PORT_NAME		"net_virtio_user_lb"
+
+enum lb_test {
+	LB_TEST_THROUGHPUT,
+	LB_TEST_LATENCY,
+	LB_TEST_MEMTBL,
+	LB_TEST_RESTART,
+	LB_TEST_MAX,
+};
+
+static const char * const test_names[] = {
+	[LB_TEST_THROUGHPUT] = "throughput",
+	[LB_TEST_LATENCY] = "latency",
+	[LB_TEST_MEMTBL] = "memtbl",
+	[LB_TEST_RESTART] = "restart",
+	NULL,
+};
+
+struct lb_list {
+	uint32_t val[MAX_LIST];
+	uint32_t nb;
+};
+
+static struct {
+	struct lb_list packed;
+	struct lb_list pkt_size;
+	struct lb_list burst;
+	struct lb_list queues;
+	struct lb_list tests;
+	const char *path;
+	const char *peer;
+	bool server;
+	struct rte_ether_addr dst_mac;
+	uint64_t nb_pkts;
+	uint32_t nb_pings;
+	uint32_t iterations;
+	uint32_t memtbl_mb;
+	uint16_t queue_size;
+	FILE *out;
+} opts = {
+	.nb_pkts = DEF_PKTS,
+	.nb_pings = DEF_PINGS,
+	.iterations = DEF_ITERATIONS,
+	.memtbl_mb = DEF_MEMTBL_MB,
+	.queue_size = DEF_QUEUE_SIZE,
+	.dst_mac = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }},
+};
+
+struct lb_case {
+	bool packed;
+	uint16_t pkt_size;
+	uint16_t burst;
+	uint16_t nb_queues;
+	uint16_t tx_port;
+	uint16_t rx_port;
+};
+
+struct lb_hdr {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t tsc;
+} __rte_packed;
+
+struct lb_stats {
+	uint64_t *samples;
+	uint32_t nb;
+	uint32_t stride;
+	uint64_t seen;
+};
+
+static struct rte_mempool *mbuf_pool;
+static uint64_t *lat_samples;
+static uint32_t lb_seq;
+static volatile uint32_t nb_mem_events;
+
+static void
+usage(const char *prgname)
+{
+	printf("%s [EAL options] --\n"
+		"  --path <path>: vhost-user socket of the VF, or /dev/vhost-vdpa-N\n"
+		"  --peer <path>: second port receiving what the first one sends\n"
+		"  --server: act as vhost-user server, for vfe-vhostd in client mode\n"
+		"  --mac <xx:xx:xx:xx:xx:xx>: destination MAC (default: broadcast)\n"
+		"  --test <throughput,latency,memtbl,restart>: tests to run\n"
+		"        (default: throughput,latency)\n"
+		"  --ring <split,packed>: ring layouts to test (default: split)\n"
+		"  --pkt-size <N,...>: packet sizes in bytes (default: %u)\n"
+		"  --burst <N,...>: burst sizes (default: %u)\n"
+		"  --queues <N,...>: queue pair counts (default: 1)\n"
+		"  --pkts <N>: packets per throughput case (default: %u)\n"
+		"  --pings <N>: packets per latency case (default: %u)\n"
+		"  --iterations <N>: changes per memtbl and restart case (default: %u)\n"
+		"  --memtbl-size <MB>: memory added per memtbl change (default: %u)\n"
+		"  --queue-size <N>: virtio ring size (default: %u)\n"
+		"  --output <file>: write results to file instead of stdout\n",
+		prgname, DEF_PKT_SIZE, DEF_BURST, DEF_PKTS, DEF_PINGS,
+		DEF_ITERATIONS, DEF_MEMTBL_MB, DEF_QUEUE_SIZE);
+}
+
+static int
+parse_list(const char *arg, struct lb_list *list,
+		const char * const *names, uint32_t max)
+{
+	char buf[256];
+	char *tok[MAX_LIST];
+	char *end;
+	int i, j, n;
+
+	if (strlcpy(buf, arg, sizeof(buf)) >= sizeof(buf))
+		return -EINVAL;
+
+	n = rte_strsplit(buf, strlen(buf), tok, MAX_LIST, ',');
+	if (n <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		if (names != NULL) {
+			for (j = 0; names[j] != NULL; j++)
+				if (strcmp(tok[i], names[j]) == 0)
+					break;
+			if (names[j] == NULL)
+				return -EINVAL;
+			list->val[i] = j;
+			continue;
+		}
+		errno = 0;
+		list->val[i] = strtoul(tok[i], &end, 0);
+		if (errno != 0 || *end != '\0' || list->val[i] > max)
+			return -EINVAL;
+	}
+	list->nb = n;
+
+	return 0;
+}
+
+static void
+list_default(struct lb_list *list, uint32_t val)
+{
+	if (list->nb == 0) {
+		list->val[0] = val;
+		list->nb = 1;
+	}
+}
+
+static int
+parse_u32(const char *arg, uint32_t min, uint32_t max, uint32_t *val)
+{
+	char *end;
+
+	errno = 0;
+	*val = strtoul(arg, &end, 0);
+	if (errno != 0 || *end != '\0' || *val < min || *val > max)
+		return -EINVAL;
+	return 0;
+}
+
+static int
+parse_u64(const char *arg, uint64_t min, uint64_t *val)
+{
+	char *end;
+
+	errno = 0;
+	*val = strtoull(arg, &end, 0);
+	if (errno != 0 || *end != '\0' || *arg == '-' || *val < min)
+		return -EINVAL;
+	return 0;
+}
+
+static int
+parse_args(int argc, char **argv)
+{
+	static const char * const ring_names[] = { "split", "packed", NULL };
+	static const struct option lgopts[] = {
+		{ "path", 1, 0, 0 },
+		{ "peer", 1, 0, 0 },
+		{ "server", 0, 0, 0 },
+		{ "mac", 1, 0, 0 },
+		{ "test", 1, 0, 0 },
+		{ "ring", 1, 0, 0 },
+		{ "pkt-size", 1, 0, 0 },
+		{ "burst", 1, 0, 0 },
+		{ "queues", 1, 0, 0 },
+		{ "pkts", 1, 0, 0 },
+		{ "pings", 1, 0, 0 },
+		{ "iterations", 1, 0, 0 },
+		{ "memtbl-size", 1, 0, 0 },
+		{ "queue-size", 1, 0, 0 },
+		{ "output", 1, 0, 0 },
+		{ "help", 0, 0, 0 },
+		{ NULL, 0, 0, 0 },
+	};
+	struct lb_list list;
+	const char *name;
+	int opt, idx, ret = 0;
+
+	while ((opt = getopt_long(argc, argv, "", lgopts, &idx)) != EOF) {
+		if (opt != 0) {
+			usage(argv[0]);
+			return -EINVAL;
+		}
+		name = lgopts[idx].name;
+		if (!strcmp(name, "path")) {
+			opts.path = optarg;
+		} else if (!strcmp(name, "peer")) {
+			opts.peer = optarg;
+		} else if (!strcmp(name, "server")) {
+			opts.server = true;
+		} else if (!strcmp(name, "mac")) {
+			ret = rte_ether_unformat_addr(optarg, &opts.dst_mac);
+		} else if (!strcmp(name, "test")) {
+			ret = parse_list(optarg, &opts.tests, test_names, 0);
+		} else if (!strcmp(name, "ring")) {
+			ret = parse_list(optarg, &opts.packed, ring_names, 0);
+		} else if (!strcmp(name, "pkt-size")) {
+			ret = parse_list(optarg, &opts.pkt_size, NULL,
+					RTE_MBUF_DEFAULT_DATAROOM);
+		} else if (!strcmp(name, "burst")) {
+			ret = parse_list(optarg, &opts.burst, NULL, MAX_BURST);
+		} else if (!strcmp(name, "queues")) {
+			ret = parse_list(optarg, &opts.queues, NULL, MAX_QUEUES);
+		} else if (!strcmp(name, "pkts")) {
+			ret = parse_u64(optarg, 1, &opts.nb_pkts);
+		} else if (!strcmp(name, "pings")) {
+			ret = parse_u32(optarg, 1, MAX_LAT_SAMPLES, &opts.nb_pings);
+		} else if (!strcmp(name, "iterations")) {
+			ret = parse_u32(optarg, 1, MAX_ITERATIONS, &opts.iterations);
+		} else if (!strcmp(name, "memtbl-size")) {
+			ret = parse_u32(optarg, 1, UINT16_MAX, &opts.memtbl_mb);
+		} else if (!strcmp(name, "queue-size")) {
+			ret = parse_list(optarg, &list, NULL, UINT16_MAX);
+			if (!ret && (list.nb != 1 || !rte_is_power_of_2(list.val[0])))
+				ret = -EINVAL;
+			opts.queue_size = list.val[0];
+		} else if (!strcmp(name, "output")) {
+			opts.out = fopen(optarg, "w");
+			ret = opts.out ? 0 : -errno;
+		} else {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (ret) {
+			printf("invalid value for --%s: %s\n", name, optarg);
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	if (opts.path == NULL) {
+		printf("--path is required\n");
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	if (opts.tests.nb == 0) {
+		opts.tests.val[0] = LB_TEST_THROUGHPUT;
+		opts.tests.val[1] = LB_TEST_LATENCY;
+		opts.tests.nb = 2;
+	}
+	list_default(&opts.packed, 0);
+	list_default(&opts.pkt_size, DEF_PKT_SIZE);
+	list_default(&opts.burst, DEF_BURST);
+	list_default(&opts.queues, 1);
+
+	if (opts.out == NULL)
+		opts.out = stdout;
+
+	return 0;
+}
+
+static double
+tsc_to_us(uint64_t cycles)
+{
+	return (double)cycles * US_PER_S / rte_get_tsc_hz();
+}
+
+static int
+pkts_alloc(const struct lb_case *lc, struct rte_mbuf **pkts, uint16_t nb)
+{
+	struct rte_ether_hdr *eth;
+	struct lb_hdr *hdr;
+	uint64_t tsc;
+	uint16_t i;
+
+	if (rte_pktmbuf_alloc_bulk(mbuf_pool, pkts, nb) != 0)
+		return -ENOMEM;
+
+	tsc = rte_rdtsc();
+	for (i = 0; i < nb; i++) {
+		pkts[i]->data_len = lc->pkt_size;
+		pkts[i]->pkt_len = lc->pkt_size;
+		eth = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+		rte_ether_addr_copy(&opts.dst_mac, &eth->dst_addr);
+		rte_eth_macaddr_get(lc->tx_port, &eth->src_addr);
+		eth->ether_type = rte_cpu_to_be_16(LB_ETHER_TYPE);
+		hdr = (struct lb_hdr *)(eth + 1);
+		hdr->magic = LB_MAGIC;
+		hdr->seq = lb_seq++;
+		hdr->tsc = tsc;
+	}
+
+	return 0;
+}
+
+/* Count our packets among the received ones, sample their latency */
+static uint16_t
+pkts_check(struct rte_mbuf **pkts, uint16_t nb, struct lb_stats *st)
+{
+	struct rte_ether_hdr *eth;
+	struct lb_hdr *hdr;
+	uint64_t now = rte_rdtsc();
+	uint16_t i, n = 0;
+
+	for (i = 0; i < nb; i++) {
+		eth = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+		if (rte_pktmbuf_data_len(pkts[i]) < sizeof(*eth) + sizeof(*hdr) ||
+				eth->ether_type != rte_cpu_to_be_16(LB_ETHER_TYPE))
+			continue;
+		hdr = (struct lb_hdr *)(eth + 1);
+		if (hdr->magic != LB_MAGIC)
+			continue;
+		n++;
+		if (st == NULL)
+			continue;
+		if (st->seen++ % st->stride == 0 && st->nb < MAX_LAT_SAMPLES)
+			st->samples[st->nb++] = now - hdr->tsc;
+	}
+	rte_pktmbuf_free_bulk(pkts, nb);
+
+	return n;
+}
+
+static uint16_t
+rx_poll(const struct lb_case *lc, uint16_t q, struct lb_stats *st)
+{
+	struct rte_mbuf *pkts[MAX_BURST];
+	uint16_t n;
+
+	n = rte_eth_rx_burst(lc->rx_port, q, pkts, MAX_BURST);
+	return n ? pkts_check(pkts, n, st) : 0;
+}
+
+static uint16_t
+tx_burst(const struct lb_case *lc, uint16_t q, uint16_t nb)
+{
+	struct rte_mbuf *pkts[MAX_BURST];
+	uint16_t n;
+
+	if (pkts_alloc(lc, pkts, nb))
+		return 0;
+	n = rte_eth_tx_burst(lc->tx_port, q, pkts, nb);
+	rte_pktmbuf_free_bulk(pkts + n, nb - n);
+
+	return n;
+}
+
+/* Probe until a packet comes back, e.g. after a control path change */
+static int
+wait_loopback(const struct lb_case *lc, uint32_t timeout_ms, uint64_t *cycles)
+{
+	uint64_t start = rte_rdtsc();
+	uint64_t deadline = start + rte_get_tsc_hz() * timeout_ms / 1000;
+	uint64_t next = start;
+	uint64_t now;
+
+	for (;;) {
+		now = rte_rdtsc();
+		if (now > deadline)
+			return -ETIMEDOUT;
+		if (now >= next) {
+			tx_burst(lc, 0, 1);
+			next = now + rte_get_tsc_hz() * PROBE_INTERVAL_US / US_PER_S;
+		}
+		if (rx_poll(lc, 0, NULL)) {
+			*cycles = rte_rdtsc() - start;
+			return 0;
+		}
+	}
+}
+
+static void
+drain(const struct lb_case *lc, struct lb_stats *st, uint64_t *rx)
+{
+	uint64_t deadline = rte_rdtsc() + rte_get_tsc_hz() * DRAIN_MS / 1000;
+	uint16_t q;
+
+	while (rte_rdtsc() < deadline)
+		for (q = 0; q < lc->nb_queues; q++)
+			*rx += rx_poll(lc, q, st);
+}
+
+static int
+u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Percentile of sorted samples, in us */
+static double
+pct_us(const uint64_t *samples, uint32_t nb, uint32_t permille)
+{
+	if (nb == 0)
+		return 0;
+	return tsc_to_us(samples[(uint64_t)(nb - 1) * permille / 1000]);
+}
+
+static void
+report_case(const struct lb_case *lc, enum lb_test test)
+{
+	fprintf(opts.out, "{\"test\":\"%s\",\"ring\":\"%s\",\"pkt_size\":%u,"
+		"\"burst\":%u,\"queues\":%u,",
+		test_names[test], lc->packed ? "packed" : "split",
+		lc->pkt_size, lc->burst, lc->nb_queues);
+}
+
+static void
+report_dist(const char *name, uint64_t *samples, uint32_t nb)
+{
+	qsort(samples, nb, sizeof(samples[0]), u64_cmp);
+	fprintf(opts.out, "\"%s\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+		"\"p999\":%.1f,\"max\":%.1f}",
+		name, pct_us(samples, nb, 500), pct_us(samples, nb, 900),
+		pct_us(samples, nb, 990), pct_us(samples, nb, 999),
+		pct_us(samples, nb, 1000));
+}
+
+static int
+test_throughput(const struct lb_case *lc)
+{
+	struct lb_stats st = {
+		.samples = lat_samples,
+		.stride = opts.nb_pkts / MAX_LAT_SAMPLES + 1,
+	};
+	uint64_t stall = rte_get_tsc_hz() * TX_STALL_MS / 1000;
+	uint64_t tx = 0, rx = 0, start, elapsed, now, last_tx;
+	uint16_t q, n;
+
+	start = rte_rdtsc();
+	last_tx = start;
+	while (tx < opts.nb_pkts) {
+		now = rte_rdtsc();
+		for (q = 0; q < lc->nb_queues; q++) {
+			n = tx_burst(lc, q, lc->burst);
+			if (n)
+				last_tx = now;
+			tx += n;
+			rx += rx_poll(lc, q, &st);
+		}
+		/* Backend stopped taking packets, report what got through */
+		if (now - last_tx > stall) {
+			printf("no packet sent in %u ms, stopping after %" PRIu64 "\n",
+				TX_STALL_MS, tx);
+			break;
+		}
+	}
+	elapsed = rte_rdtsc() - start;
+	drain(lc, &st, &rx);
+
+	report_case(lc, LB_TEST_THROUGHPUT);
+	fprintf(opts.out, "\"tx\":%" PRIu64 ",\"rx\":%" PRIu64 ",\"loss\":%.6f,"
+		"\"mpps\":%.3f,",
+		tx, rx, tx ? (double)(tx - RTE_MIN(rx, tx)) / tx : 0,
+		elapsed ? rx / tsc_to_us(elapsed) : 0);
+	report_dist("lat_us", st.samples, st.nb);
+	fprintf(opts.out, "}\n");
+	fflush(opts.out);
+
+	return rx && tx >= opts.nb_pkts ? 0 : -EIO;
+}
+
+static int
+test_latency(const struct lb_case *lc)
+{
+	struct lb_stats st = {
+		.samples = lat_samples,
+		.stride = 1,
+	};
+	uint32_t i, lost = 0;
+	uint64_t deadline;
+
+	for (i = 0; i < opts.nb_pings; i++) {
+		if (tx_burst(lc, 0, 1) == 0) {
+			lost++;
+			continue;
+		}
+		deadline = rte_rdtsc() + rte_get_tsc_hz() * PING_TIMEOUT_MS / 1000;
+		while (rx_poll(lc, 0, &st) == 0) {
+			if (rte_rdtsc() > deadline) {
+				lost++;
+				break;
+			}
+		}
+	}
+
+	report_case(lc, LB_TEST_LATENCY);
+	fprintf(opts.out, "\"pings\":%u,\"lost\":%u,", opts.nb_pings, lost);
+	report_dist("rtt_us", st.samples, st.nb);
+	fprintf(opts.out, "}\n");
+	fflush(opts.out);
+
+	return st.nb ? 0 : -EIO;
+}
+
+static void
+mem_event_cb(enum rte_mem_event type __rte_unused, const void *addr __rte_unused,
+		size_t len __rte_unused, void *arg __rte_unused)
+{
+	nb_mem_events++;
+}
+
+/*
+ * Each change pauses the queues, sends the new memory table to the backend
+ * and resumes the queues from the memory event callback of virtio-user.
+ * Memory is only added to the table if hugepages are really allocated,
+ * which needs dynamic memory mode and free hugepages.
+ */
+static int
+test_memtbl(const struct lb_case *lc)
+{
+	uint64_t add[MAX_ITERATIONS], del[MAX_ITERATIONS];
+	uint64_t recover[MAX_ITERATIONS * 2];
+	const struct rte_memzone *mz;
+	uint32_t i, nb_recover = 0, failed = 0, events;
+	uint64_t start, cycles;
+
+	events = nb_mem_events;
+	for (i = 0; i < opts.iterations; i++) {
+		start = rte_rdtsc();
+		mz = rte_memzone_reserve("vdpa_lb_memtbl",
+				(size_t)opts.memtbl_mb << 20, rte_socket_id(), 0);
+		add[i] = rte_rdtsc() - start;
+		if (mz == NULL) {
+			printf("failed to add %u MB: %s\n", opts.memtbl_mb,
+				rte_strerror(rte_errno));
+			return -ENOMEM;
+		}
+		if (wait_loopback(lc, READY_TIMEOUT_MS, &cycles) == 0)
+			recover[nb_recover++] = cycles;
+		else
+			failed++;
+
+		start = rte_rdtsc();
+		rte_memzone_free(mz);
+		del[i] = rte_rdtsc() - start;
+		if (wait_loopback(lc, READY_TIMEOUT_MS, &cycles) == 0)
+			recover[nb_recover++] = cycles;
+		else
+			failed++;
+	}
+
+	report_case(lc, LB_TEST_MEMTBL);
+	fprintf(opts.out, "\"changes\":%u,\"mem_events\":%u,\"no_traffic\":%u,",
+		opts.iterations * 2, nb_mem_events - events, failed);
+	report_dist("add_us", add, opts.iterations);
+	fprintf(opts.out, ",");
+	report_dist("del_us", del, opts.iterations);
+	fprintf(opts.out, ",");
+	report_dist("recover_us", recover, nb_recover);
+	fprintf(opts.out, "}\n");
+	fflush(opts.out);
+
+	if (nb_mem_events == events)
+		printf("no memory event, run without --legacy-mem and with free hugepages\n");
+
+	return failed ? -EIO : 0;
+}
+
+static int
+port_link_wait(uint16_t port, uint32_t timeout_ms)
+{
+	uint64_t deadline = rte_get_timer_cycles() +
+		rte_get_timer_hz() * timeout_ms / 1000;
+	struct rte_eth_link link;
+
+	for (;;) {
+		if (rte_eth_link_get_nowait(port, &link) == 0 &&
+				link.link_status == RTE_ETH_LINK_UP)
+			return 0;
+		if (rte_get_timer_cycles() > deadline)
+			return -ETIMEDOUT;
+		rte_delay_ms(1);
+	}
+}
+
+/* Stop and start close and configure the vDPA device, notifiers included */
+static int
+test_restart(const struct lb_case *lc)
+{
+	uint64_t start_cycles[MAX_ITERATIONS], traffic[MAX_ITERATIONS];
+	uint32_t i, nb_traffic = 0, failed = 0;
+	uint64_t start, cycles;
+	int ret;
+
+	for (i = 0; i < opts.iterations; i++) {
+		ret = rte_eth_dev_stop(lc->tx_port);
+		if (ret < 0)
+			return ret;
+
+		start = rte_rdtsc();
+		ret = rte_eth_dev_start(lc->tx_port);
+		start_cycles[i] = rte_rdtsc() - start;
+		if (ret < 0)
+			return ret;
+
+		if (wait_loopback(lc, READY_TIMEOUT_MS, &cycles) == 0)
+			traffic[nb_traffic++] = rte_rdtsc() - start;
+		else
+			failed++;
+	}
+
+	report_case(lc, LB_TEST_RESTART);
+	fprintf(opts.out, "\"restarts\":%u,\"no_traffic\":%u,",
+		opts.iterations, failed);
+	report_dist("start_us", start_cycles, opts.iterations);
+	fprintf(opts.out, ",");
+	report_dist("traffic_us", traffic, nb_traffic);
+	fprintf(opts.out, "}\n");
+	fflush(opts.out);
+
+	return failed ? -EIO : 0;
+}
+
+static int
+port_setup(const struct lb_case *lc, const char *path, uint32_t id, uint16_t *port)
+{
+	char name[RTE_ETH_NAME_MAX_LEN];
+	struct rte_eth_conf port_conf;
+	char args[PATH_MAX + 128];
+	uint16_t q;
+	int ret;
+
+	snprintf(name, sizeof(name), LB_PORT_NAME "%u", id);
+	snprintf(args, sizeof(args),
+		"path=%s,queues=%u,queue_size=%u,packed_vq=%d%s",
+		path, lc->nb_queues, opts.queue_size, lc->packed,
+		opts.server && strncmp(path, "/dev/vhost-vdpa", 15) ? ",server=1" : "");
+
+	ret = rte_vdev_init(name, args);
+	if (ret < 0) {
+		printf("failed to create virtio-user port: %s\n", args);
+		return ret;
+	}
+
+	ret = rte_eth_dev_get_port_by_name(name, port);
+	if (ret < 0)
+		return ret;
+
+	memset(&port_conf, 0, sizeof(port_conf));
+	ret = rte_eth_dev_configure(*port, lc->nb_queues, lc->nb_queues, &port_conf);
+	if (ret < 0)
+		return ret;
+
+	for (q = 0; q < lc->nb_queues; q++) {
+		ret = rte_eth_rx_queue_setup(*port, q, opts.queue_size,
+				rte_socket_id(), NULL, mbuf_pool);
+		if (ret < 0)
+			return ret;
+		ret = rte_eth_tx_queue_setup(*port, q, opts.queue_size,
+				rte_socket_id(), NULL);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = rte_eth_dev_start(*port);
+	if (ret < 0)
+		return ret;
+
+	ret = port_link_wait(*port, READY_TIMEOUT_MS);
+	if (ret < 0)
+		printf("port %s link not up in %u ms\n", name, READY_TIMEOUT_MS);
+
+	return ret;
+}
+
+static void
+port_close(uint32_t id, uint16_t port)
+{
+	char name[RTE_ETH_NAME_MAX_LEN];
+
+	if (port != RTE_MAX_ETHPORTS) {
+		rte_eth_dev_stop(port);
+		rte_eth_dev_close(port);
+	}
+	snprintf(name, sizeof(name), LB_PORT_NAME "%u", id);
+	rte_vdev_uninit(name);
+}
+
+static int
+run_case(struct lb_case *lc)
+{
+	uint16_t ports[2] = { RTE_MAX_ETHPORTS, RTE_MAX_ETHPORTS };
+	uint64_t cycles, rx = 0;
+	uint32_t i;
+	int ret;
+
+	ret = port_setup(lc, opts.path, 0, &ports[0]);
+	if (ret == 0 && opts.peer != NULL)
+		ret = port_setup(lc, opts.peer, 1, &ports[1]);
+	if (ret < 0)
+		goto close_ports;
+	lc->tx_port = ports[0];
+	lc->rx_port = opts.peer != NULL ? ports[1] : ports[0];
+
+	/* Backend may still be wiring the datapath after link up */
+	ret = wait_loopback(lc, READY_TIMEOUT_MS, &cycles);
+	if (ret < 0) {
+		printf("no packet looped back in %u ms\n", READY_TIMEOUT_MS);
+		goto close_ports;
+	}
+
+	for (i = 0; i < opts.tests.nb && ret == 0; i++) {
+		switch (opts.tests.val[i]) {
+		case LB_TEST_THROUGHPUT:
+			ret = test_throughput(lc);
+			break;
+		case LB_TEST_LATENCY:
+			ret = test_latency(lc);
+			break;
+		case LB_TEST_MEMTBL:
+			ret = test_memtbl(lc);
+			break;
+		case LB_TEST_RESTART:
+			ret = test_restart(lc);
+			break;
+		}
+		/* Leave nothing in flight for the next test */
+		drain(lc, NULL, &rx);
+	}
+
+close_ports:
+	if (opts.peer != NULL)
+		port_close(1, ports[1]);
+	port_close(0, ports[0]);
+
+	return ret;
+}
+
+/* Take the value of the innermost sweep dimension left in a case index */
+static uint32_t
+list_pick(const struct lb_list *list, uint32_t *idx)
+{
+	uint32_t val = list->val[*idx % list->nb];
+
+	*idx /= list->nb;
+	return val;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint32_t i, idx, nb_cases;
+	struct lb_case lc;
+	int ret, failed = 0;
+
+	ret = rte_eal_init(argc, argv);
+	if (ret < 0)
+		rte_exit(EXIT_FAILURE, "Cannot init EAL\n");
+	argc -= ret;
+	argv += ret;
+
+	if (parse_args(argc, argv) < 0)
+		rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+
+	mbuf_pool = rte_pktmbuf_pool_create("vdpa_lb_pool", NB_MBUF,
+			MBUF_CACHE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+	if (mbuf_pool == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create mbuf pool\n");
+
+	lat_samples = rte_malloc(NULL, MAX_LAT_SAMPLES * sizeof(*lat_samples), 0);
+	if (lat_samples == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot allocate latency samples\n");
+
+	rte_mem_event_callback_register("vdpa_lb_mem_event", mem_event_cb, NULL);
+
+	nb_cases = opts.packed.nb * opts.queues.nb * opts.pkt_size.nb *
+		opts.burst.nb;
+
+	for (i = 0; i < nb_cases; i++) {
+		idx = i;
+		memset(&lc, 0, sizeof(lc));
+		lc.burst = list_pick(&opts.burst, &idx);
+		lc.pkt_size = list_pick(&opts.pkt_size, &idx);
+		lc.nb_queues = list_pick(&opts.queues, &idx);
+		lc.packed = list_pick(&opts.packed, &idx);
+
+		if (lc.pkt_size < sizeof(struct rte_ether_hdr) + sizeof(struct lb_hdr) ||
+				lc.burst == 0 || lc.nb_queues == 0) {
+			printf("skipping invalid case pkt_size %u burst %u queues %u\n",
+				lc.pkt_size, lc.burst, lc.nb_queues);
+			continue;
+		}
+
+		ret = run_case(&lc);
+		if (ret < 0) {
+			printf("case failed: %s\n", strerror(-ret));
+			failed++;
+		}
+	}
+
+	rte_mem_event_callback_unregister("vdpa_lb_mem_event", NULL);
+	rte_free(lat_samples);
+	if (opts.out != stdout)
+		fclose(opts.out);
+	rte_eal_cleanup();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,726 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright (c) 2022 NVIDIA Corporation & Affiliates
+ */
+
+/*
+ * Loopback performance test for the vhost library.
+ *
+ * A vhost-user backend and a virtio-user frontend port are paired in the
+ * same process over a unix socket. The vhost side is driven through the
+ * library burst API, so the figures reported only account for
+ * lib/vhost/virtio_net.c, while the virtio-user port plays the guest.
+ * Every combination of the requested ring layouts, features, packet and
+ * burst sizes, queue counts and data paths is run in turn and one JSON
+ * object per line is printed for each case and direction.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_bus_vdev.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_dmadev.h>
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_string_fns.h>
+#include <rte_vhost.h>
+#include <rte_vhost_async.h>
+
+#define MAX_LIST		16
+#define MAX_QUEUES		8
+#define MAX_BURST		512
+#define MAX_LAT_SAMPLES		(1 << 20)
+
+#define DEF_PKTS		(1 << 22)
+#define DEF_QUEUE_SIZE		1024
+#define DEF_PKT_SIZE		64
+#define DEF_BURST		32
+#define NB_MBUF			65535
+#define MBUF_CACHE		256
+
+#define READY_TIMEOUT_MS	5000
+#define VIRTIO_USER_NAME	"net_virtio_user_perf"
+
+#define VIRTIO_RXQ		0
+#define VIRTIO_TXQ		1
+
+enum perf_path {
+	PERF_PATH_SYNC,
+	PERF_PATH_ASYNC,
+};
+
+enum perf_dir {
+	PERF_DIR_ENQUEUE,	/* vhost -> virtio-user */
+	PERF_DIR_DEQUEUE,	/* virtio-user -> vhost */
+};
+
+struct perf_list {
+	uint32_t val[MAX_LIST];
+	uint32_t nb;
+};
+
+static struct {
+	struct perf_list packed;
+	struct perf_list in_order;
+	struct perf_list mrg_rxbuf;
+	struct perf_list vectorized;
+	struct perf_list pkt_size;
+	struct perf_list burst;
+	struct perf_list queues;
+	struct perf_list path;
+	uint64_t nb_pkts;
+	uint16_t queue_size;
+	const char *sock_dir;
+	const char *dma_name;
+	int16_t dma_id;
+	FILE *out;
+} opts = {
+	.nb_pkts = DEF_PKTS,
+	.queue_size = DEF_QUEUE_SIZE,
+	.sock_dir = "/tmp",
+	.dma_id = -1,
+};
+
+struct perf_case {
+	bool packed;
+	bool in_order;
+	bool mrg_rxbuf;
+	bool vectorized;
+	enum perf_path path;
+	uint16_t pkt_size;
+	uint16_t burst;
+	uint16_t nb_queues;
+};
+
+struct perf_result {
+	uint64_t pkts;
+	uint64_t vhost_cycles;
+	uint64_t elapsed;
+	uint64_t *lat;
+	uint32_t nb_lat;
+	uint32_t lat_stride;
+};
+
+static struct rte_mempool *mbuf_pool;
+static uint64_t *lat_samples;
+
+static volatile int perf_vid = -1;
+static volatile bool perf_ready;
+static bool perf_async;
+static uint16_t perf_nb_queues;
+
+static void
+usage(const char *prgname)
+{
+	printf("%s [EAL options] --\n"
+		"  --ring <split,packed>: ring layouts to test (default: split)\n"
+		"  --in-order <0,1>: VIRTIO_F_IN_ORDER settings (default: 0)\n"
+		"  --mrg-rxbuf <0,1>: VIRTIO_NET_F_MRG_RXBUF settings (default: 0)\n"
+		"  --vectorized <0,1>: virtio-user vectorized paths (default: 0)\n"
+		"  --pkt-size <N,...>: packet sizes in bytes (default: %u)\n"
+		"  --burst <N,...>: burst sizes (default: %u)\n"
+		"  --queues <N,...>: queue pair counts (default: 1)\n"
+		"  --path <sync,async>: vhost enqueue paths (default: sync)\n"
+		"  --dma <name>: dmadev used by the async path\n"
+		"  --pkts <N>: packets per case and direction (default: %u)\n"
+		"  --queue-size <N>: virtio ring size (default: %u)\n"
+		"  --socket-dir <dir>: directory of the vhost-user socket (default: /tmp)\n"
+		"  --output <file>: write results to file instead of stdout\n",
+		prgname, DEF_PKT_SIZE, DEF_BURST, DEF_PKTS, DEF_QUEUE_SIZE);
+}
+
+static int
+parse_list(const char *arg, struct perf_list *list,
+		const char * const *names, uint32_t max)
+{
+	char buf[256];
+	char *tok[MAX_LIST];
+	char *end;
+	int i, j, n;
+
+	if (strlcpy(buf, arg, sizeof(buf)) >= sizeof(buf))
+		return -EINVAL;
+
+	n = rte_strsplit(buf, strlen(buf), tok, MAX_LIST, ',');
+	if (n <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		if (names != NULL) {
+			for (j = 0; names[j] != NULL; j++)
+				if (strcmp(tok[i], names[j]) == 0)
+					break;
+			if (names[j] == NULL)
+				return -EINVAL;
+			list->val[i] = j;
+			continue;
+		}
+		errno = 0;
+		list->val[i] = strtoul(tok[i], &end, 0);
+		if (errno != 0 || *end != '\0' || list->val[i] > max)
+			return -EINVAL;
+	}
+	list->nb = n;
+
+	return 0;
+}
+
+static void
+list_default(struct perf_list *list, uint32_t val)
+{
+	if (list->nb == 0) {
+		list->val[0] = val;
+		list->nb = 1;
+	}
+}
+
+static int
+parse_args(int argc, char **argv)
+{
+	static const char * const ring_names[] = { "split", "packed", NULL };
+	static const char * const path_names[] = { "sync", "async", NULL };
+	static const struct option lgopts[] = {
+		{ "ring", 1, 0, 0 },
+		{ "in-order", 1, 0, 0 },
+		{ "mrg-rxbuf", 1, 0, 0 },
+		{ "vectorized", 1, 0, 0 },
+		{ "pkt-size", 1, 0, 0 },
+		{ "burst", 1, 0, 0 },
+		{ "queues", 1, 0, 0 },
+		{ "path", 1, 0, 0 },
+		{ "dma", 1, 0, 0 },
+		{ "pkts", 1, 0, 0 },
+		{ "queue-size", 1, 0, 0 },
+		{ "socket-dir", 1, 0, 0 },
+		{ "output", 1, 0, 0 },
+		{ "help", 0, 0, 0 },
+		{ NULL, 0, 0, 0 },
+	};
+	struct perf_list list;
+	const char *name;
+	int opt, idx, ret = 0;
+
+	while ((opt = getopt_long(argc, argv, "", lgopts, &idx)) != EOF) {
+		if (opt != 0) {
+			usage(argv[0]);
+			return -EINVAL;
+		}
+		name = lgopts[idx].name;
+		if (!strcmp(name, "ring")) {
+			ret = parse_list(optarg, &opts.packed, ring_names, 0);
+		} else if (!strcmp(name, "in-order")) {
+			ret = parse_list(optarg, &opts.in_order, NULL, 1);
+		} else if (!strcmp(name, "mrg-rxbuf")) {
+			ret = parse_list(optarg, &opts.mrg_rxbuf, NULL, 1);
+		} else if (!strcmp(name, "vectorized")) {
+			ret = parse_list(optarg, &opts.vectorized, NULL, 1);
+		} else if (!strcmp(name, "pkt-size")) {
+			ret = parse_list(optarg, &opts.pkt_size, NULL,
+					RTE_MBUF_DEFAULT_DATAROOM);
+		} else if (!strcmp(name, "burst")) {
+			ret = parse_list(optarg, &opts.burst, NULL, MAX_BURST);
+		} else if (!strcmp(name, "queues")) {
+			ret = parse_list(optarg, &opts.queues, NULL, MAX_QUEUES);
+		} else if (!strcmp(name, "path")) {
+			ret = parse_list(optarg, &opts.path, path_names, 0);
+		} else if (!strcmp(name, "dma")) {
+			opts.dma_name = optarg;
+		} else if (!strcmp(name, "pkts")) {
+			opts.nb_pkts = strtoull(optarg, NULL, 0);
+			ret = opts.nb_pkts ? 0 : -EINVAL;
+		} else if (!strcmp(name, "queue-size")) {
+			ret = parse_list(optarg, &list, NULL, UINT16_MAX);
+			if (!ret && (list.nb != 1 || !rte_is_power_of_2(list.val[0])))
+				ret = -EINVAL;
+			opts.queue_size = list.val[0];
+		} else if (!strcmp(name, "socket-dir")) {
+			opts.sock_dir = optarg;
+		} else if (!strcmp(name, "output")) {
+			opts.out = fopen(optarg, "w");
+			ret = opts.out ? 0 : -errno;
+		} else {
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		}
+		if (ret) {
+			printf("invalid value for --%s: %s\n", name, optarg);
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	list_default(&opts.packed, 0);
+	list_default(&opts.in_order, 0);
+	list_default(&opts.mrg_rxbuf, 0);
+	list_default(&opts.vectorized, 0);
+	list_default(&opts.pkt_size, DEF_PKT_SIZE);
+	list_default(&opts.burst, DEF_BURST);
+	list_default(&opts.queues, 1);
+	list_default(&opts.path, PERF_PATH_SYNC);
+
+	if (opts.out == NULL)
+		opts.out = stdout;
+
+	return 0;
+}
+
+static int
+dma_setup(void)
+{
+	struct rte_dma_conf dev_conf = { .nb_vchans = 1 };
+	struct rte_dma_vchan_conf qconf = {
+		.direction = RTE_DMA_DIR_MEM_TO_MEM,
+	};
+	struct rte_dma_info info;
+	int16_t dev_id;
+
+	dev_id = rte_dma_get_dev_id_by_name(opts.dma_name);
+	if (dev_id < 0 || rte_dma_info_get(dev_id, &info) != 0) {
+		printf("dmadev %s not found\n", opts.dma_name);
+		return -ENODEV;
+	}
+
+	qconf.nb_desc = info.max_desc;
+	if (rte_dma_configure(dev_id, &dev_conf) != 0 ||
+			rte_dma_vchan_setup(dev_id, 0, &qconf) != 0 ||
+			rte_dma_start(dev_id) != 0) {
+		printf("failed to start dmadev %s\n", opts.dma_name);
+		return -EIO;
+	}
+
+	if (rte_vhost_async_dma_configure(dev_id, 0) < 0) {
+		printf("failed to bind dmadev %s to vhost\n", opts.dma_name);
+		return -EIO;
+	}
+
+	opts.dma_id = dev_id;
+	return 0;
+}
+
+static int
+new_device(int vid)
+{
+	uint16_t q;
+
+	if (perf_async) {
+		for (q = 0; q < perf_nb_queues; q++) {
+			if (rte_vhost_async_channel_register(vid,
+					q * 2 + VIRTIO_RXQ) < 0) {
+				printf("vid %d failed to register async channel %u\n",
+					vid, q * 2 + VIRTIO_RXQ);
+				return -1;
+			}
+		}
+	}
+
+	perf_vid = vid;
+	perf_ready = true;
+	return 0;
+}
+
+static void
+destroy_device(int vid)
+{
+	struct rte_mbuf *pkts[MAX_BURST];
+	uint16_t q, qid, n;
+
+	perf_ready = false;
+
+	if (!perf_async)
+		return;
+
+	for (q = 0; q < perf_nb_queues; q++) {
+		qid = q * 2 + VIRTIO_RXQ;
+		while (rte_vhost_async_get_inflight(vid, qid) > 0) {
+			n = rte_vhost_clear_queue_thread_unsafe(vid, qid, pkts,
+					MAX_BURST, opts.dma_id, 0);
+			rte_pktmbuf_free_bulk(pkts, n);
+		}
+		rte_vhost_async_channel_unregister(vid, qid);
+	}
+}
+
+static const struct rte_vhost_device_ops perf_ops = {
+	.new_device = new_device,
+	.destroy_device = destroy_device,
+};
+
+static int
+pkts_alloc(struct rte_mbuf **pkts, uint16_t nb, uint16_t pkt_size)
+{
+	struct rte_ether_hdr *eth;
+	uint64_t tsc;
+	uint16_t i;
+
+	if (rte_pktmbuf_alloc_bulk(mbuf_pool, pkts, nb) != 0)
+		return -ENOMEM;
+
+	tsc = rte_rdtsc();
+	for (i = 0; i < nb; i++) {
+		pkts[i]->data_len = pkt_size;
+		pkts[i]->pkt_len = pkt_size;
+		eth = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+		memset(eth, 0, sizeof(*eth));
+		eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+		*rte_pktmbuf_mtod_offset(pkts[i], uint64_t *, sizeof(*eth)) = tsc;
+	}
+
+	return 0;
+}
+
+static void
+lat_record(struct perf_result *res, struct rte_mbuf **pkts, uint16_t nb)
+{
+	uint64_t now = rte_rdtsc();
+	uint16_t i;
+
+	for (i = 0; i < nb; i++) {
+		if ((res->pkts + i) % res->lat_stride || res->nb_lat == MAX_LAT_SAMPLES)
+			continue;
+		res->lat[res->nb_lat++] = now - *rte_pktmbuf_mtod_offset(pkts[i],
+				uint64_t *, sizeof(struct rte_ether_hdr));
+	}
+}
+
+static uint16_t
+vhost_enqueue(const struct perf_case *pc, uint16_t qid,
+		struct rte_mbuf **pkts, uint16_t nb, struct perf_result *res)
+{
+	struct rte_mbuf *done[MAX_BURST];
+	uint64_t start;
+	uint16_t n, nb_done;
+
+	start = rte_rdtsc();
+	if (pc->path == PERF_PATH_ASYNC) {
+		n = rte_vhost_submit_enqueue_burst(perf_vid, qid, pkts, nb,
+				opts.dma_id, 0);
+		nb_done = rte_vhost_poll_enqueue_completed(perf_vid, qid, done,
+				MAX_BURST, opts.dma_id, 0);
+	} else {
+		n = rte_vhost_enqueue_burst(perf_vid, qid, pkts, nb);
+		nb_done = 0;
+	}
+	res->vhost_cycles += rte_rdtsc() - start;
+
+	if (pc->path == PERF_PATH_ASYNC)
+		rte_pktmbuf_free_bulk(done, nb_done);
+	else
+		rte_pktmbuf_free_bulk(pkts, n);
+	rte_pktmbuf_free_bulk(pkts + n, nb - n);
+
+	return n;
+}
+
+static int
+run_enqueue(const struct perf_case *pc, uint16_t port, struct perf_result *res)
+{
+	struct rte_mbuf *pkts[MAX_BURST];
+	uint64_t start;
+	uint16_t q, n;
+
+	start = rte_rdtsc();
+	while (res->pkts < opts.nb_pkts) {
+		for (q = 0; q < pc->nb_queues; q++) {
+			if (pkts_alloc(pkts, pc->burst, pc->pkt_size))
+				return -ENOMEM;
+			vhost_enqueue(pc, q * 2 + VIRTIO_RXQ, pkts, pc->burst, res);
+
+			n = rte_eth_rx_burst(port, q, pkts, pc->burst);
+			lat_record(res, pkts, n);
+			res->pkts += n;
+			rte_pktmbuf_free_bulk(pkts, n);
+		}
+		if (!perf_ready)
+			return -ENODEV;
+	}
+	res->elapsed = rte_rdtsc() - start;
+
+	return 0;
+}
+
+static int
+run_dequeue(const struct perf_case *pc, uint16_t port, struct perf_result *res)
+{
+	struct rte_mbuf *pkts[MAX_BURST];
+	uint64_t start, t;
+	uint16_t q, n;
+
+	start = rte_rdtsc();
+	while (res->pkts < opts.nb_pkts) {
+		for (q = 0; q < pc->nb_queues; q++) {
+			if (pkts_alloc(pkts, pc->burst, pc->pkt_size))
+				return -ENOMEM;
+			n = rte_eth_tx_burst(port, q, pkts, pc->burst);
+			rte_pktmbuf_free_bulk(pkts + n, pc->burst - n);
+
+			t = rte_rdtsc();
+			n = rte_vhost_dequeue_burst(perf_vid, q * 2 + VIRTIO_TXQ,
+					mbuf_pool, pkts, pc->burst);
+			res->vhost_cycles += rte_rdtsc() - t;
+			lat_record(res, pkts, n);
+			res->pkts += n;
+			rte_pktmbuf_free_bulk(pkts, n);
+		}
+		if (!perf_ready)
+			return -ENODEV;
+	}
+	res->elapsed = rte_rdtsc() - start;
+
+	return 0;
+}
+
+static int
+lat_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+lat_ns(const struct perf_result *res, uint32_t permille)
+{
+	uint32_t idx;
+
+	if (res->nb_lat == 0)
+		return 0;
+
+	idx = (uint64_t)(res->nb_lat - 1) * permille / 1000;
+	return (double)res->lat[idx] * NS_PER_S / rte_get_tsc_hz();
+}
+
+static void
+report(const struct perf_case *pc, enum perf_dir dir,
+		const struct perf_result *res)
+{
+	double secs = (double)res->elapsed / rte_get_tsc_hz();
+
+	qsort(res->lat, res->nb_lat, sizeof(res->lat[0]), lat_cmp);
+
+	fprintf(opts.out, "{\"ring\":\"%s\",\"in_order\":%d,\"mrg_rxbuf\":%d,"
+		"\"vectorized\":%d,\"path\":\"%s\",\"direction\":\"%s\",\"pkt_size\":%u,"
+		"\"burst\":%u,\"queues\":%u,\"pkts\":%" PRIu64 ","
+		"\"cycles_per_pkt\":%.2f,\"mpps\":%.3f,"
+		"\"lat_ns\":{\"p50\":%.0f,\"p90\":%.0f,\"p99\":%.0f,\"p999\":%.0f}}\n",
+		pc->packed ? "packed" : "split", pc->in_order, pc->mrg_rxbuf,
+		pc->vectorized,
+		dir == PERF_DIR_ENQUEUE && pc->path == PERF_PATH_ASYNC ?
+			"async" : "sync",
+		dir == PERF_DIR_ENQUEUE ? "enqueue" : "dequeue",
+		pc->pkt_size, pc->burst, pc->nb_queues, res->pkts,
+		res->pkts ? (double)res->vhost_cycles / res->pkts : 0,
+		secs > 0 ? res->pkts / secs / 1e6 : 0,
+		lat_ns(res, 500), lat_ns(res, 900), lat_ns(res, 990),
+		lat_ns(res, 999));
+	fflush(opts.out);
+}
+
+static int
+port_setup(const struct perf_case *pc, const char *path, uint16_t *port)
+{
+	struct rte_eth_conf port_conf;
+	char args[PATH_MAX + 128];
+	uint64_t deadline;
+	uint16_t q;
+	int ret;
+
+	snprintf(args, sizeof(args),
+		"path=%s,queues=%u,queue_size=%u,packed_vq=%d,in_order=%d,mrg_rxbuf=%d,"
+		"vectorized=%d",
+		path, pc->nb_queues, opts.queue_size, pc->packed, pc->in_order,
+		pc->mrg_rxbuf, pc->vectorized);
+
+	ret = rte_vdev_init(VIRTIO_USER_NAME, args);
+	if (ret < 0) {
+		printf("failed to create virtio-user port: %s\n", args);
+		return ret;
+	}
+
+	ret = rte_eth_dev_get_port_by_name(VIRTIO_USER_NAME, port);
+	if (ret < 0)
+		return ret;
+
+	memset(&port_conf, 0, sizeof(port_conf));
+	ret = rte_eth_dev_configure(*port, pc->nb_queues, pc->nb_queues, &port_conf);
+	if (ret < 0)
+		return ret;
+
+	for (q = 0; q < pc->nb_queues; q++) {
+		ret = rte_eth_rx_queue_setup(*port, q, opts.queue_size,
+				rte_socket_id(), NULL, mbuf_pool);
+		if (ret < 0)
+			return ret;
+		ret = rte_eth_tx_queue_setup(*port, q, opts.queue_size,
+				rte_socket_id(), NULL);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = rte_eth_dev_start(*port);
+	if (ret < 0)
+		return ret;
+
+	deadline = rte_get_timer_cycles() + rte_get_timer_hz() * READY_TIMEOUT_MS / 1000;
+	while (!perf_ready) {
+		if (rte_get_timer_cycles() > deadline) {
+			printf("vhost device not ready in %u ms\n", READY_TIMEOUT_MS);
+			return -ETIMEDOUT;
+		}
+		rte_delay_ms(1);
+	}
+
+	return 0;
+}
+
+/* Take the value of the innermost sweep dimension left in a case index */
+static uint32_t
+list_pick(const struct perf_list *list, uint32_t *idx)
+{
+	uint32_t val = list->val[*idx % list->nb];
+
+	*idx /= list->nb;
+	return val;
+}
+
+static int
+run_case(const struct perf_case *pc)
+{
+	struct perf_result res;
+	char path[PATH_MAX];
+	uint16_t port = RTE_MAX_ETHPORTS;
+	uint64_t flags = 0;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/vhost-perf-%d.sock", opts.sock_dir, getpid());
+	unlink(path);
+
+	perf_async = pc->path == PERF_PATH_ASYNC;
+	perf_nb_queues = pc->nb_queues;
+	perf_ready = false;
+	if (perf_async)
+		flags |= RTE_VHOST_USER_ASYNC_COPY;
+
+	if (rte_vhost_driver_register(path, flags) < 0)
+		return -EIO;
+	ret = rte_vhost_driver_callback_register(path, &perf_ops);
+	if (ret == 0)
+		ret = rte_vhost_driver_start(path);
+	if (ret < 0)
+		goto unregister;
+
+	ret = port_setup(pc, path, &port);
+	if (ret < 0)
+		goto close_port;
+
+	memset(&res, 0, sizeof(res));
+	res.lat = lat_samples;
+	res.lat_stride = opts.nb_pkts / MAX_LAT_SAMPLES + 1;
+	ret = run_enqueue(pc, port, &res);
+	if (ret < 0)
+		goto close_port;
+	report(pc, PERF_DIR_ENQUEUE, &res);
+
+	memset(&res, 0, sizeof(res));
+	res.lat = lat_samples;
+	res.lat_stride = opts.nb_pkts / MAX_LAT_SAMPLES + 1;
+	ret = run_dequeue(pc, port, &res);
+	if (ret < 0)
+		goto close_port;
+	report(pc, PERF_DIR_DEQUEUE, &res);
+
+close_port:
+	if (port != RTE_MAX_ETHPORTS) {
+		rte_eth_dev_stop(port);
+		rte_eth_dev_close(port);
+	}
+	rte_vdev_uninit(VIRTIO_USER_NAME);
+unregister:
+	rte_vhost_driver_unregister(path);
+	unlink(path);
+
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint32_t i, idx, nb_cases;
+	struct perf_case pc;
+	int ret, failed = 0;
+
+	ret = rte_eal_init(argc, argv);
+	if (ret < 0)
+		rte_exit(EXIT_FAILURE, "Cannot init EAL\n");
+	argc -= ret;
+	argv += ret;
+
+	if (parse_args(argc, argv) < 0)
+		rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+
+	if (opts.dma_name != NULL && dma_setup() < 0)
+		rte_exit(EXIT_FAILURE, "Cannot set up dmadev\n");
+
+	mbuf_pool = rte_pktmbuf_pool_create("vhost_perf_pool", NB_MBUF,
+			MBUF_CACHE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+	if (mbuf_pool == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create mbuf pool\n");
+
+	lat_samples = rte_malloc(NULL, MAX_LAT_SAMPLES * sizeof(*lat_samples), 0);
+	if (lat_samples == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot allocate latency samples\n");
+
+	nb_cases = opts.packed.nb * opts.in_order.nb * opts.mrg_rxbuf.nb *
+		opts.vectorized.nb * opts.path.nb * opts.queues.nb * opts.pkt_size.nb * opts.burst.nb;
+
+	for (i = 0; i < nb_cases; i++) {
+		idx = i;
+		pc.burst = list_pick(&opts.burst, &idx);
+		pc.pkt_size = list_pick(&opts.pkt_size, &idx);
+		pc.nb_queues = list_pick(&opts.queues, &idx);
+		pc.path = list_pick(&opts.path, &idx);
+		pc.vectorized = list_pick(&opts.vectorized, &idx);
+		pc.mrg_rxbuf = list_pick(&opts.mrg_rxbuf, &idx);
+		pc.in_order = list_pick(&opts.in_order, &idx);
+		pc.packed = list_pick(&opts.packed, &idx);
+
+		if (pc.pkt_size < sizeof(struct rte_ether_hdr) + sizeof(uint64_t) ||
+				pc.burst == 0 || pc.nb_queues == 0) {
+			printf("skipping invalid case pkt_size %u burst %u queues %u\n",
+				pc.pkt_size, pc.burst, pc.nb_queues);
+			continue;
+		}
+		if (pc.path == PERF_PATH_ASYNC && opts.dma_id < 0) {
+			printf("skipping async case, no --dma given\n");
+			continue;
+		}
+
+		ret = run_case(&pc);
+		if (ret < 0) {
+			printf("case failed: %s\n", strerror(-ret));
+			failed++;
+		}
+	}
+
+	rte_free(lat_samples);
+	if (opts.dma_id >= 0) {
+		rte_dma_stop(opts.dma_id);
+		rte_dma_close(opts.dma_id);
+	}
+	if (opts.out != stdout)
+		fclose(opts.out);
+	rte_eal_cleanup();
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
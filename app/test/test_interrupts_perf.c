@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright 2024, NVIDIA CORPORATION & AFFILIATES.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_interrupts.h>
+#include <rte_pause.h>
+#include <rte_random.h>
+
+#include "test.h"
+
+#ifndef RTE_EXEC_ENV_LINUX
+
+static int
+test_interrupts_perf(void)
+{
+	printf("interrupts_perf not supported on this OS, skipping test\n");
+	return TEST_SKIPPED;
+}
+
+#else
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#define INTR_PERF_MAX_FDS    4096
+#define INTR_PERF_KICKS      20000
+#define INTR_PERF_BURSTS     20
+#define INTR_PERF_TIMEOUT_MS 1000
+
+static struct rte_intr_handle *handles[INTR_PERF_MAX_FDS];
+static volatile uint64_t nb_calls;
+
+/* like a vhost kickfd relay, consume the eventfd and count */
+static void
+test_interrupts_perf_cb(void *arg)
+{
+	struct rte_intr_handle *handle = arg;
+	uint64_t val;
+
+	if (read(rte_intr_fd_get(handle), &val, sizeof(val)) == sizeof(val))
+		__atomic_fetch_add(&nb_calls, 1, __ATOMIC_RELAXED);
+}
+
+static int
+test_interrupts_perf_wait(uint64_t target)
+{
+	uint64_t deadline = rte_get_timer_cycles() +
+		rte_get_timer_hz() * INTR_PERF_TIMEOUT_MS / 1000;
+
+	while (__atomic_load_n(&nb_calls, __ATOMIC_RELAXED) < target) {
+		if (rte_get_timer_cycles() > deadline)
+			return -1;
+		rte_pause();
+	}
+	return 0;
+}
+
+static void
+test_interrupts_perf_cleanup(unsigned int nb_fds)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_fds; i++) {
+		if (handles[i] == NULL)
+			continue;
+		if (rte_intr_fd_get(handles[i]) >= 0)
+			close(rte_intr_fd_get(handles[i]));
+		rte_intr_instance_free(handles[i]);
+		handles[i] = NULL;
+	}
+}
+
+static unsigned int
+test_interrupts_perf_nb_fds(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+		return 0;
+	if (rlim.rlim_cur < rlim.rlim_max) {
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+		getrlimit(RLIMIT_NOFILE, &rlim);
+	}
+	/* leave room for the fds already in use */
+	if (rlim.rlim_cur <= 256)
+		return 0;
+	return RTE_MIN(rlim.rlim_cur - 256, (rlim_t)INTR_PERF_MAX_FDS);
+}
+
+/*
+ * Register thousands of eventfds with the interrupt thread, then measure
+ * registration, doorbell round trip to the callback, burst dispatch and
+ * unregistration costs.
+ */
+static int
+test_interrupts_perf(void)
+{
+	const uint64_t hz = rte_get_tsc_hz();
+	unsigned int nb_fds, i, j;
+	uint64_t start, cycles, val = 1, target;
+	int fd, ret = -1;
+
+	nb_fds = test_interrupts_perf_nb_fds();
+	if (nb_fds == 0) {
+		printf("Not enough file descriptors, skipping test\n");
+		return TEST_SKIPPED;
+	}
+
+	for (i = 0; i < nb_fds; i++) {
+		handles[i] = rte_intr_instance_alloc(RTE_INTR_INSTANCE_F_PRIVATE);
+		if (handles[i] == NULL)
+			goto out;
+		fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd < 0 || rte_intr_fd_set(handles[i], fd) ||
+				rte_intr_type_set(handles[i], RTE_INTR_HANDLE_EXT)) {
+			printf("Failed to create eventfd %u\n", i);
+			if (fd >= 0)
+				close(fd);
+			rte_intr_instance_free(handles[i]);
+			handles[i] = NULL;
+			goto out;
+		}
+	}
+
+	start = rte_rdtsc();
+	for (i = 0; i < nb_fds; i++) {
+		if (rte_intr_callback_register(handles[i],
+				test_interrupts_perf_cb, handles[i]) < 0) {
+			printf("Failed to register interrupt %u\n", i);
+			nb_fds = i;
+			goto unregister;
+		}
+	}
+	cycles = rte_rdtsc() - start;
+	printf("Register %u fds: %"PRIu64" cycles/fd\n", nb_fds,
+		cycles / nb_fds);
+
+	/* one doorbell at a time on a random fd, wait for its callback */
+	__atomic_store_n(&nb_calls, 0, __ATOMIC_RELAXED);
+	start = rte_rdtsc();
+	for (i = 0; i < INTR_PERF_KICKS; i++) {
+		j = rte_rand_max(nb_fds);
+		if (write(rte_intr_fd_get(handles[j]), &val, sizeof(val)) < 0 ||
+				test_interrupts_perf_wait(i + 1) < 0) {
+			printf("Kick %u on fd %u not delivered\n", i, j);
+			goto unregister;
+		}
+	}
+	cycles = rte_rdtsc() - start;
+	printf("Kick to callback over %u fds: %"PRIu64" cycles (%.2f us)\n",
+		nb_fds, cycles / INTR_PERF_KICKS,
+		(double)cycles * 1E6 / INTR_PERF_KICKS / hz);
+
+	/* all the fds at once, the dispatch cost dominates */
+	__atomic_store_n(&nb_calls, 0, __ATOMIC_RELAXED);
+	start = rte_rdtsc();
+	for (i = 0; i < INTR_PERF_BURSTS; i++) {
+		for (j = 0; j < nb_fds; j++)
+			if (write(rte_intr_fd_get(handles[j]), &val,
+					sizeof(val)) < 0)
+				goto unregister;
+		target = (uint64_t)(i + 1) * nb_fds;
+		if (test_interrupts_perf_wait(target) < 0) {
+			printf("Burst %u not delivered\n", i);
+			goto unregister;
+		}
+	}
+	cycles = rte_rdtsc() - start;
+	printf("Burst of %u kicks: %"PRIu64" cycles/kick\n", nb_fds,
+		cycles / ((uint64_t)INTR_PERF_BURSTS * nb_fds));
+	ret = 0;
+
+unregister:
+	start = rte_rdtsc();
+	for (i = 0; i < nb_fds; i++)
+		rte_intr_callback_unregister_sync(handles[i],
+			test_interrupts_perf_cb, handles[i]);
+	cycles = rte_rdtsc() - start;
+	if (nb_fds > 0)
+		printf("Unregister %u fds: %"PRIu64" cycles/fd\n", nb_fds,
+			cycles / nb_fds);
+out:
+	test_interrupts_perf_cleanup(INTR_PERF_MAX_FDS);
+	return ret;
+}
+
+#endif /* RTE_EXEC_ENV_LINUX */
+
+REGISTER_TEST_COMMAND(interrupts_perf_autotest, test_interrupts_perf);
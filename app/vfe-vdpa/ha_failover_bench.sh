@@ -0,0 +1,86 @@
+#!/bin/bash
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright 2024, NVIDIA CORPORATION & AFFILIATES.
+#
+# Kill the active vfe-vhostd under load and measure how long it takes the
+# standby one (started with --standby) to bring back datapath and control
+# plane. Datapath gap is the longest gap between replies of a ping running
+# through the VF, control-plane gap is the time until the VF is reported
+# configured again by vfe-vhost-cli.
+
+usage() {
+	echo "Usage: $0 -p <active vhostd pid> -v <vf bdf> -t <guest ip> [-i <ping interval s>] [-w <timeout s>]"
+	exit 1
+}
+
+INTERVAL=0.001
+TIMEOUT=60
+CLI=${CLI:-vfe-vhost-cli}
+
+while getopts "p:v:t:i:w:" opt; do
+	case $opt in
+	p) PID=$OPTARG ;;
+	v) VF=$OPTARG ;;
+	t) TARGET=$OPTARG ;;
+	i) INTERVAL=$OPTARG ;;
+	w) TIMEOUT=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+[ -z "$PID" ] || [ -z "$VF" ] || [ -z "$TARGET" ] && usage
+
+if ! $CLI vf -i "$VF" | grep -q '"configured": true'; then
+	echo "VF $VF is not configured, start the VM first"
+	exit 1
+fi
+
+PING_LOG=$(mktemp)
+ping -D -n -i "$INTERVAL" "$TARGET" > "$PING_LOG" 2>&1 &
+PING_PID=$!
+# Let the load settle before failing over
+sleep 2
+
+KILL_TS=$(date +%s.%N)
+kill -9 "$PID"
+echo "Killed active vfe-vhostd $PID at $KILL_TS"
+
+# The killed one's RPC port goes away first, wait for the standby to answer
+CP_TS=""
+DEADLINE=$(echo "$KILL_TS + $TIMEOUT" | bc)
+while [ "$(echo "$(date +%s.%N) < $DEADLINE" | bc)" -eq 1 ]; do
+	if $CLI vf -i "$VF" 2>/dev/null | grep -q '"configured": true'; then
+		CP_TS=$(date +%s.%N)
+		break
+	fi
+	sleep 0.01
+done
+
+# Keep the load running a bit after takeover to catch a late datapath stall
+sleep 2
+kill "$PING_PID"
+wait "$PING_PID" 2>/dev/null
+
+if [ -z "$CP_TS" ]; then
+	echo "Control plane not back within ${TIMEOUT}s"
+else
+	echo "Control-plane gap: $(echo "($CP_TS - $KILL_TS) * 1000" | bc) ms"
+fi
+
+# Replies look like "[1718000000.123456] 64 bytes from ...", look for the
+# longest silence around the kill
+awk -v kill="$KILL_TS" '
+	/bytes from/ {
+		ts = substr($1, 2, length($1) - 2)
+		if (last != "" && ts - last > gap && ts > kill - 1) {
+			gap = ts - last
+			from = last
+		}
+		last = ts
+		n++
+	}
+	END {
+		printf "Datapath gap: %.3f ms (from %s), %d replies\n", gap * 1000, from, n
+	}' "$PING_LOG"
+
+rm -f "$PING_LOG"
@@ -31,6 +31,7 @@
 #include <cmdline.h>
 
 #include "vdpa_rpc.h"
+#include "vdpa_place.h"
 #include "vdpa_ha.c"
 
 static struct vdpa_rpc_context vdpa_rpc_ctx;
@@ -53,6 +54,8 @@ static char iface[MAX_IF_PATH_LEN];
 static int devcnt;
 static int interactive;
 static int client_mode;
+static uint32_t msg_latency_us;
+static int standby_mode;
 int stage1 = 0;
 
 static int
@@ -79,7 +82,11 @@ vdpa_usage(const char *prgname)
 				 "	--interactive|-i: run in interactive mode.\n"
 				 "	--iface <path>: specify the path prefix of the socket files, e.g. /tmp/vhost-user-.\n"
 				 "	--client: register a vhost-user socket as client mode.\n"
-				 "	--stage1: fall back to stage1.\n",
+				 "	--stage1: fall back to stage1.\n"
+				 "	--msg-latency <us>: track vhost-user message latency, record messages slower than <us>.\n"
+				 "	--standby: wait as standby if another vfe-vhostd is active, take over when it quits.\n"
+				 "	--cpu-place <class>=<cpulist>: pin control threads of class admin|notifier|vhost|config|rpc|ha, default to device NUMA node.\n"
+				 "	--conf-threads <n>: configure VFs on <n> threads per NUMA node, 0 on vhost-user thread, default 4.\n",
 				 prgname);
 }
 
@@ -92,6 +99,10 @@ parse_args(int argc, char **argv)
 		{"interactive", no_argument, &interactive, 1},
 		{"client", no_argument, &client_mode, 1},
 		{"stage1", no_argument, &stage1, 1},
+		{"msg-latency", required_argument, NULL, 0},
+		{"standby", no_argument, &standby_mode, 1},
+		{"cpu-place", required_argument, NULL, 0},
+		{"conf-threads", required_argument, NULL, 0},
 		{NULL, 0, 0, 0},
 	};
 	int opt, idx;
@@ -118,6 +129,24 @@ parse_args(int argc, char **argv)
 				printf("Interactive-mode selected\n");
 				interactive = 1;
 			}
+			if (!strcmp(long_option[idx].name, "msg-latency")) {
+				msg_latency_us = strtoul(optarg, NULL, 0);
+				rte_vhost_msg_latency_enable(true, msg_latency_us);
+				printf("vhost-user message latency tracking, slow threshold %u us\n",
+						msg_latency_us);
+			}
+			if (!strcmp(long_option[idx].name, "cpu-place")) {
+				if (vdpa_place_arg_parse(optarg)) {
+					printf("Invalid cpu-place %s\n", optarg);
+					return -1;
+				}
+			}
+			if (!strcmp(long_option[idx].name, "conf-threads")) {
+				if (rte_vdpa_conf_threads_set(strtoul(optarg, NULL, 0))) {
+					printf("Invalid conf-threads %s\n", optarg);
+					return -1;
+				}
+			}
 			break;
 
 		default:
@@ -321,6 +350,7 @@ int vdpa_with_socket_path_start(const char *vf_name,
 		memset(&vports[vport_num], 0, sizeof(struct vdpa_port));
 		return ret;
 	}
+	vdpa_place_sock_add(ifname, vf_name);
 	return ret;
 }
 
@@ -349,6 +379,7 @@ void vdpa_with_socket_path_stop(const char *vf_name)
 	}
 
 	if (vport->ifname[0] != '\0') {
+		vdpa_place_sock_del(vport->ifname);
 		close_vdpa(vport);
 		memset(vport, 0, sizeof(*vport));
 	}
@@ -737,8 +768,10 @@ cmdline_parse_ctx_t main_ctx[] = {
 int
 main(int argc, char *argv[])
 {
-	int ret, total_vf = 0;
+	int ret, i, total_vf = 0;
+	struct timeval takeover, end;
 	rte_uuid_t vf_token;
+	bool standby;
 	sigset_t set;
 	pthread_t thread_s;
 
@@ -758,7 +791,13 @@ main(int argc, char *argv[])
 	if (ret!= 0)
 		rte_exit(EXIT_FAILURE, "sig thread create failed\n");
 
-	ret = virtio_ha_client_start(vdpa_rpc_set_ha_version_time);
+	/* Role must be known before EAL init, a standby must not touch VFIO container */
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--standby"))
+			standby_mode = 1;
+	}
+
+	ret = virtio_ha_client_start(vdpa_rpc_set_ha_version_time, standby_mode, &standby);
 	if (ret < 0)
 		rte_exit(EXIT_FAILURE, "ha client start failed\n");
 
@@ -782,6 +821,14 @@ main(int argc, char *argv[])
 	if (ret < 0)
 		rte_exit(EXIT_FAILURE, "invalid argument\n");
 
+	/* Standby keeps EAL initialized and only probes devices once the active one quits */
+	if (standby) {
+		ret = virtio_ha_client_standby_wait();
+		if (ret < 0)
+			rte_exit(EXIT_FAILURE, "standby lost HA service\n");
+		gettimeofday(&takeover, NULL);
+	}
+
 	ret = virtio_ha_client_dev_restore_pf(&total_vf);
 	if (ret < 0)
 		rte_exit(EXIT_FAILURE, "ha client dev restore pf failed\n");
@@ -799,9 +846,20 @@ main(int argc, char *argv[])
 
 	virtio_ha_client_init_finish();
 	RTE_LOG(INFO, VDPA, "vfe-vhostd init finish (version: %s)\n", rte_version());
-	/* loop for exit the application */
-	while (1)
+	if (standby) {
+		gettimeofday(&end, NULL);
+		RTE_LOG(INFO, VDPA, "Takeover finished at %lu.%06lu, took %lu us\n",
+			end.tv_sec, end.tv_usec,
+			(end.tv_sec - takeover.tv_sec) * 1000000UL + end.tv_usec - takeover.tv_usec);
+	}
+	/* loop for exit the application, placing new control threads meanwhile */
+	while (1) {
+		/* Device list walk must not race with RPC hotplug */
+		pthread_mutex_lock(&vdpa_rpc_ctx.rpc_lock);
+		vdpa_place_apply();
+		pthread_mutex_unlock(&vdpa_rpc_ctx.rpc_lock);
 		sleep(1);
+	}
 
 	return 0;
 }
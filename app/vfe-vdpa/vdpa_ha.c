@@ -3,6 +3,7 @@
  */
 
 #include <stdint.h>
+#include <sys/time.h>
 
 #include <rte_log.h>
 #include <virtio_ha.h>
@@ -48,16 +49,26 @@ virtio_ha_client_cfd_store(int container_fd)
 }
 
 int
-virtio_ha_client_start(ver_time_set set_ver)
+virtio_ha_client_start(ver_time_set set_ver, bool standby_req, bool *standby)
 {
 	int ret, vfio_container_fd = -1;
 
+	*standby = false;
 	ret = virtio_ha_ipc_client_init(set_ver);
 	if (ret) {
 		RTE_LOG(ERR, HA, "Failed to init ha ipc client\n");
 		return -1;		
 	}
 
+	if (standby_req) {
+		ret = virtio_ha_standby_register(standby);
+		if (ret < 0) {
+			RTE_LOG(ERR, HA, "Failed to register as standby\n");
+			return -1;
+		}
+		RTE_LOG(INFO, HA, "Start as %s vfe-vhostd\n", *standby ? "standby" : "active");
+	}
+
 	rte_vfio_register_dma_cb(virtio_ha_client_dma_map, virtio_ha_client_cfd_store);
 
 	ret = virtio_ha_global_cfd_query(&vfio_container_fd);
@@ -66,9 +77,31 @@ virtio_ha_client_start(ver_time_set set_ver)
 	else
 		RTE_LOG(INFO, HA, "Query success: global container fd(%d)\n", vfio_container_fd);
 
-	if (vfio_container_fd != -1)
+	if (vfio_container_fd != -1) {
 		rte_vfio_restore_default_cfd(vfio_container_fd);
+	} else if (*standby) {
+		/* Standby must share the active one's container, never create its own */
+		RTE_LOG(ERR, HA, "Active vfe-vhostd has no container stored yet\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+virtio_ha_client_standby_wait(void)
+{
+	struct timeval now;
+	int ret;
+
+	RTE_LOG(INFO, HA, "Standby vfe-vhostd ready, waiting for takeover\n");
+	ret = virtio_ha_standby_wait_takeover();
+	if (ret < 0)
+		return -1;
 
+	gettimeofday(&now, NULL);
+	RTE_LOG(INFO, HA, "Standby vfe-vhostd takes over at %lu.%06lu\n",
+		now.tv_sec, now.tv_usec);
 	return 0;
 }
 
@@ -0,0 +1,538 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright 2024, NVIDIA CORPORATION & AFFILIATES.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_dev.h>
+#include <rte_log.h>
+#include <rte_pci.h>
+#include <rte_string_fns.h>
+
+#include "vdpa_rpc.h"
+#include "vdpa_place.h"
+
+#define RTE_LOGTYPE_VDPA RTE_LOGTYPE_USER1
+
+/* Per PF admin thread, per VF notifier and vhost thread, plus config and global ones */
+#define VDPA_PLACE_MAX_THREADS (MAX_VDPA_SAMPLE_PORTS * 2 + 64)
+#define VDPA_PLACE_MAX_NODES 64
+#define VDPA_PLACE_COMM_LEN 16
+
+struct vdpa_place_thread {
+	pid_t tid;
+	char comm[VDPA_PLACE_COMM_LEN];
+	enum vdpa_thread_class cls;
+	int numa;
+	bool placed;
+	bool alive;
+	bool sampled;
+	cpu_set_t cpus;
+	uint64_t cpu_ticks;
+	uint64_t last_ticks;
+	uint32_t usage_permille; /* Of one CPU over the last scan interval */
+};
+
+struct vdpa_place_class {
+	const char *name;
+	const char *prefix;
+	bool configured;
+	cpu_set_t cpus;
+};
+
+/* fdset threads are named by their socket path, kept to map them to a VF */
+struct vdpa_place_sock {
+	char comm[VDPA_PLACE_COMM_LEN];
+	int numa;
+	bool used;
+};
+
+static struct vdpa_place_class place_classes[VDPA_THREAD_CLASS_MAX] = {
+	[VDPA_THREAD_ADMIN] = { .name = "admin", .prefix = "avq" },
+	[VDPA_THREAD_NOTIFIER] = { .name = "notifier", .prefix = "ntf" },
+	[VDPA_THREAD_VHOST] = { .name = "vhost", .prefix = "vhost_reconn" },
+	[VDPA_THREAD_CONFIG] = { .name = "config", .prefix = "vcfg-" },
+	[VDPA_THREAD_RPC] = { .name = "rpc", .prefix = "vDPA-RPC" },
+	[VDPA_THREAD_HA] = { .name = "ha", .prefix = "ha-" },
+	[VDPA_THREAD_OTHER] = { .name = "other" },
+};
+
+static struct vdpa_place_thread place_threads[VDPA_PLACE_MAX_THREADS];
+static uint32_t place_nr_threads;
+static struct vdpa_place_sock place_socks[MAX_VDPA_SAMPLE_PORTS];
+static cpu_set_t place_node_cpus[VDPA_PLACE_MAX_NODES];
+static bool place_node_read[VDPA_PLACE_MAX_NODES];
+static struct timespec place_last_scan;
+static pthread_mutex_t place_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+vdpa_place_cpulist_parse(const char *list, cpu_set_t *set)
+{
+	const char *p = list;
+	unsigned long first, last, cpu;
+	char *end;
+
+	CPU_ZERO(set);
+	while (*p) {
+		errno = 0;
+		first = strtoul(p, &end, 10);
+		if (errno || end == p)
+			return -EINVAL;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtoul(p, &end, 10);
+			if (errno || end == p || last < first)
+				return -EINVAL;
+			p = end;
+		}
+		if (last >= CPU_SETSIZE)
+			return -EINVAL;
+		for (cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, set);
+		if (*p == ',')
+			p++;
+		else if (*p != '\0' && *p != '\n')
+			return -EINVAL;
+		else
+			break;
+	}
+
+	return CPU_COUNT(set) ? 0 : -EINVAL;
+}
+
+static void
+vdpa_place_cpulist_format(const cpu_set_t *set, char *buf, size_t len)
+{
+	int cpu, first = -1;
+	size_t off = 0;
+
+	buf[0] = '\0';
+	for (cpu = 0; cpu <= CPU_SETSIZE && off < len; cpu++) {
+		if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, set)) {
+			if (first < 0)
+				first = cpu;
+			continue;
+		}
+		if (first < 0)
+			continue;
+		if (cpu - 1 == first)
+			off += snprintf(buf + off, len - off, "%s%d", off ? "," : "", first);
+		else
+			off += snprintf(buf + off, len - off, "%s%d-%d", off ? "," : "",
+					first, cpu - 1);
+		first = -1;
+	}
+}
+
+static const cpu_set_t *
+vdpa_place_node_cpus(int numa)
+{
+	char path[64], list[1024];
+	FILE *f;
+
+	if (numa < 0 || numa >= VDPA_PLACE_MAX_NODES)
+		return NULL;
+
+	if (!place_node_read[numa]) {
+		place_node_read[numa] = true;
+		CPU_ZERO(&place_node_cpus[numa]);
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa);
+		f = fopen(path, "r");
+		if (f == NULL)
+			return NULL;
+		if (fgets(list, sizeof(list), f) == NULL ||
+			vdpa_place_cpulist_parse(list, &place_node_cpus[numa]))
+			RTE_LOG(ERR, VDPA, "Failed to parse CPUs of NUMA node %d\n", numa);
+		fclose(f);
+	}
+
+	return CPU_COUNT(&place_node_cpus[numa]) ? &place_node_cpus[numa] : NULL;
+}
+
+/* Threads carry "domain:bus:dev.fn" of their device with unpadded domain to fit
+ * the thread name, match it on the PCI bus.
+ */
+static int
+vdpa_place_pci_numa(const char *bdf)
+{
+	struct rte_dev_iterator it;
+	struct rte_device *dev;
+	struct rte_pci_addr addr, dev_addr;
+	char end;
+	int numa = -1;
+
+	if (sscanf(bdf, "%x:%hhx:%hhx.%hhx%c", &addr.domain, &addr.bus,
+			&addr.devid, &addr.function, &end) != 4)
+		return -1;
+
+	RTE_DEV_FOREACH(dev, "bus=pci", &it) {
+		if (rte_pci_addr_parse(dev->name, &dev_addr) == 0 &&
+				rte_pci_addr_cmp(&addr, &dev_addr) == 0) {
+			numa = dev->numa_node;
+			break;
+		}
+	}
+
+	return numa;
+}
+
+static int
+vdpa_place_sock_numa(const char *comm, bool *found)
+{
+	int i, numa = -1;
+
+	*found = false;
+	for (i = 0; i < MAX_VDPA_SAMPLE_PORTS; i++) {
+		if (!place_socks[i].used || strcmp(place_socks[i].comm, comm))
+			continue;
+		/* Sockets sharing a name prefix on different nodes have no default node */
+		if (*found && numa != place_socks[i].numa)
+			return -1;
+		numa = place_socks[i].numa;
+		*found = true;
+	}
+
+	return numa;
+}
+
+static void
+vdpa_place_classify(struct vdpa_place_thread *t)
+{
+	const char *prefix;
+	bool sock;
+	int i;
+
+	t->cls = VDPA_THREAD_OTHER;
+	t->numa = -1;
+	for (i = 0; i < VDPA_THREAD_OTHER; i++) {
+		prefix = place_classes[i].prefix;
+		if (!strncmp(t->comm, prefix, strlen(prefix))) {
+			t->cls = i;
+			break;
+		}
+	}
+
+	switch (t->cls) {
+	case VDPA_THREAD_ADMIN:
+	case VDPA_THREAD_NOTIFIER:
+		t->numa = vdpa_place_pci_numa(t->comm + strlen(place_classes[t->cls].prefix));
+		break;
+	case VDPA_THREAD_CONFIG:
+		t->numa = atoi(t->comm + strlen(place_classes[t->cls].prefix));
+		break;
+	case VDPA_THREAD_OTHER:
+		t->numa = vdpa_place_sock_numa(t->comm, &sock);
+		if (sock)
+			t->cls = VDPA_THREAD_VHOST;
+		break;
+	default:
+		break;
+	}
+}
+
+static int
+vdpa_place_task_read(pid_t tid, char *comm, uint64_t *ticks)
+{
+	char path[64], buf[512], *p;
+	unsigned long utime, stime;
+	size_t len;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -errno;
+	if (fgets(comm, VDPA_PLACE_COMM_LEN, f) == NULL)
+		comm[0] = '\0';
+	fclose(f);
+	len = strlen(comm);
+	if (len && comm[len - 1] == '\n')
+		comm[len - 1] = '\0';
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -errno;
+	p = fgets(buf, sizeof(buf), f);
+	fclose(f);
+	if (p == NULL)
+		return -EIO;
+
+	/* Name may contain spaces, fields restart after its closing bracket */
+	p = strrchr(buf, ')');
+	if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			&utime, &stime) != 2)
+		return -EIO;
+	*ticks = utime + stime;
+	return 0;
+}
+
+static struct vdpa_place_thread *
+vdpa_place_thread_get(pid_t tid)
+{
+	struct vdpa_place_thread *t;
+	uint32_t i;
+
+	for (i = 0; i < place_nr_threads; i++) {
+		if (place_threads[i].tid == tid)
+			return &place_threads[i];
+	}
+	if (place_nr_threads >= VDPA_PLACE_MAX_THREADS)
+		return NULL;
+
+	t = &place_threads[place_nr_threads++];
+	memset(t, 0, sizeof(*t));
+	t->tid = tid;
+	return t;
+}
+
+static void
+vdpa_place_thread_pin(struct vdpa_place_thread *t)
+{
+	const cpu_set_t *target;
+	int ret;
+
+	if (t->cls == VDPA_THREAD_OTHER)
+		return;
+
+	if (place_classes[t->cls].configured)
+		target = &place_classes[t->cls].cpus;
+	else
+		target = vdpa_place_node_cpus(t->numa);
+	if (target == NULL)
+		return;
+	if (t->placed && CPU_EQUAL(&t->cpus, target))
+		return;
+
+	ret = sched_setaffinity(t->tid, sizeof(*target), target);
+	if (ret) {
+		if (!t->placed)
+			RTE_LOG(ERR, VDPA, "Failed to pin thread %s(%d) err %d\n",
+					t->comm, t->tid, errno);
+		t->placed = true;
+		return;
+	}
+	t->cpus = *target;
+	t->placed = true;
+	RTE_LOG(INFO, VDPA, "Thread %s(%d) class %s pinned to %d CPUs\n",
+			t->comm, t->tid, place_classes[t->cls].name, CPU_COUNT(target));
+}
+
+void
+vdpa_place_apply(void)
+{
+	struct vdpa_place_thread *t;
+	char comm[VDPA_PLACE_COMM_LEN];
+	struct timespec now;
+	uint64_t ticks, elapsed_ticks;
+	struct dirent *ent;
+	uint32_t i, n;
+	DIR *dir;
+	pid_t tid;
+
+	dir = opendir("/proc/self/task");
+	if (dir == NULL) {
+		RTE_LOG(ERR, VDPA, "Failed to open task dir err %d\n", errno);
+		return;
+	}
+
+	pthread_mutex_lock(&place_lock);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ticks = ((now.tv_sec - place_last_scan.tv_sec) * 1000000000ULL +
+			now.tv_nsec - place_last_scan.tv_nsec) * sysconf(_SC_CLK_TCK) / 1000000000ULL;
+	place_last_scan = now;
+
+	for (i = 0; i < place_nr_threads; i++)
+		place_threads[i].alive = false;
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		tid = atoi(ent->d_name);
+		if (vdpa_place_task_read(tid, comm, &ticks))
+			continue;
+		t = vdpa_place_thread_get(tid);
+		if (t == NULL)
+			continue;
+		if (strcmp(t->comm, comm)) {
+			/* New thread, or named after creation */
+			rte_strscpy(t->comm, comm, VDPA_PLACE_COMM_LEN);
+			vdpa_place_classify(t);
+			t->placed = false;
+		}
+		t->last_ticks = t->sampled ? t->cpu_ticks : ticks;
+		t->cpu_ticks = ticks;
+		t->sampled = true;
+		t->usage_permille = elapsed_ticks ?
+			(t->cpu_ticks - t->last_ticks) * 1000 / elapsed_ticks : 0;
+		t->alive = true;
+		vdpa_place_thread_pin(t);
+	}
+	closedir(dir);
+
+	/* Drop threads that are gone */
+	for (i = 0, n = 0; i < place_nr_threads; i++) {
+		if (!place_threads[i].alive)
+			continue;
+		if (n != i)
+			place_threads[n] = place_threads[i];
+		n++;
+	}
+	place_nr_threads = n;
+	pthread_mutex_unlock(&place_lock);
+}
+
+int
+vdpa_place_class_set(const char *class_name, const char *cpulist)
+{
+	struct vdpa_place_class *c = NULL;
+	cpu_set_t cpus;
+	uint32_t i;
+
+	for (i = 0; i < VDPA_THREAD_OTHER; i++) {
+		if (!strcmp(place_classes[i].name, class_name)) {
+			c = &place_classes[i];
+			break;
+		}
+	}
+	if (c == NULL) {
+		RTE_LOG(ERR, VDPA, "Unknown thread class %s\n", class_name);
+		return -EINVAL;
+	}
+
+	if (strcmp(cpulist, "numa") && vdpa_place_cpulist_parse(cpulist, &cpus)) {
+		RTE_LOG(ERR, VDPA, "Invalid cpu list %s for class %s\n", cpulist, class_name);
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&place_lock);
+	c->configured = strcmp(cpulist, "numa") != 0;
+	if (c->configured)
+		c->cpus = cpus;
+	/* Re-pin the class on next scan */
+	for (i = 0; i < place_nr_threads; i++) {
+		if (&place_classes[place_threads[i].cls] == c)
+			place_threads[i].placed = false;
+	}
+	pthread_mutex_unlock(&place_lock);
+	RTE_LOG(INFO, VDPA, "Thread class %s placed on %s\n", class_name, cpulist);
+	return 0;
+}
+
+int
+vdpa_place_arg_parse(const char *arg)
+{
+	char buf[256], *cpulist;
+
+	if (rte_strscpy(buf, arg, sizeof(buf)) < 0)
+		return -EINVAL;
+	cpulist = strchr(buf, '=');
+	if (cpulist == NULL)
+		return -EINVAL;
+	*cpulist++ = '\0';
+	return vdpa_place_class_set(buf, cpulist);
+}
+
+void
+vdpa_place_sock_add(const char *sock_path, const char *vf_name)
+{
+	int i;
+
+	pthread_mutex_lock(&place_lock);
+	for (i = 0; i < MAX_VDPA_SAMPLE_PORTS; i++) {
+		if (place_socks[i].used)
+			continue;
+		/* Thread names are truncated to 15 chars */
+		strlcpy(place_socks[i].comm, sock_path, VDPA_PLACE_COMM_LEN);
+		place_socks[i].numa = vdpa_place_pci_numa(vf_name);
+		place_socks[i].used = true;
+		break;
+	}
+	pthread_mutex_unlock(&place_lock);
+}
+
+void
+vdpa_place_sock_del(const char *sock_path)
+{
+	char comm[VDPA_PLACE_COMM_LEN];
+	int i;
+
+	strlcpy(comm, sock_path, VDPA_PLACE_COMM_LEN);
+	pthread_mutex_lock(&place_lock);
+	for (i = 0; i < MAX_VDPA_SAMPLE_PORTS; i++) {
+		if (place_socks[i].used && !strcmp(place_socks[i].comm, comm)) {
+			place_socks[i].used = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&place_lock);
+}
+
+cJSON *
+vdpa_place_report(void)
+{
+	uint64_t cls_ticks[VDPA_THREAD_CLASS_MAX] = {0};
+	uint32_t cls_usage[VDPA_THREAD_CLASS_MAX] = {0};
+	long hz = sysconf(_SC_CLK_TCK);
+	cJSON *result, *classes, *threads, *obj;
+	struct vdpa_place_thread *t;
+	char cpus[256];
+	uint32_t i;
+
+	result = cJSON_CreateObject();
+	classes = cJSON_CreateArray();
+	threads = cJSON_CreateArray();
+
+	pthread_mutex_lock(&place_lock);
+	for (i = 0; i < place_nr_threads; i++) {
+		t = &place_threads[i];
+		cls_ticks[t->cls] += t->cpu_ticks;
+		cls_usage[t->cls] += t->usage_permille;
+
+		obj = cJSON_CreateObject();
+		cJSON_AddStringToObject(obj, "name", t->comm);
+		cJSON_AddNumberToObject(obj, "tid", t->tid);
+		cJSON_AddStringToObject(obj, "class", place_classes[t->cls].name);
+		cJSON_AddNumberToObject(obj, "numa", t->numa);
+		if (t->placed && CPU_COUNT(&t->cpus)) {
+			vdpa_place_cpulist_format(&t->cpus, cpus, sizeof(cpus));
+			cJSON_AddStringToObject(obj, "cpus", cpus);
+		} else {
+			cJSON_AddStringToObject(obj, "cpus", "unpinned");
+		}
+		cJSON_AddNumberToObject(obj, "cpu_time_ms", t->cpu_ticks * 1000 / hz);
+		cJSON_AddNumberToObject(obj, "cpu_usage_permille", t->usage_permille);
+		cJSON_AddItemToArray(threads, obj);
+	}
+
+	for (i = 0; i < VDPA_THREAD_CLASS_MAX; i++) {
+		obj = cJSON_CreateObject();
+		cJSON_AddStringToObject(obj, "class", place_classes[i].name);
+		if (place_classes[i].configured) {
+			vdpa_place_cpulist_format(&place_classes[i].cpus, cpus, sizeof(cpus));
+			cJSON_AddStringToObject(obj, "cpus", cpus);
+		} else {
+			cJSON_AddStringToObject(obj, "cpus",
+					i == VDPA_THREAD_OTHER ? "unpinned" : "numa");
+		}
+		cJSON_AddNumberToObject(obj, "cpu_time_ms", cls_ticks[i] * 1000 / hz);
+		cJSON_AddNumberToObject(obj, "cpu_usage_permille", cls_usage[i]);
+		cJSON_AddItemToArray(classes, obj);
+	}
+	pthread_mutex_unlock(&place_lock);
+
+	cJSON_AddItemToObject(result, "classes", classes);
+	cJSON_AddItemToObject(result, "threads", threads);
+	return result;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright 2024, NVIDIA CORPORATION & AFFILIATES.
+ */
+
+#ifndef _VDPA_PLACE_H_
+#define _VDPA_PLACE_H_
+
+#include "cJSON.h"
+
+/*
+ * Control-plane threads are recognized by name and pinned per class.
+ * A class without configured CPUs follows the NUMA node of its device.
+ */
+enum vdpa_thread_class {
+	VDPA_THREAD_ADMIN,	/* Admin queue poll, one per PF: "avq<pci addr>" */
+	VDPA_THREAD_NOTIFIER,	/* Doorbell relay, one per VF: "ntf<pci addr>" */
+	VDPA_THREAD_VHOST,	/* vhost-user socket events and reconnect */
+	VDPA_THREAD_CONFIG,	/* VF configuration, per NUMA node: "vcfg-<node>-<n>" */
+	VDPA_THREAD_RPC,	/* JSON RPC server */
+	VDPA_THREAD_HA,		/* HA ipc and priority channel */
+	VDPA_THREAD_OTHER,	/* EAL and misc, reported but never moved */
+	VDPA_THREAD_CLASS_MAX,
+};
+
+/* Set CPUs of a class from a cpu list like "2-5,8", "numa" reverts to default */
+int vdpa_place_class_set(const char *class_name, const char *cpulist);
+/* Parse "<class>=<cpulist>" from command line */
+int vdpa_place_arg_parse(const char *arg);
+void vdpa_place_sock_add(const char *sock_path, const char *vf_name);
+void vdpa_place_sock_del(const char *sock_path);
+/* Scan process threads, pin new or moved ones and sample their CPU time */
+void vdpa_place_apply(void);
+cJSON *vdpa_place_report(void);
+
+#endif /* _VDPA_PLACE_H_ */
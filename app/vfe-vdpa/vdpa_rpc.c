@@ -26,6 +26,7 @@
 #include "jsonrpc-client.h"
 #include "vdpa_rpc.h"
 #include "vdpa_ha.h"
+#include "vdpa_place.h"
 
 /* VDPA RPC */
 /* For string conversion */
@@ -277,6 +278,14 @@ static void vdpa_vf_info_reformat(cJSON *device, struct vdpa_vf_params *vf_param
 		cJSON_AddTrueToObject(device, "configured");
 	else
 		cJSON_AddFalseToObject(device, "configured");
+	if (vf_params->logging) {
+		JSON_STR_NUM_TO_OBJ(device, "vm_dirty_rate_pps", "%" PRIu64,
+					vf_params->dirty_rate);
+		JSON_STR_NUM_TO_OBJ(device, "vm_dirty_pending_bytes", "%" PRIu64,
+					vf_params->dirty_pending);
+		JSON_STR_NUM_TO_OBJ(device, "vm_dirty_eta_ms", "%" PRId64,
+					vf_params->dirty_eta_ms);
+	}
 }
 
 static void vdpa_vf_info_reformat_with_devarg(cJSON *device, struct vdpa_vf_with_devargs *args)
@@ -479,6 +488,35 @@ static cJSON *version(__rte_unused jrpc_context *ctx,
 	return vdpa_rpc_format_errno(result, 0);
 }
 
+static cJSON *cpuplace(jrpc_context *ctx, cJSON *params, cJSON *id)
+{
+	cJSON *cls = cJSON_GetObjectItem(params, "class");
+	cJSON *cpus = cJSON_GetObjectItem(params, "cpus");
+	cJSON *result = NULL;
+	struct vdpa_rpc_context *rpc_ctx;
+	int ret;
+
+	rpc_ctx = (struct vdpa_rpc_context *)ctx->data;
+	pthread_mutex_lock(&rpc_ctx->rpc_lock);
+	if (cls && cpus) {
+		ret = vdpa_place_class_set(cls->valuestring, cpus->valuestring);
+		if (!ret)
+			vdpa_place_apply();
+		result = vdpa_rpc_format_errno(cJSON_CreateObject(), ret);
+	} else if (!cls && !cpus) {
+		vdpa_place_apply();
+		result = vdpa_place_report();
+	}
+	if (!result) {
+		result = cJSON_CreateObject();
+		cJSON_AddStringToObject(result, "Error",
+			"Invalid cpuplace parameters in RPC message");
+		cJSON_AddItemToObject(result, "id", id);
+	}
+	pthread_mutex_unlock(&rpc_ctx->rpc_lock);
+	return result;
+}
+
 static void *vdpa_rpc_handler(void *ctx)
 {
 	struct vdpa_rpc_context *rpc_ctx;
@@ -488,6 +526,7 @@ static void *vdpa_rpc_handler(void *ctx)
 	jrpc_register_procedure(&rpc_ctx->rpc_server, mgmtpf, "mgmtpf", ctx);
 	jrpc_register_procedure(&rpc_ctx->rpc_server, mgmtvf, "vf", ctx);
 	jrpc_register_procedure(&rpc_ctx->rpc_server, version, "version", ctx);
+	jrpc_register_procedure(&rpc_ctx->rpc_server, cpuplace, "cpuplace", ctx);
 	jrpc_server_run(&rpc_ctx->rpc_server);
 	pthread_exit(NULL);
 }
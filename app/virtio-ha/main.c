@@ -84,12 +84,22 @@ struct prio_chnl_vf_cache_entry {
 };
 TAILQ_HEAD(prio_chnl_vf_cache, prio_chnl_vf_cache_entry);
 
+/* Active vfe-vhostd and optionally a standby one waiting to take over */
+#define HA_SERVER_MAX_CONN 2
+
+struct ha_server_conn {
+	struct virtio_ha_event_handler hdlr;
+	bool in_use;
+	bool standby;
+};
+
 typedef int (*ha_message_handler_t)(struct virtio_ha_msg *msg);
 
 static struct virtio_ha_device_list hs;
 static pthread_mutex_t prio_chnl_mutex = PTHREAD_MUTEX_INITIALIZER;
 static struct prio_chnl_vf_cache vf_cache;
-static struct virtio_ha_event_handler msg_hdlr;
+static struct ha_server_conn conns[HA_SERVER_MAX_CONN];
+static struct ha_server_conn *cur_conn; /* Connection of the message being handled */
 static struct virtio_ha_msg *msg;
 
 static int
@@ -351,10 +361,12 @@ ha_server_app_query_vf_ctx(struct virtio_ha_msg *msg)
 			vf_ctt->mem.nregions = vf_dev->vf_ctx.ctt.mem.nregions;
 			memcpy((void *)vf_ctt->mem.regions, vf_dev->vf_ctx.ctt.mem.regions,
 				vf_dev->vf_ctx.ctt.mem.nregions * sizeof(struct virtio_vdpa_mem_region));
-			msg->nr_fds = 3;
+			vf_ctt->state_fd_saved = vf_dev->state_fd != -1;
+			msg->nr_fds = vf_ctt->state_fd_saved ? 4 : 3;
 			msg->fds[0] = vf_dev->vf_ctx.vfio_container_fd;
 			msg->fds[1] = vf_dev->vf_ctx.vfio_group_fd;
 			msg->fds[2] = vf_dev->vf_ctx.vfio_device_fd;
+			msg->fds[3] = vf_dev->state_fd;
 			HA_APP_LOG(INFO, "Got vf %s ctx query and reply with container fd %d group fd %d "
 				"and device fd %d", vf->vf_name.dev_bdf, msg->fds[0], msg->fds[1], msg->fds[2]);
 			break;
@@ -482,6 +494,7 @@ ha_server_vf_store_devarg_vfio_fds(struct virtio_ha_msg *msg)
 	vf_dev->vf_ctx.vfio_group_fd = msg->fds[1];
 	vf_dev->vf_ctx.vfio_device_fd = msg->fds[2];
 	vf_dev->vhost_fd = -1;
+	vf_dev->state_fd = -1;
 	HA_APP_LOG(INFO, "Stored vf %s", vf_dev->vf_devargs.vf_name.dev_bdf);
 	HA_APP_LOG(INFO, "vf %s: sock %s, vm_uuid %s", vf_dev->vf_devargs.vf_name.dev_bdf,
 		vf_dev->vf_devargs.vhost_sock_addr, vf_dev->vf_devargs.vm_uuid);
@@ -539,6 +552,50 @@ ha_server_store_vhost_fd(struct virtio_ha_msg *msg)
 	return HA_MSG_HDLR_SUCCESS;
 }
 
+static int
+ha_server_store_state_fd(struct virtio_ha_msg *msg)
+{
+	struct virtio_ha_vf_dev_list *vf_list = NULL;
+	struct virtio_ha_pf_dev_list *list = &hs.pf_list;
+	struct virtio_ha_pf_dev *dev;
+	struct virtio_ha_vf_dev *vf_dev;
+	struct virtio_dev_name *vf_name;
+	bool found = false;
+
+	if (msg->nr_fds != 1 || msg->iov.iov_len != sizeof(struct virtio_dev_name)) {
+		HA_APP_LOG(ERR, "Wrong msg(nr_fds %d, sz %lu), should be nr_fds 1, sz %lu",
+			msg->nr_fds, msg->iov.iov_len, sizeof(struct virtio_dev_name));
+		return HA_MSG_HDLR_ERR;
+	}
+
+	TAILQ_FOREACH(dev, list, next) {
+		if (!strcmp(dev->pf_name.dev_bdf, msg->hdr.bdf)) {
+			vf_list = &dev->vf_list;
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+		return HA_MSG_HDLR_ERR;
+
+	vf_name = (struct virtio_dev_name *)msg->iov.iov_base;
+	TAILQ_FOREACH(vf_dev, vf_list, next) {
+		if (!strcmp(vf_dev->vf_devargs.vf_name.dev_bdf, vf_name->dev_bdf)) {
+			if (vf_dev->state_fd != -1) {
+				HA_APP_LOG(INFO, "Close vf %s state old fd %d",
+					vf_name->dev_bdf, vf_dev->state_fd);
+				close(vf_dev->state_fd);
+			}
+			vf_dev->state_fd = msg->fds[0];
+			HA_APP_LOG(INFO, "Stored vf %s state fd %d", vf_name->dev_bdf, msg->fds[0]);
+			break;
+		}
+	}
+
+	return HA_MSG_HDLR_SUCCESS;
+}
+
 static int
 ha_server_store_dma_tbl(struct virtio_ha_msg *msg)
 {
@@ -644,6 +701,8 @@ ha_server_remove_devarg_vfio_fds(struct virtio_ha_msg *msg)
 		close(vf_dev->vf_ctx.vfio_container_fd);
 		if (vf_dev->vhost_fd != -1)
 			close(vf_dev->vhost_fd);
+		if (vf_dev->state_fd != -1)
+			close(vf_dev->state_fd);
 		free(vf_dev);
 	}
 
@@ -840,6 +899,36 @@ ha_server_global_init_finish(__attribute__((__unused__)) struct virtio_ha_msg *m
 	return HA_MSG_HDLR_SUCCESS;
 }
 
+static int
+ha_server_standby_register(struct virtio_ha_msg *msg)
+{
+	bool *standby;
+	int i;
+
+	standby = malloc(sizeof(bool));
+	if (!standby) {
+		HA_APP_LOG(ERR, "Failed to alloc standby reply");
+		return HA_MSG_HDLR_ERR;
+	}
+
+	/* Standby only if another vfe-vhostd is active, otherwise it goes on as the active one */
+	*standby = false;
+	for (i = 0; i < HA_SERVER_MAX_CONN; i++) {
+		if (conns[i].in_use && !conns[i].standby && &conns[i] != cur_conn) {
+			*standby = true;
+			break;
+		}
+	}
+	cur_conn->standby = *standby;
+	HA_APP_LOG(INFO, "vfe-vhostd on fd %d registered as %s", cur_conn->hdlr.sock,
+		*standby ? "standby" : "active");
+
+	msg->iov.iov_len = msg->hdr.size = sizeof(bool);
+	msg->iov.iov_base = standby;
+
+	return HA_MSG_HDLR_REPLY;
+}
+
 static void
 ha_server_cleanup_global_dma(void)
 {
@@ -891,13 +980,16 @@ static ha_message_handler_t ha_message_handlers[VIRTIO_HA_MESSAGE_MAX] = {
 	[VIRTIO_HA_GLOBAL_STORE_DMA_MAP] = ha_server_global_store_dma_map,
 	[VIRTIO_HA_GLOBAL_REMOVE_DMA_MAP] = ha_server_global_remove_dma_map,
 	[VIRTIO_HA_GLOBAL_INIT_FINISH] = ha_server_global_init_finish,
+	[VIRTIO_HA_VF_STORE_STATE_FD] = ha_server_store_state_fd,
+	[VIRTIO_HA_STANDBY_REGISTER] = ha_server_standby_register,
 };
 
 static void
-ha_message_handler(int fd, __attribute__((__unused__)) void *data)
+ha_message_handler(int fd, void *data)
 {
 	int ret;
 
+	cur_conn = data;
 	virtio_ha_reset_msg(msg);
 
 	ret = virtio_ha_recv_msg(fd, msg);
@@ -932,7 +1024,8 @@ static void
 add_connection(int fd, void *data)
 {
 	struct epoll_event event;
-	int sock, epfd;
+	struct ha_server_conn *conn = NULL;
+	int sock, epfd, i;
 
 	sock = accept(fd, NULL, NULL);
 	if (sock < 0) {
@@ -940,13 +1033,27 @@ add_connection(int fd, void *data)
 		return;
 	}
 
-	msg_hdlr.sock = sock;
-	msg_hdlr.cb = ha_message_handler;
-	msg_hdlr.data = NULL;
+	for (i = 0; i < HA_SERVER_MAX_CONN; i++) {
+		if (!conns[i].in_use) {
+			conn = &conns[i];
+			break;
+		}
+	}
+	if (!conn) {
+		HA_APP_LOG(ERR, "Too many vfe-vhostd connections, reject fd %d", sock);
+		close(sock);
+		return;
+	}
+
+	conn->hdlr.sock = sock;
+	conn->hdlr.cb = ha_message_handler;
+	conn->hdlr.data = conn;
+	conn->in_use = true;
+	conn->standby = false;
 
 	epfd = *(int *)data;
 	event.events = EPOLLIN | EPOLLHUP | EPOLLERR;
-	event.data.ptr = &msg_hdlr;
+	event.data.ptr = &conn->hdlr;
 	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event) < 0)
 		HA_APP_LOG(ERR, "Failed to epoll ctl add for message");
 
@@ -1120,6 +1227,31 @@ ha_server_remove_pf_reset_file(FILE *fp)
 		HA_APP_LOG(ERR, "PF reset file deleted");
 }
 
+/* Hand the devices over to the standby vfe-vhostd, if any, once PFs are reset */
+static void
+ha_server_standby_takeover(void)
+{
+	struct timeval now;
+	int i;
+
+	for (i = 0; i < HA_SERVER_MAX_CONN; i++) {
+		if (!conns[i].in_use || !conns[i].standby)
+			continue;
+
+		virtio_ha_reset_msg(msg);
+		msg->hdr.type = VIRTIO_HA_STANDBY_TAKEOVER;
+		if (virtio_ha_send_msg(conns[i].hdlr.sock, msg) < 0) {
+			HA_APP_LOG(ERR, "Failed to send takeover msg to fd %d", conns[i].hdlr.sock);
+			continue;
+		}
+		conns[i].standby = false;
+		gettimeofday(&now, NULL);
+		HA_APP_LOG(INFO, "Standby vfe-vhostd on fd %d takes over at %lu.%06lu",
+			conns[i].hdlr.sock, now.tv_sec, now.tv_usec);
+		return;
+	}
+}
+
 static void
 ha_server_reset_all_pfs(void)
 {
@@ -1188,8 +1320,10 @@ int
 main(__attribute__((__unused__)) int argc, __attribute__((__unused__)) char *argv[])
 {
 	struct sockaddr_un addr;
-	struct epoll_event event, ev[2];
+	struct epoll_event event, ev[HA_SERVER_MAX_CONN + 1];
 	struct virtio_ha_event_handler hdl, *handler;
+	struct ha_server_conn *conn;
+	struct timeval now;
 	int sock, epfd, nev, i;
 	FILE *fp;
 
@@ -1249,13 +1383,25 @@ main(__attribute__((__unused__)) int argc, __attribute__((__unused__)) char *arg
 	HA_APP_LOG(INFO, "HA server init success");
 
 	while (1) {
-		nev = epoll_wait(epfd, ev, 2, -1);
+		nev = epoll_wait(epfd, ev, HA_SERVER_MAX_CONN + 1, -1);
 		for (i = 0; i < nev; i++) {
 			handler = (struct virtio_ha_event_handler *)ev[i].data.ptr;
 			if ((ev[i].events & EPOLLERR) || (ev[i].events & EPOLLHUP)) {
 				if (epoll_ctl(epfd, EPOLL_CTL_DEL, handler->sock, &ev[i]) < 0)
 					HA_APP_LOG(ERR, "Failed to epoll ctl del for fd %d", handler->sock);
 				close(handler->sock);
+				conn = handler != &hdl ? handler->data : NULL;
+				if (conn) {
+					conn->in_use = false;
+					if (conn->standby) {
+						/* Standby owns no device, nothing to recover */
+						HA_APP_LOG(INFO, "Standby vfe-vhostd on fd %d quit", handler->sock);
+						continue;
+					}
+				}
+				gettimeofday(&now, NULL);
+				HA_APP_LOG(INFO, "Active vfe-vhostd on fd %d quit at %lu.%06lu",
+					handler->sock, now.tv_sec, now.tv_usec);
 				fp = ha_server_create_pf_reset_file();
 				pthread_mutex_lock(&prio_chnl_mutex);
 				if (hs.prio_chnl_fd != -1) {
@@ -1274,6 +1420,7 @@ main(__attribute__((__unused__)) int argc, __attribute__((__unused__)) char *arg
 					ha_server_reset_all_pfs();
 					ha_server_remove_pf_reset_file(fp);
 				}
+				ha_server_standby_takeover();
 			} else { /* EPOLLIN */
 				handler->cb(handler->sock, handler->data);
 			}
@@ -258,48 +258,232 @@ virtio_pci_dev_state_dev_status_set(void *state, uint8_t dev_status)
 	state_info->common_cfg.device_status = dev_status;
 }
 
-static struct virtio_field_hdr *
-virtio_pci_dev_state_filed_find(struct virtio_field_hdr *f_hdr, uint32_t field_cnt, uint32_t f_type,
-						void *state, uint32_t state_size)
+static int
+virtio_pci_dev_state_q_field(uint32_t f_type)
 {
-	while(field_cnt) {
-		if (rte_le_to_cpu_32(f_hdr->type) == f_type) {
-			return f_hdr;
-		}
-		f_hdr = (struct virtio_field_hdr *)((uint8_t *)(f_hdr + 1) + rte_le_to_cpu_32(f_hdr->size));
-		if (((uint8_t *)f_hdr - (uint8_t *)state) > state_size) {
-			PMD_INIT_LOG(ERR, "TLV exceed state size, tlv:%p state:%p size:%d\n", f_hdr, state, state_size);
-			return NULL;
-		}
-		field_cnt--;
+	switch (f_type) {
+	case VIRTIO_DEV_QUEUE_CFG:
+		return VIRTIO_DEV_Q_FIELD_CFG;
+	case VIRTIO_DEV_SPLIT_Q_RUN_STATE:
+		return VIRTIO_DEV_Q_FIELD_RUN_STATE;
+	case VIRTIO_DEV_IN_FLIGHT_DESC:
+		return VIRTIO_DEV_Q_FIELD_IN_FLIGHT;
+	case VIRTIO_DEV_COMPLETED_DESC:
+		return VIRTIO_DEV_Q_FIELD_COMPLETED;
+	default:
+		return -1;
 	}
+}
 
-	return NULL;
+static int
+virtio_pci_dev_state_index_grow(struct virtio_dev_state_index *idx, uint16_t qidx)
+{
+	uint32_t (*q_field)[VIRTIO_DEV_Q_FIELD_NUM];
+	uint32_t q_alloc;
+
+	q_alloc = RTE_MAX(RTE_MAX((uint32_t)qidx + 1, (uint32_t)idx->q_alloc * 2), 16U);
+	q_alloc = RTE_MIN(q_alloc, (uint32_t)UINT16_MAX + 1);
+	q_field = rte_realloc(idx->q_field, q_alloc * sizeof(*q_field), 0);
+	if (!q_field)
+		return -ENOMEM;
+
+	memset(q_field + idx->q_alloc, 0, (q_alloc - idx->q_alloc) * sizeof(*q_field));
+	idx->q_field = q_field;
+	idx->q_alloc = RTE_MIN(q_alloc, (uint32_t)UINT16_MAX);
+	return 0;
 }
 
-static struct virtio_field_hdr *
-virtio_pci_dev_state_queue_filed_find(struct virtio_field_hdr *f_hdr, uint32_t field_cnt,
-						void *state, uint32_t state_size, uint16_t qidx)
+void
+virtio_pci_dev_state_index_free(struct virtio_dev_state_index *idx)
 {
-	struct virtio_dev_q_cfg *tmp_q_cfg;
+	rte_free(idx->q_field);
+	idx->q_field = NULL;
+	idx->q_alloc = 0;
+	idx->nr_queues = 0;
+}
 
-	while(field_cnt) {
-		if (rte_le_to_cpu_32(f_hdr->type) == VIRTIO_DEV_QUEUE_CFG) {
-			tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr + 1);
-			if (qidx == rte_le_to_cpu_16(tmp_q_cfg->queue_index))
-				return f_hdr;
+int
+virtio_pci_dev_state_index_build(void *state, uint32_t state_size,
+						struct virtio_dev_state_index *idx)
+{
+	struct virtio_dev_state_hdr *hdr = state;
+	struct virtio_field_hdr *f_hdr;
+	uint32_t field_cnt, f_type, f_size, offset;
+	uint16_t qidx;
+	int q_field;
+
+	memset(idx, 0, sizeof(*idx));
+	if (state_size < sizeof(*hdr))
+		return -EINVAL;
+
+	idx->state = state;
+	idx->state_size = state_size;
+	field_cnt = rte_le_to_cpu_32(hdr->virtio_field_count);
+	offset = sizeof(*hdr);
+
+	while (field_cnt) {
+		if (state_size - offset < sizeof(*f_hdr))
+			goto exceed;
+		f_hdr = (struct virtio_field_hdr *)((uint8_t *)state + offset);
+		f_type = rte_le_to_cpu_32(f_hdr->type);
+		f_size = rte_le_to_cpu_32(f_hdr->size);
+		if (state_size - offset - sizeof(*f_hdr) < f_size)
+			goto exceed;
+
+		q_field = virtio_pci_dev_state_q_field(f_type);
+		if (q_field >= 0 && f_size >= sizeof(uint16_t)) {
+			qidx = rte_le_to_cpu_16(*(uint16_t *)(f_hdr + 1));
+			if (qidx >= idx->q_alloc &&
+			    virtio_pci_dev_state_index_grow(idx, qidx)) {
+				virtio_pci_dev_state_index_free(idx);
+				return -ENOMEM;
+			}
+			/* First occurrence wins, as with a linear lookup */
+			if (!idx->q_field[qidx][q_field])
+				idx->q_field[qidx][q_field] = offset;
+			idx->nr_queues = RTE_MAX(idx->nr_queues, qidx + 1);
+		} else if (f_type < VIRTIO_DEV_FIELD_TYPE_NUM && !idx->dev_field[f_type]) {
+			idx->dev_field[f_type] = offset;
 		}
 
-		f_hdr = (struct virtio_field_hdr *)((uint8_t *)(f_hdr + 1) + rte_le_to_cpu_32(f_hdr->size));
-		if (((uint8_t *)f_hdr - (uint8_t *)state) > state_size) {
-			PMD_INIT_LOG(ERR, "TLV exceed state size, tlv:%p state:%p size:%d\n", f_hdr, state, state_size);
+		offset += sizeof(*f_hdr) + f_size;
+		idx->field_cnt++;
+		field_cnt--;
+	}
+
+	return 0;
+
+exceed:
+	PMD_INIT_LOG(ERR, "TLV exceed state size, offset:%u state:%p size:%u",
+				offset, state, state_size);
+	virtio_pci_dev_state_index_free(idx);
+	return -EINVAL;
+}
+
+struct virtio_field_hdr *
+virtio_pci_dev_state_field_get(const struct virtio_dev_state_index *idx,
+						uint32_t f_type, uint16_t qidx)
+{
+	struct virtio_field_hdr *f_hdr;
+	uint32_t offset;
+	int q_field;
+
+	q_field = virtio_pci_dev_state_q_field(f_type);
+	if (q_field >= 0) {
+		if (qidx >= idx->nr_queues)
+			return NULL;
+		offset = idx->q_field[qidx][q_field];
+	} else {
+		if (f_type >= VIRTIO_DEV_FIELD_TYPE_NUM)
 			return NULL;
+		offset = idx->dev_field[f_type];
+	}
+
+	if (!offset)
+		return NULL;
+
+	f_hdr = (struct virtio_field_hdr *)((uint8_t *)idx->state + offset);
+
+	return f_hdr;
+}
+
+int
+virtio_pci_dev_state_desc_list_get(const struct virtio_dev_state_index *idx, uint32_t f_type,
+						uint16_t qidx, uint16_t *desc_idx, uint16_t max_num)
+{
+	struct virtio_dev_inflight_desc *desc_list;
+	struct virtio_field_hdr *f_hdr;
+	uint16_t i, num;
+
+	/* Completed list has the same layout as the in-flight one */
+	RTE_BUILD_BUG_ON(sizeof(struct virtio_dev_inflight_desc) !=
+			sizeof(struct virtio_dev_completed_desc));
+
+	if (f_type != VIRTIO_DEV_IN_FLIGHT_DESC && f_type != VIRTIO_DEV_COMPLETED_DESC)
+		return -EINVAL;
+
+	f_hdr = virtio_pci_dev_state_field_get(idx, f_type, qidx);
+	if (!f_hdr)
+		return 0;
+
+	if (f_hdr->size < sizeof(*desc_list)) {
+		PMD_INIT_LOG(ERR, "Desc list %u of queue %u is truncated, size: %u",
+					f_type, qidx, f_hdr->size);
+		return -EINVAL;
+	}
+
+	desc_list = (struct virtio_dev_inflight_desc *)(f_hdr + 1);
+	num = rte_le_to_cpu_16(desc_list->inflight_desc_hdr_count);
+	if (f_hdr->size < sizeof(*desc_list) + num * sizeof(desc_list->desc_idx[0])) {
+		PMD_INIT_LOG(ERR, "Desc list %u of queue %u is truncated, size: %u count: %u",
+					f_type, qidx, f_hdr->size, num);
+		return -EINVAL;
+	}
+	if (num > max_num)
+		return -E2BIG;
+
+	for (i = 0; i < num; i++)
+		desc_idx[i] = rte_le_to_cpu_16(desc_list->desc_idx[i]);
+
+	return num;
+}
+
+static bool
+virtio_pci_dev_state_field_same(const struct virtio_field_hdr *f_hdr,
+						const struct virtio_field_hdr *f_hdr_remote)
+{
+	if (!f_hdr || !f_hdr_remote)
+		return f_hdr == f_hdr_remote;
+
+	return f_hdr->size == f_hdr_remote->size &&
+		!memcmp(f_hdr, f_hdr_remote, sizeof(*f_hdr) + rte_le_to_cpu_32(f_hdr->size));
+}
+
+uint32_t
+virtio_pci_dev_state_diff(const struct virtio_dev_state_index *idx,
+					const struct virtio_dev_state_index *idx_remote,
+					virtio_pci_dev_state_diff_cb_t cb, void *cb_arg)
+{
+	struct virtio_field_hdr *f_hdr, *f_hdr_remote;
+	uint16_t qidx, nr_queues;
+	uint32_t f_type, diff = 0;
+	int q_field;
+
+	for (f_type = 0; f_type < VIRTIO_DEV_FIELD_TYPE_NUM; f_type++) {
+		if (virtio_pci_dev_state_q_field(f_type) >= 0)
+			continue;
+		f_hdr = virtio_pci_dev_state_field_get(idx, f_type, 0);
+		f_hdr_remote = virtio_pci_dev_state_field_get(idx_remote, f_type, 0);
+		if (virtio_pci_dev_state_field_same(f_hdr, f_hdr_remote))
+			continue;
+		PMD_DUMP_LOG(INFO, "state field %u differs\n", f_type);
+		if (cb)
+			cb(f_type, VIRTIO_DEV_STATE_NO_QUEUE, cb_arg);
+		diff++;
+	}
+
+	nr_queues = RTE_MAX(idx->nr_queues, idx_remote->nr_queues);
+	for (qidx = 0; qidx < nr_queues; qidx++) {
+		for (q_field = 0; q_field < VIRTIO_DEV_Q_FIELD_NUM; q_field++) {
+			f_hdr = qidx < idx->nr_queues && idx->q_field[qidx][q_field] ?
+				(struct virtio_field_hdr *)((uint8_t *)idx->state +
+					idx->q_field[qidx][q_field]) : NULL;
+			f_hdr_remote = qidx < idx_remote->nr_queues && idx_remote->q_field[qidx][q_field] ?
+				(struct virtio_field_hdr *)((uint8_t *)idx_remote->state +
+					idx_remote->q_field[qidx][q_field]) : NULL;
+			if (virtio_pci_dev_state_field_same(f_hdr, f_hdr_remote))
+				continue;
+			f_type = rte_le_to_cpu_32((f_hdr ? f_hdr : f_hdr_remote)->type);
+			PMD_DUMP_LOG(INFO, "state field %u of queue %u differs\n", f_type, qidx);
+			if (cb)
+				cb(f_type, qidx, cb_arg);
+			diff++;
 		}
-		field_cnt--;
 	}
 
-	return NULL;
+	return diff;
 }
+
 static void
 virtio_pci_dev_q_cfg_dump(struct virtio_dev_q_cfg *tmp_q_cfg)
 {
@@ -331,106 +515,104 @@ virtio_pci_dev_common_cfg_dump(struct virtio_pci_state_common_cfg *common_cfg)
 			common_cfg->config_generation);
 }
 
-bool
-virtio_pci_dev_state_compare(struct virtio_pci_dev *vpdev, void *state, uint32_t state_size,
-					  void *state_remote, uint32_t state_size_remote)
+static bool
+virtio_pci_dev_state_index_compare(struct virtio_hw *hw,
+					const struct virtio_dev_state_index *idx,
+					const struct virtio_dev_state_index *idx_remote)
 {
-	struct virtio_dev_state_hdr *hdr,*hdr_remote;
-	struct virtio_field_hdr *f_hdr,*f_hdr_remote,*f_hdr_tmp;
-	struct virtio_dev_q_cfg *tmp_q_cfg;
-	uint32_t field_cnt, field_cnt_remote;
+	struct virtio_field_hdr *f_hdr, *f_hdr_remote;
 	struct virtio_pci_state_common_cfg *common_cfg, *common_cfg_remote;
-	struct virtio_hw *hw;
-
-	hw = &vpdev->hw;
-
-	hdr = state;
-	field_cnt = rte_le_to_cpu_32(hdr->virtio_field_count);
-	hdr_remote = state_remote;
-	field_cnt_remote = rte_le_to_cpu_32(hdr_remote->virtio_field_count);
+	struct virtio_dev_q_cfg *tmp_q_cfg;
+	uint16_t qidx;
 
-	f_hdr = (struct virtio_field_hdr *)(hdr + 1);
-	f_hdr_remote = (struct virtio_field_hdr *)(hdr_remote + 1);
-	while(field_cnt) {
-		switch (rte_le_to_cpu_32(f_hdr->type)) {
-			case VIRTIO_DEV_PCI_COMMON_CFG:
-				f_hdr_tmp = virtio_pci_dev_state_filed_find(f_hdr_remote, field_cnt_remote,
-									    f_hdr->type, state_remote, state_size_remote);
-				if (!f_hdr_tmp)
-					return false;
-				common_cfg = (struct virtio_pci_state_common_cfg *)(f_hdr + 1);
-				common_cfg_remote = (struct virtio_pci_state_common_cfg *)(f_hdr_tmp + 1);
-				if((common_cfg->device_feature != common_cfg_remote->device_feature) ||
-				   (common_cfg->driver_feature != common_cfg_remote->driver_feature) ||
-				   (common_cfg->msix_config != common_cfg_remote->msix_config) ||
-				   (common_cfg->num_queues != common_cfg_remote->num_queues) ||
-				   (common_cfg->device_status != common_cfg_remote->device_status)) {
-					PMD_DUMP_LOG(INFO, "VIRTIO_DEV_PCI_COMMON_CFG, local size:%d bytes \n", f_hdr->size);
-					virtio_pci_dev_common_cfg_dump(common_cfg);
-					PMD_DUMP_LOG(INFO, "VIRTIO_DEV_PCI_COMMON_CFG, remote size:%d bytes \n", f_hdr_tmp->size);
-					virtio_pci_dev_common_cfg_dump(common_cfg_remote);
-					return false;
-				}
-				break;
-			case VIRTIO_DEV_CFG_SPACE:
-				f_hdr_tmp = virtio_pci_dev_state_filed_find(f_hdr_remote, field_cnt_remote,
-									    f_hdr->type, state_remote, state_size_remote);
-				if (!f_hdr_tmp)
-					return false;
-				if (hw->virtio_dev_sp_ops->dev_cfg_compare) {
-					if (hw->virtio_dev_sp_ops->dev_cfg_compare(hw, f_hdr, f_hdr_tmp))
-						break;
-					else
-						return false;
-				}
+	f_hdr = virtio_pci_dev_state_field_get(idx, VIRTIO_DEV_PCI_COMMON_CFG, 0);
+	if (f_hdr) {
+		f_hdr_remote = virtio_pci_dev_state_field_get(idx_remote, VIRTIO_DEV_PCI_COMMON_CFG, 0);
+		if (!f_hdr_remote)
+			return false;
+		common_cfg = (struct virtio_pci_state_common_cfg *)(f_hdr + 1);
+		common_cfg_remote = (struct virtio_pci_state_common_cfg *)(f_hdr_remote + 1);
+		if((common_cfg->device_feature != common_cfg_remote->device_feature) ||
+		   (common_cfg->driver_feature != common_cfg_remote->driver_feature) ||
+		   (common_cfg->msix_config != common_cfg_remote->msix_config) ||
+		   (common_cfg->num_queues != common_cfg_remote->num_queues) ||
+		   (common_cfg->device_status != common_cfg_remote->device_status)) {
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_PCI_COMMON_CFG, local size:%d bytes \n", f_hdr->size);
+			virtio_pci_dev_common_cfg_dump(common_cfg);
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_PCI_COMMON_CFG, remote size:%d bytes \n", f_hdr_remote->size);
+			virtio_pci_dev_common_cfg_dump(common_cfg_remote);
+			return false;
+		}
+	}
 
-				if(memcmp(f_hdr, f_hdr_tmp, f_hdr->size + sizeof(*f_hdr))) {
-					PMD_DUMP_LOG(INFO, "VIRTIO_DEV_CFG_SPACE, local size:%d bytes \n", f_hdr->size);
-					hw->virtio_dev_sp_ops->dev_cfg_dump(f_hdr);
-					if(f_hdr_tmp) {
-						PMD_DUMP_LOG(INFO, "VIRTIO_DEV_CFG_SPACE, remote size:%d bytes \n", f_hdr_tmp->size);
-						hw->virtio_dev_sp_ops->dev_cfg_dump(f_hdr_tmp);
-					}
-					return false;
-				}
-				break;
-			case VIRTIO_DEV_SPLIT_Q_RUN_STATE:
-				break;
-			case VIRTIO_DEV_QUEUE_CFG:
-				tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr + 1);
-				f_hdr_tmp = virtio_pci_dev_state_queue_filed_find(f_hdr_remote, field_cnt_remote,
-									state_remote, state_size_remote,
-									rte_le_to_cpu_16(tmp_q_cfg->queue_index));
-				if (!f_hdr_tmp)
-					return false;
-				if(memcmp(f_hdr, f_hdr_tmp, f_hdr->size + sizeof(*f_hdr))) {
-					PMD_DUMP_LOG(INFO, "VIRTIO_DEV_QUEUE_CFG, local size:%d bytes \n", f_hdr->size);
-					virtio_pci_dev_q_cfg_dump(tmp_q_cfg);
-
-					if(f_hdr_tmp) {
-						PMD_DUMP_LOG(INFO, "VIRTIO_DEV_QUEUE_CFG, remote size:%d bytes \n", f_hdr_tmp->size);
-						tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr_tmp + 1);
-						virtio_pci_dev_q_cfg_dump(tmp_q_cfg);
-					}
-					return false;
-				}
-				break;
-			default:
-				break;
+	f_hdr = virtio_pci_dev_state_field_get(idx, VIRTIO_DEV_CFG_SPACE, 0);
+	if (f_hdr) {
+		f_hdr_remote = virtio_pci_dev_state_field_get(idx_remote, VIRTIO_DEV_CFG_SPACE, 0);
+		if (!f_hdr_remote)
+			return false;
+		if (hw->virtio_dev_sp_ops->dev_cfg_compare) {
+			if (!hw->virtio_dev_sp_ops->dev_cfg_compare(hw, f_hdr, f_hdr_remote))
+				return false;
+		} else if (memcmp(f_hdr, f_hdr_remote, f_hdr->size + sizeof(*f_hdr))) {
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_CFG_SPACE, local size:%d bytes \n", f_hdr->size);
+			hw->virtio_dev_sp_ops->dev_cfg_dump(f_hdr);
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_CFG_SPACE, remote size:%d bytes \n", f_hdr_remote->size);
+			hw->virtio_dev_sp_ops->dev_cfg_dump(f_hdr_remote);
+			return false;
 		}
-		f_hdr = (struct virtio_field_hdr *)((uint8_t *)(f_hdr + 1) + rte_le_to_cpu_32(f_hdr->size));
-		field_cnt--;
+	}
 
-		if ((uint8_t *)f_hdr > ((uint8_t *)state + state_size)) {
-			PMD_DUMP_LOG(ERR, "state compare pointer exceed!\r\n");
+	/* Run states are expected to move, only queue configs are compared */
+	for (qidx = 0; qidx < idx->nr_queues; qidx++) {
+		f_hdr = virtio_pci_dev_state_field_get(idx, VIRTIO_DEV_QUEUE_CFG, qidx);
+		if (!f_hdr)
+			continue;
+		f_hdr_remote = virtio_pci_dev_state_field_get(idx_remote, VIRTIO_DEV_QUEUE_CFG, qidx);
+		if (!f_hdr_remote)
+			return false;
+		if(memcmp(f_hdr, f_hdr_remote, f_hdr->size + sizeof(*f_hdr))) {
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_QUEUE_CFG, local size:%d bytes \n", f_hdr->size);
+			tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr + 1);
+			virtio_pci_dev_q_cfg_dump(tmp_q_cfg);
+			PMD_DUMP_LOG(INFO, "VIRTIO_DEV_QUEUE_CFG, remote size:%d bytes \n", f_hdr_remote->size);
+			tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr_remote + 1);
+			virtio_pci_dev_q_cfg_dump(tmp_q_cfg);
 			return false;
 		}
 	}
 
-	PMD_DUMP_LOG(INFO, "--------------state compare same--------------\r\n");
 	return true;
 }
 
+bool
+virtio_pci_dev_state_compare(struct virtio_pci_dev *vpdev, void *state, uint32_t state_size,
+					  void *state_remote, uint32_t state_size_remote)
+{
+	struct virtio_dev_state_index idx, idx_remote;
+	bool same;
+
+	if (virtio_pci_dev_state_index_build(state, state_size, &idx)) {
+		PMD_DUMP_LOG(ERR, "local state index build fail\r\n");
+		return false;
+	}
+	if (virtio_pci_dev_state_index_build(state_remote, state_size_remote, &idx_remote)) {
+		PMD_DUMP_LOG(ERR, "remote state index build fail\r\n");
+		virtio_pci_dev_state_index_free(&idx);
+		return false;
+	}
+
+	same = virtio_pci_dev_state_index_compare(&vpdev->hw, &idx, &idx_remote);
+	if (same)
+		PMD_DUMP_LOG(INFO, "--------------state compare same--------------\r\n");
+	else
+		PMD_DUMP_LOG(INFO, "state compare: %u fields differ\r\n",
+			virtio_pci_dev_state_diff(&idx, &idx_remote, NULL, NULL));
+
+	virtio_pci_dev_state_index_free(&idx_remote);
+	virtio_pci_dev_state_index_free(&idx);
+	return same;
+}
+
 void
 virtio_pci_dev_state_dump(struct virtio_pci_dev *vpdev, void *state, uint32_t state_size)
 {
@@ -440,7 +622,9 @@ virtio_pci_dev_state_dump(struct virtio_pci_dev *vpdev, void *state, uint32_t st
 	struct virtio_dev_split_q_run_state *tmp_hw_idx;
 	struct virtio_pci_state_common_cfg *common_cfg;
 	struct virtio_dev_q_cfg *tmp_q_cfg;
+	struct virtio_dev_inflight_desc *tmp_desc_list;
 	uint32_t field_cnt, *tmp, *tmp_start;
+	uint16_t i;
 
 	hw = &vpdev->hw;
 
@@ -468,11 +652,39 @@ virtio_pci_dev_state_dump(struct virtio_pci_dev *vpdev, void *state, uint32_t st
 					PMD_DUMP_LOG(INFO, ">> VIRTIO_DEV_SPLIT_Q_RUN_STATE is truncated\n");
 					break;
 				}
+				if (virtio_with_packed_queue(hw)) {
+					PMD_DUMP_LOG(INFO, ">>> qid:%d hw_avail_idx: %d wrap: %d hw_used_idx: %d wrap: %d\r\n",
+							rte_le_to_cpu_16(tmp_hw_idx->queue_index),
+							rte_le_to_cpu_16(tmp_hw_idx->last_avail_idx) & VIRTIO_DEV_PACKED_Q_IDX_MASK,
+							rte_le_to_cpu_16(tmp_hw_idx->last_avail_idx) >> VIRTIO_DEV_PACKED_Q_WRAP_SHIFT,
+							rte_le_to_cpu_16(tmp_hw_idx->last_used_idx) & VIRTIO_DEV_PACKED_Q_IDX_MASK,
+							rte_le_to_cpu_16(tmp_hw_idx->last_used_idx) >> VIRTIO_DEV_PACKED_Q_WRAP_SHIFT);
+					break;
+				}
 				PMD_DUMP_LOG(INFO, ">>> qid:%d hw_avail_idx: %d hw_used_idx: %d\r\n",
 									rte_le_to_cpu_16(tmp_hw_idx->queue_index),
 									rte_le_to_cpu_16(tmp_hw_idx->last_avail_idx),
 									rte_le_to_cpu_16(tmp_hw_idx->last_used_idx));
 				break;
+			case VIRTIO_DEV_IN_FLIGHT_DESC:
+			case VIRTIO_DEV_COMPLETED_DESC:
+				tmp_desc_list = (struct virtio_dev_inflight_desc *)(f_hdr + 1);
+				PMD_DUMP_LOG(INFO, ">> %s, size:%d bytes \n",
+						rte_le_to_cpu_32(f_hdr->type) == VIRTIO_DEV_IN_FLIGHT_DESC ?
+						"VIRTIO_DEV_IN_FLIGHT_DESC" : "VIRTIO_DEV_COMPLETED_DESC", f_hdr->size);
+				if (f_hdr->size < sizeof(struct virtio_dev_inflight_desc) ||
+					f_hdr->size < sizeof(struct virtio_dev_inflight_desc) +
+					rte_le_to_cpu_16(tmp_desc_list->inflight_desc_hdr_count) * sizeof(uint16_t)) {
+					PMD_DUMP_LOG(INFO, ">> desc list is truncated\n");
+					break;
+				}
+				PMD_DUMP_LOG(INFO, ">>> qid:%d count: %d\r\n>>>",
+						rte_le_to_cpu_16(tmp_desc_list->queue_index),
+						rte_le_to_cpu_16(tmp_desc_list->inflight_desc_hdr_count));
+				for (i = 0; i < rte_le_to_cpu_16(tmp_desc_list->inflight_desc_hdr_count); i++)
+					PMD_DUMP_LOG(INFO, " %d", rte_le_to_cpu_16(tmp_desc_list->desc_idx[i]));
+				PMD_DUMP_LOG(INFO, "\n");
+				break;
 			case VIRTIO_DEV_QUEUE_CFG:
 				tmp_q_cfg = (struct virtio_dev_q_cfg *)(f_hdr + 1);
 				PMD_DUMP_LOG(INFO, ">> VIRTIO_DEV_QUEUE_CFG, size:%d bytes \n", f_hdr->size);
@@ -518,40 +730,36 @@ virtio_pci_dev_state_hw_idx_get(void *state, uint32_t state_size,
 											struct virtio_dev_run_state_info *hw_idx_info,
 											int num_queues)
 {
-	struct virtio_dev_state_hdr *hdr;
+	struct virtio_dev_state_index idx;
 	struct virtio_field_hdr *f_hdr;
 	struct virtio_dev_split_q_run_state *tmp_hw_idx;
 	uint16_t qid;
-	uint32_t field_cnt;
+	int ret;
 
-	hdr = state;
-	field_cnt = rte_le_to_cpu_32(hdr->virtio_field_count);
+	ret = virtio_pci_dev_state_index_build(state, state_size, &idx);
+	if (ret)
+		return ret;
 
-	f_hdr = (struct virtio_field_hdr *)(hdr + 1);
-	while(field_cnt) {
-		if (rte_le_to_cpu_32(f_hdr->type) == VIRTIO_DEV_SPLIT_Q_RUN_STATE) {
-			if (f_hdr->size < sizeof(struct virtio_dev_split_q_run_state)) {
-				PMD_INIT_LOG(ERR, "State is truncated, size: %d \n", f_hdr->size);
-				return -EINVAL;
-			}
+	/* Packed rings keep the wrap counters in bit 15 of the indexes */
+	for (qid = 0; qid < RTE_MIN(num_queues, idx.nr_queues); qid++) {
+		f_hdr = virtio_pci_dev_state_field_get(&idx, VIRTIO_DEV_SPLIT_Q_RUN_STATE, qid);
+		if (!f_hdr)
+			continue;
 
-			tmp_hw_idx = (struct virtio_dev_split_q_run_state *)(f_hdr + 1);
-			qid = rte_le_to_cpu_16(tmp_hw_idx->queue_index);
-			if (qid < num_queues) {
-				hw_idx_info[qid].flag = true;
-				hw_idx_info[qid].last_avail_idx = rte_le_to_cpu_16(tmp_hw_idx->last_avail_idx);
-				hw_idx_info[qid].last_used_idx = rte_le_to_cpu_16(tmp_hw_idx->last_used_idx);
-			}
-		}
-		f_hdr = (struct virtio_field_hdr *)((uint8_t *)(f_hdr + 1) + rte_le_to_cpu_32(f_hdr->size));
-		if (((uint8_t *)f_hdr - (uint8_t *)state) > state_size) {
-			PMD_INIT_LOG(ERR, "TLV exceed state size, tlv:%p state:%p size:%d\n", f_hdr, state, state_size);
-			return -EINVAL;
+		if (f_hdr->size < sizeof(struct virtio_dev_split_q_run_state)) {
+			PMD_INIT_LOG(ERR, "State is truncated, size: %d \n", f_hdr->size);
+			ret = -EINVAL;
+			break;
 		}
-		field_cnt--;
+
+		tmp_hw_idx = (struct virtio_dev_split_q_run_state *)(f_hdr + 1);
+		hw_idx_info[qid].flag = true;
+		hw_idx_info[qid].last_avail_idx = rte_le_to_cpu_16(tmp_hw_idx->last_avail_idx);
+		hw_idx_info[qid].last_used_idx = rte_le_to_cpu_16(tmp_hw_idx->last_used_idx);
 	}
 
-	return 0;
+	virtio_pci_dev_state_index_free(&idx);
+	return ret;
 }
 
 int
@@ -120,8 +120,12 @@ struct virtadmin_ctl {
 	const struct rte_memzone *mz;   /**< mem zone to populate CTL ring. */
 	rte_spinlock_t lock;	    /**< spinlock for control queue. */
 	struct desc_state *desc_list;  /**< Desc meta data, used to get free desc */
+	const struct rte_memzone *indirect_mz; /**< indirect desc table for each ring desc */
+	uint32_t indirect_tbl_size; /**< bytes of one indirect desc table */
+	bool in_order; /**< commands complete in the order they were made available */
 	int vq_size;
-	sem_t poll_sem;
+	uint32_t nr_pending; /**< commands made available and not reaped yet */
+	sem_t poll_sem;	/**< posted for each command, wakes up idle poll thread */
 	pthread_t poll_tid;
 };
 
@@ -79,12 +79,32 @@ __rte_internal
 void virtio_pci_dev_queue_del(struct virtio_pci_dev *vpdev, uint16_t qid);
 __rte_internal
 void virtio_pci_dev_state_dev_status_set(void *state, uint8_t dev_status);
+#define VIRTIO_DEV_STATE_NO_QUEUE UINT16_MAX
+
+/* Called for each field that differs, qidx is VIRTIO_DEV_STATE_NO_QUEUE for device wide fields */
+typedef void (*virtio_pci_dev_state_diff_cb_t)(uint32_t f_type, uint16_t qidx, void *arg);
+
+struct virtio_dev_state_index;
+struct virtio_field_hdr;
+
+__rte_internal
+int virtio_pci_dev_state_index_build(void *state, uint32_t state_size, struct virtio_dev_state_index *idx);
+__rte_internal
+void virtio_pci_dev_state_index_free(struct virtio_dev_state_index *idx);
+__rte_internal
+struct virtio_field_hdr *virtio_pci_dev_state_field_get(const struct virtio_dev_state_index *idx, uint32_t f_type, uint16_t qidx);
+__rte_internal
+uint32_t virtio_pci_dev_state_diff(const struct virtio_dev_state_index *idx, const struct virtio_dev_state_index *idx_remote, virtio_pci_dev_state_diff_cb_t cb, void *cb_arg);
+/* Copy VIRTIO_DEV_IN_FLIGHT_DESC or VIRTIO_DEV_COMPLETED_DESC heads of a queue, returns the count */
+__rte_internal
+int virtio_pci_dev_state_desc_list_get(const struct virtio_dev_state_index *idx, uint32_t f_type, uint16_t qidx, uint16_t *desc_idx, uint16_t max_num);
 __rte_internal
 bool virtio_pci_dev_state_compare(struct virtio_pci_dev *vpdev, void *state, uint32_t state_size, void *state_remote, uint32_t state_size_remote);
 __rte_internal
 void virtio_pci_dev_state_dump(struct virtio_pci_dev *vpdev, void *state, uint32_t state_size);
 __rte_internal
 void virtio_pci_dev_state_all_queues_disable(struct virtio_pci_dev *vpdev, void *state);
+/* For packed rings bit 15 of last_avail_idx and last_used_idx holds the wrap counter */
 __rte_internal
 int virtio_pci_dev_state_hw_idx_set(struct virtio_pci_dev *vpdev, uint16_t qid, uint16_t last_avail_idx, uint16_t last_used_idx, void *state);
 __rte_internal
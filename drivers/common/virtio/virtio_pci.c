@@ -810,28 +810,20 @@ int
 virtio_pci_dev_state_bar_copy(struct virtio_pci_dev *vpdev, void *state, int state_len)
 {
 	struct virtio_hw *hw;
-	struct virtqueue *hw_vq;
 	struct virtio_dev_common_state *state_info = state;
 	struct virtio_dev_queue_info *q_info;
-	uint16_t qid, max_q, notify_off, num_queues, dev_cfg_len;
+	uint16_t qid, max_q, nr_q, num_queues, dev_cfg_len, notify_off;
 
 	if (state_len < virtio_pci_dev_state_size_get(vpdev)) {
 		PMD_INIT_LOG(ERR, "State len is too small:%d", state_len);
 		return -EINVAL;
 	}
 
-	/* Internal vq info assign */
-	max_q = virtio_pci_dev_nr_vq_get(vpdev);
 	hw = &vpdev->hw;
-	for(qid = 0; qid < max_q; qid++) {
-		hw_vq = hw->vqs[qid];
-		rte_write16(qid, &vpdev->common_cfg->queue_select);
-		notify_off = rte_read16(&vpdev->common_cfg->queue_notify_off);
-		hw_vq->notify_addr=  (void *)((uint8_t *)vpdev->notify_base +
-				notify_off * vpdev->notify_off_multiplier);
-	}
-
+	max_q = virtio_pci_dev_nr_vq_get(vpdev);
 	num_queues = hw->num_queues;
+	nr_q = RTE_MAX(max_q, num_queues);
+
 	state_info->hdr.virtio_field_count = rte_cpu_to_le_32(VIRTIO_DEV_STATE_COMMON_FIELD_CNT +
 										VIRTIO_DEV_STATE_PER_QUEUE_FIELD_CNT * num_queues);
 	state_info->common_cfg_hdr.type = rte_cpu_to_le_32(VIRTIO_DEV_PCI_COMMON_CFG);
@@ -852,16 +844,24 @@ virtio_pci_dev_state_bar_copy(struct virtio_pci_dev *vpdev, void *state, int sta
 	if(hw->virtio_dev_sp_ops->dev_state_init)
 		hw->virtio_dev_sp_ops->dev_state_init(state);
 
-	/* Queue state info init */
+	/* Internal vq info and queue state info init, in one pass over the queues */
 	q_info = hw->virtio_dev_sp_ops->get_queue_offset(state);
-	for(qid = 0; qid < num_queues; qid++) {
+	for(qid = 0; qid < nr_q; qid++) {
 		rte_write16(qid, &vpdev->common_cfg->queue_select);
+		notify_off = rte_read16(&vpdev->common_cfg->queue_notify_off);
+
+		if (qid < max_q)
+			hw->vqs[qid]->notify_addr = (void *)((uint8_t *)vpdev->notify_base +
+					notify_off * vpdev->notify_off_multiplier);
+
+		if (qid >= num_queues)
+			continue;
 		q_info[qid].q_cfg_hdr.type = rte_cpu_to_le_32(VIRTIO_DEV_QUEUE_CFG);
 		q_info[qid].q_cfg_hdr.size = rte_cpu_to_le_32(sizeof(struct virtio_dev_q_cfg));
 		q_info[qid].q_cfg.queue_index = rte_cpu_to_le_16(qid);
 		q_info[qid].q_cfg.queue_size = rte_cpu_to_le_16(rte_read16(&vpdev->common_cfg->queue_size));
 		q_info[qid].q_cfg.queue_msix_vector = rte_cpu_to_le_16(rte_read16(&vpdev->common_cfg->queue_msix_vector));
-		q_info[qid].q_cfg.queue_notify_off = rte_cpu_to_le_16(rte_read16(&vpdev->common_cfg->queue_notify_off));
+		q_info[qid].q_cfg.queue_notify_off = rte_cpu_to_le_16(notify_off);
 		q_info[qid].q_cfg.queue_notify_data = rte_cpu_to_le_16(rte_read16(&vpdev->common_cfg->queue_notify_data));
 
 		q_info[qid].q_run_state_hdr.type = rte_cpu_to_le_32(VIRTIO_DEV_SPLIT_Q_RUN_STATE);
@@ -87,12 +87,18 @@ struct virtio_dev_blk_q_statistic_state   {
 	uint16_t queue_index;
 } __rte_packed;
 
+/*also used with VIRTIO_F_RING_PACKED: bits 0-14 hold the ring position and bit 15
+ *the wrap counter, as in the vhost vring base
+ */
 struct virtio_dev_split_q_run_state {
 	uint16_t queue_index;
 	uint16_t last_avail_idx;
 	uint16_t last_used_idx;
 } __rte_packed;
 
+#define VIRTIO_DEV_PACKED_Q_WRAP_SHIFT 15
+#define VIRTIO_DEV_PACKED_Q_IDX_MASK ((1 << VIRTIO_DEV_PACKED_Q_WRAP_SHIFT) - 1)
+
 /*to be defined*/
 struct virtio_dev_packed_q_run_state {
 	uint16_t queue_index;
@@ -126,6 +132,28 @@ struct virtio_dev_common_state {
 	struct virtio_field_hdr dev_cfg_hdr;
 } __rte_packed;
 
+#define VIRTIO_DEV_FIELD_TYPE_NUM (VIRTIO_DEV_SUBVENDOR_SPECIFIC_CFG + 1)
+
+/*per queue fields, all of them start with the queue index*/
+enum virtio_dev_q_field {
+	VIRTIO_DEV_Q_FIELD_CFG,		/* VIRTIO_DEV_QUEUE_CFG */
+	VIRTIO_DEV_Q_FIELD_RUN_STATE,	/* VIRTIO_DEV_SPLIT_Q_RUN_STATE */
+	VIRTIO_DEV_Q_FIELD_IN_FLIGHT,	/* VIRTIO_DEV_IN_FLIGHT_DESC */
+	VIRTIO_DEV_Q_FIELD_COMPLETED,	/* VIRTIO_DEV_COMPLETED_DESC */
+	VIRTIO_DEV_Q_FIELD_NUM,
+};
+
+/*offsets of the tlv headers of a state blob, built in one pass, 0 if the field is absent*/
+struct virtio_dev_state_index {
+	void *state;
+	uint32_t state_size;
+	uint32_t field_cnt;
+	uint32_t dev_field[VIRTIO_DEV_FIELD_TYPE_NUM];
+	uint16_t nr_queues;	/* highest queue index found + 1 */
+	uint16_t q_alloc;
+	uint32_t (*q_field)[VIRTIO_DEV_Q_FIELD_NUM];
+};
+
 #define VIRTIO_DEV_STATE_COMMON_FIELD_CNT 2
 #define VIRTIO_DEV_STATE_PER_QUEUE_FIELD_CNT 2
 
@@ -426,6 +426,7 @@ virtio_ha_ipc_client_init(ver_time_set set_ver)
 		HA_IPC_LOG(ERR, "Failed to create ipc conn handler");
 		goto err_sock;
 	}
+	pthread_setname_np(thread, "ha-ipc");
 
 	return 0;
 
@@ -568,6 +569,7 @@ virtio_ha_prio_chnl_init(struct virtio_ha_vf_restore_queue *rq)
 		ret = -1;
 		goto err_prio;
 	}
+	pthread_setname_np(client_devs.prio_thread, "ha-prio");
 
 	msg = virtio_ha_alloc_msg();
 	if (!msg) {
@@ -933,7 +935,7 @@ virtio_ha_vf_ctx_query(struct virtio_dev_name *vf,
 		goto err_msg;
 	}
 
-	if (msg->nr_fds != 3) {
+	if (msg->nr_fds != 3 && msg->nr_fds != 4) {
 		HA_IPC_LOG(ERR, "Wrong number of fds");
 		ret = -1;
 		goto err_msg;
@@ -952,6 +954,7 @@ virtio_ha_vf_ctx_query(struct virtio_dev_name *vf,
 	(*ctx)->vfio_container_fd = msg->fds[0];
 	(*ctx)->vfio_group_fd = msg->fds[1];
 	(*ctx)->vfio_device_fd = msg->fds[2];
+	(*ctx)->vf_state_fd = msg->fds[3];
 	memcpy(&(*ctx)->ctt, msg->iov.iov_base, msg->iov.iov_len);
 
 	pthread_mutex_lock(&client_devs.pf_lock);
@@ -973,6 +976,7 @@ virtio_ha_vf_ctx_query(struct virtio_dev_name *vf,
 			vf_dev->vf_ctx.vfio_container_fd = msg->fds[0];
 			vf_dev->vf_ctx.vfio_group_fd = msg->fds[1];
 			vf_dev->vf_ctx.vfio_device_fd = msg->fds[2];
+			vf_dev->state_fd = msg->fds[3];
 			memcpy(&vf_dev->vf_ctx.ctt, msg->iov.iov_base, msg->iov.iov_len);
 			break;
 		}
@@ -1214,6 +1218,7 @@ virtio_ha_vf_devargs_fds_store(struct vdpa_vf_with_devargs *vf_dev,
 	vf->vf_ctx.vfio_group_fd = vfio_group_fd;
 	vf->vf_ctx.vfio_device_fd = vfio_device_fd;
 	vf->vhost_fd = -1;
+	vf->state_fd = -1;
 
 	if (!__atomic_load_n(&ipc_client_connected, __ATOMIC_RELAXED))
 		return 0;
@@ -1428,6 +1433,78 @@ virtio_ha_vf_vhost_fd_remove(struct virtio_dev_name *vf,
 	}
 }
 
+static int
+virtio_ha_vf_state_fd_store_no_cache(struct virtio_dev_name *vf,
+	const struct virtio_dev_name *pf, int fd)
+{
+	struct virtio_ha_msg *msg;
+	int ret;
+
+	msg = virtio_ha_alloc_msg();
+	if (!msg) {
+		HA_IPC_LOG(ERR, "Failed to alloc ipc client msg");
+		return -1;
+	}
+
+	msg->hdr.type = VIRTIO_HA_VF_STORE_STATE_FD;
+	msg->hdr.size = sizeof(struct virtio_dev_name);
+	memcpy(msg->hdr.bdf, pf->dev_bdf, PCI_PRI_STR_SIZE);
+	msg->nr_fds = 1;
+	msg->fds[0] = fd;
+	msg->iov.iov_len = sizeof(struct virtio_dev_name);
+	msg->iov.iov_base = vf;
+	ret = virtio_ha_send_ipc_msg_with_lock(msg);
+	if (ret < 0) {
+		HA_IPC_LOG(ERR, "Failed to send msg");
+		virtio_ha_free_msg(msg);
+		return -1;
+	}
+
+	virtio_ha_free_msg(msg);
+
+	return 0;
+}
+
+int
+virtio_ha_vf_state_fd_store(struct virtio_dev_name *vf,
+	const struct virtio_dev_name *pf, int fd)
+{
+	struct virtio_ha_vf_dev_list *vf_list = NULL;
+	struct virtio_ha_pf_dev *dev;
+	struct virtio_ha_vf_dev *vf_dev;
+	bool found = false;
+
+	while (__atomic_load_n(&ipc_client_sync, __ATOMIC_RELAXED))
+		;
+
+	pthread_mutex_lock(&client_devs.pf_lock);
+	TAILQ_FOREACH(dev, &client_devs.pf_list, next) {
+		if (!strcmp(dev->pf_name.dev_bdf, pf->dev_bdf)) {
+			vf_list = &dev->vf_list;
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&client_devs.pf_lock);
+
+	if (!found)
+		return -1;
+
+	pthread_mutex_lock(&dev->vf_lock);
+	TAILQ_FOREACH(vf_dev, vf_list, next) {
+		if (!strcmp(vf_dev->vf_devargs.vf_name.dev_bdf, vf->dev_bdf)) {
+			vf_dev->state_fd = fd;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dev->vf_lock);
+
+	if (!__atomic_load_n(&ipc_client_connected, __ATOMIC_RELAXED))
+		return 0;
+	else
+		return virtio_ha_vf_state_fd_store_no_cache(vf, pf, fd);
+}
+
 static int
 virtio_ha_vf_mem_tbl_store_no_cache(const struct virtio_dev_name *vf,
     const struct virtio_dev_name *pf, const struct virtio_vdpa_dma_mem *mem)
@@ -1789,6 +1866,86 @@ virtio_ha_global_init_finish(void)
 	return 0;
 }
 
+int
+virtio_ha_standby_register(bool *standby)
+{
+	struct virtio_ha_msg *msg;
+	int ret;
+
+	*standby = false;
+	if (!__atomic_load_n(&ipc_client_connected, __ATOMIC_RELAXED))
+		return 0;
+
+	msg = virtio_ha_alloc_msg();
+	if (!msg) {
+		HA_IPC_LOG(ERR, "Failed to alloc ipc client msg");
+		return -1;
+	}
+
+	msg->hdr.type = VIRTIO_HA_STANDBY_REGISTER;
+	ret = virtio_ha_send_ipc_msg_with_lock(msg);
+	if (ret < 0) {
+		HA_IPC_LOG(ERR, "Failed to send msg");
+		ret = -1;
+		goto out;
+	}
+
+	ret = virtio_ha_recv_msg(ipc_client_sock, msg);
+	if (ret <= 0) {
+		HA_IPC_LOG(ERR, "Failed to recv msg");
+		ret = -1;
+		goto out;
+	}
+
+	if (msg->iov.iov_len != sizeof(bool)) {
+		HA_IPC_LOG(ERR, "Wrong iov len");
+		ret = -1;
+		goto err;
+	}
+
+	*standby = *(bool *)msg->iov.iov_base;
+	ret = 0;
+err:
+	free(msg->iov.iov_base);
+out:
+	virtio_ha_free_msg(msg);
+	return ret;
+}
+
+int
+virtio_ha_standby_wait_takeover(void)
+{
+	struct virtio_ha_msg *msg;
+	int ret;
+
+	msg = virtio_ha_alloc_msg();
+	if (!msg) {
+		HA_IPC_LOG(ERR, "Failed to alloc ipc client msg");
+		return -1;
+	}
+
+	/* Nothing else is sent to HA service by a standby app */
+	ret = virtio_ha_recv_msg(ipc_client_sock, msg);
+	if (ret <= 0) {
+		HA_IPC_LOG(ERR, "Lost HA service while waiting for takeover");
+		ret = -1;
+		goto out;
+	}
+
+	if (msg->hdr.type != VIRTIO_HA_STANDBY_TAKEOVER) {
+		HA_IPC_LOG(ERR, "Wrong msg type %u while waiting for takeover", msg->hdr.type);
+		ret = -1;
+	} else {
+		ret = 0;
+	}
+
+	if (msg->iov.iov_len != 0)
+		free(msg->iov.iov_base);
+out:
+	virtio_ha_free_msg(msg);
+	return ret;
+}
+
 static void
 sync_dev_context_to_ha(ver_time_set set_ver)
 {
@@ -1849,6 +2006,15 @@ sync_dev_context_to_ha(ver_time_set set_ver)
 				}
 			}
 
+			if (vf_dev->state_fd != -1) {
+				ret = virtio_ha_vf_state_fd_store_no_cache(&vf_dev->vf_devargs.vf_name,
+						&dev->pf_name, vf_dev->state_fd);
+				if (ret) {
+					HA_IPC_LOG(ERR, "Failed to sync vf state fd");
+					continue;
+				}
+			}
+
 			if (vf_dev->vf_ctx.ctt.mem.nregions != 0) {
 				ret = virtio_ha_vf_mem_tbl_store_no_cache(&vf_dev->vf_devargs.vf_name,
 						&dev->pf_name, &vf_dev->vf_ctx.ctt.mem);
@@ -14,7 +14,7 @@
 
 #define VIRTIO_HA_UDS_PATH "/tmp/virtio_ha_ipc"
 #define VDPA_MAX_SOCK_LEN 108 /* Follow definition of struct sockaddr_un in sys/un.h */
-#define VIRTIO_HA_MAX_FDS 3
+#define VIRTIO_HA_MAX_FDS 4
 #define VIRTIO_HA_MAX_MEM_REGIONS 8
 #define VIRTIO_HA_VERSION_SIZE 64
 #define VIRTIO_HA_TIME_SIZE 32
@@ -49,7 +49,10 @@ enum virtio_ha_msg_type {
 	VIRTIO_HA_GLOBAL_REMOVE_DMA_MAP = 18,
 	VIRTIO_HA_GLOBAL_INIT_FINISH = 19,
 	VIRTIO_HA_PRIO_CHNL_ADD_VF = 20,
-	VIRTIO_HA_MESSAGE_MAX = 21,
+	VIRTIO_HA_VF_STORE_STATE_FD = 21,
+	VIRTIO_HA_STANDBY_REGISTER = 22,
+	VIRTIO_HA_STANDBY_TAKEOVER = 23,
+	VIRTIO_HA_MESSAGE_MAX = 24,
 };
 
 struct virtio_ha_msg_hdr {
@@ -105,6 +108,7 @@ struct virtio_vdpa_dma_mem {
 
 struct vdpa_vf_ctx_content {
 	bool vhost_fd_saved;
+	bool state_fd_saved;
     struct virtio_vdpa_dma_mem mem;
 };
 
@@ -112,6 +116,7 @@ struct vdpa_vf_ctx {
     int vfio_container_fd;
     int vfio_group_fd;
     int vfio_device_fd;
+	int vf_state_fd; /* shared memory keeping VF state across restarts, -1 if none */
 	struct vdpa_vf_ctx_content ctt;
 };
 
@@ -119,6 +124,7 @@ struct virtio_ha_vf_dev {
 	TAILQ_ENTRY(virtio_ha_vf_dev) next;
 	struct vdpa_vf_with_devargs vf_devargs;
 	int vhost_fd;
+	int state_fd;
 	struct vdpa_vf_ctx vf_ctx;
 };
 
@@ -277,6 +283,11 @@ int virtio_ha_vf_vhost_fd_store(struct virtio_dev_name *vf,
 int virtio_ha_vf_vhost_fd_remove(struct virtio_dev_name *vf, 
 	const struct virtio_dev_name *pf);
 
+/* VF driver store VF state shared memory fd to HA service, it is closed with the VF context */
+__rte_internal
+int virtio_ha_vf_state_fd_store(struct virtio_dev_name *vf,
+	const struct virtio_dev_name *pf, int fd);
+
 /* VF driver store VF DMA memory table to HA service */
 __rte_internal
 int virtio_ha_vf_mem_tbl_store(const struct virtio_dev_name *vf,
@@ -302,4 +313,10 @@ int virtio_ha_global_dma_map_remove(struct virtio_ha_global_dma_map *map);
 /* App notify HA service that all devices are init */
 int virtio_ha_global_init_finish(void);
 
+/* App register to HA service as standby, *standby is false if no other app is active */
+int virtio_ha_standby_register(bool *standby);
+
+/* Standby app wait until the active app quits and HA service asks it to take over */
+int virtio_ha_standby_wait_takeover(void);
+
 #endif /* _VIRTIO_HA_H_ */
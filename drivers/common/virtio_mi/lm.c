@@ -35,7 +35,15 @@
 										1ULL << VIRTIO_F_IOMMU_PLATFORM | \
 										1ULL << VIRTIO_F_VERSION_1)
 
+/* Negotiated when the device offers them */
+#define VIRTIO_VDPA_MI_OPTIONAL_FEATURES \
+										(1ULL << VIRTIO_F_ADMIN_VQ_INDIRECT_DESC | \
+										1ULL << VIRTIO_F_ADMIN_VQ_IN_ORDER)
+
 #define VIRTIO_VDPA_MI_MAX_SGES 32
+#define VIRTIO_VDPA_MI_MAX_ARGS 1
+/* Header, arguments, in and out data and status */
+#define VIRTIO_VDPA_MI_MAX_CMD_DESCS (2 + VIRTIO_VDPA_MI_MAX_ARGS + 2 * VIRTIO_VDPA_MI_MAX_SGES)
 #define VIRTIO_VDPA_MI_GET_GROUP_RETRIES 120
 
 struct virtio_vdpa_pf_priv;
@@ -150,42 +158,69 @@ virtio_vdpa_mi_poll(void *arg)
 	struct virtqueue *vq;
 	uint32_t idx, used_idx;
 	struct vring_used_elem *uep;
+	uint16_t i, nused;
 
 	vq = virtnet_aq_to_vq(avq);
 
 	while(1){
-		sem_wait(&avq->poll_sem);
-		while (virtqueue_nused(vq) == 0) {
+		/* Posts may outnumber the commands, only sleep on it when idle */
+		while (__atomic_load_n(&avq->nr_pending, __ATOMIC_ACQUIRE) == 0)
+			sem_wait(&avq->poll_sem);
+		nused = virtqueue_nused(vq);
+		if (nused == 0) {
 			usleep(100);
+			continue;
 		}
 
-		used_idx = (uint32_t)(vq->vq_used_cons_idx
-				& (vq->vq_nentries - 1));
-		uep = &vq->vq_split.ring.used->ring[used_idx];
-		idx = (uint32_t) uep->id;
-		if (!avq->desc_list[idx].in_use) {
-			DRV_LOG(ERR, "desc:%d is not head", idx);
+		if (!avq->in_order)
+			nused = 1;
+		/* Read used entries after the used index */
+		virtio_rmb(vq->hw->weak_barriers);
+
+		for (i = 0; i < nused; i++) {
+			/* In order, a batch may be reported by its last used entry
+			 * only, the heads completed are the ones made available.
+			 */
+			used_idx = (uint32_t)(vq->vq_used_cons_idx
+					& (vq->vq_nentries - 1));
+			if (avq->in_order) {
+				idx = vq->vq_split.ring.avail->ring[used_idx];
+			} else {
+				uep = &vq->vq_split.ring.used->ring[used_idx];
+				idx = (uint32_t) uep->id;
+			}
+			if (!avq->desc_list[idx].in_use) {
+				DRV_LOG(ERR, "desc:%d is not head", idx);
+			}
+			vq->vq_used_cons_idx++;
+			avq->desc_list[idx].in_use = false;
+			sem_post(&avq->desc_list[idx].wait_sem);
 		}
-		vq->vq_used_cons_idx++;
-		avq->desc_list[idx].in_use = false;
-		sem_post(&avq->desc_list[idx].wait_sem);
+		__atomic_sub_fetch(&avq->nr_pending, nused, __ATOMIC_RELEASE);
 	}
 
 	return NULL;
 }
 
 static int
-virtio_vdpa_mi_poll_thread_init(struct virtadmin_ctl *avq)
+virtio_vdpa_mi_poll_thread_init(struct virtadmin_ctl *avq, const struct rte_pci_addr *addr)
 {
+	char name[RTE_MAX_THREAD_NAME_LEN];
 	int ret;
 
+	avq->nr_pending = 0;
 	ret = sem_init(&avq->poll_sem, 0, 0);
 	if (ret < 0) {
 		DRV_LOG(ERR, "admin pool thread mutx init failed");
 		return ret;
 	}
 
-	ret = rte_ctrl_thread_create(&avq->poll_tid, "admin_poll", NULL,
+	/* PF address in name lets thread placement find its NUMA node,
+	 * domain unpadded and no dash to fit 15 chars.
+	 */
+	snprintf(name, sizeof(name), "avq%x:%02x:%02x.%x", addr->domain, addr->bus,
+			addr->devid, addr->function);
+	ret = rte_ctrl_thread_create(&avq->poll_tid, name, NULL,
 			     virtio_vdpa_mi_poll, avq);
 	if (ret != 0) {
 		DRV_LOG(ERR, "admin pool thread create failed");
@@ -196,6 +231,16 @@ virtio_vdpa_mi_poll_thread_init(struct virtadmin_ctl *avq)
 	return ret;
 }
 
+static inline void
+virtio_vdpa_admin_desc_add(struct vring_desc *cmd, int *n, uint64_t addr,
+		uint32_t len, uint16_t flags)
+{
+	cmd[*n].addr = addr;
+	cmd[*n].len = len;
+	cmd[*n].flags = flags;
+	(*n)++;
+}
+
 static uint16_t
 virtio_vdpa_send_admin_command_split(struct virtadmin_ctl *avq,
 		struct virtio_admin_ctrl *ctrl,
@@ -203,8 +248,14 @@ virtio_vdpa_send_admin_command_split(struct virtadmin_ctl *avq,
 		int *dlen, int pkt_num)
 {
 	struct virtqueue *vq = virtnet_aq_to_vq(avq);
+	struct vring_desc cmd[VIRTIO_VDPA_MI_MAX_CMD_DESCS];
+	struct vring_desc *tbl;
 	uint32_t head, i;
-	int k, sum = 0;
+	int k, n = 0, sum = 0;
+
+	RTE_VERIFY(pkt_num <= VIRTIO_VDPA_MI_MAX_ARGS);
+	RTE_VERIFY(dat_ctrl->num_in_data <= VIRTIO_VDPA_MI_MAX_SGES);
+	RTE_VERIFY(dat_ctrl->num_out_data <= VIRTIO_VDPA_MI_MAX_SGES);
 
 	head = vq->vq_desc_head_idx;
 
@@ -214,48 +265,63 @@ virtio_vdpa_send_admin_command_split(struct virtadmin_ctl *avq,
 	 * At least one TX packet per argument;
 	 * One RX packet for ACK.
 	 */
-	vq->vq_split.ring.desc[head].flags = VRING_DESC_F_NEXT;
-	vq->vq_split.ring.desc[head].addr = avq->virtio_admin_hdr_mem;
-	vq->vq_split.ring.desc[head].len = sizeof(struct virtio_admin_ctrl_hdr);
-	vq->vq_free_cnt--;
-	i = vq->vq_split.ring.desc[head].next;
+	virtio_vdpa_admin_desc_add(cmd, &n, avq->virtio_admin_hdr_mem,
+			sizeof(struct virtio_admin_ctrl_hdr), 0);
 
 	for (k = 0; k < pkt_num; k++) {
-		vq->vq_split.ring.desc[i].flags = VRING_DESC_F_NEXT;
-		vq->vq_split.ring.desc[i].addr = avq->virtio_admin_hdr_mem
+		virtio_vdpa_admin_desc_add(cmd, &n, avq->virtio_admin_hdr_mem
 			+ sizeof(struct virtio_admin_ctrl_hdr)
-			+ sizeof(ctrl->status) + sizeof(uint8_t)*sum;
-		vq->vq_split.ring.desc[i].len = dlen[k];
+			+ sizeof(ctrl->status) + sizeof(uint8_t)*sum, dlen[k], 0);
 		sum += dlen[k];
-		vq->vq_free_cnt--;
-		i = vq->vq_split.ring.desc[i].next;
 	}
 
-	for (k = 0; k < dat_ctrl->num_in_data; k++) {
-		vq->vq_split.ring.desc[i].flags = VRING_DESC_F_NEXT;
-		vq->vq_split.ring.desc[i].addr = dat_ctrl->in_data[k].iova;
-		vq->vq_split.ring.desc[i].len = dat_ctrl->in_data[k].len;
-		vq->vq_free_cnt--;
-		i = vq->vq_split.ring.desc[i].next;
-	}
+	for (k = 0; k < dat_ctrl->num_in_data; k++)
+		virtio_vdpa_admin_desc_add(cmd, &n, dat_ctrl->in_data[k].iova,
+				dat_ctrl->in_data[k].len, 0);
 
-	for (k = 0; k < dat_ctrl->num_out_data; k++) {
-		vq->vq_split.ring.desc[i].flags = VRING_DESC_F_WRITE | VRING_DESC_F_NEXT;
-		vq->vq_split.ring.desc[i].addr = dat_ctrl->out_data[k].iova;
-		vq->vq_split.ring.desc[i].len = dat_ctrl->out_data[k].len;
+	for (k = 0; k < dat_ctrl->num_out_data; k++)
+		virtio_vdpa_admin_desc_add(cmd, &n, dat_ctrl->out_data[k].iova,
+				dat_ctrl->out_data[k].len, VRING_DESC_F_WRITE);
+
+	virtio_vdpa_admin_desc_add(cmd, &n, avq->virtio_admin_hdr_mem
+			+ sizeof(struct virtio_admin_ctrl_hdr),
+			sizeof(ctrl->status), VRING_DESC_F_WRITE);
+
+	if (avq->indirect_mz) {
+		/* The whole command takes a single ring slot */
+		tbl = (struct vring_desc *)((uint8_t *)avq->indirect_mz->addr +
+				head * avq->indirect_tbl_size);
+		for (k = 0; k < n; k++) {
+			tbl[k] = cmd[k];
+			if (k != n - 1) {
+				tbl[k].flags |= VRING_DESC_F_NEXT;
+				tbl[k].next = k + 1;
+			}
+		}
+		vq->vq_split.ring.desc[head].addr = avq->indirect_mz->iova +
+				head * avq->indirect_tbl_size;
+		vq->vq_split.ring.desc[head].len = n * sizeof(struct vring_desc);
+		vq->vq_split.ring.desc[head].flags = VRING_DESC_F_INDIRECT;
 		vq->vq_free_cnt--;
-		i = vq->vq_split.ring.desc[i].next;
+		i = head;
+	} else {
+		i = head;
+		for (k = 0; k < n; k++) {
+			if (k)
+				i = vq->vq_split.ring.desc[i].next;
+			vq->vq_split.ring.desc[i].addr = cmd[k].addr;
+			vq->vq_split.ring.desc[i].len = cmd[k].len;
+			vq->vq_split.ring.desc[i].flags = cmd[k].flags |
+				(k != n - 1 ? VRING_DESC_F_NEXT : 0);
+			vq->vq_free_cnt--;
+		}
 	}
 
-	vq->vq_split.ring.desc[i].flags = VRING_DESC_F_WRITE;
-	vq->vq_split.ring.desc[i].addr = avq->virtio_admin_hdr_mem
-			+ sizeof(struct virtio_admin_ctrl_hdr);
-	vq->vq_split.ring.desc[i].len = sizeof(ctrl->status);
-	vq->vq_free_cnt--;
-
 	vq->vq_desc_head_idx = vq->vq_split.ring.desc[i].next;
 
 	vq_update_avail_ring(vq, head);
+	/* Counted before the device can complete it */
+	__atomic_add_fetch(&avq->nr_pending, 1, __ATOMIC_RELEASE);
 	vq_update_avail_idx(vq);
 	avq->desc_list[head].in_use = true;
 
@@ -301,6 +367,7 @@ virtio_vdpa_send_admin_command(struct virtadmin_ctl *avq,
 			rte_spinlock_lock(&avq->lock);
 			avq->desc_list[*head].in_use = true;
 			vq_update_avail_ring(vq, *head);
+			__atomic_add_fetch(&avq->nr_pending, 1, __ATOMIC_RELEASE);
 			vq_update_avail_idx(vq);
 
 			virtqueue_notify(vq);
@@ -320,6 +387,8 @@ static void virtio_vdpa_free_desc_check(struct virtadmin_ctl *avq, uint16_t free
 	struct timeval start;
 
 	vq = virtnet_aq_to_vq(avq);
+	if (avq->indirect_mz)
+		free_cnt = 1;
 
 	do {
 		if (vq->vq_free_cnt < free_cnt) {
@@ -931,6 +1000,7 @@ virtio_vdpa_destroy_aq_ctl(struct virtadmin_ctl *ctl)
 	virtio_vdpa_mi_poll_thread_uninit(ctl);
 	rte_memzone_free(ctl->mz);
 	rte_memzone_free(ctl->virtio_admin_hdr_mz);
+	rte_memzone_free(ctl->indirect_mz);
 	for(i = 0;i < ctl->vq_size;i++) {
 		ret = sem_destroy(&ctl->desc_list[i].wait_sem);
 		if (ret) {
@@ -944,7 +1014,7 @@ virtio_vdpa_destroy_aq_ctl(struct virtadmin_ctl *ctl)
 static int
 virtio_vdpa_init_admin_queue(struct virtio_vdpa_pf_priv *priv)
 {
-	const struct rte_memzone *mz = NULL, *hdr_mz = NULL;
+	const struct rte_memzone *mz = NULL, *hdr_mz = NULL, *ind_mz = NULL;
 	int numa_node = priv->pdev->device.numa_node;
 	struct virtio_pci_dev *vpdev = priv->vpdev;
 	struct virtio_pci_dev_vring_info vr_info;
@@ -1036,6 +1106,29 @@ virtio_vdpa_init_admin_queue(struct virtio_vdpa_pf_priv *priv)
 		goto err_free_mz;
 	}
 
+	if (virtio_with_feature(hw, VIRTIO_F_ADMIN_VQ_INDIRECT_DESC)) {
+		snprintf(vq_hdr_name, sizeof(vq_hdr_name), "vdev%d_aq%u_ind",
+				vpdev->vfio_dev_fd, queue_idx);
+		avq->indirect_tbl_size = VIRTIO_VDPA_MI_MAX_CMD_DESCS * sizeof(struct vring_desc);
+		ind_mz = rte_memzone_reserve_aligned(vq_hdr_name,
+				avq->indirect_tbl_size * vq_size,
+				numa_node, RTE_MEMZONE_IOVA_CONTIG,
+				RTE_CACHE_LINE_SIZE);
+		if (ind_mz == NULL) {
+			if (rte_errno == EEXIST)
+				ind_mz = rte_memzone_lookup(vq_hdr_name);
+			if (ind_mz == NULL) {
+				ret = -ENOMEM;
+				goto err_desc_mem;
+			}
+		}
+		memset(ind_mz->addr, 0, ind_mz->len);
+		avq->indirect_mz = ind_mz;
+	}
+	avq->in_order = virtio_with_feature(hw, VIRTIO_F_ADMIN_VQ_IN_ORDER);
+	DRV_LOG(INFO, "admin queue indirect desc %s, in order %s",
+			avq->indirect_mz ? "on" : "off", avq->in_order ? "on" : "off");
+
 	avq->desc_list = rte_zmalloc(NULL, vq_size * sizeof(*avq->desc_list), 0);
 	if (!avq->desc_list) {
 		ret = -ENOMEM;
@@ -1064,7 +1157,7 @@ virtio_vdpa_init_admin_queue(struct virtio_vdpa_pf_priv *priv)
 		goto err_clean_avq;
 	}
 
-	ret = virtio_vdpa_mi_poll_thread_init(avq);
+	ret = virtio_vdpa_mi_poll_thread_init(avq, &VTPCI_DEV(hw)->addr);
 	if (ret) {
 		DRV_LOG(ERR, "Failed to alloc admin poll thread");
 		ret = -VFE_VDPA_ERR_ADD_PF_ALLOC_ADMIN_QUEUE;
@@ -1081,6 +1174,7 @@ virtio_vdpa_init_admin_queue(struct virtio_vdpa_pf_priv *priv)
 	rte_free(avq->desc_list);
 err_desc_mem:
 	hw->avq = NULL;
+	rte_memzone_free(ind_mz);
 	rte_memzone_free(hdr_mz);
 err_free_mz:
 	rte_memzone_free(mz);
@@ -1335,6 +1429,7 @@ virtio_vdpa_mi_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 		ret = -VFE_VDPA_ERR_ADD_PF_FEATURE_NOT_MEET;
 		goto err_free_pci_dev;
 	}
+	features |= priv->device_features & VIRTIO_VDPA_MI_OPTIONAL_FEATURES;
 	features = virtio_pci_dev_features_set(priv->vpdev, features);
 	priv->vpdev->hw.weak_barriers = !virtio_with_feature(&priv->vpdev->hw, VIRTIO_F_ORDER_PLATFORM);
 	virtio_pci_dev_set_status(priv->vpdev, VIRTIO_CONFIG_STATUS_FEATURES_OK);
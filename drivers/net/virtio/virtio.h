@@ -200,6 +200,7 @@ struct virtio_hw {
 	uint8_t use_vec_tx;
 	uint8_t use_inorder_rx;
 	uint8_t use_inorder_tx;
+	uint8_t use_adaptive_rx;
 	uint8_t opened;
 	uint16_t port_id;
 	uint8_t mac_addr[RTE_ETHER_ADDR_LEN];
@@ -228,6 +229,19 @@ struct virtio_hw {
 	uint64_t req_guest_features;
 	struct virtnet_ctl *cvq;
 	bool use_va;
+	/*
+	 * Idle time after which an Rx queue stops polling, set via
+	 * 'rx_idle_us' devarg, 0 to always poll
+	 */
+	uint32_t rx_idle_us;
+	uint64_t rx_idle_cycles;
+	/*
+	 * Tx doorbell budget, set via 'tx_kick_pkts' and 'tx_kick_us'
+	 * devargs, a kick per burst if tx_kick_pkts is 0 or 1
+	 */
+	uint32_t tx_kick_pkts;
+	uint32_t tx_kick_us;
+	uint64_t tx_kick_cycles;
 };
 
 struct virtio_ops {
@@ -45,7 +45,10 @@ static int virtio_dev_allmulticast_disable(struct rte_eth_dev *dev);
 static uint32_t virtio_dev_speed_capa_get(uint32_t speed);
 static int virtio_dev_devargs_parse(struct rte_devargs *devargs,
 	uint32_t *speed,
-	int *vectorized);
+	int *vectorized,
+	uint32_t *rx_idle_us,
+	uint32_t *tx_kick_pkts,
+	uint32_t *tx_kick_us);
 static int virtio_dev_info_get(struct rte_eth_dev *dev,
 				struct rte_eth_dev_info *dev_info);
 static int virtio_dev_link_update(struct rte_eth_dev *dev,
@@ -84,8 +87,6 @@ static int virtio_mac_addr_set(struct rte_eth_dev *dev,
 				struct rte_ether_addr *mac_addr);
 
 static int virtio_intr_disable(struct rte_eth_dev *dev);
-static int virtio_get_monitor_addr(void *rx_queue,
-				struct rte_power_monitor_cond *pmc);
 
 static int virtio_dev_queue_stats_mapping_set(
 	struct rte_eth_dev *eth_dev,
@@ -132,10 +133,23 @@ static const struct rte_virtio_xstats_name_off rte_virtio_txq_stat_strings[] = {
 	{"size_512_1023_packets",  offsetof(struct virtnet_tx, stats.size_bins[5])},
 	{"size_1024_1518_packets", offsetof(struct virtnet_tx, stats.size_bins[6])},
 	{"size_1519_max_packets",  offsetof(struct virtnet_tx, stats.size_bins[7])},
+	{"notifications",          offsetof(struct virtnet_tx, kick.notified)},
+	{"notifications_suppressed", offsetof(struct virtnet_tx, kick.suppressed)},
+	{"notifications_deferred", offsetof(struct virtnet_tx, kick.deferred)},
+	{"notifications_flushed",  offsetof(struct virtnet_tx, kick.flushed)},
+};
+
+/* rx_qX_ is prepended to the name string here, only with 'rx_idle_us' */
+static const char * const rte_virtio_rxq_adaptive_strings[] = {
+	"poll_time_us",
+	"sleep_time_us",
+	"sleeps",
+	"wakeups",
 };
 
 #define VIRTIO_NB_RXQ_XSTATS (sizeof(rte_virtio_rxq_stat_strings) / \
 			    sizeof(rte_virtio_rxq_stat_strings[0]))
+#define VIRTIO_NB_RXQ_ADAPTIVE_XSTATS RTE_DIM(rte_virtio_rxq_adaptive_strings)
 #define VIRTIO_NB_TXQ_XSTATS (sizeof(rte_virtio_txq_stat_strings) / \
 			    sizeof(rte_virtio_txq_stat_strings[0]))
 
@@ -461,6 +475,7 @@ virtio_init_vring(struct virtqueue *vq)
 
 		vring_init_split(vr, ring_mem, VIRTIO_VRING_ALIGN, size);
 		vring_desc_init_split(vr->desc, size);
+		vq->vq_split.kick_avail_idx = 0;
 	}
 	/*
 	 * Disable device(host) interrupting guest
@@ -1108,16 +1123,43 @@ virtio_update_stats(struct rte_eth_dev *dev, struct rte_eth_stats *stats)
 	stats->rx_nombuf = dev->data->rx_mbuf_alloc_failed;
 }
 
+static unsigned int
+virtio_nb_rxq_xstats(struct rte_eth_dev *dev)
+{
+	struct virtio_hw *hw = dev->data->dev_private;
+
+	return VIRTIO_NB_RXQ_XSTATS +
+		(hw->rx_idle_us ? VIRTIO_NB_RXQ_ADAPTIVE_XSTATS : 0);
+}
+
+static void
+virtio_rxq_adaptive_xstats(struct virtnet_rx *rxvq, uint64_t *values)
+{
+	const struct virtnet_rx_adaptive *ad = &rxvq->adaptive;
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t poll_cycles = ad->poll_cycles;
+
+	/* Count the polling in progress, it is only added when sleeping */
+	if (ad->poll_since != 0)
+		poll_cycles += rte_rdtsc() - ad->poll_since;
+
+	values[0] = poll_cycles * US_PER_S / hz;
+	values[1] = ad->sleep_cycles * US_PER_S / hz;
+	values[2] = ad->sleeps;
+	values[3] = ad->wakeups;
+}
+
 static int virtio_dev_xstats_get_names(struct rte_eth_dev *dev,
 				       struct rte_eth_xstat_name *xstats_names,
 				       __rte_unused unsigned limit)
 {
+	struct virtio_hw *hw = dev->data->dev_private;
 	unsigned i;
 	unsigned count = 0;
 	unsigned t;
 
 	unsigned nstats = dev->data->nb_tx_queues * VIRTIO_NB_TXQ_XSTATS +
-		dev->data->nb_rx_queues * VIRTIO_NB_RXQ_XSTATS;
+		dev->data->nb_rx_queues * virtio_nb_rxq_xstats(dev);
 
 	if (xstats_names != NULL) {
 		/* Note: limit checked in rte_eth_xstats_names() */
@@ -1133,6 +1175,15 @@ static int virtio_dev_xstats_get_names(struct rte_eth_dev *dev,
 					rte_virtio_rxq_stat_strings[t].name);
 				count++;
 			}
+			if (hw->rx_idle_us == 0)
+				continue;
+			for (t = 0; t < VIRTIO_NB_RXQ_ADAPTIVE_XSTATS; t++) {
+				snprintf(xstats_names[count].name,
+					sizeof(xstats_names[count].name),
+					"rx_q%u_%s", i,
+					rte_virtio_rxq_adaptive_strings[t]);
+				count++;
+			}
 		}
 
 		for (i = 0; i < dev->data->nb_tx_queues; i++) {
@@ -1156,11 +1207,13 @@ static int
 virtio_dev_xstats_get(struct rte_eth_dev *dev, struct rte_eth_xstat *xstats,
 		      unsigned n)
 {
+	struct virtio_hw *hw = dev->data->dev_private;
+	uint64_t values[VIRTIO_NB_RXQ_ADAPTIVE_XSTATS];
 	unsigned i;
 	unsigned count = 0;
 
 	unsigned nstats = dev->data->nb_tx_queues * VIRTIO_NB_TXQ_XSTATS +
-		dev->data->nb_rx_queues * VIRTIO_NB_RXQ_XSTATS;
+		dev->data->nb_rx_queues * virtio_nb_rxq_xstats(dev);
 
 	if (n < nstats)
 		return nstats;
@@ -1179,6 +1232,16 @@ virtio_dev_xstats_get(struct rte_eth_dev *dev, struct rte_eth_xstat *xstats,
 			xstats[count].id = count;
 			count++;
 		}
+
+		if (hw->rx_idle_us == 0)
+			continue;
+
+		virtio_rxq_adaptive_xstats(rxvq, values);
+		for (t = 0; t < VIRTIO_NB_RXQ_ADAPTIVE_XSTATS; t++) {
+			xstats[count].value = values[t];
+			xstats[count].id = count;
+			count++;
+		}
 	}
 
 	for (i = 0; i < dev->data->nb_tx_queues; i++) {
@@ -1224,6 +1287,11 @@ virtio_dev_stats_reset(struct rte_eth_dev *dev)
 		txvq->stats.broadcast = 0;
 		memset(txvq->stats.size_bins, 0,
 		       sizeof(txvq->stats.size_bins[0]) * 8);
+
+		txvq->kick.notified = 0;
+		txvq->kick.suppressed = 0;
+		txvq->kick.deferred = 0;
+		txvq->kick.flushed = 0;
 	}
 
 	for (i = 0; i < dev->data->nb_rx_queues; i++) {
@@ -1238,6 +1306,13 @@ virtio_dev_stats_reset(struct rte_eth_dev *dev)
 		rxvq->stats.broadcast = 0;
 		memset(rxvq->stats.size_bins, 0,
 		       sizeof(rxvq->stats.size_bins[0]) * 8);
+
+		rxvq->adaptive.poll_cycles = 0;
+		rxvq->adaptive.sleep_cycles = 0;
+		rxvq->adaptive.sleeps = 0;
+		rxvq->adaptive.wakeups = 0;
+		if (rxvq->adaptive.poll_since != 0)
+			rxvq->adaptive.poll_since = rte_rdtsc();
 	}
 
 	return 0;
@@ -1402,7 +1477,7 @@ virtio_monitor_callback(const uint64_t value,
 		return (value & m) == v ? 0 : -1;
 }
 
-static int
+int
 virtio_get_monitor_addr(void *rx_queue, struct rte_power_monitor_cond *pmc)
 {
 	struct virtnet_rx *rxvq = rx_queue;
@@ -1700,7 +1775,12 @@ set_rxtx_funcs(struct rte_eth_dev *eth_dev)
 		else
 			eth_dev->tx_pkt_burst = virtio_xmit_pkts_packed;
 	} else {
-		if (hw->use_inorder_tx) {
+		if (hw->use_vec_tx) {
+			PMD_INIT_LOG(INFO,
+				"virtio: using inorder vectorized Tx path on port %u",
+				eth_dev->data->port_id);
+			eth_dev->tx_pkt_burst = virtio_xmit_pkts_inorder_vec;
+		} else if (hw->use_inorder_tx) {
 			PMD_INIT_LOG(INFO, "virtio: using inorder Tx path on port %u",
 				eth_dev->data->port_id);
 			eth_dev->tx_pkt_burst = virtio_xmit_pkts_inorder;
@@ -1731,7 +1811,12 @@ set_rxtx_funcs(struct rte_eth_dev *eth_dev)
 			eth_dev->rx_pkt_burst = &virtio_recv_pkts_packed;
 		}
 	} else {
-		if (hw->use_vec_rx) {
+		if (hw->use_vec_rx && hw->use_inorder_rx) {
+			PMD_INIT_LOG(INFO,
+				"virtio: using inorder vectorized Rx path on port %u",
+				eth_dev->data->port_id);
+			eth_dev->rx_pkt_burst = &virtio_recv_pkts_inorder_vec;
+		} else if (hw->use_vec_rx) {
 			PMD_INIT_LOG(INFO, "virtio: using vectorized Rx path on port %u",
 				eth_dev->data->port_id);
 			eth_dev->rx_pkt_burst = virtio_recv_pkts_vec;
@@ -2199,6 +2284,18 @@ virtio_dev_rss_init(struct rte_eth_dev *eth_dev)
 }
 
 #define DUPLEX_UNKNOWN   0xff
+
+/* Event idx is only asked for by adaptive Rx, which arms the used event */
+static uint64_t
+virtio_dev_default_features(struct virtio_hw *hw)
+{
+	uint64_t features = VIRTIO_PMD_DEFAULT_GUEST_FEATURES;
+
+	if (hw->rx_idle_us)
+		features |= 1ULL << VIRTIO_RING_F_EVENT_IDX;
+	return features;
+}
+
 /* reset device and renegotiate features if needed */
 static int
 virtio_init_device(struct rte_eth_dev *eth_dev, uint64_t req_features)
@@ -2362,6 +2459,9 @@ eth_virtio_dev_init(struct rte_eth_dev *eth_dev)
 {
 	struct virtio_hw *hw = eth_dev->data->dev_private;
 	uint32_t speed = RTE_ETH_SPEED_NUM_UNKNOWN;
+	uint32_t rx_idle_us = 0;
+	uint32_t tx_kick_pkts = 0;
+	uint32_t tx_kick_us = VIRTIO_TX_KICK_US_DEFAULT;
 	int vectorized = 0;
 	int ret;
 
@@ -2381,10 +2481,15 @@ eth_virtio_dev_init(struct rte_eth_dev *eth_dev)
 		return 0;
 	}
 
-	ret = virtio_dev_devargs_parse(eth_dev->device->devargs, &speed, &vectorized);
+	ret = virtio_dev_devargs_parse(eth_dev->device->devargs, &speed,
+			&vectorized, &rx_idle_us, &tx_kick_pkts, &tx_kick_us);
 	if (ret < 0)
 		return ret;
 	hw->speed = speed;
+	hw->rx_idle_us = rx_idle_us;
+	hw->tx_kick_pkts = tx_kick_pkts;
+	hw->tx_kick_us = tx_kick_us;
+	hw->tx_kick_cycles = (uint64_t)tx_kick_us * rte_get_tsc_hz() / US_PER_S;
 	hw->duplex = DUPLEX_UNKNOWN;
 
 	/* Allocate memory for storing MAC addresses */
@@ -2400,13 +2505,17 @@ eth_virtio_dev_init(struct rte_eth_dev *eth_dev)
 	rte_spinlock_init(&hw->state_lock);
 
 	/* reset device and negotiate default features */
-	ret = virtio_init_device(eth_dev, VIRTIO_PMD_DEFAULT_GUEST_FEATURES);
+	ret = virtio_init_device(eth_dev, virtio_dev_default_features(hw));
 	if (ret < 0)
 		goto err_virtio_init;
 
 	if (vectorized) {
 		if (!virtio_with_packed_queue(hw)) {
 			hw->use_vec_rx = 1;
+#ifdef CC_AVX512_SUPPORT
+			/* only with in-order, checked at configure */
+			hw->use_vec_tx = 1;
+#endif
 		} else {
 #if defined(CC_AVX512_SUPPORT) || defined(RTE_ARCH_ARM)
 			hw->use_vec_rx = 1;
@@ -2466,6 +2575,9 @@ static int vectorized_check_handler(__rte_unused const char *key,
 
 #define VIRTIO_ARG_SPEED      "speed"
 #define VIRTIO_ARG_VECTORIZED "vectorized"
+#define VIRTIO_ARG_RX_IDLE_US "rx_idle_us"
+#define VIRTIO_ARG_TX_KICK_PKTS "tx_kick_pkts"
+#define VIRTIO_ARG_TX_KICK_US "tx_kick_us"
 
 static int
 link_speed_handler(const char *key __rte_unused,
@@ -2483,9 +2595,28 @@ link_speed_handler(const char *key __rte_unused,
 	return 0;
 }
 
+static int
+uint32_arg_handler(const char *key __rte_unused,
+		const char *value, void *ret_val)
+{
+	unsigned long val;
+	char *end;
+
+	if (!value || !ret_val)
+		return -EINVAL;
+	errno = 0;
+	val = strtoul(value, &end, 0);
+	if (errno != 0 || *end != '\0' || val > UINT32_MAX)
+		return -EINVAL;
+	*(uint32_t *)ret_val = val;
+
+	return 0;
+}
 
 static int
-virtio_dev_devargs_parse(struct rte_devargs *devargs, uint32_t *speed, int *vectorized)
+virtio_dev_devargs_parse(struct rte_devargs *devargs, uint32_t *speed,
+		int *vectorized, uint32_t *rx_idle_us, uint32_t *tx_kick_pkts,
+		uint32_t *tx_kick_us)
 {
 	struct rte_kvargs *kvlist;
 	int ret = 0;
@@ -2522,6 +2653,42 @@ virtio_dev_devargs_parse(struct rte_devargs *devargs, uint32_t *speed, int *vect
 		}
 	}
 
+	if (rx_idle_us &&
+		rte_kvargs_count(kvlist, VIRTIO_ARG_RX_IDLE_US) == 1) {
+		ret = rte_kvargs_process(kvlist,
+				VIRTIO_ARG_RX_IDLE_US,
+				uint32_arg_handler, rx_idle_us);
+		if (ret < 0) {
+			PMD_INIT_LOG(ERR, "Failed to parse %s",
+					VIRTIO_ARG_RX_IDLE_US);
+			goto exit;
+		}
+	}
+
+	if (tx_kick_pkts &&
+		rte_kvargs_count(kvlist, VIRTIO_ARG_TX_KICK_PKTS) == 1) {
+		ret = rte_kvargs_process(kvlist,
+				VIRTIO_ARG_TX_KICK_PKTS,
+				uint32_arg_handler, tx_kick_pkts);
+		if (ret < 0) {
+			PMD_INIT_LOG(ERR, "Failed to parse %s",
+					VIRTIO_ARG_TX_KICK_PKTS);
+			goto exit;
+		}
+	}
+
+	if (tx_kick_us &&
+		rte_kvargs_count(kvlist, VIRTIO_ARG_TX_KICK_US) == 1) {
+		ret = rte_kvargs_process(kvlist,
+				VIRTIO_ARG_TX_KICK_US,
+				uint32_arg_handler, tx_kick_us);
+		if (ret < 0) {
+			PMD_INIT_LOG(ERR, "Failed to parse %s",
+					VIRTIO_ARG_TX_KICK_US);
+			goto exit;
+		}
+	}
+
 exit:
 	rte_kvargs_free(kvlist);
 	return ret;
@@ -2561,7 +2728,7 @@ virtio_dev_configure(struct rte_eth_dev *dev)
 	int ret;
 
 	PMD_INIT_LOG(DEBUG, "configure");
-	req_features = VIRTIO_PMD_DEFAULT_GUEST_FEATURES;
+	req_features = virtio_dev_default_features(hw);
 
 	if (rxmode->mq_mode != RTE_ETH_MQ_RX_NONE && rxmode->mq_mode != RTE_ETH_MQ_RX_RSS) {
 		PMD_DRV_LOG(ERR,
@@ -2710,10 +2877,36 @@ virtio_dev_configure(struct rte_eth_dev *dev)
 		if (virtio_with_feature(hw, VIRTIO_F_IN_ORDER)) {
 			hw->use_inorder_tx = 1;
 			hw->use_inorder_rx = 1;
+#if defined(RTE_ARCH_X86_64) && defined(CC_AVX512_SUPPORT)
+			if ((hw->use_vec_rx || hw->use_vec_tx) &&
+			    (!rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) ||
+			     !rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512BW) ||
+			     !rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512VL) ||
+			     !virtio_with_feature(hw, VIRTIO_F_VERSION_1) ||
+			     rte_vect_get_max_simd_bitwidth() < RTE_VECT_SIMD_512)) {
+				PMD_DRV_LOG(INFO,
+					"disabled split ring in-order vectorized path for requirements not met");
+				hw->use_vec_rx = 0;
+				hw->use_vec_tx = 0;
+			}
+
+			if (hw->use_vec_rx &&
+			    (rx_offloads & (RTE_ETH_RX_OFFLOAD_TCP_LRO |
+					    RTE_ETH_RX_OFFLOAD_VLAN_STRIP))) {
+				PMD_DRV_LOG(INFO,
+					"disabled split ring in-order vectorized rx for offloading enabled");
+				hw->use_vec_rx = 0;
+			}
+#else
 			hw->use_vec_rx = 0;
+			hw->use_vec_tx = 0;
+#endif
+		} else {
+			/* no vectorized Tx without in-order */
+			hw->use_vec_tx = 0;
 		}
 
-		if (hw->use_vec_rx) {
+		if (hw->use_vec_rx && !hw->use_inorder_rx) {
 #if defined RTE_ARCH_ARM
 			if (!rte_cpu_get_flag_enabled(RTE_CPUFLAG_NEON)) {
 				PMD_DRV_LOG(INFO,
@@ -2744,6 +2937,23 @@ virtio_dev_configure(struct rte_eth_dev *dev)
 		}
 	}
 
+	hw->use_adaptive_rx = 0;
+	if (hw->rx_idle_us) {
+		struct rte_cpu_intrinsics intrinsics;
+
+		/* Sleep on the Rx interrupts, else monitor the used ring */
+		rte_cpu_get_intrinsics_support(&intrinsics);
+		if (dev->data->dev_conf.intr_conf.rxq ||
+				intrinsics.power_monitor) {
+			hw->use_adaptive_rx = 1;
+			hw->rx_idle_cycles = (uint64_t)hw->rx_idle_us *
+				rte_get_tsc_hz() / US_PER_S;
+		} else {
+			PMD_DRV_LOG(WARNING,
+				"disabled adaptive rx, requires Rx interrupts or power monitor");
+		}
+	}
+
 	return 0;
 }
 
@@ -2817,6 +3027,9 @@ virtio_dev_start(struct rte_eth_dev *dev)
 
 	for (i = 0; i < dev->data->nb_tx_queues; i++) {
 		vq = virtnet_txq_to_vq(dev->data->tx_queues[i]);
+		vq->txq.kick.pending = 0;
+		vq->txq.kick.deadline = 0;
+		vq->txq.kick.tid = 0;
 		virtqueue_notify(vq);
 	}
 
@@ -2833,6 +3046,11 @@ virtio_dev_start(struct rte_eth_dev *dev)
 	}
 
 	set_rxtx_funcs(dev);
+	if (hw->use_adaptive_rx)
+		virtio_rx_adaptive_setup(dev);
+	/* Before adaptive Rx in the chain, a sleeping burst flushes first */
+	if (hw->tx_kick_pkts > 1)
+		virtio_rx_tx_flush_setup(dev);
 	hw->started = 1;
 
 	/* Initialize Link state */
@@ -17,6 +17,9 @@
 #define VIRTIO_MIN_RX_BUFSIZE 64
 #define VIRTIO_MAX_RX_PKTLEN  9728U
 
+/* Tx doorbell time budget when only 'tx_kick_pkts' is given. */
+#define VIRTIO_TX_KICK_US_DEFAULT 20
+
 /* Features desired/implemented by this driver. */
 #define VIRTIO_PMD_DEFAULT_GUEST_FEATURES	\
 	(1u << VIRTIO_NET_F_MAC		  |	\
@@ -46,6 +49,7 @@
 	 1u << VIRTIO_NET_F_CSUM           |	\
 	 1u << VIRTIO_NET_F_HOST_TSO4      |	\
 	 1u << VIRTIO_NET_F_HOST_TSO6      |	\
+	 1u << VIRTIO_RING_F_EVENT_IDX    |	\
 	 1ULL << VIRTIO_NET_F_RSS)
 
 extern const struct eth_dev_ops virtio_user_secondary_eth_dev_ops;
@@ -108,9 +112,23 @@ uint16_t virtio_recv_pkts_packed_vec(void *rx_queue, struct rte_mbuf **rx_pkts,
 uint16_t virtio_xmit_pkts_packed_vec(void *tx_queue, struct rte_mbuf **tx_pkts,
 		uint16_t nb_pkts);
 
+uint16_t virtio_recv_pkts_inorder_vec(void *rx_queue, struct rte_mbuf **rx_pkts,
+		uint16_t nb_pkts);
+
+uint16_t virtio_xmit_pkts_inorder_vec(void *tx_queue, struct rte_mbuf **tx_pkts,
+		uint16_t nb_pkts);
+
+uint16_t virtio_recv_pkts_adaptive(void *rx_queue, struct rte_mbuf **rx_pkts,
+		uint16_t nb_pkts);
+void virtio_rx_adaptive_setup(struct rte_eth_dev *dev);
+uint16_t virtio_recv_pkts_tx_flush(void *rx_queue, struct rte_mbuf **rx_pkts,
+		uint16_t nb_pkts);
+void virtio_rx_tx_flush_setup(struct rte_eth_dev *dev);
+
 int eth_virtio_dev_init(struct rte_eth_dev *eth_dev);
 
 void virtio_interrupt_handler(void *param);
+int virtio_get_monitor_addr(void *rx_queue, struct rte_power_monitor_cond *pmc);
 
 int virtio_dev_pause(struct rte_eth_dev *dev);
 void virtio_dev_resume(struct rte_eth_dev *dev);
@@ -126,7 +126,14 @@ struct vring {
  * versa. They are at the end for backwards compatibility.
  */
 #define vring_used_event(vr)  ((vr)->avail->ring[(vr)->num])
-#define vring_avail_event(vr) (*(uint16_t *)&(vr)->used->ring[(vr)->num])
+
+/* The avail event is a 16-bit field right after the used elements */
+static inline uint16_t *
+vring_avail_event_ptr(struct vring *vr)
+{
+	return (uint16_t *)((uintptr_t)vr->used + offsetof(struct vring_used, ring) +
+			vr->num * sizeof(struct vring_used_elem));
+}
 
 static inline size_t
 vring_size(struct virtio_hw *hw, unsigned int num, unsigned long align)
@@ -141,11 +148,13 @@ vring_size(struct virtio_hw *hw, unsigned int num, unsigned long align)
 		return size;
 	}
 
+	/* Each ring is followed by the event index of the other side */
 	size = num * sizeof(struct vring_desc);
-	size += sizeof(struct vring_avail) + (num * sizeof(uint16_t));
+	size += sizeof(struct vring_avail) + (num * sizeof(uint16_t)) +
+		sizeof(uint16_t);
 	size = RTE_ALIGN_CEIL(size, align);
 	size += sizeof(struct vring_used) +
-		(num * sizeof(struct vring_used_elem));
+		(num * sizeof(struct vring_used_elem)) + sizeof(uint16_t);
 	return size;
 }
 static inline void
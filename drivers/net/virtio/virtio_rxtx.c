@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <rte_cycles.h>
 #include <rte_memory.h>
@@ -696,10 +698,11 @@ virtio_dev_rx_queue_setup(struct rte_eth_dev *dev,
 
 	/*
 	 * For split ring vectorized path descriptors number must be
-	 * equal to the ring size.
+	 * equal to the ring size, in-order vectorized path has no such limit.
 	 */
 	if (nb_desc > vq->vq_nentries ||
-	    (!virtio_with_packed_queue(hw) && hw->use_vec_rx)) {
+	    (!virtio_with_packed_queue(hw) && hw->use_vec_rx &&
+	     !hw->use_inorder_rx)) {
 		nb_desc = vq->vq_nentries;
 	}
 	vq->vq_free_cnt = RTE_MIN(vq->vq_free_cnt, nb_desc);
@@ -729,7 +732,7 @@ virtio_dev_rx_queue_setup_finish(struct rte_eth_dev *dev, uint16_t queue_idx)
 	/* Allocate blank mbufs for the each rx descriptor */
 	nbufs = 0;
 
-	if (hw->use_vec_rx && !virtio_with_packed_queue(hw)) {
+	if (hw->use_vec_rx && !virtio_with_packed_queue(hw) && !in_order) {
 		for (desc_idx = 0; desc_idx < vq->vq_nentries;
 		     desc_idx++) {
 			vq->vq_split.ring.avail->ring[desc_idx] = desc_idx;
@@ -744,12 +747,15 @@ virtio_dev_rx_queue_setup_finish(struct rte_eth_dev *dev, uint16_t queue_idx)
 	for (desc_idx = 0; desc_idx < RTE_PMD_VIRTIO_RX_MAX_BURST; desc_idx++)
 		vq->sw_ring[vq->vq_nentries + desc_idx] = rxvq->fake_mbuf;
 
-	if (hw->use_vec_rx && !virtio_with_packed_queue(hw)) {
+	if (hw->use_vec_rx && !virtio_with_packed_queue(hw) && !in_order) {
 		while (vq->vq_free_cnt >= RTE_VIRTIO_VPMD_RX_REARM_THRESH) {
 			virtio_rxq_rearm_vec(rxvq);
 			nbufs += RTE_VIRTIO_VPMD_RX_REARM_THRESH;
 		}
 	} else if (!virtio_with_packed_queue(vq->hw) && in_order) {
+		if (hw->use_vec_rx)
+			virtio_rxq_vec_setup(rxvq);
+
 		if ((!virtqueue_full(vq))) {
 			uint16_t free_cnt = vq->vq_free_cnt;
 			struct rte_mbuf *pkts[free_cnt];
@@ -1775,8 +1781,10 @@ virtio_xmit_pkts_packed(void *tx_queue, struct rte_mbuf **tx_pkts,
 	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
 		return nb_tx;
 
-	if (unlikely(nb_pkts < 1))
+	if (unlikely(nb_pkts < 1)) {
+		virtio_tx_kick(txvq, vq, 0);
 		return nb_pkts;
+	}
 
 	PMD_TX_LOG(DEBUG, "%d packets to xmit", nb_pkts);
 
@@ -1833,12 +1841,7 @@ virtio_xmit_pkts_packed(void *tx_queue, struct rte_mbuf **tx_pkts,
 
 	txvq->stats.packets += nb_tx;
 
-	if (likely(nb_tx)) {
-		if (unlikely(virtqueue_kick_prepare_packed(vq))) {
-			virtqueue_notify(vq);
-			PMD_TX_LOG(DEBUG, "Notified backend after xmit");
-		}
-	}
+	virtio_tx_kick(txvq, vq, nb_tx);
 
 	return nb_tx;
 }
@@ -1855,8 +1858,10 @@ virtio_xmit_pkts(void *tx_queue, struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
 	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
 		return nb_tx;
 
-	if (unlikely(nb_pkts < 1))
+	if (unlikely(nb_pkts < 1)) {
+		virtio_tx_kick(txvq, vq, 0);
 		return nb_pkts;
+	}
 
 	PMD_TX_LOG(DEBUG, "%d packets to xmit", nb_pkts);
 
@@ -1915,14 +1920,10 @@ virtio_xmit_pkts(void *tx_queue, struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
 
 	txvq->stats.packets += nb_tx;
 
-	if (likely(nb_tx)) {
+	if (likely(nb_tx))
 		vq_update_avail_idx(vq);
 
-		if (unlikely(virtqueue_kick_prepare(vq))) {
-			virtqueue_notify(vq);
-			PMD_TX_LOG(DEBUG, "Notified backend after xmit");
-		}
-	}
+	virtio_tx_kick(txvq, vq, nb_tx);
 
 	return nb_tx;
 }
@@ -1941,12 +1942,12 @@ virtio_xmit_try_cleanup_inorder(struct virtqueue *vq, uint16_t need)
 	return nb_descs - vq->vq_free_cnt;
 }
 
+/* Caller checked the port may send, tx_pkts may be the tail of an injected burst */
 uint16_t
-virtio_xmit_pkts_inorder(void *tx_queue,
+virtio_xmit_pkts_inorder_nocheck(struct virtnet_tx *txvq,
 			struct rte_mbuf **tx_pkts,
 			uint16_t nb_pkts)
 {
-	struct virtnet_tx *txvq = tx_queue;
 	struct virtqueue *vq = virtnet_txq_to_vq(txvq);
 	struct virtio_hw *hw = vq->hw;
 	uint16_t hdr_size = hw->vtnet_hdr_size;
@@ -1954,11 +1955,10 @@ virtio_xmit_pkts_inorder(void *tx_queue,
 	struct rte_mbuf *inorder_pkts[nb_pkts];
 	int need;
 
-	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
-		return nb_tx;
-
-	if (unlikely(nb_pkts < 1))
+	if (unlikely(nb_pkts < 1)) {
+		virtio_tx_kick(txvq, vq, 0);
 		return nb_pkts;
+	}
 
 	VIRTQUEUE_DUMP(vq);
 	PMD_TX_LOG(DEBUG, "%d packets to xmit", nb_pkts);
@@ -2040,20 +2040,180 @@ virtio_xmit_pkts_inorder(void *tx_queue,
 
 	txvq->stats.packets += nb_tx;
 
-	if (likely(nb_tx)) {
+	if (likely(nb_tx))
 		vq_update_avail_idx(vq);
 
-		if (unlikely(virtqueue_kick_prepare(vq))) {
-			virtqueue_notify(vq);
-			PMD_TX_LOG(DEBUG, "Notified backend after xmit");
-		}
-	}
+	virtio_tx_kick(txvq, vq, nb_tx);
 
 	VIRTQUEUE_DUMP(vq);
 
 	return nb_tx;
 }
 
+uint16_t
+virtio_xmit_pkts_inorder(void *tx_queue,
+			struct rte_mbuf **tx_pkts,
+			uint16_t nb_pkts)
+{
+	struct virtnet_tx *txvq = tx_queue;
+	struct virtio_hw *hw = virtnet_txq_to_vq(txvq)->hw;
+
+	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
+		return 0;
+
+	return virtio_xmit_pkts_inorder_nocheck(txvq, tx_pkts, nb_pkts);
+}
+
+void
+virtio_rx_tx_flush_setup(struct rte_eth_dev *dev)
+{
+	struct virtnet_rx *rxvq;
+	uint16_t i;
+
+	for (i = 0; i < dev->data->nb_rx_queues; i++) {
+		rxvq = dev->data->rx_queues[i];
+		rxvq->tx_flush_burst = dev->rx_pkt_burst;
+	}
+	dev->rx_pkt_burst = virtio_recv_pkts_tx_flush;
+}
+
+/*
+ * A deferred Tx kick is otherwise only flushed by a later Tx burst, which
+ * may never come. Past its deadline, kick the Tx queue with the same index,
+ * but only when the pending kick was deferred by this thread, so that the
+ * queue is not used concurrently. This requires that a Tx queue with a kick
+ * pending is not moved to another thread while this one polls the Rx queue.
+ * Applications polling Rx and Tx queues of an index from different threads
+ * must flush with an empty Tx burst.
+ */
+uint16_t
+virtio_recv_pkts_tx_flush(void *rx_queue, struct rte_mbuf **rx_pkts,
+			  uint16_t nb_pkts)
+{
+	struct virtnet_rx *rxvq = rx_queue;
+	struct rte_eth_dev *dev = &rte_eth_devices[rxvq->port_id];
+	struct virtnet_tx *txvq;
+
+	if (likely(rxvq->queue_id < dev->data->nb_tx_queues)) {
+		txvq = dev->data->tx_queues[rxvq->queue_id];
+		if (__atomic_load_n(&txvq->kick.tid, __ATOMIC_RELAXED) == rte_gettid() &&
+		    unlikely(txvq->kick.deadline != 0 &&
+			     rte_rdtsc() >= txvq->kick.deadline)) {
+			virtio_tx_kick(txvq, virtnet_txq_to_vq(txvq), 0);
+			txvq->kick.flushed++;
+		}
+	}
+
+	return rxvq->tx_flush_burst(rx_queue, rx_pkts, nb_pkts);
+}
+
+/* Longest sleep of an adaptive Rx burst, so that it returns regularly */
+#define VIRTIO_RX_SLEEP_MAX_MS 10
+
+void
+virtio_rx_adaptive_setup(struct rte_eth_dev *dev)
+{
+	struct virtio_hw *hw = dev->data->dev_private;
+	struct virtnet_rx *rxvq;
+	uint16_t i;
+
+	PMD_INIT_LOG(INFO, "virtio: using adaptive Rx on port %u, idle after %u us",
+		dev->data->port_id, hw->rx_idle_us);
+
+	for (i = 0; i < dev->data->nb_rx_queues; i++) {
+		rxvq = dev->data->rx_queues[i];
+		rxvq->adaptive.burst = dev->rx_pkt_burst;
+		rxvq->adaptive.idle_since = 0;
+		rxvq->adaptive.poll_since = rte_rdtsc();
+	}
+	dev->rx_pkt_burst = virtio_recv_pkts_adaptive;
+}
+
+static inline bool
+virtio_rxq_has_used(struct virtqueue *vq)
+{
+	if (virtio_with_packed_queue(vq->hw))
+		return desc_is_used(&vq->vq_packed.ring.desc[vq->vq_used_cons_idx],
+				    vq);
+
+	return virtqueue_nused(vq) != 0;
+}
+
+static void
+virtio_rx_sleep(struct virtnet_rx *rxvq, uint64_t now)
+{
+	struct rte_eth_dev *dev = &rte_eth_devices[rxvq->port_id];
+	struct virtnet_rx_adaptive *ad = &rxvq->adaptive;
+	struct virtqueue *vq = virtnet_rxq_to_vq(rxvq);
+	struct rte_power_monitor_cond pmc;
+	struct pollfd pfd;
+	uint64_t val;
+
+	ad->poll_cycles += now - ad->poll_since;
+	ad->sleeps++;
+
+	if (dev->data->dev_conf.intr_conf.rxq) {
+		pfd.fd = rte_intr_efds_index_get(dev->intr_handle,
+						 rxvq->queue_id);
+		pfd.events = POLLIN;
+
+		virtqueue_enable_intr(vq);
+		virtio_mb(vq->hw->weak_barriers);
+
+		/* Buffers used before the notification was armed */
+		if (pfd.fd >= 0 && !virtio_rxq_has_used(vq) &&
+				poll(&pfd, 1, VIRTIO_RX_SLEEP_MAX_MS) > 0 &&
+				read(pfd.fd, &val, sizeof(val)) < 0)
+			PMD_RX_LOG(DEBUG, "failed to read Rx eventfd: %s",
+				   strerror(errno));
+
+		virtqueue_disable_intr(vq);
+	} else if (virtio_get_monitor_addr(rxvq, &pmc) == 0) {
+		rte_power_monitor(&pmc, now + rte_get_tsc_hz() / MS_PER_S *
+				  VIRTIO_RX_SLEEP_MAX_MS);
+	}
+
+	ad->poll_since = rte_rdtsc();
+	ad->sleep_cycles += ad->poll_since - now;
+	if (virtio_rxq_has_used(vq))
+		ad->wakeups++;
+}
+
+/*
+ * Busy-poll while packets come in, sleep until the device uses an Rx
+ * buffer once the queue has been idle for rx_idle_us. A sleep that times
+ * out leaves the queue idle, the next empty poll sleeps again.
+ */
+uint16_t
+virtio_recv_pkts_adaptive(void *rx_queue, struct rte_mbuf **rx_pkts,
+			  uint16_t nb_pkts)
+{
+	struct virtnet_rx *rxvq = rx_queue;
+	struct virtnet_rx_adaptive *ad = &rxvq->adaptive;
+	struct virtqueue *vq = virtnet_rxq_to_vq(rxvq);
+	struct virtio_hw *hw = vq->hw;
+	uint16_t nb_rx;
+	uint64_t now;
+
+	nb_rx = ad->burst(rx_queue, rx_pkts, nb_pkts);
+	if (likely(nb_rx)) {
+		ad->idle_since = 0;
+		virtqueue_used_event_advance(vq);
+		return nb_rx;
+	}
+
+	if (unlikely(hw->started == 0))
+		return 0;
+
+	now = rte_rdtsc();
+	if (ad->idle_since == 0)
+		ad->idle_since = now;
+	else if (now - ad->idle_since >= hw->rx_idle_cycles)
+		virtio_rx_sleep(rxvq, now);
+
+	return 0;
+}
+
 __rte_weak uint16_t
 virtio_recv_pkts_packed_vec(void *rx_queue __rte_unused,
 			    struct rte_mbuf **rx_pkts __rte_unused,
@@ -2069,3 +2229,19 @@ virtio_xmit_pkts_packed_vec(void *tx_queue __rte_unused,
 {
 	return 0;
 }
+
+__rte_weak uint16_t
+virtio_recv_pkts_inorder_vec(void *rx_queue __rte_unused,
+			     struct rte_mbuf **rx_pkts __rte_unused,
+			     uint16_t nb_pkts __rte_unused)
+{
+	return 0;
+}
+
+__rte_weak uint16_t
+virtio_xmit_pkts_inorder_vec(void *tx_queue __rte_unused,
+			     struct rte_mbuf **tx_pkts __rte_unused,
+			     uint16_t nb_pkts __rte_unused)
+{
+	return 0;
+}
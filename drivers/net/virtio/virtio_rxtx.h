@@ -5,6 +5,8 @@
 #ifndef _VIRTIO_RXTX_H_
 #define _VIRTIO_RXTX_H_
 
+#include <rte_ethdev.h>
+
 #define RTE_PMD_VIRTIO_RX_MAX_BURST 64
 
 struct virtnet_stats {
@@ -17,6 +19,17 @@ struct virtnet_stats {
 	uint64_t	size_bins[8];
 };
 
+/* Adaptive Rx state and counters, see virtio_recv_pkts_adaptive(). */
+struct virtnet_rx_adaptive {
+	eth_rx_burst_t burst;  /**< Wrapped Rx burst function. */
+	uint64_t idle_since;   /**< TSC of the first empty poll, 0 if busy. */
+	uint64_t poll_since;   /**< TSC of the last return to polling. */
+	uint64_t poll_cycles;  /**< TSC cycles spent polling. */
+	uint64_t sleep_cycles; /**< TSC cycles spent sleeping. */
+	uint64_t sleeps;       /**< Number of sleeps. */
+	uint64_t wakeups;      /**< Sleeps ended by the device. */
+};
+
 struct virtnet_rx {
 	/* dummy mbuf, for wraparound when processing RX ring. */
 	struct rte_mbuf *fake_mbuf;
@@ -29,9 +42,23 @@ struct virtnet_rx {
 	/* Statistics */
 	struct virtnet_stats stats;
 
+	struct virtnet_rx_adaptive adaptive;
+	eth_rx_burst_t tx_flush_burst; /**< Rx burst wrapped by the Tx flush. */
+
 	const struct rte_memzone *mz; /**< mem zone to populate RX ring. */
 };
 
+/* Tx doorbell state and counters, see virtio_tx_kick(). */
+struct virtnet_tx_kick {
+	uint64_t deadline;   /**< TSC to kick the pending packets by, or 0. */
+	uint32_t pending;    /**< Packets published since the last kick. */
+	int tid;             /**< Thread of the pending deferred kick, or 0. */
+	uint64_t notified;   /**< Doorbells rung. */
+	uint64_t suppressed; /**< Kicks not wanted by the device. */
+	uint64_t deferred;   /**< Bursts left to a later kick. */
+	uint64_t flushed;    /**< Deferred kicks checked by an Rx burst. */
+};
+
 struct virtnet_tx {
 	/**< memzone to populate hdr. */
 	const struct rte_memzone *virtio_net_hdr_mz;
@@ -43,6 +70,8 @@ struct virtnet_tx {
 	/* Statistics */
 	struct virtnet_stats stats;
 
+	struct virtnet_tx_kick kick;
+
 	const struct rte_memzone *mz;    /**< mem zone to populate TX ring. */
 };
 
@@ -58,5 +87,7 @@ struct virtnet_ctl {
 int virtio_rxq_vec_setup(struct virtnet_rx *rxvq);
 void virtio_update_packet_stats(struct virtnet_stats *stats,
 				struct rte_mbuf *mbuf);
+uint16_t virtio_xmit_pkts_inorder_nocheck(struct virtnet_tx *txvq,
+				struct rte_mbuf **tx_pkts, uint16_t nb_pkts);
 
 #endif /* _VIRTIO_RXTX_H_ */
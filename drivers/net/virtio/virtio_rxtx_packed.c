@@ -35,8 +35,10 @@ virtio_xmit_pkts_packed_vec(void *tx_queue, struct rte_mbuf **tx_pkts,
 	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
 		return nb_tx;
 
-	if (unlikely(nb_pkts < 1))
+	if (unlikely(nb_pkts < 1)) {
+		virtio_tx_kick(txvq, vq, 0);
 		return nb_pkts;
+	}
 
 	PMD_TX_LOG(DEBUG, "%d packets to xmit", nb_pkts);
 
@@ -65,12 +67,7 @@ virtio_xmit_pkts_packed_vec(void *tx_queue, struct rte_mbuf **tx_pkts,
 
 	txvq->stats.packets += nb_tx;
 
-	if (likely(nb_tx)) {
-		if (unlikely(virtqueue_kick_prepare_packed(vq))) {
-			virtqueue_notify(vq);
-			PMD_TX_LOG(DEBUG, "Notified backend after xmit");
-		}
-	}
+	virtio_tx_kick(txvq, vq, nb_tx);
 
 	return nb_tx;
 }
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright (c) 2024 NVIDIA Corporation & Affiliates
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_net.h>
+
+#include "virtio_logs.h"
+#include "virtio_ethdev.h"
+#include "virtio_pci.h"
+#include "virtio_rxtx_split_avx.h"
+#include "virtqueue.h"
+
+uint16_t
+virtio_xmit_pkts_inorder_vec(void *tx_queue, struct rte_mbuf **tx_pkts,
+			     uint16_t nb_pkts)
+{
+	struct virtnet_tx *txvq = tx_queue;
+	struct virtqueue *vq = virtnet_txq_to_vq(txvq);
+	struct virtio_hw *hw = vq->hw;
+	uint16_t nb_used, nb_batch, nb_tx = 0;
+
+	if (unlikely(hw->started == 0 && tx_pkts != hw->inject_pkts))
+		return nb_tx;
+
+	if (unlikely(nb_pkts < 1)) {
+		virtio_tx_kick(txvq, vq, 0);
+		return nb_pkts;
+	}
+
+	PMD_TX_LOG(DEBUG, "%d packets to xmit", nb_pkts);
+
+	nb_used = virtqueue_nused(vq);
+	if (likely(nb_used > vq->vq_nentries - vq->vq_free_thresh))
+		virtio_xmit_cleanup_inorder(vq, nb_used);
+
+	while (nb_pkts - nb_tx >= SPLIT_DESC_BATCH_SIZE) {
+		if (unlikely(vq->vq_free_cnt < SPLIT_DESC_BATCH_SIZE)) {
+			nb_used = virtqueue_nused(vq);
+			virtio_xmit_cleanup_inorder(vq,
+				RTE_MIN(nb_used, SPLIT_DESC_BATCH_SIZE));
+			if (vq->vq_free_cnt < SPLIT_DESC_BATCH_SIZE)
+				break;
+		}
+		if (virtqueue_enqueue_batch_split_vec(txvq, &tx_pkts[nb_tx]))
+			break;
+		nb_tx += SPLIT_DESC_BATCH_SIZE;
+	}
+
+	nb_batch = nb_tx;
+	txvq->stats.packets += nb_batch;
+
+	if (likely(nb_batch))
+		vq_update_avail_idx(vq);
+
+	/* Chained, shared or wrapping packets and the tail go the scalar
+	 * way, which also kicks for the batched ones.
+	 */
+	if (nb_tx < nb_pkts) {
+		txvq->kick.pending += nb_batch;
+		nb_tx += virtio_xmit_pkts_inorder_nocheck(txvq, &tx_pkts[nb_tx],
+							  nb_pkts - nb_tx);
+		nb_batch = 0;
+	}
+
+	virtio_tx_kick(txvq, vq, nb_batch);
+
+	return nb_tx;
+}
+
+uint16_t
+virtio_recv_pkts_inorder_vec(void *rx_queue, struct rte_mbuf **rx_pkts,
+			     uint16_t nb_pkts)
+{
+	struct virtnet_rx *rxvq = rx_queue;
+	struct virtqueue *vq = virtnet_rxq_to_vq(rxvq);
+	struct virtio_hw *hw = vq->hw;
+	uint16_t free_cnt = vq->vq_free_thresh;
+	uint16_t nb_used, nb_rx = 0;
+
+	if (unlikely(hw->started == 0))
+		return nb_rx;
+
+	nb_used = virtqueue_nused(vq);
+	nb_used = RTE_MIN(nb_used, nb_pkts);
+	nb_used = RTE_MIN(nb_used, VIRTIO_MBUF_BURST_SZ);
+
+	while (nb_used - nb_rx >= SPLIT_RX_BATCH_SIZE) {
+		if (virtqueue_dequeue_batch_split_vec(rxvq, &rx_pkts[nb_rx]))
+			break;
+		nb_rx += SPLIT_RX_BATCH_SIZE;
+	}
+
+	PMD_RX_LOG(DEBUG, "dequeue:%d", nb_rx);
+
+	rxvq->stats.packets += nb_rx;
+
+	/* Short, merged or wrapping packets and the tail go the scalar way,
+	 * which also refills the ring.
+	 */
+	if (nb_rx < nb_used)
+		return nb_rx + virtio_recv_pkts_inorder(rxvq, &rx_pkts[nb_rx],
+							nb_pkts - nb_rx);
+
+	if (likely(vq->vq_free_cnt >= free_cnt)) {
+		struct rte_mbuf *new_pkts[free_cnt];
+
+		if (likely(rte_pktmbuf_alloc_bulk(rxvq->mpool, new_pkts,
+						  free_cnt) == 0)) {
+			virtio_recv_refill_split_vec(rxvq, new_pkts, free_cnt);
+			vq_update_avail_idx(vq);
+
+			if (unlikely(virtqueue_kick_prepare(vq))) {
+				virtqueue_notify(vq);
+				PMD_RX_LOG(DEBUG, "Notified");
+			}
+		} else {
+			struct rte_eth_dev *dev =
+				&rte_eth_devices[rxvq->port_id];
+			dev->data->rx_mbuf_alloc_failed += free_cnt;
+		}
+	}
+
+	return nb_rx;
+}
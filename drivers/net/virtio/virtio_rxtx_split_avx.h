@@ -0,0 +1,296 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright (c) 2024 NVIDIA Corporation & Affiliates
+ */
+
+#ifndef _VIRTIO_RXTX_SPLIT_AVX_H_
+#define _VIRTIO_RXTX_SPLIT_AVX_H_
+
+#include <stdint.h>
+
+#include <rte_ether.h>
+#include <rte_net.h>
+#include <rte_vect.h>
+
+#include "virtio_logs.h"
+#include "virtio_ethdev.h"
+#include "virtio.h"
+#include "virtio_rxtx.h"
+#include "virtio_rxtx_packed.h"
+#include "virtqueue.h"
+
+/* Four split descriptors or eight used elements fill a cache line */
+#define SPLIT_DESC_BATCH_SIZE (RTE_CACHE_LINE_SIZE / sizeof(struct vring_desc))
+#define SPLIT_RX_BATCH_SIZE (RTE_CACHE_LINE_SIZE / \
+	sizeof(struct vring_used_elem))
+
+/* addr, len and flags words of each desc, next is kept for chained Tx */
+#define SPLIT_DESC_STORE_MASK 0x7F7F7F7F
+
+/*
+ * In-order split ring: descriptors are used in ring order, the avail ring
+ * of a batch of single descriptor packets holds consecutive indexes.
+ */
+static inline int
+virtqueue_enqueue_batch_split_vec(struct virtnet_tx *txvq,
+				  struct rte_mbuf **tx_pkts)
+{
+	struct virtqueue *vq = virtnet_txq_to_vq(txvq);
+	uint16_t head_size = vq->hw->vtnet_hdr_size;
+	uint16_t mask = vq->vq_nentries - 1;
+	uint16_t idx = vq->vq_desc_head_idx & mask;
+	uint16_t avail_idx = vq->vq_avail_idx & mask;
+	struct virtio_net_hdr *hdr;
+	struct vq_desc_extra *dxp;
+	uint64_t indirect = 0;
+	uint64_t avail_ids;
+	uint16_t i, cmp;
+
+	if (unlikely(idx + SPLIT_DESC_BATCH_SIZE > vq->vq_nentries ||
+		     avail_idx + SPLIT_DESC_BATCH_SIZE > vq->vq_nentries))
+		return -1;
+
+	/* Load four mbufs rearm data */
+	RTE_BUILD_BUG_ON(REFCNT_BITS_OFFSET >= 64);
+	RTE_BUILD_BUG_ON(SEG_NUM_BITS_OFFSET >= 64);
+	__m256i mbufs = _mm256_set_epi64x(*tx_pkts[3]->rearm_data,
+					  *tx_pkts[2]->rearm_data,
+					  *tx_pkts[1]->rearm_data,
+					  *tx_pkts[0]->rearm_data);
+
+	/* refcnt=1 and nb_segs=1 */
+	__m256i mbuf_ref = _mm256_set1_epi64x(DEFAULT_REARM_DATA);
+	__m256i head_rooms = _mm256_set1_epi16(head_size);
+
+	/* Check refcnt and nb_segs */
+	const __mmask16 seg_mask = 0x6 | 0x6 << 4 | 0x6 << 8 | 0x6 << 12;
+	cmp = _mm256_mask_cmpneq_epu16_mask(seg_mask, mbufs, mbuf_ref);
+	if (unlikely(cmp))
+		return -1;
+
+	/* Check headroom is enough */
+	const __mmask16 data_mask = 0x1 | 0x1 << 4 | 0x1 << 8 | 0x1 << 12;
+	RTE_BUILD_BUG_ON(offsetof(struct rte_mbuf, data_off) !=
+		offsetof(struct rte_mbuf, rearm_data));
+	cmp = _mm256_mask_cmplt_epu16_mask(data_mask, mbufs, head_rooms);
+	if (unlikely(cmp))
+		return -1;
+
+	/* Header is pushed in the buffer, it must be direct and aligned */
+	virtio_for_each_try_unroll(i, 0, SPLIT_DESC_BATCH_SIZE) {
+		indirect |= tx_pkts[i]->ol_flags &
+			(RTE_MBUF_F_INDIRECT | RTE_MBUF_F_EXTERNAL);
+		indirect |= rte_pktmbuf_mtod(tx_pkts[i], uintptr_t) &
+			(__alignof__(struct virtio_net_hdr_mrg_rxbuf) - 1);
+	}
+	if (unlikely(indirect))
+		return -1;
+
+	virtio_for_each_try_unroll(i, 0, SPLIT_DESC_BATCH_SIZE) {
+		dxp = &vq->vq_descx[avail_idx + i];
+		dxp->ndescs = 1;
+		dxp->cookie = tx_pkts[i];
+	}
+
+	if (!vq->hw->has_tx_offload) {
+		__m128i all_mask = _mm_set1_epi16(0xFFFF);
+		virtio_for_each_try_unroll(i, 0, SPLIT_DESC_BATCH_SIZE) {
+			hdr = rte_pktmbuf_mtod_offset(tx_pkts[i],
+					struct virtio_net_hdr *, -head_size);
+			__m128i v_hdr = _mm_loadu_si128((void *)hdr);
+			if (unlikely(_mm_mask_test_epi16_mask(NET_HDR_MASK,
+							v_hdr, all_mask))) {
+				__m128i all_zero = _mm_setzero_si128();
+				_mm_mask_storeu_epi16((void *)hdr,
+						NET_HDR_MASK, all_zero);
+			}
+		}
+	} else {
+		virtio_for_each_try_unroll(i, 0, SPLIT_DESC_BATCH_SIZE) {
+			hdr = rte_pktmbuf_mtod_offset(tx_pkts[i],
+					struct virtio_net_hdr *, -head_size);
+			virtqueue_xmit_offload(hdr, tx_pkts[i]);
+		}
+	}
+
+	/* addr and len of each desc, flags left to zero */
+	__m512i v_desc = _mm512_set_epi64(
+			tx_pkts[3]->data_len + head_size,
+			VIRTIO_MBUF_DATA_DMA_ADDR(tx_pkts[3], vq) - head_size,
+			tx_pkts[2]->data_len + head_size,
+			VIRTIO_MBUF_DATA_DMA_ADDR(tx_pkts[2], vq) - head_size,
+			tx_pkts[1]->data_len + head_size,
+			VIRTIO_MBUF_DATA_DMA_ADDR(tx_pkts[1], vq) - head_size,
+			tx_pkts[0]->data_len + head_size,
+			VIRTIO_MBUF_DATA_DMA_ADDR(tx_pkts[0], vq) - head_size);
+
+	/* Enqueue Packet buffers */
+	_mm512_mask_storeu_epi16((void *)&vq->vq_split.ring.desc[idx],
+			SPLIT_DESC_STORE_MASK, v_desc);
+
+	/* Only write the avail entries if they changed since the last lap */
+	avail_ids = (uint64_t)idx | (uint64_t)(idx + 1) << 16 |
+		(uint64_t)(idx + 2) << 32 | (uint64_t)(idx + 3) << 48;
+	__m128i v_avail = _mm_loadl_epi64(
+			(void *)&vq->vq_split.ring.avail->ring[avail_idx]);
+	if (unlikely((uint64_t)_mm_cvtsi128_si64(v_avail) != avail_ids))
+		_mm_storel_epi64((void *)&vq->vq_split.ring.avail->ring[avail_idx],
+				_mm_cvtsi64_si128(avail_ids));
+
+	/* Same per size and per address type counters as the scalar path */
+	virtio_for_each_try_unroll(i, 0, SPLIT_DESC_BATCH_SIZE)
+		virtio_update_packet_stats(&txvq->stats, tx_pkts[i]);
+
+	vq->vq_avail_idx += SPLIT_DESC_BATCH_SIZE;
+	vq->vq_desc_head_idx = (idx + SPLIT_DESC_BATCH_SIZE) & mask;
+	vq->vq_free_cnt -= SPLIT_DESC_BATCH_SIZE;
+
+	return 0;
+}
+
+/*
+ * In-order split ring: the used ring index is the descriptor index. Short
+ * packets and packets merged from several buffers are left to the scalar
+ * path.
+ */
+static inline int
+virtqueue_dequeue_batch_split_vec(struct virtnet_rx *rxvq,
+				  struct rte_mbuf **rx_pkts)
+{
+	struct virtqueue *vq = virtnet_rxq_to_vq(rxvq);
+	struct virtio_hw *hw = vq->hw;
+	uint16_t hdr_size = hw->vtnet_hdr_size;
+	uint16_t used_idx = vq->vq_used_cons_idx & (vq->vq_nentries - 1);
+	struct virtio_net_hdr_mrg_rxbuf *hdr[SPLIT_RX_BATCH_SIZE];
+	uint64_t lens[SPLIT_RX_BATCH_SIZE];
+	uint16_t i;
+
+	if (unlikely(used_idx + SPLIT_RX_BATCH_SIZE > vq->vq_nentries))
+		return -1;
+
+	/* len is the upper half of each used element */
+	__m512i v_used = _mm512_loadu_si512(
+			(void *)&vq->vq_split.ring.used->ring[used_idx]);
+	__m512i v_len = _mm512_srli_epi64(v_used, 32);
+	__m512i v_min = _mm512_set1_epi64(hdr_size + RTE_ETHER_HDR_LEN);
+
+	if (unlikely(_mm512_cmplt_epu64_mask(v_len, v_min)))
+		return -1;
+
+	v_len = _mm512_sub_epi64(v_len, _mm512_set1_epi64(hdr_size));
+	_mm512_storeu_si512((void *)lens, v_len);
+
+	virtio_for_each_try_unroll(i, 0, SPLIT_RX_BATCH_SIZE) {
+		rx_pkts[i] = vq->vq_descx[used_idx + i].cookie;
+		hdr[i] = (struct virtio_net_hdr_mrg_rxbuf *)
+			((char *)rx_pkts[i]->buf_addr + RTE_PKTMBUF_HEADROOM -
+			 hdr_size);
+		rte_packet_prefetch(hdr[i]);
+	}
+
+	if (virtio_with_feature(hw, VIRTIO_NET_F_MRG_RXBUF)) {
+		virtio_for_each_try_unroll(i, 0, SPLIT_RX_BATCH_SIZE) {
+			if (unlikely(hdr[i]->num_buffers > 1))
+				return -1;
+		}
+	}
+
+	/*
+	 * rearm data, ol_flags then packet_type, pkt_len, data_len and
+	 * vlan_tci are contiguous, one store per mbuf
+	 */
+	RTE_BUILD_BUG_ON(offsetof(struct rte_mbuf, ol_flags) !=
+		offsetof(struct rte_mbuf, rearm_data) + 8);
+	RTE_BUILD_BUG_ON(offsetof(struct rte_mbuf, rx_descriptor_fields1) !=
+		offsetof(struct rte_mbuf, rearm_data) + 16);
+	RTE_BUILD_BUG_ON(offsetof(struct rte_mbuf, pkt_len) !=
+		offsetof(struct rte_mbuf, rearm_data) + 20);
+	RTE_BUILD_BUG_ON(offsetof(struct rte_mbuf, data_len) !=
+		offsetof(struct rte_mbuf, rearm_data) + 24);
+	virtio_for_each_try_unroll(i, 0, SPLIT_RX_BATCH_SIZE) {
+		_mm256_storeu_si256((void *)&rx_pkts[i]->rearm_data,
+			_mm256_set_epi64x(lens[i], lens[i] << 32, 0,
+					  rxvq->mbuf_initializer));
+		vq->vq_descx[used_idx + i].cookie = NULL;
+	}
+
+	if (hw->has_rx_offload) {
+		virtio_for_each_try_unroll(i, 0, SPLIT_RX_BATCH_SIZE)
+			virtio_vec_rx_offload(rx_pkts[i],
+					(struct virtio_net_hdr *)hdr[i]);
+	}
+
+	virtio_for_each_try_unroll(i, 0, SPLIT_RX_BATCH_SIZE)
+		virtio_update_packet_stats(&rxvq->stats, rx_pkts[i]);
+
+	vq->vq_used_cons_idx += SPLIT_RX_BATCH_SIZE;
+	vq_ring_free_inorder(vq, used_idx + SPLIT_RX_BATCH_SIZE - 1,
+			SPLIT_RX_BATCH_SIZE);
+
+	return 0;
+}
+
+static inline void
+virtio_recv_refill_split_vec(struct virtnet_rx *rxvq,
+			     struct rte_mbuf **cookies,
+			     uint16_t num)
+{
+	struct virtqueue *vq = virtnet_rxq_to_vq(rxvq);
+	struct vring_desc *start_dp = vq->vq_split.ring.desc;
+	uint16_t hdr_size = vq->hw->vtnet_hdr_size;
+	uint16_t mask = vq->vq_nentries - 1;
+	struct vq_desc_extra *dxp;
+	uint16_t idx, i = 0, j;
+	uint64_t len_flags[SPLIT_DESC_BATCH_SIZE];
+
+	while (i < num) {
+		idx = (vq->vq_desc_head_idx + i) & mask;
+
+		if (num - i < SPLIT_DESC_BATCH_SIZE ||
+		    idx + SPLIT_DESC_BATCH_SIZE > vq->vq_nentries) {
+			dxp = &vq->vq_descx[idx];
+			dxp->cookie = cookies[i];
+			dxp->ndescs = 1;
+			start_dp[idx].addr = VIRTIO_MBUF_ADDR(cookies[i], vq) +
+				RTE_PKTMBUF_HEADROOM - hdr_size;
+			start_dp[idx].len = cookies[i]->buf_len -
+				RTE_PKTMBUF_HEADROOM + hdr_size;
+			start_dp[idx].flags = VRING_DESC_F_WRITE;
+			vq_update_avail_ring(vq, idx);
+			i++;
+			continue;
+		}
+
+		virtio_for_each_try_unroll(j, 0, SPLIT_DESC_BATCH_SIZE) {
+			dxp = &vq->vq_descx[idx + j];
+			dxp->cookie = cookies[i + j];
+			dxp->ndescs = 1;
+			len_flags[j] = (uint64_t)VRING_DESC_F_WRITE << 32 |
+				(uint32_t)(cookies[i + j]->buf_len -
+					   RTE_PKTMBUF_HEADROOM + hdr_size);
+		}
+
+		__m512i v_desc = _mm512_set_epi64(len_flags[3],
+			VIRTIO_MBUF_ADDR(cookies[i + 3], vq) +
+				RTE_PKTMBUF_HEADROOM - hdr_size,
+			len_flags[2],
+			VIRTIO_MBUF_ADDR(cookies[i + 2], vq) +
+				RTE_PKTMBUF_HEADROOM - hdr_size,
+			len_flags[1],
+			VIRTIO_MBUF_ADDR(cookies[i + 1], vq) +
+				RTE_PKTMBUF_HEADROOM - hdr_size,
+			len_flags[0],
+			VIRTIO_MBUF_ADDR(cookies[i], vq) +
+				RTE_PKTMBUF_HEADROOM - hdr_size);
+		_mm512_mask_storeu_epi16((void *)&start_dp[idx],
+				SPLIT_DESC_STORE_MASK, v_desc);
+
+		virtio_for_each_try_unroll(j, 0, SPLIT_DESC_BATCH_SIZE)
+			vq_update_avail_ring(vq, idx + j);
+		i += SPLIT_DESC_BATCH_SIZE;
+	}
+
+	vq->vq_desc_head_idx += num;
+	vq->vq_free_cnt = (uint16_t)(vq->vq_free_cnt - num);
+}
+
+#endif /* _VIRTIO_RXTX_SPLIT_AVX_H_ */
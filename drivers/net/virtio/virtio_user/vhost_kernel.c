@@ -8,15 +8,30 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <rte_eal_memconfig.h>
 #include <rte_memory.h>
 
 #include "vhost.h"
 #include "virtio_user_dev.h"
 #include "vhost_kernel_tap.h"
 
+/* Memory registered on demand with rte_dev_dma_map() */
+struct vhost_kernel_ext_region {
+	uint64_t addr;
+	uint64_t len;
+};
+
 struct vhost_kernel_data {
 	int *vhostfds;
 	int *tapfds;
+	struct vhost_kernel_ext_region *ext_regions;
+	uint32_t nb_ext_regions;
+};
+
+struct vhost_kernel_mem_ctx {
+	struct vhost_memory_region *regions;
+	uint32_t nregions;
+	uint32_t max;
 };
 
 struct vhost_memory_kernel {
@@ -83,6 +98,26 @@ get_vhost_kernel_max_regions(void)
 	close(fd);
 }
 
+/* Vhost-net sends large frames to the TAP without a copy if enabled */
+static bool
+get_vhost_kernel_zcopy_tx(void)
+{
+	int fd;
+	char buf[4] = {'\0'};
+	bool zcopy = false;
+
+	fd = open("/sys/module/vhost_net/parameters/experimental_zcopytx", O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	if (read(fd, buf, sizeof(buf) - 1) > 0)
+		zcopy = buf[0] == '1' || buf[0] == 'Y';
+
+	close(fd);
+
+	return zcopy;
+}
+
 static int
 vhost_kernel_ioctl(int fd, uint64_t request, void *arg)
 {
@@ -183,62 +218,139 @@ vhost_kernel_set_features(struct virtio_user_dev *dev, uint64_t features)
 static int
 add_memseg_list(const struct rte_memseg_list *msl, void *arg)
 {
-	struct vhost_memory_kernel *vm = arg;
+	struct vhost_kernel_mem_ctx *ctx = arg;
 	struct vhost_memory_region *mr;
-	void *start_addr;
-	uint64_t len;
 
-	if (msl->external)
+	/* Unused lists have no memory, external memory out of the heaps
+	 * is registered on demand by vhost_kernel_dma_map().
+	 */
+	if (msl->base_va == NULL || msl->len == 0 ||
+			(msl->external && !msl->heap))
 		return 0;
 
-	if (vm->nregions >= max_regions)
+	if (ctx->nregions >= ctx->max)
 		return -1;
 
-	start_addr = msl->base_va;
-	len = msl->page_sz * msl->memseg_arr.len;
+	mr = &ctx->regions[ctx->nregions++];
+	mr->userspace_addr = (uint64_t)(uintptr_t)msl->base_va;
+	mr->memory_size = msl->len;
+
+	return 0;
+}
 
-	mr = &vm->regions[vm->nregions++];
+static int
+region_cmp(const void *a, const void *b)
+{
+	const struct vhost_memory_region *ra = a;
+	const struct vhost_memory_region *rb = b;
 
-	mr->guest_phys_addr = (uint64_t)(uintptr_t)start_addr;
-	mr->userspace_addr = (uint64_t)(uintptr_t)start_addr;
-	mr->memory_size = len;
-	mr->mmap_offset = 0; /* flags_padding */
+	if (ra->userspace_addr == rb->userspace_addr)
+		return 0;
+	return ra->userspace_addr < rb->userspace_addr ? -1 : 1;
+}
 
-	PMD_DRV_LOG(DEBUG, "index=%u addr=%p len=%" PRIu64,
-			vm->nregions - 1, start_addr, len);
+static void
+merge_regions(struct vhost_memory_region *regions, uint32_t *nregions,
+		uint32_t idx)
+{
+	struct vhost_memory_region *mr = &regions[idx];
+	struct vhost_memory_region *next = &regions[idx + 1];
+	uint64_t end;
+
+	end = RTE_MAX(mr->userspace_addr + mr->memory_size,
+			next->userspace_addr + next->memory_size);
+	mr->memory_size = end - mr->userspace_addr;
+	memmove(next, next + 1, (*nregions - idx - 2) * sizeof(*next));
+	(*nregions)--;
+}
 
-	return 0;
+/* Vhost kernel only translates addresses with the table, it never maps the
+ * regions. As virtio-user addresses are virtual addresses, a region may span
+ * unmapped holes, no descriptor points there. Regions are sorted, the
+ * contiguous or overlapping ones are merged, then the closest ones are merged
+ * until the table fits the limit of the vhost module.
+ */
+static void
+coalesce_regions(struct vhost_memory_region *regions, uint32_t *nregions)
+{
+	uint64_t gap, min_gap;
+	uint32_t i, min_idx;
+
+	qsort(regions, *nregions, sizeof(*regions), region_cmp);
+
+	i = 0;
+	while (i + 1 < *nregions) {
+		if (regions[i].userspace_addr + regions[i].memory_size >=
+				regions[i + 1].userspace_addr)
+			merge_regions(regions, nregions, i);
+		else
+			i++;
+	}
+
+	while (*nregions > max_regions) {
+		min_gap = UINT64_MAX;
+		min_idx = 0;
+		for (i = 0; i + 1 < *nregions; i++) {
+			gap = regions[i + 1].userspace_addr -
+				(regions[i].userspace_addr + regions[i].memory_size);
+			if (gap < min_gap) {
+				min_gap = gap;
+				min_idx = i;
+			}
+		}
+		merge_regions(regions, nregions, min_idx);
+	}
+
+	for (i = 0; i < *nregions; i++) {
+		regions[i].guest_phys_addr = regions[i].userspace_addr;
+		regions[i].mmap_offset = 0; /* flags_padding */
+		PMD_DRV_LOG(DEBUG, "index=%u addr=0x%" PRIx64 " len=%" PRIu64,
+				i, regions[i].userspace_addr,
+				(uint64_t)regions[i].memory_size);
+	}
 }
 
 /* By default, vhost kernel module allows 64 regions, but DPDK may
  * have much more memory regions. Below function will treat each
- * contiguous memory space reserved by DPDK as one region.
+ * contiguous memory space reserved by DPDK as one region, external
+ * memory included, and coalesce them to fit the limit.
  */
 static int
 vhost_kernel_set_memory_table(struct virtio_user_dev *dev)
 {
 	uint32_t i;
 	struct vhost_kernel_data *data = dev->backend_data;
+	struct vhost_kernel_mem_ctx ctx;
 	struct vhost_memory_kernel *vm;
 	int ret;
 
+	ctx.max = RTE_MAX_MEMSEG_LISTS + data->nb_ext_regions;
 	vm = malloc(sizeof(struct vhost_memory_kernel) +
-			max_regions *
-			sizeof(struct vhost_memory_region));
+			ctx.max * sizeof(struct vhost_memory_region));
 	if (!vm)
 		goto err;
 
-	vm->nregions = 0;
-	vm->padding = 0;
+	ctx.regions = vm->regions;
+	ctx.nregions = 0;
 
 	/*
 	 * The memory lock has already been taken by memory subsystem
 	 * or virtio_user_start_device().
 	 */
-	ret = rte_memseg_list_walk_thread_unsafe(add_memseg_list, vm);
+	ret = rte_memseg_list_walk_thread_unsafe(add_memseg_list, &ctx);
 	if (ret < 0)
 		goto err_free;
 
+	for (i = 0; i < data->nb_ext_regions; i++) {
+		ctx.regions[ctx.nregions].userspace_addr = data->ext_regions[i].addr;
+		ctx.regions[ctx.nregions].memory_size = data->ext_regions[i].len;
+		ctx.nregions++;
+	}
+
+	coalesce_regions(ctx.regions, &ctx.nregions);
+	vm->nregions = ctx.nregions;
+	vm->padding = 0;
+
 	for (i = 0; i < dev->max_queue_pairs; ++i) {
 		if (data->vhostfds[i] < 0)
 			continue;
@@ -258,6 +370,75 @@ vhost_kernel_set_memory_table(struct virtio_user_dev *dev)
 	return -1;
 }
 
+/* Register memory out of DPDK memory, e.g. buffers attached to mbufs, so
+ * vhost-net can access it without a copy. Vhost-net swaps the table under
+ * the virtqueue locks, the queues are not paused.
+ */
+static int
+vhost_kernel_dma_map(struct virtio_user_dev *dev, void *addr,
+		uint64_t iova __rte_unused, size_t len)
+{
+	struct vhost_kernel_data *data = dev->backend_data;
+	struct vhost_kernel_ext_region *regions;
+	int ret = 0;
+
+	/* Same lock order as the memory event callback */
+	rte_mcfg_mem_read_lock();
+	pthread_mutex_lock(&dev->mutex);
+
+	regions = realloc(data->ext_regions,
+			(data->nb_ext_regions + 1) * sizeof(*regions));
+	if (regions == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	data->ext_regions = regions;
+	regions[data->nb_ext_regions].addr = (uint64_t)(uintptr_t)addr;
+	regions[data->nb_ext_regions].len = len;
+	data->nb_ext_regions++;
+
+	if (dev->started) {
+		ret = vhost_kernel_set_memory_table(dev);
+		if (ret < 0)
+			data->nb_ext_regions--;
+	}
+out:
+	pthread_mutex_unlock(&dev->mutex);
+	rte_mcfg_mem_read_unlock();
+
+	return ret;
+}
+
+static int
+vhost_kernel_dma_unmap(struct virtio_user_dev *dev, void *addr,
+		uint64_t iova __rte_unused, size_t len)
+{
+	struct vhost_kernel_data *data = dev->backend_data;
+	uint32_t i;
+	int ret = 0;
+
+	rte_mcfg_mem_read_lock();
+	pthread_mutex_lock(&dev->mutex);
+
+	for (i = 0; i < data->nb_ext_regions; i++)
+		if (data->ext_regions[i].addr == (uint64_t)(uintptr_t)addr &&
+				data->ext_regions[i].len == len)
+			break;
+	if (i == data->nb_ext_regions) {
+		ret = -ENOENT;
+		goto out;
+	}
+	data->ext_regions[i] = data->ext_regions[--data->nb_ext_regions];
+
+	if (dev->started)
+		ret = vhost_kernel_set_memory_table(dev);
+out:
+	pthread_mutex_unlock(&dev->mutex);
+	rte_mcfg_mem_read_unlock();
+
+	return ret;
+}
+
 static int
 vhost_kernel_set_vring(struct virtio_user_dev *dev, uint64_t req, struct vhost_vring_state *state)
 {
@@ -406,6 +587,8 @@ vhost_kernel_setup(struct virtio_user_dev *dev)
 		PMD_INIT_LOG(ERR, "(%s) Failed to allocate Vhost FDs", dev->path);
 		goto err_data;
 	}
+	data->ext_regions = NULL;
+	data->nb_ext_regions = 0;
 	data->tapfds = malloc(dev->max_queue_pairs * sizeof(int));
 	if (!data->tapfds) {
 		PMD_INIT_LOG(ERR, "(%s) Failed to allocate TAP FDs", dev->path);
@@ -418,6 +601,8 @@ vhost_kernel_setup(struct virtio_user_dev *dev)
 	}
 
 	get_vhost_kernel_max_regions();
+	if (get_vhost_kernel_zcopy_tx())
+		PMD_INIT_LOG(INFO, "(%s) vhost-net zero-copy Tx enabled", dev->path);
 
 	for (i = 0; i < dev->max_queue_pairs; ++i) {
 		vhostfd = open(dev->path, O_RDWR);
@@ -490,6 +675,7 @@ vhost_kernel_destroy(struct virtio_user_dev *dev)
 
 	free(data->vhostfds);
 	free(data->tapfds);
+	free(data->ext_regions);
 	free(data);
 	dev->backend_data = NULL;
 
@@ -608,6 +794,8 @@ struct virtio_user_backend_ops virtio_ops_kernel = {
 	.get_status = vhost_kernel_get_status,
 	.set_status = vhost_kernel_set_status,
 	.enable_qp = vhost_kernel_enable_queue_pair,
+	.dma_map = vhost_kernel_dma_map,
+	.dma_unmap = vhost_kernel_dma_unmap,
 	.update_link_state = vhost_kernel_update_link_state,
 	.get_intr_fd = vhost_kernel_get_intr_fd,
 };
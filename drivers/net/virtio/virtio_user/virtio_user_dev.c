@@ -452,9 +452,12 @@ virtio_user_mem_event_cb(enum rte_mem_event type __rte_unused,
 	uint16_t i;
 	int ret = 0;
 
-	/* ignore externally allocated memory */
+	/* ignore externally allocated memory, but vhost-kernel which only
+	 * needs virtual addresses
+	 */
 	msl = rte_mem_virt2memseg_list(addr);
-	if (msl->external)
+	if (msl->external &&
+			dev->backend_type != VIRTIO_USER_BACKEND_VHOST_KERNEL)
 		return;
 
 	pthread_mutex_lock(&dev->mutex);
@@ -552,6 +555,7 @@ virtio_user_dev_setup(struct virtio_user_dev *dev)
 	 1ULL << VIRTIO_NET_F_HOST_TSO6		|	\
 	 1ULL << VIRTIO_NET_F_MRG_RXBUF		|	\
 	 1ULL << VIRTIO_RING_F_INDIRECT_DESC	|	\
+	 1ULL << VIRTIO_RING_F_EVENT_IDX	|	\
 	 1ULL << VIRTIO_NET_F_GUEST_CSUM	|	\
 	 1ULL << VIRTIO_NET_F_GUEST_TSO4	|	\
 	 1ULL << VIRTIO_NET_F_GUEST_TSO6	|	\
@@ -563,7 +567,7 @@ int
 virtio_user_dev_init(struct virtio_user_dev *dev, char *path, int queues,
 		     int cq, int queue_size, const char *mac, char **ifname,
 		     int server, int mrg_rxbuf, int in_order, int packed_vq,
-		     enum virtio_user_backend_type backend_type)
+		     int event_idx, enum virtio_user_backend_type backend_type)
 {
 	uint64_t backend_features;
 	int i;
@@ -624,6 +628,9 @@ virtio_user_dev_init(struct virtio_user_dev *dev, char *path, int queues,
 	if (!packed_vq)
 		dev->unsupported_features |= (1ull << VIRTIO_F_RING_PACKED);
 
+	if (!event_idx)
+		dev->unsupported_features |= (1ull << VIRTIO_RING_F_EVENT_IDX);
+
 	if (dev->mac_specified)
 		dev->frontend_features |= (1ull << VIRTIO_NET_F_MAC);
 	else
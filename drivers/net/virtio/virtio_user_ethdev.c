@@ -319,6 +319,12 @@ static const char *valid_args[] = {
 	VIRTIO_USER_ARG_SPEED,
 #define VIRTIO_USER_ARG_VECTORIZED     "vectorized"
 	VIRTIO_USER_ARG_VECTORIZED,
+#define VIRTIO_USER_ARG_RX_IDLE_US     "rx_idle_us"
+	VIRTIO_USER_ARG_RX_IDLE_US,
+#define VIRTIO_USER_ARG_TX_KICK_PKTS   "tx_kick_pkts"
+	VIRTIO_USER_ARG_TX_KICK_PKTS,
+#define VIRTIO_USER_ARG_TX_KICK_US     "tx_kick_us"
+	VIRTIO_USER_ARG_TX_KICK_US,
 	NULL
 };
 
@@ -470,6 +476,7 @@ virtio_user_pmd_probe(struct rte_vdev_device *vdev)
 	uint64_t in_order = 1;
 	uint64_t packed_vq = 0;
 	uint64_t vectorized = 0;
+	uint64_t rx_idle_us = 0;
 	char *path = NULL;
 	char *ifname = NULL;
 	char *mac_addr = NULL;
@@ -641,6 +648,16 @@ virtio_user_pmd_probe(struct rte_vdev_device *vdev)
 		}
 	}
 
+	/* Adaptive Rx is set up by the ethdev, only event idx depends on it here */
+	if (rte_kvargs_count(kvlist, VIRTIO_USER_ARG_RX_IDLE_US) == 1) {
+		if (rte_kvargs_process(kvlist, VIRTIO_USER_ARG_RX_IDLE_US,
+				       &get_integer_arg, &rx_idle_us) < 0) {
+			PMD_INIT_LOG(ERR, "error to parse %s",
+				     VIRTIO_USER_ARG_RX_IDLE_US);
+			goto end;
+		}
+	}
+
 	eth_dev = virtio_user_eth_dev_alloc(vdev);
 	if (!eth_dev) {
 		PMD_INIT_LOG(ERR, "virtio_user fails to alloc device");
@@ -651,7 +668,8 @@ virtio_user_pmd_probe(struct rte_vdev_device *vdev)
 	hw = &dev->hw;
 	if (virtio_user_dev_init(dev, path, queues, cq,
 			 queue_size, mac_addr, &ifname, server_mode,
-			 mrg_rxbuf, in_order, packed_vq, backend_type) < 0) {
+			 mrg_rxbuf, in_order, packed_vq, rx_idle_us != 0,
+			 backend_type) < 0) {
 		PMD_INIT_LOG(ERR, "virtio_user_dev_init fails");
 		virtio_user_eth_dev_free(eth_dev);
 		goto end;
@@ -682,6 +700,10 @@ virtio_user_pmd_probe(struct rte_vdev_device *vdev)
 #endif
 		} else {
 			hw->use_vec_rx = 1;
+#ifdef CC_AVX512_SUPPORT
+			/* only with in-order, checked at configure */
+			hw->use_vec_tx = 1;
+#endif
 		}
 	}
 
@@ -788,4 +810,7 @@ RTE_PMD_REGISTER_PARAM_STRING(net_virtio_user,
 	"in_order=<0|1> "
 	"packed_vq=<0|1> "
 	"speed=<int> "
-	"vectorized=<0|1>");
+	"vectorized=<0|1> "
+	"rx_idle_us=<int> "
+	"tx_kick_pkts=<int> "
+	"tx_kick_us=<int>");
@@ -8,6 +8,8 @@
 #include <stdint.h>
 
 #include <rte_atomic.h>
+#include <rte_cycles.h>
+#include <rte_eal.h>
 #include <rte_memory.h>
 #include <rte_mempool.h>
 #include <rte_net.h>
@@ -268,6 +270,8 @@ struct virtqueue {
 		struct {
 			/**< vring keeping desc, used and avail */
 			struct vring ring;
+			/**< avail idx at the last kick check, for event idx */
+			uint16_t kick_avail_idx;
 		} vq_split;
 
 		struct {
@@ -425,9 +429,31 @@ virtqueue_disable_intr_packed(struct virtqueue *vq)
 static inline void
 virtqueue_disable_intr_split(struct virtqueue *vq)
 {
+	/*
+	 * The flag is ignored with event idx: put the used event just behind
+	 * the consumed index, the device only reaches it after a full wrap.
+	 * Queues polled with interrupts off keep it there with
+	 * virtqueue_used_event_advance().
+	 */
+	if (virtio_with_feature(vq->hw, VIRTIO_RING_F_EVENT_IDX))
+		vring_used_event(&vq->vq_split.ring) = vq->vq_used_cons_idx - 1;
 	vq->vq_split.ring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
 }
 
+/**
+ * Move the used event of a split virtqueue with interrupts off along with
+ * the consumed index, to be called after consuming used buffers. Left
+ * behind, the used index of the device reaches it again after 65536
+ * buffers and raises an interrupt nobody waits for.
+ */
+static inline void
+virtqueue_used_event_advance(struct virtqueue *vq)
+{
+	if (!virtio_with_packed_queue(vq->hw) &&
+	    virtio_with_feature(vq->hw, VIRTIO_RING_F_EVENT_IDX))
+		vring_used_event(&vq->vq_split.ring) = vq->vq_used_cons_idx - 1;
+}
+
 /**
  * Tell the backend not to interrupt us.
  */
@@ -459,6 +485,8 @@ virtqueue_enable_intr_packed(struct virtqueue *vq)
 static inline void
 virtqueue_enable_intr_split(struct virtqueue *vq)
 {
+	if (virtio_with_feature(vq->hw, VIRTIO_RING_F_EVENT_IDX))
+		vring_used_event(&vq->vq_split.ring) = vq->vq_used_cons_idx;
 	vq->vq_split.ring.avail->flags &= (~VRING_AVAIL_F_NO_INTERRUPT);
 }
 
@@ -583,11 +611,23 @@ vq_update_avail_ring(struct virtqueue *vq, uint16_t desc_idx)
 static inline int
 virtqueue_kick_prepare(struct virtqueue *vq)
 {
+	uint16_t old_idx, new_idx, event_idx;
+
 	/*
 	 * Ensure updated avail->idx is visible to vhost before reading
-	 * the used->flags.
+	 * the used->flags or the avail event.
 	 */
 	virtio_mb(vq->hw->weak_barriers);
+
+	if (virtio_with_feature(vq->hw, VIRTIO_RING_F_EVENT_IDX)) {
+		old_idx = vq->vq_split.kick_avail_idx;
+		new_idx = vq->vq_avail_idx;
+		vq->vq_split.kick_avail_idx = new_idx;
+		event_idx = __atomic_load_n(vring_avail_event_ptr(&vq->vq_split.ring),
+					    __ATOMIC_RELAXED);
+		return vring_need_event(event_idx, new_idx, old_idx);
+	}
+
 	return !(vq->vq_split.ring.used->flags & VRING_USED_F_NO_NOTIFY);
 }
 
@@ -615,6 +655,67 @@ virtqueue_notify(struct virtqueue *vq)
 	VIRTIO_OPS(vq->hw)->notify_queue(vq->hw, vq);
 }
 
+/*
+ * Notify the device of the packets made available by a Tx burst, to be
+ * called once they are published, with nb_tx 0 to flush a deferred kick.
+ * With 'tx_kick_pkts', the kick waits for that many packets or for
+ * 'tx_kick_us' across bursts. The event idx, or the used flags, are only
+ * checked when kicking, so the check covers all the deferred packets; the
+ * notification data, if negotiated, is read from the ring at that time.
+ * Past the deadline, an Rx burst of the same thread on the same queue index
+ * may kick too, see virtio_recv_pkts_tx_flush().
+ */
+static inline void
+virtio_tx_kick(struct virtnet_tx *txvq, struct virtqueue *vq, uint16_t nb_tx)
+{
+	struct virtnet_tx_kick *kick = &txvq->kick;
+	struct virtio_hw *hw = vq->hw;
+	uint64_t now, deadline;
+	int notify;
+
+	kick->pending += nb_tx;
+	if (kick->pending == 0)
+		return;
+
+	/* Injected packets are sent while stopped, no later burst flushes */
+	if (hw->tx_kick_pkts > 1 && hw->started &&
+	    kick->pending < hw->tx_kick_pkts &&
+	    vq->vq_free_cnt >= vq->vq_free_thresh) {
+		now = rte_rdtsc();
+		deadline = kick->deadline;
+		if (deadline == 0)
+			deadline = now + hw->tx_kick_cycles;
+		if (now < deadline) {
+			kick->deadline = deadline;
+			/* Only read by other threads, which then leave the queue alone */
+			__atomic_store_n(&kick->tid, rte_gettid(),
+					 __ATOMIC_RELAXED);
+			if (nb_tx)
+				kick->deferred++;
+			return;
+		}
+	}
+
+	kick->pending = 0;
+	kick->deadline = 0;
+	if (kick->tid != 0)
+		__atomic_store_n(&kick->tid, 0, __ATOMIC_RELAXED);
+	virtqueue_used_event_advance(vq);
+
+	if (virtio_with_packed_queue(hw))
+		notify = virtqueue_kick_prepare_packed(vq);
+	else
+		notify = virtqueue_kick_prepare(vq);
+
+	if (unlikely(notify)) {
+		virtqueue_notify(vq);
+		kick->notified++;
+		PMD_TX_LOG(DEBUG, "Notified backend after xmit");
+	} else {
+		kick->suppressed++;
+	}
+}
+
 #ifdef RTE_LIBRTE_VIRTIO_DEBUG_DUMP
 #define VIRTQUEUE_DUMP(vq) do { \
 	uint16_t used_idx, nused; \
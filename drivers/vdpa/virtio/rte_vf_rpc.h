@@ -31,6 +31,11 @@ struct vdpa_vf_params {
 	struct rte_ether_addr mac;
 	char vm_uuid[RTE_UUID_STRLEN];
 	bool configured;
+	bool logging; /* Dirty page tracking on, dirty_* below are valid */
+	/* dirty_* are of the whole VM, QEMU shares one log between its devices */
+	uint64_t dirty_rate; /* Pages dirtied per second */
+	uint64_t dirty_pending; /* Dirty bytes not yet collected by QEMU */
+	int64_t dirty_eta_ms; /* Time to collect pending bytes at current rates, -1 if not converging */
 };
 
 enum vdpa_vf_prov_flags {
@@ -80,6 +85,20 @@ int
 rte_vdpa_vf_dev_debug(const char *pf_name,
 		struct vdpa_debug_vf_params *vf_debug_params);
 
+/**
+ * Set the number of configuration threads per NUMA node. Queue setup, DMA
+ * mapping and device state save of the VFs run on them instead of the
+ * vhost-user thread. 0 runs all of it inline. Takes effect on NUMA nodes
+ * without VF yet.
+ *
+ * @param nr_threads
+ *  Number of threads, up to 64, default 4.
+ * @return
+ *  0 on success, -EINVAL if too many.
+ */
+int
+rte_vdpa_conf_threads_set(uint32_t nr_threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,6 +8,9 @@
 #include <linux/vfio.h>
 
 #include <rte_malloc.h>
+#include <rte_alarm.h>
+#include <rte_cycles.h>
+#include <rte_telemetry.h>
 #include <rte_vfio.h>
 #include <rte_vhost.h>
 #include <rte_vdpa.h>
@@ -16,6 +19,7 @@
 #include <rte_uuid.h>
 #include <virtio_api.h>
 #include <virtio_lm.h>
+#include <virtio_pci_state.h>
 #include <virtio_util.h>
 
 #include "rte_vf_rpc.h"
@@ -26,12 +30,7 @@ RTE_LOG_REGISTER(virtio_vdpa_logtype, pmd.vdpa.virtio, NOTICE);
 	rte_log(RTE_LOG_ ## level, virtio_vdpa_logtype, \
 		"VIRTIO VDPA %s(): " fmt "\n", __func__, ##args)
 
-int virtio_vdpa_lcore_id = 0;
 static int stage1 = 0;
-#define VIRTIO_VDPA_DEV_CLOSE_WORK_CLEAN 0
-#define VIRTIO_VDPA_DEV_CLOSE_WORK_START 1
-#define VIRTIO_VDPA_DEV_CLOSE_WORK_DONE 2
-#define VIRTIO_VDPA_DEV_CLOSE_WORK_ERR 3
 
 #define VIRTIO_VDPA_STATE_ALIGN 4096
 #define VIRTIO_VDPA_MAX_IOMMU_DOMAIN 2048
@@ -140,6 +139,8 @@ alloc_iommu_domain(void)
 	iommu_domain->mem_tbl_ref_cnt = 0;
 	iommu_domain->tbl_recover_cnt = 0;
 	iommu_domain->cont_recover_cnt = 0;
+	rte_spinlock_init(&iommu_domain->dirty_rate.lock);
+	pthread_mutex_init(&iommu_domain->dirty_rate.scan_lock, NULL);
 	virtio_iommu_domains[i] = iommu_domain;
 
 	return i;
@@ -246,6 +247,13 @@ int virtio_vdpa_dirty_desc_get(struct virtio_vdpa_priv *priv, int qix, uint64_t
 
 int virtio_vdpa_used_vring_addr_get(struct virtio_vdpa_priv *priv, int qix, uint64_t *used_vring_addr, uint32_t *used_vring_len)
 {
+	/* Packed rings write used elements back into the descriptor ring */
+	if (priv->guest_features & (1ULL << VIRTIO_F_RING_PACKED)) {
+		*used_vring_addr = priv->vrings[qix]->desc;
+		*used_vring_len = priv->vrings[qix]->size * sizeof(struct vring_packed_desc);
+		return 0;
+	}
+
 	*used_vring_addr = priv->vrings[qix]->used;
 	*used_vring_len = sizeof(struct vring_used);
 	return 0;
@@ -572,9 +580,145 @@ virtio_vdpa_doorbell_relay_disable(struct virtio_vdpa_priv *priv)
 	}
 }
 
+/*
+ * Write the heads a frozen device reported in flight to the avail slots
+ * right after the used index, so that the device fetches them again first
+ * once resumed there. The device had fetched exactly those heads past the
+ * used index, anything beyond its last avail index is still untouched.
+ */
+static int
+virtio_vdpa_inflight_desc_replay(struct virtio_vdpa_priv *priv, int qix,
+		struct rte_vhost_vring *vq, uint16_t *last_avail_idx, uint16_t *last_used_idx)
+{
+	struct virtio_vdpa_vring_info *vring = priv->vrings[qix];
+	uint16_t i, slot, used_idx;
+
+	used_idx = vring->hw_idx.last_used_idx;
+	if ((uint16_t)(vring->hw_idx.last_avail_idx - used_idx) != vring->nr_inflight_desc) {
+		DRV_LOG(ERR, "%s virtq %d %u descs in flight, device fetched %u",
+				priv->vdev->device->name, qix, vring->nr_inflight_desc,
+				(uint16_t)(vring->hw_idx.last_avail_idx - used_idx));
+		return -EINVAL;
+	}
+
+	for (i = 0; i < vring->nr_inflight_desc; i++) {
+		slot = (uint16_t)(used_idx + i) & (vq->size - 1);
+		vq->avail->ring[slot] = vring->inflight_desc[i];
+		rte_vhost_log_write(priv->vid, vring->avail +
+				offsetof(struct vring_avail, ring[slot]), sizeof(uint16_t));
+	}
+	rte_smp_wmb();
+
+	*last_avail_idx = used_idx;
+	*last_used_idx = used_idx;
+	return 0;
+}
+
+/*
+ * Indices the device resumes a stopped queue from. By default every request
+ * past the last used entry is fetched again, drivers that track in-flight
+ * requests can narrow this down to the requests really outstanding.
+ * The in-flight list of a device frozen with requests outstanding takes
+ * precedence when one was read back.
+ * Packed rings have no used index in memory, their indices and wrap
+ * counters come from the device state when it was read back, else from vhost.
+ * Called with the queue stopped or the device frozen, the avail slots may
+ * then be rewritten for the device to fetch the outstanding requests.
+ */
+static void
+virtio_vdpa_vring_base_get(struct virtio_vdpa_priv *priv, int qix,
+		struct rte_vhost_vring *vq, uint16_t *last_avail_idx, uint16_t *last_used_idx)
+{
+	if (priv->guest_features & (1ULL << VIRTIO_F_RING_PACKED)) {
+		if (priv->vrings[qix]->hw_idx.flag) {
+			*last_avail_idx = priv->vrings[qix]->hw_idx.last_avail_idx;
+			*last_used_idx = priv->vrings[qix]->hw_idx.last_used_idx;
+		} else if (rte_vhost_get_vring_base(priv->vid, qix, last_avail_idx, last_used_idx)) {
+			DRV_LOG(ERR, "%s virtq %d fail to get vring base",
+					priv->vdev->device->name, qix);
+			*last_avail_idx = 1 << VIRTIO_DEV_PACKED_Q_WRAP_SHIFT;
+			*last_used_idx = 1 << VIRTIO_DEV_PACKED_Q_WRAP_SHIFT;
+		}
+		return;
+	}
+
+	if (priv->vrings[qix]->inflight_desc && priv->vrings[qix]->hw_idx.flag &&
+		!virtio_vdpa_inflight_desc_replay(priv, qix, vq, last_avail_idx, last_used_idx))
+		return;
+
+	if (priv->dev_ops->inflight_recover &&
+		!priv->dev_ops->inflight_recover(priv, qix, last_avail_idx, last_used_idx))
+		return;
+
+	*last_avail_idx = vq->used->idx;
+	*last_used_idx = vq->used->idx;
+}
+
+static int
+virtio_vdpa_inflight_sync_work(struct virtio_vdpa_priv *priv, int idx __rte_unused,
+		void *arg __rte_unused)
+{
+	uint16_t i, nr_virtqs;
+
+	__atomic_store_n(&priv->inflight_sync_queued, false, __ATOMIC_RELEASE);
+	if (!__atomic_load_n(&priv->inflight_sync_on, __ATOMIC_ACQUIRE))
+		return 0;
+
+	nr_virtqs = rte_vhost_get_vring_num(priv->vid);
+	for (i = 0; i < nr_virtqs && i < priv->hw_nr_virtqs; i++) {
+		if (priv->vrings[i]->enable)
+			priv->dev_ops->inflight_sync(priv, i);
+	}
+	return 0;
+}
+
+/* Runs on the interrupt thread, the sync itself goes to the config thread */
+static void
+virtio_vdpa_inflight_sync_alarm(void *arg)
+{
+	struct virtio_vdpa_priv *priv = arg;
+
+	if (!__atomic_load_n(&priv->inflight_sync_on, __ATOMIC_ACQUIRE))
+		return;
+
+	if (!__atomic_exchange_n(&priv->inflight_sync_queued, true, __ATOMIC_ACQ_REL))
+		virtio_vdpa_task_submit(priv, virtio_vdpa_inflight_sync_work, NULL);
+	rte_eal_alarm_set(VIRTIO_VDPA_INFLIGHT_SYNC_INTERVAL_US,
+			virtio_vdpa_inflight_sync_alarm, priv);
+}
+
+static void
+virtio_vdpa_inflight_sync_start(struct virtio_vdpa_priv *priv)
+{
+	if (!priv->dev_ops->inflight_sync)
+		return;
+
+	priv->inflight_sync_queued = false;
+	__atomic_store_n(&priv->inflight_sync_on, true, __ATOMIC_RELEASE);
+	if (rte_eal_alarm_set(VIRTIO_VDPA_INFLIGHT_SYNC_INTERVAL_US,
+			virtio_vdpa_inflight_sync_alarm, priv)) {
+		DRV_LOG(WARNING, "%s failed to start in-flight request sync",
+				priv->vdev->device->name);
+		priv->inflight_sync_on = false;
+	}
+}
+
+/* Caller waits for the device tasks, a queued sync may still be pending */
+static void
+virtio_vdpa_inflight_sync_stop(struct virtio_vdpa_priv *priv)
+{
+	if (!priv->inflight_sync_on)
+		return;
+
+	__atomic_store_n(&priv->inflight_sync_on, false, __ATOMIC_RELEASE);
+	/* Waits for a running alarm */
+	rte_eal_alarm_cancel(virtio_vdpa_inflight_sync_alarm, priv);
+}
+
 static int
 virtio_vdpa_virtq_disable(struct virtio_vdpa_priv *priv, int vq_idx)
 {
+	uint16_t last_avail_idx, last_used_idx;
 	struct rte_vhost_vring vq;
 	int ret;
 
@@ -602,9 +746,10 @@ virtio_vdpa_virtq_disable(struct virtio_vdpa_priv *priv, int vq_idx)
 							priv->vdev->device->name, vq_idx);
 		}
 
+		virtio_vdpa_vring_base_get(priv, vq_idx, &vq, &last_avail_idx, &last_used_idx);
 		DRV_LOG(INFO, "%s virtq %d set hardware idx:%d",
-				priv->vdev->device->name, vq_idx, vq.used->idx);
-		ret = rte_vhost_set_vring_base(priv->vid, vq_idx, vq.used->idx, vq.used->idx);
+				priv->vdev->device->name, vq_idx, last_avail_idx);
+		ret = rte_vhost_set_vring_base(priv->vid, vq_idx, last_avail_idx, last_used_idx);
 		if (ret) {
 			DRV_LOG(ERR, "%s virtq %d fail to set hardware idx",
 							priv->vdev->device->name, vq_idx);
@@ -739,13 +884,10 @@ virtio_vdpa_vring_state_set(int vid, int vq_idx, int state)
 		return 0;
 	}
 
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_START) {
-		DRV_LOG(ERR, "%s is waiting dev close work finish lcore:%d", vdev->device->name, priv->lcore_id);
-		rte_eal_wait_lcore(priv->lcore_id);
-	}
-
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_ERR) {
-		DRV_LOG(ERR, "%s is dev close work had err", vdev->device->name);
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret) {
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+		ret = 0;
 	}
 
 	/* TO_DO: check if vid set here is suitable */
@@ -778,6 +920,50 @@ virtio_vdpa_vring_state_set(int vid, int vq_idx, int state)
 	return 0;
 }
 
+/* Queue setup below only touches the device state of its queue, before
+ * driver ok queues of a device are set up in parallel.
+ */
+static int
+virtio_vdpa_virtq_conf_enable_task(struct virtio_vdpa_priv *priv, int vq_idx,
+		void *arg __rte_unused)
+{
+	if (!priv->vrings[vq_idx]->conf_enable || priv->vrings[vq_idx]->enable)
+		return 0;
+
+	DRV_LOG(DEBUG, "%s enable queue %d in device configure",
+			priv->vdev->device->name, vq_idx);
+	return virtio_vdpa_virtq_enable(priv, vq_idx);
+}
+
+static int
+virtio_vdpa_virtq_close_task(struct virtio_vdpa_priv *priv, int vq_idx,
+		void *arg __rte_unused)
+{
+	uint16_t last_avail_idx, last_used_idx;
+	struct rte_vhost_vring vq;
+	int ret;
+
+	if (!priv->vrings[vq_idx]->enable)
+		return 0;
+
+	virtio_vdpa_virtq_disable(priv, vq_idx);
+	ret = rte_vhost_get_vhost_vring(priv->vid, vq_idx, &vq);
+	if (ret) {
+		DRV_LOG(ERR, "%s virtq %d fail to get hardware idx",
+						priv->vdev->device->name, vq_idx);
+	}
+	virtio_vdpa_vring_base_get(priv, vq_idx, &vq, &last_avail_idx, &last_used_idx);
+	DRV_LOG(INFO, "%s vid %d qid %d set avail idx:%d used idx:%d",
+		priv->vdev->device->name, priv->vid,
+		vq_idx, last_avail_idx, last_used_idx);
+	ret = rte_vhost_set_vring_base(priv->vid, vq_idx, last_avail_idx, last_used_idx);
+	if (ret) {
+		DRV_LOG(ERR, "%s virtq %d fail to set hardware idx",
+						priv->vdev->device->name, vq_idx);
+	}
+	return ret;
+}
+
 static int
 virtio_vdpa_raw_vfio_dma_unmap(int container_fd, uint64_t gpa, uint64_t sz)
 {
@@ -838,6 +1024,12 @@ virtio_vdpa_dev_cleanup(int vid)
 		return -ENODEV;
 	}
 
+	/* Mapping queued by the last set_mem_table must be done before unmap */
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+	priv->dma_map_err = 0;
+
 	priv->dev_conf_read = false;
 
 	/* In case kill -9 qemu */
@@ -947,46 +1139,486 @@ virtio_vdpa_dev_store_mem_tbl(struct virtio_vdpa_priv *priv, struct virtio_vdpa_
 	free(mem);
 }
 
+/* One byte of log bitmap covers 8 pages, ranges must start on a byte */
+#define VIRTIO_VDPA_TRACK_ALIGN (PAGE_SIZE * 8)
+
+static void
+virtio_vdpa_max_track_ranges_get(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_admin_dirty_page_identity_result res;
+
+	if (priv->max_track_ranges)
+		return;
+
+	if (virtio_vdpa_cmd_dirty_page_identity(priv->pf_priv, &res) || !res.max_track_ranges)
+		priv->max_track_ranges = 1;
+	else
+		priv->max_track_ranges = RTE_MIN(res.max_track_ranges,
+				(uint32_t)VIRTIO_VDPA_MAX_MEM_REGIONS);
+	DRV_LOG(INFO, "%s device tracks up to %u ranges", priv->vdev->device->name,
+			priv->max_track_ranges);
+}
+
+/* Build the tracked ranges from guest memory table, so holes are not tracked.
+ * Overlapping ranges are merged, then the closest ones until the device limit.
+ */
 static int
-virtio_vdpa_dev_set_mem_table(int vid)
+virtio_vdpa_track_ranges_build(struct virtio_vdpa_priv *priv,
+		struct virtio_vdpa_track_range *ranges, uint32_t *nr_ranges)
 {
-	uint32_t i = 0;
+	struct rte_vhost_memory *mem = NULL;
+	struct rte_vhost_mem_region *reg;
+	uint64_t start, end, gap, min_gap;
+	uint32_t i, j, n = 0, merge;
 	int ret;
-	struct rte_vhost_memory *cur_mem = NULL;
-	struct virtio_vdpa_vf_drv_mem_region *reg;
-	struct rte_vhost_mem_region *vhost_reg;
-	struct virtio_vdpa_iommu_domain *iommu_domain;
-	struct rte_vdpa_device *vdev = rte_vhost_get_vdpa_device(vid);
-	struct virtio_vdpa_priv *priv =
-		virtio_vdpa_find_priv_resource_by_vdev(vdev);
 
-	if (priv == NULL) {
-		DRV_LOG(ERR, "Invalid vDPA device: %s", vdev->device->name);
-		return -ENODEV;
+	ret = rte_vhost_get_mem_table(priv->vid, &mem);
+	if (ret < 0) {
+		DRV_LOG(ERR, "%s failed to get VM memory layout ret:%d",
+					priv->vdev->device->name, ret);
+		return ret;
 	}
 
-    /* In case of hotplug VM memory */
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_START) {
-		DRV_LOG(ERR, "%s is waiting dev close work finish lcore:%d", vdev->device->name, priv->lcore_id);
-		rte_eal_wait_lcore(priv->lcore_id);
+	for (i = 0; i < RTE_MIN(mem->nregions, (uint32_t)VIRTIO_VDPA_MAX_MEM_REGIONS); i++) {
+		reg = &mem->regions[i];
+		start = RTE_ALIGN_FLOOR(reg->guest_phys_addr, VIRTIO_VDPA_TRACK_ALIGN);
+		end = RTE_ALIGN_CEIL(reg->guest_phys_addr + reg->size, VIRTIO_VDPA_TRACK_ALIGN);
+		for (j = n; j > 0 && ranges[j - 1].addr > start; j--)
+			ranges[j] = ranges[j - 1];
+		ranges[j].addr = start;
+		ranges[j].len = end - start;
+		n++;
+	}
+	free(mem);
+
+	while (n > 1) {
+		min_gap = UINT64_MAX;
+		merge = 0;
+		for (j = 0; j + 1 < n; j++) {
+			end = ranges[j].addr + ranges[j].len;
+			gap = ranges[j + 1].addr > end ? ranges[j + 1].addr - end : 0;
+			if (gap < min_gap) {
+				min_gap = gap;
+				merge = j;
+			}
+		}
+		if (min_gap && n <= priv->max_track_ranges)
+			break;
+		end = RTE_MAX(ranges[merge].addr + ranges[merge].len,
+				ranges[merge + 1].addr + ranges[merge + 1].len);
+		ranges[merge].len = end - ranges[merge].addr;
+		memmove(&ranges[merge + 1], &ranges[merge + 2],
+				(n - merge - 2) * sizeof(ranges[0]));
+		n--;
 	}
 
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_ERR) {
-		DRV_LOG(ERR, "%s is dev close work had err", vdev->device->name);
+	*nr_ranges = n;
+	return 0;
+}
+
+static struct virtio_vdpa_dirty_rate *
+virtio_vdpa_dirty_rate_of(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_vdpa_iommu_domain *iommu_domain = virtio_iommu_domains[priv->iommu_idx];
+
+	return iommu_domain ? &iommu_domain->dirty_rate : NULL;
+}
+
+/* Compare the log bitmap with the last sample: bits set since then were
+ * dirtied by the devices of the VM (or vhost), bits cleared since then were
+ * collected by QEMU. Scanning a big log takes long, it runs on config thread.
+ */
+static int
+virtio_vdpa_dirty_rate_sample_work(struct virtio_vdpa_priv *priv, int idx __rte_unused,
+		void *arg)
+{
+	struct virtio_vdpa_dirty_rate *dr = arg;
+	const uint64_t *log;
+	uint64_t i, cur, old, dirtied = 0, drained = 0;
+	uint64_t now;
+	double dt, dirty_pps, drain_pps;
+
+	__atomic_store_n(&dr->queued, false, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&dr->scan_lock);
+	/* Stopped or handed over, log of this VF may be unmapped already */
+	if (dr->owner != priv) {
+		pthread_mutex_unlock(&dr->scan_lock);
+		return 0;
 	}
 
-	priv->vid = vid;
-	ret = rte_vhost_get_mem_table(priv->vid, &cur_mem);
+	log = (const uint64_t *)(uintptr_t)dr->log_base;
+	for (i = 0; i < dr->nr_words; i++) {
+		cur = __atomic_load_n(&log[i], __ATOMIC_RELAXED);
+		old = dr->shadow[i];
+		if (cur == old)
+			continue;
+		dirtied += __builtin_popcountll(cur & ~old);
+		drained += __builtin_popcountll(old & ~cur);
+		dr->shadow[i] = cur;
+	}
+
+	now = rte_get_tsc_cycles();
+	dt = (double)(now - dr->last_tsc) / rte_get_tsc_hz();
+	dirty_pps = dirtied / dt;
+	drain_pps = drained / dt;
+
+	rte_spinlock_lock(&dr->lock);
+	dr->pending_pages = dr->pending_pages + dirtied - drained;
+	dr->dirtied_pages += dirtied;
+	/* EWMA 1/4 to smooth QEMU sync bursts */
+	dr->dirty_pps = (dr->dirty_pps * 3 + dirty_pps) / 4;
+	dr->drain_pps = (dr->drain_pps * 3 + drain_pps) / 4;
+	dr->last_tsc = now;
+	rte_spinlock_unlock(&dr->lock);
+	pthread_mutex_unlock(&dr->scan_lock);
+	return 0;
+}
+
+static void
+virtio_vdpa_dirty_rate_alarm(void *arg)
+{
+	struct virtio_vdpa_dirty_rate *dr = arg;
+	struct virtio_vdpa_priv *owner;
+
+	rte_spinlock_lock(&dr->lock);
+	owner = dr->owner;
+	rte_spinlock_unlock(&dr->lock);
+	if (!owner)
+		return;
+	/* Config thread behind, skip instead of piling up samples */
+	if (!__atomic_exchange_n(&dr->queued, true, __ATOMIC_ACQ_REL))
+		virtio_vdpa_task_submit(owner, virtio_vdpa_dirty_rate_sample_work, dr);
+	rte_eal_alarm_set(VIRTIO_VDPA_DIRTY_RATE_INTERVAL_US,
+			virtio_vdpa_dirty_rate_alarm, dr);
+}
+
+/* Must be called before the log is unmapped */
+static void
+virtio_vdpa_dirty_rate_stop(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_vdpa_dirty_rate *dr;
+	struct virtio_vdpa_priv *p, *owner = NULL;
+	uint64_t *shadow = NULL;
+
+	if (!priv->dirty_rate_user)
+		return;
+	dr = virtio_vdpa_dirty_rate_of(priv);
+
+	/* Waits for a running sample, queued ones see the new owner */
+	pthread_mutex_lock(&dr->scan_lock);
+	priv->dirty_rate_user = false;
+	if (dr->owner != priv) {
+		pthread_mutex_unlock(&dr->scan_lock);
+		return;
+	}
+
+	/* Waits for a running alarm, it may be submitting a sample to this VF */
+	rte_eal_alarm_cancel(virtio_vdpa_dirty_rate_alarm, dr);
+
+	/* Go on from the log mapping of another tracking VF of the VM */
+	pthread_mutex_lock(&priv_list_lock);
+	TAILQ_FOREACH(p, &virtio_priv_list, next) {
+		if (p != priv && p->iommu_idx == priv->iommu_idx && p->dirty_rate_user &&
+			p->log_size / sizeof(uint64_t) == dr->nr_words) {
+			owner = p;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&priv_list_lock);
+
+	rte_spinlock_lock(&dr->lock);
+	dr->owner = owner;
+	if (owner) {
+		dr->log_base = owner->log_base;
+	} else {
+		shadow = dr->shadow;
+		dr->shadow = NULL;
+	}
+	rte_spinlock_unlock(&dr->lock);
+
+	if (owner && rte_eal_alarm_set(VIRTIO_VDPA_DIRTY_RATE_INTERVAL_US,
+			virtio_vdpa_dirty_rate_alarm, dr))
+		DRV_LOG(WARNING, "%s failed to hand over dirty rate sampling",
+				priv->vdev->device->name);
+	pthread_mutex_unlock(&dr->scan_lock);
+	rte_free(shadow);
+}
+
+static void
+virtio_vdpa_dirty_rate_start(struct virtio_vdpa_priv *priv, uint64_t log_base, uint64_t log_size)
+{
+	struct virtio_vdpa_dirty_rate *dr = virtio_vdpa_dirty_rate_of(priv);
+	uint64_t nr_words = log_size / sizeof(uint64_t);
+	uint64_t *shadow;
+
+	if (!dr || priv->dirty_rate_user)
+		return;
+
+	pthread_mutex_lock(&dr->scan_lock);
+	/* Another VF of the VM samples the same log already */
+	if (dr->owner && dr->nr_words == nr_words)
+		goto out;
+
+	/* Rate estimation is best effort, tracking goes on without it */
+	shadow = rte_zmalloc("virtio vdpa dirty rate", nr_words * sizeof(uint64_t), 0);
+	if (!shadow) {
+		DRV_LOG(WARNING, "%s no memory to sample dirty rate", priv->vdev->device->name);
+		pthread_mutex_unlock(&dr->scan_lock);
+		return;
+	}
+
+	/* First VF of the VM to track, or QEMU moved to a resized log */
+	rte_eal_alarm_cancel(virtio_vdpa_dirty_rate_alarm, dr);
+	rte_free(dr->shadow);
+	rte_spinlock_lock(&dr->lock);
+	dr->shadow = shadow;
+	dr->owner = priv;
+	dr->nr_words = nr_words;
+	dr->log_base = log_base;
+	dr->last_tsc = rte_get_tsc_cycles();
+	dr->dirtied_pages = 0;
+	dr->pending_pages = 0;
+	dr->dirty_pps = 0;
+	dr->drain_pps = 0;
+	dr->queued = false;
+	rte_spinlock_unlock(&dr->lock);
+
+	if (rte_eal_alarm_set(VIRTIO_VDPA_DIRTY_RATE_INTERVAL_US,
+			virtio_vdpa_dirty_rate_alarm, dr)) {
+		DRV_LOG(WARNING, "%s failed to start dirty rate sampling", priv->vdev->device->name);
+		rte_spinlock_lock(&dr->lock);
+		dr->owner = NULL;
+		dr->shadow = NULL;
+		rte_spinlock_unlock(&dr->lock);
+		pthread_mutex_unlock(&dr->scan_lock);
+		rte_free(shadow);
+		return;
+	}
+out:
+	priv->dirty_rate_user = true;
+	pthread_mutex_unlock(&dr->scan_lock);
+}
+
+/* Rates are those of the whole VM the VF belongs to */
+static void
+virtio_vdpa_dirty_rate_get(struct virtio_vdpa_priv *priv, struct vdpa_vf_params *vf_info)
+{
+	struct virtio_vdpa_dirty_rate *dr = virtio_vdpa_dirty_rate_of(priv);
+
+	vf_info->logging = priv->dirty_rate_user;
+	if (!dr || !vf_info->logging)
+		return;
+
+	rte_spinlock_lock(&dr->lock);
+	vf_info->dirty_rate = dr->dirty_pps;
+	vf_info->dirty_pending = dr->pending_pages * PAGE_SIZE;
+	if (dr->drain_pps > dr->dirty_pps)
+		vf_info->dirty_eta_ms = dr->pending_pages * 1000 / (dr->drain_pps - dr->dirty_pps);
+	else
+		vf_info->dirty_eta_ms = dr->pending_pages ? -1 : 0;
+	rte_spinlock_unlock(&dr->lock);
+}
+
+static int
+virtio_vdpa_track_range_start(struct virtio_vdpa_priv *priv,
+		const struct virtio_vdpa_track_range *range)
+{
+	uint64_t off = range->addr / VIRTIO_VDPA_TRACK_ALIGN;
+	struct virtio_sge lb_sge;
+	uint64_t len;
+	int ret;
+
+	if (off >= priv->log_size) {
+		DRV_LOG(ERR, "%s range 0x%" PRIx64 " beyond log size 0x%" PRIx64,
+				priv->vdev->device->name, range->addr, priv->log_size);
+		return -EINVAL;
+	}
+
+	/* Only the part of the range the log has bits for is tracked */
+	lb_sge.addr = priv->log_iova + off;
+	lb_sge.len = RTE_MIN(range->len / VIRTIO_VDPA_TRACK_ALIGN, priv->log_size - off);
+	len = (uint64_t)lb_sge.len * VIRTIO_VDPA_TRACK_ALIGN;
+	ret = virtio_vdpa_cmd_dirty_page_start_track(priv->pf_priv, priv->vf_id,
+			VIRTIO_M_DIRTY_TRACK_PUSH_BITMAP, PAGE_SIZE, range->addr, len,
+			1, &lb_sge);
+	if (ret)
+		DRV_LOG(ERR, "%s vfid %d failed to track range 0x%" PRIx64 " len 0x%" PRIx64 " ret:%d",
+				priv->vdev->device->name, priv->vf_id, range->addr, len, ret);
+	return ret;
+}
+
+static void
+virtio_vdpa_track_range_stop(struct virtio_vdpa_priv *priv,
+		const struct virtio_vdpa_track_range *range)
+{
+	int ret;
+
+	ret = virtio_vdpa_cmd_dirty_page_stop_track(priv->pf_priv, priv->vf_id, range->addr);
+	if (ret)
+		DRV_LOG(ERR, "%s failed to stop track range 0x%" PRIx64 " ret:%d",
+					priv->vdev->device->name, range->addr, ret);
+}
+
+static bool
+virtio_vdpa_track_range_find(const struct virtio_vdpa_track_range *ranges, uint32_t nr,
+		const struct virtio_vdpa_track_range *range)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (ranges[i].addr == range->addr && ranges[i].len == range->len)
+			return true;
+	}
+	return false;
+}
+
+/* The device writes dirty bits to the vhost log, map it for DMA */
+static int
+virtio_vdpa_log_dma_map(struct virtio_vdpa_priv *priv, uint64_t log_base, uint64_t log_size)
+{
+	uint64_t log_size_align = RTE_ROUNDUP(log_size, getpagesize());
+	rte_iova_t iova;
+	int ret;
+
+	iova = rte_mem_virt2iova((void *)log_base);
+	if (iova == RTE_BAD_IOVA) {
+		DRV_LOG(ERR, "%s log get iova failed", priv->vdev->device->name);
+		return -EINVAL;
+	}
+	DRV_LOG(INFO, "log buffer %" PRIx64 " iova %" PRIx64 " log size %" PRIx64
+				" log size align %" PRIx64,
+				log_base, iova, log_size, log_size_align);
+
+	ret = rte_vfio_container_dma_map(RTE_VFIO_DEFAULT_CONTAINER_FD, log_base,
+					 iova, log_size_align);
 	if (ret < 0) {
-		DRV_LOG(ERR, "%s failed to get VM memory layout ret:%d",
+		DRV_LOG(ERR, "%s log buffer DMA map failed ret:%d",
 					priv->vdev->device->name, ret);
 		return ret;
 	}
 
+	priv->log_base = log_base;
+	priv->log_size = log_size;
+	priv->log_iova = iova;
+	return 0;
+}
+
+/* vhost may have unmapped the log already, use what was mapped */
+static void
+virtio_vdpa_log_dma_unmap(struct virtio_vdpa_priv *priv)
+{
+	int ret;
+
+	if (!priv->log_size)
+		return;
+
+	ret = rte_vfio_container_dma_unmap(RTE_VFIO_DEFAULT_CONTAINER_FD, priv->log_base,
+			priv->log_iova, RTE_ROUNDUP(priv->log_size, getpagesize()));
+	if (ret < 0)
+		DRV_LOG(ERR, "%s log buffer DMA unmap failed ret:%d",
+					priv->vdev->device->name, ret);
+	priv->log_base = 0;
+	priv->log_size = 0;
+	priv->log_iova = 0;
+}
+
+static void
+virtio_vdpa_logging_abort(struct virtio_vdpa_priv *priv)
+{
+	uint32_t i;
+
+	virtio_vdpa_dirty_rate_stop(priv);
+	for (i = 0; i < priv->nr_track_ranges; i++)
+		virtio_vdpa_track_range_stop(priv, &priv->track_ranges[i]);
+	priv->nr_track_ranges = 0;
+	virtio_vdpa_log_dma_unmap(priv);
+	priv->log_started = false;
+}
+
+/*
+ * Guest memory layout or vhost log changed under migration. Ranges are
+ * re-armed when they changed, all of them when the log moved. Logging is
+ * aborted if any range cannot be tracked, as its pages would be missed.
+ */
+static int
+virtio_vdpa_track_ranges_update(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_vdpa_track_range ranges[VIRTIO_VDPA_MAX_MEM_REGIONS];
+	uint64_t log_base, log_size;
+	uint32_t i, nr_ranges, nr_kept;
+	int ret;
+
+	ret = rte_vhost_get_log_base(priv->vid, &log_base, &log_size);
+	if (ret) {
+		DRV_LOG(ERR, "%s failed to get log base", priv->vdev->device->name);
+		goto abort;
+	}
+
+	ret = virtio_vdpa_track_ranges_build(priv, ranges, &nr_ranges);
+	if (ret)
+		goto abort;
+
+	if (log_base != priv->log_base || log_size != priv->log_size) {
+		virtio_vdpa_dirty_rate_stop(priv);
+		for (i = 0; i < priv->nr_track_ranges; i++)
+			virtio_vdpa_track_range_stop(priv, &priv->track_ranges[i]);
+		priv->nr_track_ranges = 0;
+		virtio_vdpa_log_dma_unmap(priv);
+		ret = virtio_vdpa_log_dma_map(priv, log_base, log_size);
+		if (ret)
+			goto abort;
+	} else {
+		for (i = 0, nr_kept = 0; i < priv->nr_track_ranges; i++) {
+			if (!virtio_vdpa_track_range_find(ranges, nr_ranges, &priv->track_ranges[i]))
+				virtio_vdpa_track_range_stop(priv, &priv->track_ranges[i]);
+			else
+				priv->track_ranges[nr_kept++] = priv->track_ranges[i];
+		}
+		priv->nr_track_ranges = nr_kept;
+	}
+
+	nr_kept = priv->nr_track_ranges;
+	for (i = 0; i < nr_ranges; i++) {
+		if (virtio_vdpa_track_range_find(priv->track_ranges, nr_kept, &ranges[i]))
+			continue;
+		ret = virtio_vdpa_track_range_start(priv, &ranges[i]);
+		if (ret)
+			goto abort;
+		priv->track_ranges[priv->nr_track_ranges++] = ranges[i];
+	}
+
+	virtio_vdpa_dirty_rate_start(priv, priv->log_base, priv->log_size);
+	DRV_LOG(INFO, "%s vfid %d re-armed dirty track on %u ranges",
+			priv->vdev->device->name, priv->vf_id, nr_ranges);
+	return 0;
+
+abort:
+	DRV_LOG(ERR, "%s vfid %d dirty track lost, logging aborted ret:%d",
+			priv->vdev->device->name, priv->vf_id, ret);
+	virtio_vdpa_logging_abort(priv);
+	return ret;
+}
+
+/* Pinning guest memory takes long for big VMs, run on config thread with a
+ * copy of the vhost memory table taken when the message came.
+ */
+static int
+virtio_vdpa_dev_dma_map_work(struct virtio_vdpa_priv *priv, int idx __rte_unused, void *arg)
+{
+	uint32_t i = 0;
+	int ret = 0;
+	struct rte_vhost_memory *cur_mem = arg;
+	struct virtio_vdpa_vf_drv_mem_region *reg;
+	struct rte_vhost_mem_region *vhost_reg;
+	struct virtio_vdpa_iommu_domain *iommu_domain;
+	struct rte_vdpa_device *vdev = priv->vdev;
+
 	pthread_mutex_lock(&iommu_domain_locks[priv->iommu_idx]);
 	iommu_domain = virtio_iommu_domains[priv->iommu_idx];
-	if (iommu_domain == NULL)
+	if (iommu_domain == NULL) {
+		free(cur_mem);
 		goto err;
+	}
 	/* Unmap region does not exist in current */
 	for (i = 0; i < iommu_domain->mem.nregions; i++) {
 		reg = &iommu_domain->mem.regions[i];
@@ -1057,6 +1689,7 @@ virtio_vdpa_dev_set_mem_table(int vid)
 
 	iommu_domain->mem.nregions = cur_mem->nregions;
 	free(cur_mem);
+	ret = 0;
 
 	if (priv->tbl_recovering) {
 		iommu_domain->tbl_recover_cnt--;
@@ -1069,20 +1702,66 @@ virtio_vdpa_dev_set_mem_table(int vid)
 	}
 
 	virtio_vdpa_dev_store_mem_tbl(priv, iommu_domain);
+	pthread_mutex_unlock(&iommu_domain_locks[priv->iommu_idx]);
+	priv->dma_map_err = ret;
+	return ret;
 
 err:
 	pthread_mutex_unlock(&iommu_domain_locks[priv->iommu_idx]);
+	priv->dma_map_err = ret;
 	return ret;
 }
 
+static int
+virtio_vdpa_dev_set_mem_table(int vid)
+{
+	struct rte_vhost_memory *cur_mem = NULL;
+	struct rte_vdpa_device *vdev = rte_vhost_get_vdpa_device(vid);
+	struct virtio_vdpa_priv *priv =
+		virtio_vdpa_find_priv_resource_by_vdev(vdev);
+	int ret;
+
+	if (priv == NULL) {
+		DRV_LOG(ERR, "Invalid vDPA device: %s", vdev->device->name);
+		return -ENODEV;
+	}
+
+	priv->vid = vid;
+	ret = rte_vhost_get_mem_table(priv->vid, &cur_mem);
+	if (ret < 0) {
+		DRV_LOG(ERR, "%s failed to get VM memory layout ret:%d",
+					priv->vdev->device->name, ret);
+		return ret;
+	}
+
+	/* Runs after a pending close work of the device, dev_conf waits for it */
+	ret = virtio_vdpa_task_submit(priv, virtio_vdpa_dev_dma_map_work, cur_mem);
+	if (ret || !(priv->configured || priv->log_started))
+		return ret;
+
+	/* Running device may DMA to new memory as soon as the message is acked,
+	 * and pages it dirties there must be tracked by then.
+	 */
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+	if (priv->dma_map_err)
+		return priv->dma_map_err;
+
+	if (!priv->log_started)
+		return 0;
+	/* Guest memory is mapped even if dirty logging had to be aborted */
+	virtio_vdpa_track_ranges_update(priv);
+	return 0;
+}
+
 static int
 virtio_vdpa_start_logging(struct virtio_vdpa_priv *priv)
 {
-	uint64_t log_base, log_size, max_phy, log_size_align;
-	rte_iova_t iova;
-	struct virtio_sge lb_sge;
+	uint64_t log_base, log_size;
 	struct timeval start, end;
 	uint64_t time_used;
+	uint32_t i;
 	int ret;
 
 	if (priv->log_started) {
@@ -1100,103 +1779,52 @@ virtio_vdpa_start_logging(struct virtio_vdpa_priv *priv)
 		return ret;
 	}
 
-	iova = rte_mem_virt2iova((void *)log_base);
-	if (iova == RTE_BAD_IOVA) {
-		DRV_LOG(ERR, "%s log get iova failed ret:%d",
-					priv->vdev->device->name, ret);
-		return ret;
-	}
-	log_size_align = RTE_ROUNDUP(log_size, getpagesize());
-	DRV_LOG(INFO, "log buffer %" PRIx64 " iova %" PRIx64 " log size %" PRIx64
-				" log size align %" PRIx64,
-				log_base, iova, log_size, log_size_align);
-
-	ret = rte_vfio_container_dma_map(RTE_VFIO_DEFAULT_CONTAINER_FD, log_base,
-					 iova, log_size_align);
-	if (ret < 0) {
-		DRV_LOG(ERR, "%s log buffer DMA map failed ret:%d",
-					priv->vdev->device->name, ret);
+	ret = virtio_vdpa_log_dma_map(priv, log_base, log_size);
+	if (ret)
 		return ret;
-	}
 
-	lb_sge.addr = log_base;
-	lb_sge.len = log_size;
-	ret = virtio_vdpa_max_phy_addr_get(priv, &max_phy);
-
-	if (ret) {
-		DRV_LOG(ERR, "%s failed to get max phy addr", priv->vdev->device->name);
+	virtio_vdpa_max_track_ranges_get(priv);
+	ret = virtio_vdpa_track_ranges_build(priv, priv->track_ranges, &priv->nr_track_ranges);
+	if (ret)
 		goto error_unmap;
+
+	for (i = 0; i < priv->nr_track_ranges; i++) {
+		ret = virtio_vdpa_track_range_start(priv, &priv->track_ranges[i]);
+		if (ret) {
+			while (i--)
+				virtio_vdpa_track_range_stop(priv, &priv->track_ranges[i]);
+			priv->nr_track_ranges = 0;
+			goto error_unmap;
+		}
 	}
 
-	ret = virtio_vdpa_cmd_dirty_page_start_track(priv->pf_priv, priv->vf_id,
-			VIRTIO_M_DIRTY_TRACK_PUSH_BITMAP, PAGE_SIZE, 0, max_phy, 1, &lb_sge);
-	if (!ret)
-		priv->log_started = true;
+	priv->log_started = true;
+	virtio_vdpa_dirty_rate_start(priv, log_base, log_size);
 
 	gettimeofday(&end, NULL);
 	time_used = (end.tv_sec - start.tv_sec) * 1e6 + end.tv_usec - start.tv_usec;
-	DRV_LOG(INFO, "%s vfid %d start track max phy:%" PRIx64 "log_base %" PRIx64
-			"log_size %" PRIx64 "at %lu.%06lu took %lu us.",
-			priv->vdev->device->name, priv->vf_id, max_phy ,
+	DRV_LOG(INFO, "%s vfid %d start track %u ranges log_base %" PRIx64
+			" log_size %" PRIx64 " at %lu.%06lu took %lu us.",
+			priv->vdev->device->name, priv->vf_id, priv->nr_track_ranges,
 			log_base, log_size, end.tv_sec, end.tv_usec, time_used);
-	return ret;
+	return 0;
 
 error_unmap:
-	rte_vfio_container_dma_unmap(RTE_VFIO_DEFAULT_CONTAINER_FD, log_base,
-					 iova, log_size_align);
+	virtio_vdpa_log_dma_unmap(priv);
 	return ret;
 }
 
 static int
 virtio_vdpa_stop_logging(struct virtio_vdpa_priv *priv)
 {
-	uint64_t max_phy, log_base, log_size, log_size_align;
-	rte_iova_t iova;
-	int ret;
-
 	if (!priv->log_started) {
 		return 0;
 	}
 
-	ret = virtio_vdpa_max_phy_addr_get(priv, &max_phy);
-	if (ret) {
-		DRV_LOG(ERR, "%s failed to get max phy addr",
-					priv->vdev->device->name);
-	}
-
-	ret = virtio_vdpa_cmd_dirty_page_stop_track(priv->pf_priv, priv->vf_id, max_phy);
-	if (ret) {
-		DRV_LOG(ERR, "%s failed to stop track max_phy %" PRIx64 " ret:%d",
-					priv->vdev->device->name, max_phy, ret);
-	}
-
-	ret = rte_vhost_get_log_base(priv->vid, &log_base, &log_size);
-	if (ret) {
-		DRV_LOG(ERR, "%s failed to get log base",
-					priv->vdev->device->name);
-	}
-
-	DRV_LOG(INFO, "%s vfid %d stop track max phy:%" PRIx64 "log_base %" PRIx64 "log_size %" PRIx64,
-				priv->vdev->device->name, priv->vf_id, max_phy , log_base, log_size);
-
-	iova = rte_mem_virt2iova((void *)log_base);
-	if (iova == RTE_BAD_IOVA) {
-		DRV_LOG(ERR, "%s log get iova failed ret:%d",
-					priv->vdev->device->name, ret);
-	}
-
-	log_size_align = RTE_ROUNDUP(log_size, getpagesize());
-	DRV_LOG(INFO, "log buffer %" PRIx64 " iova %" PRIx64 " log size align %" PRIx64,
-			log_base, iova, log_size_align);
-
-	ret = rte_vfio_container_dma_unmap(RTE_VFIO_DEFAULT_CONTAINER_FD, log_base,
-					 iova, log_size_align);
-	if (ret < 0) {
-		DRV_LOG(ERR, "%s log buffer DMA map failed ret:%d",
-					priv->vdev->device->name, ret);
-	}
-	priv->log_started = false;
-	return ret;
+	DRV_LOG(INFO, "%s vfid %d stop track log_base %" PRIx64 " log_size %" PRIx64,
+				priv->vdev->device->name, priv->vf_id, priv->log_base, priv->log_size);
+	virtio_vdpa_logging_abort(priv);
+	return 0;
 }
 
 static int
@@ -1213,14 +1841,9 @@ virtio_vdpa_features_set(int vid)
 		return -ENODEV;
 	}
 
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_START) {
-		DRV_LOG(ERR, "%s is waiting dev close work finish lcore:%d", vdev->device->name, priv->lcore_id);
-		rte_eal_wait_lcore(priv->lcore_id);
-	}
-
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_ERR) {
-		DRV_LOG(ERR, "%s is dev close work had err", vdev->device->name);
-	}
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
 
 	priv->vid = vid;
 	ret = rte_vhost_get_negotiated_features(vid, &features);
@@ -1260,13 +1883,13 @@ virtio_vdpa_features_set(int vid)
 }
 
 static int
-virtio_vdpa_dev_close_work(void *arg)
+virtio_vdpa_dev_close_work(struct virtio_vdpa_priv *priv, int idx __rte_unused,
+		void *arg __rte_unused)
 {
-	struct virtio_vdpa_priv *priv = arg;
 	void *status;
 	int ret;
 
-	DRV_LOG(INFO, "%s vfid %d dev close work of lcore:%d start", priv->vdev->device->name, priv->vf_id, priv->lcore_id);
+	DRV_LOG(INFO, "%s vfid %d dev close work start", priv->vdev->device->name, priv->vf_id);
 	if (priv->is_notify_thread_started) {
 		ret = pthread_join(priv->notify_tid, &status);
 		if (ret) {
@@ -1278,12 +1901,10 @@ virtio_vdpa_dev_close_work(void *arg)
 	ret = virtio_vdpa_cmd_restore_state(priv->pf_priv, priv->vf_id, 0, priv->state_size, priv->state_mz->iova);
 	if (ret) {
 		DRV_LOG(ERR, "%s vfid %d failed restore state ret:%d", priv->vdev->device->name, priv->vf_id, ret);
-		priv->dev_work_flag = VIRTIO_VDPA_DEV_CLOSE_WORK_ERR;
 		return ret;
 	}
 
-	DRV_LOG(INFO, "%s vfid %d dev close work of lcore:%d finish", priv->vdev->device->name, priv->vf_id, priv->lcore_id);
-	priv->dev_work_flag = VIRTIO_VDPA_DEV_CLOSE_WORK_DONE;
+	DRV_LOG(INFO, "%s vfid %d dev close work finish", priv->vdev->device->name, priv->vf_id);
 	return ret;
 }
 
@@ -1350,6 +1971,206 @@ virtio_vdpa_save_state(struct virtio_vdpa_priv *priv)
 	return ret;
 }
 
+/* Keep the packed ring indexes of a saved device state for the next resync */
+static void
+virtio_vdpa_hw_idx_load(struct virtio_vdpa_priv *priv, void *state, uint32_t state_size)
+{
+	struct virtio_dev_run_state_info *hw_idx;
+	uint16_t i, nr_vq = priv->hw_nr_virtqs;
+
+	hw_idx = rte_zmalloc(NULL, sizeof(*hw_idx) * nr_vq, 0);
+	if (!hw_idx) {
+		DRV_LOG(ERR, "%s failed to alloc hw idx", priv->vdev->device->name);
+		return;
+	}
+
+	if (virtio_pci_dev_state_hw_idx_get(state, state_size, hw_idx, nr_vq))
+		DRV_LOG(ERR, "%s failed to parse hw idx from state", priv->vdev->device->name);
+	else
+		for (i = 0; i < nr_vq; i++)
+			priv->vrings[i]->hw_idx = hw_idx[i];
+
+	rte_free(hw_idx);
+}
+
+static void
+virtio_vdpa_hw_idx_clear(struct virtio_vdpa_priv *priv)
+{
+	uint16_t i;
+
+	for (i = 0; i < priv->hw_nr_virtqs; i++) {
+		priv->vrings[i]->hw_idx.flag = false;
+		rte_free(priv->vrings[i]->inflight_desc);
+		priv->vrings[i]->inflight_desc = NULL;
+		priv->vrings[i]->nr_inflight_desc = 0;
+	}
+}
+
+/* Bytes the device may have written to the buffers of a chain */
+static uint32_t
+virtio_vdpa_desc_write_len(struct rte_vhost_vring *vq, struct rte_vhost_memory *mem,
+		uint16_t head)
+{
+	struct vring_desc *desc = vq->desc;
+	uint32_t len = 0, nr_desc = vq->size, cnt = 0;
+	uint64_t tbl_len;
+	uint16_t idx = head;
+
+	if (desc[idx].flags & VRING_DESC_F_INDIRECT) {
+		tbl_len = desc[idx].len;
+		nr_desc = tbl_len / sizeof(*desc);
+		desc = (struct vring_desc *)(uintptr_t)rte_vhost_va_from_guest_pa(mem,
+				desc[idx].addr, &tbl_len);
+		if (!desc || tbl_len < nr_desc * sizeof(*desc))
+			return 0;
+		idx = 0;
+	}
+
+	while (cnt++ < nr_desc && idx < nr_desc) {
+		if (desc[idx].flags & VRING_DESC_F_WRITE)
+			len += desc[idx].len;
+		if (!(desc[idx].flags & VRING_DESC_F_NEXT))
+			break;
+		idx = desc[idx].next;
+	}
+
+	return len;
+}
+
+/*
+ * Requests the device finished before freezing but did not mark as used yet,
+ * their data is already in guest memory and only the used entries are missing.
+ * The state does not carry the written length, so this is only done for
+ * queues whose driver does not rely on it.
+ */
+static void
+virtio_vdpa_completed_desc_publish(struct virtio_vdpa_priv *priv, int qix,
+		struct rte_vhost_memory *mem, uint16_t *desc_idx, uint16_t num)
+{
+	struct virtio_vdpa_vring_info *vring = priv->vrings[qix];
+	struct rte_vhost_vring vq;
+	uint16_t i, slot, used_idx;
+
+	if (rte_vhost_get_vhost_vring(priv->vid, qix, &vq) || !vq.used)
+		return;
+
+	used_idx = vring->hw_idx.last_used_idx;
+	for (i = 0; i < num; i++) {
+		if (desc_idx[i] >= vq.size) {
+			DRV_LOG(ERR, "%s virtq %d completed desc %u out of ring",
+					priv->vdev->device->name, qix, desc_idx[i]);
+			break;
+		}
+		slot = (uint16_t)(used_idx + i) & (vq.size - 1);
+		vq.used->ring[slot].id = desc_idx[i];
+		vq.used->ring[slot].len = virtio_vdpa_desc_write_len(&vq, mem, desc_idx[i]);
+		rte_vhost_log_used_vring(priv->vid, qix, offsetof(struct vring_used, ring[slot]),
+				sizeof(vq.used->ring[slot]));
+	}
+	if (!i)
+		return;
+
+	used_idx += i;
+	__atomic_store_n(&vq.used->idx, used_idx, __ATOMIC_RELEASE);
+	rte_vhost_log_used_vring(priv->vid, qix, offsetof(struct vring_used, idx),
+			sizeof(vq.used->idx));
+	vring->hw_idx.last_used_idx = used_idx;
+	rte_vhost_vring_call(priv->vid, qix);
+
+	DRV_LOG(INFO, "%s virtq %d published %u completed descs, used idx %u",
+			priv->vdev->device->name, qix, i, used_idx);
+}
+
+/*
+ * A device may be frozen with requests still outstanding in the backend,
+ * it then reports them in its state instead of waiting for them to drain.
+ */
+static void
+virtio_vdpa_desc_lists_load(struct virtio_vdpa_priv *priv, void *state, uint32_t state_size)
+{
+	struct virtio_dev_state_index idx;
+	struct rte_vhost_memory *mem = NULL;
+	struct virtio_vdpa_vring_info *vring;
+	uint16_t *desc_idx;
+	uint16_t qix, nr_refetch;
+	int num;
+
+	if (virtio_pci_dev_state_index_build(state, state_size, &idx)) {
+		DRV_LOG(ERR, "%s failed to index state", priv->vdev->device->name);
+		return;
+	}
+
+	for (qix = 0; qix < RTE_MIN(priv->hw_nr_virtqs, idx.nr_queues); qix++) {
+		vring = priv->vrings[qix];
+		if (!vring->enable || !vring->hw_idx.flag || !vring->size)
+			continue;
+
+		desc_idx = rte_zmalloc(NULL, vring->size * sizeof(*desc_idx), 0);
+		if (!desc_idx) {
+			DRV_LOG(ERR, "%s virtq %d failed to alloc desc list",
+					priv->vdev->device->name, qix);
+			break;
+		}
+
+		num = virtio_pci_dev_state_desc_list_get(&idx, VIRTIO_DEV_COMPLETED_DESC,
+				qix, desc_idx, vring->size);
+		nr_refetch = 0;
+		if (num > 0 && priv->dev_ops->used_len_needed &&
+			priv->dev_ops->used_len_needed(qix)) {
+			/* The state has no length, have the device redo them first */
+			nr_refetch = num;
+		} else if (num > 0) {
+			if (!mem && rte_vhost_get_mem_table(priv->vid, &mem))
+				mem = NULL;
+			if (mem)
+				virtio_vdpa_completed_desc_publish(priv, qix, mem, desc_idx, num);
+		} else if (num < 0) {
+			DRV_LOG(ERR, "%s virtq %d bad completed desc list ret:%d",
+					priv->vdev->device->name, qix, num);
+		}
+
+		num = virtio_pci_dev_state_desc_list_get(&idx, VIRTIO_DEV_IN_FLIGHT_DESC,
+				qix, desc_idx + nr_refetch, vring->size - nr_refetch);
+		if (num < 0) {
+			DRV_LOG(ERR, "%s virtq %d bad in-flight desc list ret:%d",
+					priv->vdev->device->name, qix, num);
+			num = 0;
+		}
+		num += nr_refetch;
+		if (num > 0) {
+			vring->inflight_desc = desc_idx;
+			vring->nr_inflight_desc = num;
+			DRV_LOG(INFO, "%s virtq %d %d descs in flight at freeze, %u of them completed",
+					priv->vdev->device->name, qix, num, nr_refetch);
+			continue;
+		}
+		rte_free(desc_idx);
+	}
+
+	free(mem);
+	virtio_pci_dev_state_index_free(&idx);
+}
+
+/* Read back the state of the frozen device to resync the rings from it,
+ * once per freeze, nothing changed when the device was frozen already.
+ */
+static void
+virtio_vdpa_frozen_state_load(struct virtio_vdpa_priv *priv)
+{
+	if (!priv->frozen_state)
+		return;
+	priv->frozen_state = false;
+
+	if (virtio_vdpa_save_state(priv))
+		return;
+
+	virtio_vdpa_hw_idx_load(priv, priv->state_mz_remote->addr,
+			priv->state_mz_remote->len);
+	if (!(priv->guest_features & (1ULL << VIRTIO_F_RING_PACKED)))
+		virtio_vdpa_desc_lists_load(priv, priv->state_mz_remote->addr,
+				priv->state_mz_remote->len);
+}
+
 static int
 virtio_vdpa_dev_state_run(struct virtio_vdpa_priv *priv)
 {
@@ -1377,6 +2198,7 @@ virtio_vdpa_dev_state_run(struct virtio_vdpa_priv *priv)
 		return -rte_errno;
 	}
 	priv->lm_status = VIRTIO_S_RUNNING;
+	priv->frozen_state = false;
 
 	return 0;
 }
@@ -1409,6 +2231,7 @@ virtio_vdpa_dev_state_freeze(struct virtio_vdpa_priv *priv)
 		return -rte_errno;
 	}
 	priv->lm_status = VIRTIO_S_FREEZED;
+	priv->frozen_state = true;
 
 	return 0;
 }
@@ -1419,13 +2242,12 @@ virtio_vdpa_dev_close(int vid)
 	struct rte_vdpa_device *vdev = rte_vhost_get_vdpa_device(vid);
 	struct virtio_vdpa_priv *priv =
 		virtio_vdpa_find_priv_resource_by_vdev(vdev);
-	struct rte_vhost_vring vq;
 	uint64_t features = 0;
 	uint16_t num_vr;
 	struct timeval start, end;
 	uint64_t time_used;
 	void *status;
-	int ret, i;
+	int ret;
 
 	if (priv == NULL) {
 		DRV_LOG(ERR, "Invalid vDPA device: %s", vdev->device->name);
@@ -1436,6 +2258,11 @@ virtio_vdpa_dev_close(int vid)
 	DRV_LOG(INFO, "System time of dev close start (dev %s): %lu.%06lu",
 		vdev->device->name, start.tv_sec, start.tv_usec);
 
+	virtio_vdpa_inflight_sync_stop(priv);
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+
 	if (priv->is_notify_thread_started) {
 		ret = pthread_cancel(priv->notify_tid);
 		if (ret) {
@@ -1465,6 +2292,11 @@ virtio_vdpa_dev_close(int vid)
 	if (ret) {
 		DRV_LOG(ERR, "%s vfid %d failed close state modify ret:%d",
 				vdev->device->name, priv->vf_id, ret);
+	} else {
+		/* Packed rings have no used index in guest memory, and the device
+		 * may have been frozen with requests in flight, take both from it.
+		 */
+		virtio_vdpa_frozen_state_load(priv);
 	}
 
 	rte_vhost_get_negotiated_features(vid, &features);
@@ -1475,24 +2307,8 @@ virtio_vdpa_dev_close(int vid)
 	num_vr = rte_vhost_get_vring_num(priv->vid);
 
 	/* Disable all queues */
-	for (i = 0; i < num_vr; i++) {
-		if (priv->vrings[i]->enable) {
-			virtio_vdpa_virtq_disable(priv, i);
-			ret = rte_vhost_get_vhost_vring(priv->vid, i, &vq);
-			if (ret) {
-				DRV_LOG(ERR, "%s virtq %d fail to get hardware idx",
-								priv->vdev->device->name, i);
-			}
-			DRV_LOG(INFO, "%s vid %d qid %d set used idx:%d",
-				vdev->device->name, priv->vid,
-				i, vq.used->idx);
-			ret = rte_vhost_set_vring_base(priv->vid, i, vq.used->idx, vq.used->idx);
-			if (ret) {
-				DRV_LOG(ERR, "%s virtq %d fail to set hardware idx",
-								priv->vdev->device->name, i);
-			}
-		}
-	}
+	virtio_vdpa_task_run_all(priv, virtio_vdpa_virtq_close_task, num_vr, NULL);
+	virtio_vdpa_hw_idx_clear(priv);
 	virtio_pci_dev_state_all_queues_disable(priv->vpdev, priv->state_mz->addr);
 
 	virtio_pci_dev_state_dev_status_set(priv->state_mz->addr, VIRTIO_CONFIG_STATUS_ACK |
@@ -1500,14 +2316,11 @@ virtio_vdpa_dev_close(int vid)
 
 
 
-	virtio_vdpa_lcore_id = rte_get_next_lcore(virtio_vdpa_lcore_id, 1, 1);
-	priv->lcore_id = virtio_vdpa_lcore_id;
-	DRV_LOG(INFO, "%s vfid %d launch dev close work lcore:%d", vdev->device->name, priv->vf_id, priv->lcore_id);
-	ret = rte_eal_remote_launch(virtio_vdpa_dev_close_work, priv, virtio_vdpa_lcore_id);
+	DRV_LOG(INFO, "%s vfid %d queue dev close work", vdev->device->name, priv->vf_id);
+	ret = virtio_vdpa_task_submit(priv, virtio_vdpa_dev_close_work, NULL);
 	if (ret) {
-		DRV_LOG(ERR, "%s vfid %d failed launch work ret:%d lcore:%d", vdev->device->name, priv->vf_id, ret, virtio_vdpa_lcore_id);
+		DRV_LOG(ERR, "%s vfid %d failed queue work ret:%d", vdev->device->name, priv->vf_id, ret);
 	}
-	priv->dev_work_flag = VIRTIO_VDPA_DEV_CLOSE_WORK_START;
 
 	gettimeofday(&end, NULL);
 
@@ -1527,9 +2340,11 @@ virtio_vdpa_dev_config(int vid)
 		virtio_vdpa_find_priv_resource_by_vdev(vdev);
 	struct rte_vhost_vring vq;
 	int ret, i, vhost_sock_fd;
+	char name[RTE_MAX_THREAD_NAME_LEN];
 	struct timeval start, end;
 	bool compare = true;
 	uint64_t time_used;
+	uint16_t last_avail_idx, last_used_idx;
 	uint16_t nr_virtqs;
 
 	gettimeofday(&start, NULL);
@@ -1546,13 +2361,14 @@ virtio_vdpa_dev_config(int vid)
 		return -EBUSY;
 	}
 
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_START) {
-		DRV_LOG(ERR, "%s is waiting dev close work finish lcore:%d", vdev->device->name, priv->lcore_id);
-		rte_eal_wait_lcore(priv->lcore_id);
-	}
-
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_ERR) {
-		DRV_LOG(ERR, "%s is dev close work had err", vdev->device->name);
+	/* Memory must be mapped before device runs, report a failed mapping */
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+	if (priv->dma_map_err) {
+		DRV_LOG(ERR, "%s guest memory not mapped ret:%d",
+				vdev->device->name, priv->dma_map_err);
+		return priv->dma_map_err;
 	}
 
 	nr_virtqs = rte_vhost_get_vring_num(vid);
@@ -1563,14 +2379,11 @@ virtio_vdpa_dev_config(int vid)
 
 	priv->vid = vid;
 
-	for (i = 0; i < nr_virtqs; i++) {
-		/* For mem hotplug case, needs enable queues again */
-		if (priv->vrings[i]->conf_enable && !priv->vrings[i]->enable) {
-			DRV_LOG(DEBUG, "%s enable queue %d in device configure",
-					vdev->device->name, i);
-			virtio_vdpa_virtq_enable(priv, i);
-		}
-	}
+	/* For mem hotplug case, needs enable queues again */
+	ret = virtio_vdpa_task_run_all(priv, virtio_vdpa_virtq_conf_enable_task,
+			nr_virtqs, NULL);
+	if (ret)
+		DRV_LOG(ERR, "%s failed to enable queues ret:%d", vdev->device->name, ret);
 
 	DRV_LOG(INFO, "%s vfid %d launch all vq notifier thread",
 			priv->vdev->device->name, priv->vf_id);
@@ -1584,6 +2397,9 @@ virtio_vdpa_dev_config(int vid)
 		rte_errno = rte_errno ? rte_errno : EINVAL;
 		return -rte_errno;
 	}
+	snprintf(name, sizeof(name), "ntf%x:%02x:%02x.%x", priv->pdev->addr.domain,
+			priv->pdev->addr.bus, priv->pdev->addr.devid, priv->pdev->addr.function);
+	rte_thread_setname(priv->notify_tid, name);
 	priv->is_notify_thread_started = true;
 
 	virtio_pci_dev_state_dev_status_set(priv->state_mz->addr, VIRTIO_CONFIG_STATUS_ACK |
@@ -1605,8 +2421,12 @@ virtio_vdpa_dev_config(int vid)
 		}
 
 		/* In case of recovery or lm, hw idx might changed and device is ready before dev config.
-		 * If we use idx from qemu, it will lag behind, so read from memory to get idx
+		 * If we use idx from qemu, it will lag behind, so read from memory to get idx.
+		 * Packed rings and requests left in flight are taken from the frozen device.
 		 */
+		if (priv->restore)
+			virtio_vdpa_frozen_state_load(priv);
+
 		for (i = 0; i < nr_virtqs; i++) {
 			if (!priv->vrings[i]->conf_enable)
 				continue;
@@ -1617,19 +2437,22 @@ virtio_vdpa_dev_config(int vid)
 				rte_errno = rte_errno ? rte_errno : EINVAL;
 				return -rte_errno;
 			}
+			virtio_vdpa_vring_base_get(priv, i, &vq, &last_avail_idx, &last_used_idx);
 			DRV_LOG(INFO, "%s vid %d qid %d recover avail_idx:%d used_idx:%d",
 							vdev->device->name, vid,
-							i, vq.used->idx, vq.used->idx);
+							i, last_avail_idx, last_used_idx);
 
 			ret = virtio_pci_dev_state_hw_idx_set(priv->vpdev, i ,
-							vq.used->idx,
-							vq.used->idx, priv->state_mz->addr);
+							last_avail_idx,
+							last_used_idx, priv->state_mz->addr);
 			if (ret) {
 				DRV_LOG(ERR, "%s error set dev state ret:%d", vdev->device->name, ret);
+				virtio_vdpa_hw_idx_clear(priv);
 				rte_errno = rte_errno ? rte_errno : EINVAL;
 				return -rte_errno;
 			}
 		}
+		virtio_vdpa_hw_idx_clear(priv);
 		ret = virtio_vdpa_cmd_restore_state(priv->pf_priv, priv->vf_id, 0, priv->state_size, priv->state_mz->iova);
 		if (ret) {
 			DRV_LOG(ERR, "%s vfid %d failed restore state ret:%d", vdev->device->name, priv->vf_id, ret);
@@ -1690,6 +2513,7 @@ virtio_vdpa_dev_config(int vid)
 
 out:
 	priv->configured = 1;
+	virtio_vdpa_inflight_sync_start(priv);
 	return 0;
 }
 
@@ -1774,13 +2598,22 @@ virtio_vdpa_dev_presetup_done(int vid)
 		virtio_vdpa_find_priv_resource_by_vdev(vdev);
 	struct timeval start, end;
 	uint64_t time_used;
-	uint16_t nr_virtqs;
+	uint16_t nr_virtqs, init_idx;
 	int ret, i;
 
 	gettimeofday(&start, NULL);
 	DRV_LOG(INFO, "virtio vDPA presetup start (dev %s): %lu.%06lu",
 		vdev->device->name, start.tv_sec, start.tv_usec);
 
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+	if (priv->dma_map_err) {
+		DRV_LOG(ERR, "%s guest memory not mapped ret:%d",
+				vdev->device->name, priv->dma_map_err);
+		return priv->dma_map_err;
+	}
+
 	nr_virtqs = rte_vhost_get_vring_num(vid);
 	if (priv->nvec < (nr_virtqs + 1)) {
 		DRV_LOG(ERR, "%s warning: dev interrupts %d less than queue: %d",
@@ -1789,9 +2622,13 @@ virtio_vdpa_dev_presetup_done(int vid)
 
 	priv->vid = vid;
 
+	/* Packed rings start with both wrap counters set */
+	init_idx = (priv->guest_features & (1ULL << VIRTIO_F_RING_PACKED)) ?
+			1 << VIRTIO_DEV_PACKED_Q_WRAP_SHIFT : 0;
+
 	for (i = 0; i < nr_virtqs; i++) {
 		ret = virtio_pci_dev_state_hw_idx_set(priv->vpdev, i,
-				0, 0, priv->state_mz->addr);
+				init_idx, init_idx, priv->state_mz->addr);
 		if (ret) {
 			DRV_LOG(ERR, "%s error get vring base ret:%d", vdev->device->name, ret);
 			rte_errno = rte_errno ? rte_errno : EINVAL;
@@ -1899,6 +2736,31 @@ virtio_vdpa_dev_mem_tbl_cleanup(struct rte_vdpa_device *vdev)
 	pthread_mutex_unlock(&iommu_domain_locks[priv->iommu_idx]);
 }
 
+/* QEMU resized the log, device must write to the new one before vhost unmaps the old */
+static int
+virtio_vdpa_dev_set_log_base(int vid)
+{
+	struct rte_vdpa_device *vdev = rte_vhost_get_vdpa_device(vid);
+	struct virtio_vdpa_priv *priv =
+		virtio_vdpa_find_priv_resource_by_vdev(vdev);
+	int ret;
+
+	if (priv == NULL) {
+		DRV_LOG(ERR, "Invalid vDPA device: %s", vdev->device->name);
+		return -ENODEV;
+	}
+
+	/* Memory table work in flight may update tracking as well */
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work had err:%d", vdev->device->name, ret);
+
+	if (!priv->log_started)
+		return 0;
+
+	return virtio_vdpa_track_ranges_update(priv);
+}
+
 static struct rte_vdpa_dev_ops virtio_vdpa_ops = {
 	.get_queue_num = virtio_vdpa_vqs_max_get,
 	.get_features = virtio_vdpa_features_get,
@@ -1919,6 +2781,7 @@ static struct rte_vdpa_dev_ops virtio_vdpa_ops = {
 	.dev_cleanup = virtio_vdpa_dev_cleanup,
 	.presetup_done = virtio_vdpa_dev_presetup_done,
 	.mem_tbl_cleanup = virtio_vdpa_dev_mem_tbl_cleanup,
+	.set_log_base = virtio_vdpa_dev_set_log_base,
 };
 
 static int vdpa_check_handler(__rte_unused const char *key,
@@ -2029,6 +2892,8 @@ virtio_vdpa_queues_free(struct virtio_vdpa_priv *priv)
 			vr = priv->vrings[i];
 			if (!vr)
 				continue;
+			pthread_mutex_destroy(&vr->inflight_lock);
+			rte_free(vr->inflight_track);
 			rte_free(vr);
 			priv->vrings[i] = NULL;
 		}
@@ -2070,6 +2935,7 @@ virtio_vdpa_queues_alloc(struct virtio_vdpa_priv *priv)
 			virtio_vdpa_queues_free(priv);
 			return -ENOMEM;
 		}
+		pthread_mutex_init(&vr->inflight_lock, NULL);
 		priv->vrings[i] = vr;
 		priv->vrings[i]->index = i;
 		priv->vrings[i]->priv = priv;
@@ -2137,16 +3003,11 @@ virtio_vdpa_dev_do_remove(struct rte_pci_device *pci_dev, struct virtio_vdpa_pri
 
 	if (priv->configured)
 		virtio_vdpa_dev_close(priv->vid);
+	virtio_vdpa_dirty_rate_stop(priv);
 	virtio_vdpa_doorbell_relay_disable(priv);
 
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_START) {
-		DRV_LOG(ERR, "%s is waiting dev close work finish lcore:%d", pci_dev->name, priv->lcore_id);
-		rte_eal_wait_lcore(priv->lcore_id);
-	}
-
-	if (priv->dev_work_flag == VIRTIO_VDPA_DEV_CLOSE_WORK_ERR) {
-		DRV_LOG(ERR, "%s is dev close work had err", pci_dev->name);
-	}
+	/* Also stops config threads of the node with its last device */
+	virtio_vdpa_task_dev_uninit(priv);
 
 	if (priv->dev_ops && priv->dev_ops->unreg_dev_intr) {
 		ret = virtio_pci_dev_interrupt_disable(priv->vpdev, 0);
@@ -2190,6 +3051,7 @@ virtio_vdpa_dev_do_remove(struct rte_pci_device *pci_dev, struct virtio_vdpa_pri
 				priv->vfio_container_fd = -1;
 			}
 			virtio_iommu_domains[priv->iommu_idx] = NULL;
+			pthread_mutex_destroy(&iommu_domain->dirty_rate.scan_lock);
 			rte_free(iommu_domain);
 		}
 	}
@@ -2253,7 +3115,7 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 	uint32_t i;
 	size_t mz_len;
 	int retries = VIRTIO_VDPA_GET_GROUPE_RETRIES;
-	struct timeval start, end;
+	struct timeval start, end, bar_start;
 	uint64_t time_used;
 	struct vdpa_vf_with_devargs vf_dev;
 	bool unmap_all = false;
@@ -2292,6 +3154,8 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 
 	strcpy(priv->vf_name.dev_bdf, devname);
 	priv->pdev = pci_dev;
+	/* Before any error path, remove waits for device tasks */
+	virtio_vdpa_task_dev_init(priv);
 
 	ret = virtio_vdpa_get_pf_name(devname, pfname, sizeof(pfname));
 	if (ret) {
@@ -2357,6 +3221,9 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 		container_fd = cached_ctx.ctx->vfio_container_fd;
 		group_fd = cached_ctx.ctx->vfio_group_fd;
 		device_fd = cached_ctx.ctx->vfio_device_fd;
+		/* A state copy kept by an older driver is not used any more */
+		if (cached_ctx.ctx->vf_state_fd >= 0)
+			close(cached_ctx.ctx->vf_state_fd);
 		/* When devices in same iommu_domain restore, only the first device
 		 * needs to restore memory table. It's assumed that those devices'
 		 * memory table is the same.
@@ -2527,6 +3394,7 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 	mz_len = priv->state_mz->len;
 	memset(priv->state_mz->addr, 0, mz_len);
 
+	gettimeofday(&bar_start, NULL);
 	ret = virtio_pci_dev_state_bar_copy(priv->vpdev, priv->state_mz->addr, state_len);
 	if (ret) {
 		DRV_LOG(ERR, "%s error copy bar to state ret:%d",
@@ -2534,6 +3402,9 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 		rte_errno = rte_errno ? rte_errno : VFE_VDPA_ERR_ADD_VF_BAR_COPY;
 		goto error;
 	}
+	gettimeofday(&end, NULL);
+	time_used = (end.tv_sec - bar_start.tv_sec) * 1e6 + end.tv_usec - bar_start.tv_usec;
+	DRV_LOG(INFO, "%s copy bar to state took %lu us.", devname, time_used);
 
 	/* Init remote state mz */
 
@@ -2557,6 +3428,9 @@ virtio_vdpa_dev_probe(struct rte_pci_driver *pci_drv __rte_unused,
 	mz_len = priv->state_mz_remote->len;
 	memset(priv->state_mz_remote->addr, 0, mz_len);
 
+	/* The device may have changed its state on its own, read it back to
+	 * compare it with the local one.
+	 */
 	if (priv->restore) {
 		ret = virtio_vdpa_save_state(priv);
 		if (ret) {
@@ -2674,6 +3548,7 @@ virtio_vdpa_dev_vf_filter_dump(const char *vf_name, struct vdpa_vf_params *vf_in
 			vf_info->queue_size = priv->vrings[0]->size;
 			vf_info->features = priv->guest_features;
 			vf_info->configured = priv->configured;
+			virtio_vdpa_dirty_rate_get(priv, vf_info);
 			rte_uuid_unparse(priv->vm_uuid, vf_info->vm_uuid, sizeof(vf_info->vm_uuid));
 			strlcpy(vf_info->vf_name, priv->vdev->device->name, RTE_DEV_NAME_MAX_LEN);
 			found = true;
@@ -2685,6 +3560,48 @@ virtio_vdpa_dev_vf_filter_dump(const char *vf_name, struct vdpa_vf_params *vf_in
 	return found ? 0 : -VFE_VDPA_ERR_NO_VF_DEVICE;
 }
 
+static int
+virtio_vdpa_telemetry_dirty_rate(const char *cmd __rte_unused,
+		const char *params, struct rte_tel_data *d)
+{
+	struct virtio_vdpa_priv *priv;
+	struct vdpa_vf_params vf_info = {0};
+	bool found = false;
+
+	if (params == NULL || strlen(params) == 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&priv_list_lock);
+	TAILQ_FOREACH(priv, &virtio_priv_list, next) {
+		if (!strncmp(params, priv->vf_name.dev_bdf, sizeof(priv->vf_name.dev_bdf))) {
+			virtio_vdpa_dirty_rate_get(priv, &vf_info);
+			rte_uuid_unparse(priv->vm_uuid, vf_info.vm_uuid, sizeof(vf_info.vm_uuid));
+			vf_info.dirty_eta_ms = RTE_MIN(vf_info.dirty_eta_ms, (int64_t)INT_MAX);
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&priv_list_lock);
+	if (!found)
+		return -ENODEV;
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_string(d, "vf", params);
+	rte_tel_data_add_dict_string(d, "vm_uuid", vf_info.vm_uuid);
+	rte_tel_data_add_dict_int(d, "logging", vf_info.logging);
+	rte_tel_data_add_dict_u64(d, "vm_dirty_pages_per_sec", vf_info.dirty_rate);
+	rte_tel_data_add_dict_u64(d, "vm_pending_bytes", vf_info.dirty_pending);
+	rte_tel_data_add_dict_int(d, "vm_eta_ms", vf_info.dirty_eta_ms);
+	return 0;
+}
+
+RTE_INIT(virtio_vdpa_telemetry_init)
+{
+	rte_telemetry_register_cmd("/vdpa_virtio/dirty_rate",
+			virtio_vdpa_telemetry_dirty_rate,
+			"Returns dirty page rate of the VM of a VF under live migration. Parameters: VF BDF");
+}
+
 /*
  * The set of PCI devices this driver supports
  */
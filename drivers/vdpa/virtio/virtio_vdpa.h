@@ -5,6 +5,9 @@
 #ifndef _VIRTIO_VDPA_H_
 #define _VIRTIO_VDPA_H_
 
+#include <pthread.h>
+
+#include <rte_spinlock.h>
 #include <virtio_ha.h>
 
 #define VIRTIO_VDPA_MAX_MEM_REGIONS 8
@@ -27,6 +30,26 @@ struct virtio_vdpa_vf_drv_mem {
 	struct virtio_vdpa_vf_drv_mem_region regions[VIRTIO_VDPA_MAX_MEM_REGIONS];
 };
 
+/*
+ * Dirty rate of a VM, sampled from the vhost log bitmap while its VFs track
+ * dirty pages. QEMU shares one log between the vhost devices of a VM, so the
+ * log is sampled once per VM, from the mapping of one of the tracking VFs.
+ */
+struct virtio_vdpa_dirty_rate {
+	rte_spinlock_t lock;
+	pthread_mutex_t scan_lock; /* Held while the log is read or the sampler changes */
+	struct virtio_vdpa_priv *owner; /* VF whose log mapping and config thread sample, NULL if stopped */
+	uint64_t *shadow; /* Log bitmap as of last sample */
+	uint64_t nr_words;
+	uint64_t log_base;
+	uint64_t last_tsc;
+	uint64_t dirtied_pages; /* Pages found newly dirty since logging start */
+	uint64_t pending_pages; /* Dirty pages not yet collected by QEMU */
+	double dirty_pps; /* Smoothed pages dirtied per second */
+	double drain_pps; /* Smoothed pages collected by QEMU per second */
+	bool queued; /* Sample submitted to config thread, not run yet */
+};
+
 struct virtio_vdpa_iommu_domain {
 	TAILQ_ENTRY(virtio_vdpa_iommu_domain) next;
 	rte_uuid_t vm_uuid;
@@ -36,6 +59,7 @@ struct virtio_vdpa_iommu_domain {
 	int mem_tbl_ref_cnt;
 	int tbl_recover_cnt;
 	int cont_recover_cnt;
+	struct virtio_vdpa_dirty_rate dirty_rate;
 };
 
 struct virtio_vdpa_vring_info {
@@ -47,12 +71,36 @@ struct virtio_vdpa_vring_info {
 	uint8_t notifier_state;
 	bool enable;
 	bool conf_enable; /* save queue enable configuration got from vhost */
+	struct virtio_dev_run_state_info hw_idx; /* ring indexes read back from frozen device state */
+	uint16_t *inflight_desc; /* heads the frozen device still had in flight, replayed on resume */
+	uint16_t nr_inflight_desc;
+	pthread_mutex_t inflight_lock; /* Serializes the in-flight request tracking of the ring */
+	void *inflight_track; /* Device type in-flight tracking state, freed with the ring */
 	struct rte_intr_handle *intr_handle;
 	struct virtio_vdpa_priv *priv;
 };
 
 #define VIRTIO_VDPA_DRIVER_NAME vdpa_virtio
 
+/* Guest physical range tracked by device, logged to its part of the vhost log bitmap */
+struct virtio_vdpa_track_range {
+	uint64_t addr;
+	uint64_t len;
+};
+
+/* Completion of control-path tasks run by the config threads */
+struct virtio_vdpa_task_sync {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t pending;
+	int err; /* First error since last wait */
+};
+
+#define VIRTIO_VDPA_CONF_THREADS_DEFAULT 4
+#define VIRTIO_VDPA_CONF_THREADS_MAX 64
+
+struct virtio_vdpa_worker_pool;
+
 #define VIRTIO_VDPA_DOOR_BELL_INIT 0
 #define VIRTIO_VDPA_DOOR_BELL_RELAY 1
 #define VIRTIO_VDPA_DOOR_BELL_CANCLE 2
@@ -77,10 +125,18 @@ struct virtio_vdpa_priv {
 	int vid;
 	int vf_id;
 	int nvec;
-	int lcore_id;
-	int dev_work_flag;
+	struct virtio_vdpa_task_sync task_sync; /* Device tasks queued to config threads */
+	struct virtio_vdpa_worker_pool *task_pool; /* NULL if work runs inline */
+	uint32_t task_worker; /* Config thread running the device tasks in order */
+	int dma_map_err; /* Result of last queued DMA mapping, fails dev_conf */
 	uint64_t guest_features;
 	struct virtio_vdpa_vring_info **vrings;
+	struct virtio_vdpa_track_range track_ranges[VIRTIO_VDPA_MAX_MEM_REGIONS];
+	uint32_t nr_track_ranges;
+	uint32_t max_track_ranges; /* Device limit, 0 if not queried yet */
+	uint64_t log_base; /* vhost log mapped for the device to write, 0 if none */
+	uint64_t log_size;
+	rte_iova_t log_iova;
 	uint16_t hw_nr_virtqs; /* Number of vq device supported */
 	volatile uint16_t doorbell_relay;
 	bool configured;
@@ -92,11 +148,18 @@ struct virtio_vdpa_priv {
 	bool restore;
 	bool is_notify_thread_started;
 	bool log_started;
+	bool dirty_rate_user; /* Dirty rate of the VM sampled while tracking */
+	bool frozen_state; /* Device frozen since its state was last read back */
+	bool inflight_sync_on; /* In-flight requests synced periodically */
+	bool inflight_sync_queued;
 	struct virtio_dev_name vf_name;
 	struct virtio_dev_name pf_name;
 };
 
 #define VIRTIO_VDPA_REMOTE_STATE_DEFAULT_SIZE 8192
+#define VIRTIO_VDPA_DIRTY_RATE_INTERVAL_US (200 * 1000)
+#define VIRTIO_VDPA_INFLIGHT_SYNC_INTERVAL_US (10 * 1000)
+
 #define VIRTIO_VDPA_INTR_RETRIES_USEC 1000
 #define VIRTIO_VDPA_INTR_RETRIES 256
 
@@ -108,12 +171,26 @@ struct virtio_vdpa_device_callback {
 	int (*vdpa_queue_num_unit_get)(void);
 	void (*add_vdpa_feature)(uint64_t *features);
 	void (*set_vdpa_feature)(uint64_t *features);
+	int (*inflight_recover)(struct virtio_vdpa_priv *priv, int qix, uint16_t *last_avail_idx,
+			uint16_t *last_used_idx);
+	int (*inflight_sync)(struct virtio_vdpa_priv *priv, int qix); /* Called periodically while running, rings are read only */
+	bool (*used_len_needed)(int qix); /* Guest driver relies on the used length of the queue */
 };
 
 int virtio_vdpa_dev_pf_filter_dump(struct vdpa_vf_params *vf_info, int max_vf_num, struct virtio_vdpa_pf_priv *pf_priv);
 int virtio_vdpa_dev_vf_filter_dump(const char *vf_name, struct vdpa_vf_params *vf_info);
 struct virtio_vdpa_priv * virtio_vdpa_find_priv_resource_by_name(const char *vf_name);
 int virtio_vdpa_max_phy_addr_get(struct virtio_vdpa_priv *priv, uint64_t *phy_addr);
+typedef int (*virtio_vdpa_task_cb)(struct virtio_vdpa_priv *priv, int idx, void *arg);
+
+void virtio_vdpa_task_dev_init(struct virtio_vdpa_priv *priv);
+void virtio_vdpa_task_dev_uninit(struct virtio_vdpa_priv *priv);
+/* Queue a device task, tasks of a device run in submission order */
+int virtio_vdpa_task_submit(struct virtio_vdpa_priv *priv, virtio_vdpa_task_cb cb, void *arg);
+/* Wait for queued device tasks, return and clear their first error */
+int virtio_vdpa_task_wait(struct virtio_vdpa_priv *priv);
+/* Run cb for idx 0 to nr - 1 in parallel and wait, return first error */
+int virtio_vdpa_task_run_all(struct virtio_vdpa_priv *priv, virtio_vdpa_task_cb cb, int nr, void *arg);
 int virtio_vdpa_dirty_desc_get(struct virtio_vdpa_priv *priv, int qix, uint64_t *desc_addr, uint32_t *write_len);
 int virtio_vdpa_used_vring_addr_get(struct virtio_vdpa_priv *priv, int qix, uint64_t *used_vring_addr, uint32_t *used_vring_len);
 const struct rte_memzone * virtio_vdpa_dev_dp_map_get(struct virtio_vdpa_priv *priv, size_t len);
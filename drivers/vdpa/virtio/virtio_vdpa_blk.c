@@ -1,8 +1,11 @@
 /* SPDX-License-Identifier: BSD-3-Clause
  * Copyright (c) 2022 NVIDIA Corporation & Affiliates
  */
+#include <pthread.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <rte_common.h>
+#include <rte_malloc.h>
 #include <rte_vhost.h>
 #include "rte_vf_rpc.h"
 #include "virtio_api.h"
@@ -18,6 +21,7 @@
 				 (1ULL << VHOST_USER_PROTOCOL_F_HOST_NOTIFIER) | \
 				 (1ULL << VHOST_USER_PROTOCOL_F_LOG_SHMFD) | \
 				 (1ULL << VHOST_USER_PROTOCOL_F_REPLY_ACK) | \
+				 (1ULL << VHOST_USER_PROTOCOL_F_INFLIGHT_SHMFD) | \
 				 (1ULL << VHOST_USER_PROTOCOL_F_PRESETUP) | \
 				 (1ULL << VHOST_USER_PROTOCOL_F_EXTEND_STATUS))
 
@@ -27,6 +31,7 @@ extern int virtio_vdpa_logtype;
 		"VIRTIO VDPA BLK %s(): " fmt "\n", __func__, ##args)
 
 #define VIRTIO_VDPA_BLK_QUEUE_NUM_UNIT 1
+#define VIRTIO_VDPA_BLK_QUEUE_SIZE_MAX 32768
 
 static void
 virtio_vdpa_blk_vhost_feature_get(uint64_t *features)
@@ -38,6 +43,7 @@ static int
 virtio_vdpa_blk_dirty_desc_get(int vid, int qix, uint64_t *desc_addr, uint32_t *write_len)
 {
 	struct rte_vhost_vring vq;
+	uint64_t features;
 	uint32_t desc_id, desc_len;
 	struct virtio_blk_outhdr *blk_hdr;
 	int ret;
@@ -48,6 +54,13 @@ virtio_vdpa_blk_dirty_desc_get(int vid, int qix, uint64_t *desc_addr, uint32_t *
 		return -ENODEV;
 	}
 
+	/* Used elements of a packed ring do not carry the buffer address */
+	if (!rte_vhost_get_negotiated_features(vid, &features) &&
+		(features & (1ULL << VIRTIO_F_RING_PACKED))) {
+		BLK_LOG(INFO, "VID: %d qix:%d packed ring, no last desc to check", vid, qix);
+		return -ENOTSUP;
+	}
+
 	desc_id = vq.used->ring[(vq.used->idx -1) & (vq.size -1)].id;
 	*desc_addr = vq.desc[desc_id].addr;
 	*write_len = RTE_MIN(vq.used->ring[(vq.used->idx -1) & (vq.size -1)].len, vq.desc[desc_id].len);
@@ -74,6 +87,311 @@ virtio_vdpa_blk_dirty_desc_get(int vid, int qix, uint64_t *desc_addr, uint32_t *
 	return 0;
 }
 
+static int
+virtio_vdpa_blk_inflight_cmp(const void *a, const void *b)
+{
+	const struct rte_vhost_resubmit_desc *desc0 = a;
+	const struct rte_vhost_resubmit_desc *desc1 = b;
+
+	if (desc0->counter > desc1->counter)
+		return 1;
+
+	return desc0->counter < desc1->counter ? -1 : 0;
+}
+
+/*
+ * The inflight region records the requests outstanding at its last sync:
+ * their heads are flagged in desc[], and used_idx and last_inflight_io hold
+ * the used and avail indices of the sync. The region is only written by
+ * this driver for vDPA devices.
+ *
+ * Block requests complete out of order, so the requests in the avail ring
+ * past used->idx are not the outstanding ones: some of them may be done
+ * already while older ones are still pending. The flagged heads plus the
+ * heads made available since the sync, minus the heads used since then,
+ * give the exact outstanding set.
+ *
+ * Each queue keeps the outstanding count per head of the region, so that a
+ * sync only walks the ring entries added since the previous one.
+ */
+struct virtio_vdpa_blk_inflight_queue {
+	struct rte_vhost_inflight_info_split *region; /* Region pending[] was loaded from */
+	uint16_t avail_idx; /* Indices of the last sync written to the region */
+	uint16_t used_idx;
+	uint16_t size;
+	uint16_t nr_pending; /* Sum of pending[] */
+	uint64_t counter; /* Last counter given to a request */
+	int16_t pending[]; /* Outstanding requests per head */
+};
+
+static void
+virtio_vdpa_blk_inflight_load(struct virtio_vdpa_blk_inflight_queue *q,
+		struct rte_vhost_inflight_info_split *inflight)
+{
+	uint16_t head;
+
+	q->counter = 0;
+	q->nr_pending = 0;
+	for (head = 0; head < q->size; head++) {
+		q->pending[head] = inflight->desc[head].inflight ? 1 : 0;
+		if (q->pending[head])
+			q->counter = RTE_MAX(q->counter, inflight->desc[head].counter);
+		q->nr_pending += q->pending[head];
+	}
+	q->region = inflight;
+	q->avail_idx = inflight->last_inflight_io;
+	q->used_idx = inflight->used_idx;
+}
+
+/* Account the ring entries past the given indices, fails if they do not match */
+static int
+virtio_vdpa_blk_inflight_count(struct virtio_vdpa_blk_inflight_queue *q,
+		struct rte_vhost_vring *vq, uint16_t start_avail, uint16_t start_used,
+		uint16_t avail_idx, uint16_t used_idx)
+{
+	uint16_t i, head;
+
+	for (i = start_used; i != used_idx; i++) {
+		head = vq->used->ring[i & (vq->size - 1)].id;
+		if (head >= vq->size)
+			return -EINVAL;
+		q->pending[head]--;
+	}
+	for (i = start_avail; i != avail_idx; i++) {
+		head = vq->avail->ring[i & (vq->size - 1)];
+		if (head >= vq->size)
+			return -EINVAL;
+		q->pending[head]++;
+	}
+
+	/* Only the heads seen above may have changed */
+	for (i = start_used; i != used_idx; i++) {
+		head = vq->used->ring[i & (vq->size - 1)].id;
+		if (q->pending[head] < 0 || q->pending[head] > 1)
+			return -EINVAL;
+	}
+	for (i = start_avail; i != avail_idx; i++) {
+		head = vq->avail->ring[i & (vq->size - 1)];
+		if (q->pending[head] < 0 || q->pending[head] > 1)
+			return -EINVAL;
+	}
+
+	q->nr_pending += (uint16_t)(avail_idx - start_avail) - (uint16_t)(used_idx - start_used);
+	return q->nr_pending == (uint16_t)(avail_idx - used_idx) ? 0 : -EINVAL;
+}
+
+/* Bring the region up to the given ring indices */
+static int
+virtio_vdpa_blk_inflight_update(int vid, int qix, struct virtio_vdpa_blk_inflight_queue *q,
+		struct rte_vhost_vring *vq, struct rte_vhost_inflight_info_split *inflight,
+		uint16_t avail_idx, uint16_t used_idx)
+{
+	uint16_t i, head, start_avail, start_used;
+	int ret = -EINVAL;
+
+	if (q->region != inflight || q->avail_idx != inflight->last_inflight_io ||
+		q->used_idx != inflight->used_idx)
+		virtio_vdpa_blk_inflight_load(q, inflight);
+
+	start_avail = q->avail_idx;
+	start_used = q->used_idx;
+	if (start_avail == avail_idx && start_used == used_idx)
+		return 0;
+
+	if ((uint16_t)(avail_idx - start_avail) <= vq->size &&
+		(uint16_t)(used_idx - start_used) <= vq->size)
+		ret = virtio_vdpa_blk_inflight_count(q, vq, start_avail, start_used,
+				avail_idx, used_idx);
+	if (ret) {
+		/* Rings wrapped since the last sync or were rewritten on resume */
+		BLK_LOG(DEBUG, "VID: %d qix:%d inflight region behind ring, restart from used idx %u",
+			vid, qix, used_idx);
+		q->region = NULL;
+		if ((uint16_t)(avail_idx - used_idx) > vq->size)
+			return -EINVAL;
+		for (head = 0; head < vq->size; head++) {
+			inflight->desc[head].inflight = 0;
+			q->pending[head] = 0;
+		}
+		q->nr_pending = 0;
+		start_avail = used_idx;
+		start_used = used_idx;
+		ret = virtio_vdpa_blk_inflight_count(q, vq, start_avail, start_used,
+				avail_idx, used_idx);
+		if (ret)
+			return ret;
+	}
+
+	for (i = start_used; i != used_idx; i++) {
+		head = vq->used->ring[i & (vq->size - 1)].id;
+		inflight->desc[head].inflight = 0;
+	}
+	/* Requests first seen now are newer than anything tracked before */
+	for (i = start_avail; i != avail_idx; i++) {
+		head = vq->avail->ring[i & (vq->size - 1)];
+		if (q->pending[head] && !inflight->desc[head].inflight) {
+			inflight->desc[head].counter = ++q->counter;
+			inflight->desc[head].inflight = 1;
+		}
+	}
+	rte_smp_wmb();
+
+	inflight->last_inflight_io = avail_idx;
+	inflight->used_idx = used_idx;
+	q->region = inflight;
+	q->avail_idx = avail_idx;
+	q->used_idx = used_idx;
+	return 0;
+}
+
+/* Called with the inflight lock of the ring held */
+static int
+virtio_vdpa_blk_inflight_get(struct virtio_vdpa_priv *priv, int qix,
+		struct rte_vhost_vring *vq, struct rte_vhost_inflight_info_split **inflight,
+		struct virtio_vdpa_blk_inflight_queue **q)
+{
+	struct virtio_vdpa_vring_info *vring = priv->vrings[qix];
+	struct virtio_vdpa_blk_inflight_queue *track = vring->inflight_track;
+	struct rte_vhost_ring_inflight ring;
+	uint64_t features;
+
+	if (rte_vhost_get_negotiated_features(priv->vid, &features) ||
+		(features & (1ULL << VIRTIO_F_RING_PACKED)))
+		return -ENOTSUP;
+
+	if (rte_vhost_get_vhost_vring(priv->vid, qix, vq))
+		return -ENODEV;
+
+	if (rte_vhost_get_vhost_ring_inflight(priv->vid, qix, &ring) ||
+		!ring.inflight_split)
+		return -ENOTSUP;
+
+	if (ring.inflight_split->desc_num != vq->size ||
+		vq->size > VIRTIO_VDPA_BLK_QUEUE_SIZE_MAX)
+		return -EINVAL;
+
+	if (!track || track->size != vq->size) {
+		rte_free(track);
+		vring->inflight_track = NULL;
+		track = rte_zmalloc_socket(NULL, sizeof(*track) +
+				vq->size * sizeof(track->pending[0]), 0,
+				priv->pdev->device.numa_node);
+		if (!track)
+			return -ENOMEM;
+		track->size = vq->size;
+		vring->inflight_track = track;
+	}
+
+	*inflight = ring.inflight_split;
+	*q = track;
+	return 0;
+}
+
+/*
+ * Keep the region of a running queue current, so that it still covers the
+ * rings when the queue is stopped or the service restarts. Only the region
+ * is written, the rings of a running queue are left to the guest.
+ */
+static int
+virtio_vdpa_blk_inflight_sync(struct virtio_vdpa_priv *priv, int qix)
+{
+	pthread_mutex_t *lock = &priv->vrings[qix]->inflight_lock;
+	struct rte_vhost_inflight_info_split *inflight;
+	struct virtio_vdpa_blk_inflight_queue *q;
+	struct rte_vhost_vring vq;
+	uint16_t avail_idx, used_idx;
+	int ret;
+
+	pthread_mutex_lock(lock);
+	ret = virtio_vdpa_blk_inflight_get(priv, qix, &vq, &inflight, &q);
+	if (ret)
+		goto out;
+
+	/* Completions are read first so that each one is matched by its request */
+	used_idx = __atomic_load_n(&vq.used->idx, __ATOMIC_ACQUIRE);
+	avail_idx = __atomic_load_n(&vq.avail->idx, __ATOMIC_ACQUIRE);
+	ret = virtio_vdpa_blk_inflight_update(priv->vid, qix, q, &vq, inflight,
+			avail_idx, used_idx);
+out:
+	pthread_mutex_unlock(lock);
+	return ret;
+}
+
+/*
+ * Rebuild the requests outstanding on a stopped queue from the region and
+ * write them back, oldest first, to the avail slots the device fetches from
+ * once it is resumed at used->idx. Only called while the device has the
+ * queue stopped, so it cannot fetch a slot being rewritten. The slots
+ * rewritten are the avail_idx - used_idx ones below avail->idx, which the
+ * driver already handed over and cannot reuse before the device consumed
+ * them, and whose content the driver does not read back.
+ */
+static int
+virtio_vdpa_blk_inflight_recover(struct virtio_vdpa_priv *priv, int qix,
+		uint16_t *last_avail_idx, uint16_t *last_used_idx)
+{
+	pthread_mutex_t *lock = &priv->vrings[qix]->inflight_lock;
+	struct rte_vhost_inflight_info_split *inflight;
+	struct rte_vhost_resubmit_desc *resubmit = NULL;
+	struct virtio_vdpa_blk_inflight_queue *q;
+	uint16_t avail_idx, used_idx, slot;
+	struct rte_vhost_vring vq;
+	uint16_t i, head, num = 0;
+	int ret;
+
+	pthread_mutex_lock(lock);
+	ret = virtio_vdpa_blk_inflight_get(priv, qix, &vq, &inflight, &q);
+	if (ret)
+		goto out;
+
+	/* The region may have been handed over again, do not trust the cache */
+	q->region = NULL;
+	used_idx = __atomic_load_n(&vq.used->idx, __ATOMIC_ACQUIRE);
+	avail_idx = __atomic_load_n(&vq.avail->idx, __ATOMIC_ACQUIRE);
+	ret = virtio_vdpa_blk_inflight_update(priv->vid, qix, q, &vq, inflight,
+			avail_idx, used_idx);
+	if (ret) {
+		BLK_LOG(ERR, "VID: %d qix:%d inconsistent rings, avail idx %u used idx %u",
+			priv->vid, qix, avail_idx, used_idx);
+		goto out;
+	}
+
+	resubmit = rte_zmalloc(NULL, vq.size * sizeof(*resubmit), 0);
+	if (!resubmit) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (head = 0; head < vq.size; head++) {
+		if (!inflight->desc[head].inflight)
+			continue;
+		resubmit[num].index = head;
+		resubmit[num].counter = inflight->desc[head].counter;
+		num++;
+	}
+
+	qsort(resubmit, num, sizeof(*resubmit), virtio_vdpa_blk_inflight_cmp);
+	for (i = 0; i < num; i++) {
+		slot = (uint16_t)(used_idx + i) & (vq.size - 1);
+		if (vq.avail->ring[slot] == resubmit[i].index)
+			continue;
+		vq.avail->ring[slot] = resubmit[i].index;
+		rte_vhost_log_write(priv->vid, priv->vrings[qix]->avail +
+				offsetof(struct vring_avail, ring[slot]), sizeof(uint16_t));
+	}
+	rte_smp_wmb();
+
+	*last_avail_idx = used_idx;
+	*last_used_idx = used_idx;
+
+	BLK_LOG(INFO, "VID: %d qix:%d %u requests in flight from used idx %u",
+		priv->vid, qix, num, used_idx);
+out:
+	pthread_mutex_unlock(lock);
+	rte_free(resubmit);
+	return ret;
+}
+
 static void
 virtio_vdpa_blk_dev_intr_handler(void *cb_arg)
 {
@@ -173,5 +491,8 @@ struct virtio_vdpa_device_callback virtio_vdpa_blk_callback = {
 	.vdpa_queue_num_unit_get = virtio_vdpa_blk_queue_num_unit_get,
 	.add_vdpa_feature = NULL,
 	.set_vdpa_feature = NULL,
+	.inflight_recover = virtio_vdpa_blk_inflight_recover,
+	.inflight_sync = virtio_vdpa_blk_inflight_sync,
+	.used_len_needed = NULL,
 };
 
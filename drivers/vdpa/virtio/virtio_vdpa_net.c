@@ -35,6 +35,7 @@ static int
 virtio_vdpa_net_dirty_desc_get(int vid, int qix, uint64_t *desc_addr, uint32_t *write_len)
 {
 	struct rte_vhost_vring vq;
+	uint64_t features;
 	uint32_t desc_id;
 	int ret;
 
@@ -44,6 +45,13 @@ virtio_vdpa_net_dirty_desc_get(int vid, int qix, uint64_t *desc_addr, uint32_t *
 		return -ENODEV;
 	}
 
+	/* Used elements of a packed ring do not carry the buffer address */
+	if (!rte_vhost_get_negotiated_features(vid, &features) &&
+		(features & (1ULL << VIRTIO_F_RING_PACKED))) {
+		NET_LOG(INFO, "VID: %d qix:%d packed ring, no last desc to check", vid, qix);
+		return -ENOTSUP;
+	}
+
 	desc_id = vq.used->ring[(vq.used->idx -1) & (vq.size -1)].id;
 	*desc_addr = vq.desc[desc_id].addr;
 	*write_len = RTE_MIN(vq.used->ring[(vq.used->idx -1) & (vq.size -1)].len, vq.desc[desc_id].len);
@@ -68,6 +76,13 @@ virtio_vdpa_net_set_vdpa_feature(uint64_t *features)
 	*features &= (~(1ULL << VIRTIO_NET_F_GUEST_ANNOUNCE));
 }
 
+/* Rx buffers hold as many bytes as the used length says */
+static bool
+virtio_vdpa_net_used_len_needed(int qix)
+{
+	return !(qix & 1);
+}
+
 struct virtio_vdpa_device_callback virtio_vdpa_net_callback = {
 	.vhost_feature_get = virtio_vdpa_net_vhost_feature_get,
 	.dirty_desc_get = virtio_vdpa_net_dirty_desc_get,
@@ -76,5 +91,8 @@ struct virtio_vdpa_device_callback virtio_vdpa_net_callback = {
 	.vdpa_queue_num_unit_get = virtio_vdpa_net_queue_num_unit_get,
 	.add_vdpa_feature = virtio_vdpa_net_add_vdpa_feature,
 	.set_vdpa_feature = virtio_vdpa_net_set_vdpa_feature,
+	.inflight_recover = NULL,
+	.inflight_sync = NULL,
+	.used_len_needed = virtio_vdpa_net_used_len_needed,
 };
 
@@ -0,0 +1,436 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright (c) 2024 NVIDIA Corporation & Affiliates
+ */
+
+/*
+ * Control-path work of the VFs runs on a small pool of threads per NUMA node,
+ * so that one VM's DMA mapping or 128 queue setup does not hold the vhost-user
+ * thread, and all other VMs, behind it.
+ *
+ * Device tasks are queued to the home worker of the device and run in order.
+ * Queue tasks of one request are spread over the workers of the node that are
+ * idle and the caller, which waits for them. Workers busy with device tasks,
+ * such as the DMA mapping of another VM, are left out so they do not delay it.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/queue.h>
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_memory.h>
+#include <rte_vdpa.h>
+#include <vdpa_driver.h>
+#include <virtio_api.h>
+
+#include "rte_vf_rpc.h"
+#include "virtio_vdpa.h"
+
+extern int virtio_vdpa_logtype;
+#define DRV_LOG(level, fmt, args...) \
+	rte_log(RTE_LOG_ ## level, virtio_vdpa_logtype, \
+		"VIRTIO VDPA %s(): " fmt "\n", __func__, ##args)
+
+struct virtio_vdpa_task {
+	TAILQ_ENTRY(virtio_vdpa_task) next;
+	virtio_vdpa_task_cb cb;
+	struct virtio_vdpa_priv *priv;
+	void *arg;
+	int idx;
+	bool owned; /* Freed by worker, not waited for by submitter */
+	struct virtio_vdpa_task_sync *sync;
+};
+
+struct virtio_vdpa_worker {
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	TAILQ_HEAD(, virtio_vdpa_task) tasks;
+	bool busy; /* Running a task */
+	bool stop;
+	bool started;
+};
+
+struct virtio_vdpa_worker_pool {
+	struct virtio_vdpa_worker *workers;
+	uint32_t nr_workers;
+	uint32_t next; /* Home worker of the next device */
+	uint32_t ref_cnt;
+};
+
+static struct virtio_vdpa_worker_pool worker_pools[RTE_MAX_NUMA_NODES];
+static pthread_mutex_t worker_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t virtio_vdpa_conf_threads = VIRTIO_VDPA_CONF_THREADS_DEFAULT;
+static __thread struct virtio_vdpa_worker *cur_worker;
+
+static void
+virtio_vdpa_task_sync_done(struct virtio_vdpa_task_sync *sync, int ret)
+{
+	pthread_mutex_lock(&sync->lock);
+	if (ret && !sync->err)
+		sync->err = ret;
+	if (--sync->pending == 0)
+		pthread_cond_broadcast(&sync->cond);
+	pthread_mutex_unlock(&sync->lock);
+}
+
+static int
+virtio_vdpa_task_sync_wait(struct virtio_vdpa_task_sync *sync)
+{
+	int ret;
+
+	pthread_mutex_lock(&sync->lock);
+	while (sync->pending)
+		pthread_cond_wait(&sync->cond, &sync->lock);
+	ret = sync->err;
+	sync->err = 0;
+	pthread_mutex_unlock(&sync->lock);
+	return ret;
+}
+
+static void
+virtio_vdpa_task_sync_init(struct virtio_vdpa_task_sync *sync)
+{
+	pthread_mutex_init(&sync->lock, NULL);
+	pthread_cond_init(&sync->cond, NULL);
+	sync->pending = 0;
+	sync->err = 0;
+}
+
+static void
+virtio_vdpa_task_sync_uninit(struct virtio_vdpa_task_sync *sync)
+{
+	pthread_cond_destroy(&sync->cond);
+	pthread_mutex_destroy(&sync->lock);
+}
+
+static void *
+virtio_vdpa_worker_main(void *arg)
+{
+	struct virtio_vdpa_worker *w = arg;
+	struct virtio_vdpa_task_sync *sync;
+	struct virtio_vdpa_task *task;
+	int ret;
+
+	cur_worker = w;
+	pthread_mutex_lock(&w->lock);
+	while (!w->stop) {
+		task = TAILQ_FIRST(&w->tasks);
+		if (task == NULL) {
+			pthread_cond_wait(&w->cond, &w->lock);
+			continue;
+		}
+		TAILQ_REMOVE(&w->tasks, task, next);
+		w->busy = true;
+		pthread_mutex_unlock(&w->lock);
+
+		ret = task->cb(task->priv, task->idx, task->arg);
+		/* Waiter may free a task it owns as soon as it is done */
+		sync = task->sync;
+		if (task->owned)
+			free(task);
+		virtio_vdpa_task_sync_done(sync, ret);
+
+		pthread_mutex_lock(&w->lock);
+		w->busy = false;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+static void
+virtio_vdpa_worker_enqueue(struct virtio_vdpa_worker *w, struct virtio_vdpa_task *task)
+{
+	pthread_mutex_lock(&w->lock);
+	TAILQ_INSERT_TAIL(&w->tasks, task, next);
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* CPUs of a NUMA node, from "0-3,8-11" in sysfs */
+static int
+virtio_vdpa_node_cpus_get(int node, rte_cpuset_t *cpus)
+{
+	char path[64], list[1024], *p, *end;
+	unsigned long first, last, cpu;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -errno;
+	p = fgets(list, sizeof(list), f);
+	fclose(f);
+	if (p == NULL)
+		return -EIO;
+
+	CPU_ZERO(cpus);
+	while (*p != '\0' && *p != '\n') {
+		first = strtoul(p, &end, 10);
+		if (end == p)
+			return -EINVAL;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtoul(p + 1, &end, 10);
+			if (end == p + 1 || last < first)
+				return -EINVAL;
+			p = end;
+		}
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, cpus);
+		if (*p == ',')
+			p++;
+	}
+
+	return CPU_COUNT(cpus) ? 0 : -ENOENT;
+}
+
+static void
+virtio_vdpa_worker_pool_stop(struct virtio_vdpa_worker_pool *pool)
+{
+	struct virtio_vdpa_worker *w;
+	uint32_t i;
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		w = &pool->workers[i];
+		if (w->started) {
+			pthread_mutex_lock(&w->lock);
+			w->stop = true;
+			pthread_cond_signal(&w->cond);
+			pthread_mutex_unlock(&w->lock);
+			pthread_join(w->tid, NULL);
+		}
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->lock);
+	}
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->nr_workers = 0;
+}
+
+static int
+virtio_vdpa_worker_pool_start(struct virtio_vdpa_worker_pool *pool, int node)
+{
+	char name[RTE_MAX_THREAD_NAME_LEN];
+	rte_cpuset_t node_cpus, cpus;
+	struct virtio_vdpa_worker *w;
+	bool pin;
+	uint32_t i;
+	int ret;
+
+	pool->workers = calloc(virtio_vdpa_conf_threads, sizeof(*pool->workers));
+	if (pool->workers == NULL)
+		return -ENOMEM;
+	pool->nr_workers = virtio_vdpa_conf_threads;
+	pin = !virtio_vdpa_node_cpus_get(node, &node_cpus);
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		w = &pool->workers[i];
+		pthread_mutex_init(&w->lock, NULL);
+		pthread_cond_init(&w->cond, NULL);
+		TAILQ_INIT(&w->tasks);
+		/* "vcfg-<node>-<n>", vfe-vhostd places the threads by this name.
+		 * Node and worker count are below 256, at most 12 chars.
+		 */
+		RTE_BUILD_BUG_ON(RTE_MAX_NUMA_NODES > UINT8_MAX + 1 ||
+				VIRTIO_VDPA_CONF_THREADS_MAX > UINT8_MAX + 1);
+		snprintf(name, sizeof(name), "vcfg-%u-%u", (uint8_t)node, (uint8_t)i);
+		ret = rte_ctrl_thread_create(&w->tid, name, NULL,
+				virtio_vdpa_worker_main, w);
+		if (ret) {
+			DRV_LOG(ERR, "Failed to create config thread %s ret:%d", name, ret);
+			virtio_vdpa_worker_pool_stop(pool);
+			return -ret;
+		}
+		w->started = true;
+
+		/* Stay on control CPUs, only those close to the devices */
+		if (!pin || pthread_getaffinity_np(w->tid, sizeof(cpus), &cpus))
+			continue;
+		CPU_AND(&cpus, &cpus, &node_cpus);
+		if (CPU_COUNT(&cpus))
+			pthread_setaffinity_np(w->tid, sizeof(cpus), &cpus);
+	}
+
+	DRV_LOG(INFO, "Started %u config threads on NUMA node %d%s",
+		pool->nr_workers, node, pin ? "" : ", not pinned");
+	return 0;
+}
+
+void
+virtio_vdpa_task_dev_init(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_vdpa_worker_pool *pool;
+	int node = priv->pdev->device.numa_node;
+	int ret;
+
+	if (node < 0 || node >= RTE_MAX_NUMA_NODES)
+		node = 0;
+
+	virtio_vdpa_task_sync_init(&priv->task_sync);
+	priv->task_pool = NULL;
+
+	pthread_mutex_lock(&worker_pools_lock);
+	if (virtio_vdpa_conf_threads == 0)
+		goto unlock;
+	pool = &worker_pools[node];
+	if (pool->ref_cnt == 0) {
+		ret = virtio_vdpa_worker_pool_start(pool, node);
+		if (ret) {
+			/* Still usable, work runs inline */
+			DRV_LOG(ERR, "%s no config threads on NUMA node %d ret:%d",
+				priv->vf_name.dev_bdf, node, ret);
+			goto unlock;
+		}
+	}
+	pool->ref_cnt++;
+	priv->task_pool = pool;
+	priv->task_worker = pool->next++ % pool->nr_workers;
+unlock:
+	pthread_mutex_unlock(&worker_pools_lock);
+}
+
+void
+virtio_vdpa_task_dev_uninit(struct virtio_vdpa_priv *priv)
+{
+	struct virtio_vdpa_worker_pool *pool = priv->task_pool;
+	int ret;
+
+	ret = virtio_vdpa_task_wait(priv);
+	if (ret)
+		DRV_LOG(ERR, "%s pending work failed ret:%d", priv->vf_name.dev_bdf, ret);
+
+	if (pool) {
+		pthread_mutex_lock(&worker_pools_lock);
+		if (--pool->ref_cnt == 0)
+			virtio_vdpa_worker_pool_stop(pool);
+		pthread_mutex_unlock(&worker_pools_lock);
+		priv->task_pool = NULL;
+	}
+	virtio_vdpa_task_sync_uninit(&priv->task_sync);
+}
+
+int
+virtio_vdpa_task_submit(struct virtio_vdpa_priv *priv, virtio_vdpa_task_cb cb, void *arg)
+{
+	struct virtio_vdpa_worker_pool *pool = priv->task_pool;
+	struct virtio_vdpa_task *task;
+	int ret;
+
+	if (pool == NULL || cur_worker != NULL)
+		goto inline_run;
+
+	task = calloc(1, sizeof(*task));
+	if (task == NULL)
+		goto inline_run;
+	task->cb = cb;
+	task->priv = priv;
+	task->arg = arg;
+	task->owned = true;
+	task->sync = &priv->task_sync;
+
+	pthread_mutex_lock(&priv->task_sync.lock);
+	priv->task_sync.pending++;
+	pthread_mutex_unlock(&priv->task_sync.lock);
+	virtio_vdpa_worker_enqueue(&pool->workers[priv->task_worker], task);
+	return 0;
+
+inline_run:
+	ret = cb(priv, 0, arg);
+	if (ret) {
+		pthread_mutex_lock(&priv->task_sync.lock);
+		if (!priv->task_sync.err)
+			priv->task_sync.err = ret;
+		pthread_mutex_unlock(&priv->task_sync.lock);
+	}
+	return 0;
+}
+
+int
+virtio_vdpa_task_wait(struct virtio_vdpa_priv *priv)
+{
+	return virtio_vdpa_task_sync_wait(&priv->task_sync);
+}
+
+int
+virtio_vdpa_task_run_all(struct virtio_vdpa_priv *priv, virtio_vdpa_task_cb cb,
+		int nr, void *arg)
+{
+	struct virtio_vdpa_worker *idle[VIRTIO_VDPA_CONF_THREADS_MAX];
+	struct virtio_vdpa_worker_pool *pool = priv->task_pool;
+	struct virtio_vdpa_task_sync sync;
+	struct virtio_vdpa_task *tasks;
+	struct virtio_vdpa_worker *w;
+	uint32_t j, nr_idle = 0;
+	int i, ret, err = 0;
+
+	if (pool == NULL || cur_worker != NULL || nr <= 1)
+		goto inline_run;
+
+	for (j = 0; j < pool->nr_workers; j++) {
+		w = &pool->workers[j];
+		pthread_mutex_lock(&w->lock);
+		if (!w->busy && TAILQ_EMPTY(&w->tasks))
+			idle[nr_idle++] = w;
+		pthread_mutex_unlock(&w->lock);
+	}
+	if (nr_idle == 0)
+		goto inline_run;
+
+	tasks = calloc(nr, sizeof(*tasks));
+	if (tasks == NULL)
+		goto inline_run;
+
+	/* Idle workers take one share each, caller takes the last one */
+	virtio_vdpa_task_sync_init(&sync);
+	for (i = 0; i < nr; i++) {
+		j = i % (nr_idle + 1);
+		if (j == nr_idle)
+			continue;
+		tasks[i].cb = cb;
+		tasks[i].priv = priv;
+		tasks[i].arg = arg;
+		tasks[i].idx = i;
+		tasks[i].sync = &sync;
+		pthread_mutex_lock(&sync.lock);
+		sync.pending++;
+		pthread_mutex_unlock(&sync.lock);
+		virtio_vdpa_worker_enqueue(idle[j], &tasks[i]);
+	}
+	for (i = nr_idle; i < nr; i += nr_idle + 1) {
+		ret = cb(priv, i, arg);
+		if (ret && !err)
+			err = ret;
+	}
+	ret = virtio_vdpa_task_sync_wait(&sync);
+	if (ret && !err)
+		err = ret;
+	virtio_vdpa_task_sync_uninit(&sync);
+	free(tasks);
+	return err;
+
+inline_run:
+	for (i = 0; i < nr; i++) {
+		ret = cb(priv, i, arg);
+		if (ret && !err)
+			err = ret;
+	}
+	return err;
+}
+
+int
+rte_vdpa_conf_threads_set(uint32_t nr_threads)
+{
+	if (nr_threads > VIRTIO_VDPA_CONF_THREADS_MAX)
+		return -EINVAL;
+
+	/* Pools already running keep their size */
+	pthread_mutex_lock(&worker_pools_lock);
+	virtio_vdpa_conf_threads = nr_threads;
+	pthread_mutex_unlock(&worker_pools_lock);
+	return 0;
+}
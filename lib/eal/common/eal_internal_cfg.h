@@ -48,6 +48,8 @@ struct hugepage_file_discipline {
 	bool unlink_existing;
 };
 
+#define EAL_INTR_MAX_THREADS 16 /**< max number of interrupt threads */
+
 /**
  * internal configuration
  */
@@ -89,6 +91,10 @@ struct internal_config {
 	volatile enum rte_intr_mode vfio_intr_mode;
 	/** the shared VF token for VFIO-PCI bound PF and VFs devices */
 	rte_uuid_t vfio_vf_token;
+	/** number of pinned interrupt threads, 0 for a single unpinned one */
+	unsigned int intr_nb_threads;
+	/** CPU of each pinned interrupt thread */
+	unsigned int intr_thread_cpu[EAL_INTR_MAX_THREADS];
 	char *hugefile_prefix;      /**< the base filename of hugetlbfs files */
 	char *hugepage_dir;         /**< specific hugetlbfs directory to use */
 	char *user_mbuf_pool_ops_name;
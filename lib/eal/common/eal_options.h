@@ -71,6 +71,8 @@ enum {
 	OPT_VFIO_INTR_NUM,
 #define OPT_VFIO_VF_TOKEN     "vfio-vf-token"
 	OPT_VFIO_VF_TOKEN_NUM,
+#define OPT_INTR_THREADS      "intr-threads"
+	OPT_INTR_THREADS_NUM,
 #define OPT_VMWARE_TSC_MAP    "vmware-tsc-map"
 	OPT_VMWARE_TSC_MAP_NUM,
 #define OPT_LEGACY_MEM    "legacy-mem"
@@ -448,6 +448,7 @@ eal_usage(const char *prgname)
 	       "  --"OPT_CREATE_UIO_DEV"    Create /dev/uioX (usually done by hotplug)\n"
 	       "  --"OPT_VFIO_INTR"         Interrupt mode for VFIO (legacy|msi|msix)\n"
 	       "  --"OPT_VFIO_VF_TOKEN"     VF token (UUID) shared between SR-IOV PF and VFs\n"
+	       "  --"OPT_INTR_THREADS"      CPU list, one interrupt thread pinned on each CPU\n"
 	       "  --"OPT_LEGACY_MEM"        Legacy memory mode (no dynamic allocation, contiguous segments)\n"
 	       "  --"OPT_SINGLE_FILE_SEGMENTS" Put all hugepage memory in single files\n"
 	       "  --"OPT_MATCH_ALLOCATIONS" Free hugepages exactly as allocated\n"
@@ -540,6 +541,47 @@ eal_parse_vfio_vf_token(const char *vf_token)
 	return -1;
 }
 
+static int
+eal_parse_intr_threads(const char *cpulist)
+{
+	struct internal_config *cfg = eal_get_internal_configuration();
+	unsigned int nb = 0;
+	unsigned long first, last;
+	const char *p = cpulist;
+	char *end;
+
+	while (*p != '\0') {
+		errno = 0;
+		first = strtoul(p, &end, 10);
+		if (errno != 0 || end == p)
+			return -1;
+		last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (errno != 0 || end == p || last < first)
+				return -1;
+		}
+		if (last >= CPU_SETSIZE)
+			return -1;
+		for (; first <= last; first++) {
+			if (nb == EAL_INTR_MAX_THREADS)
+				return -1;
+			cfg->intr_thread_cpu[nb++] = first;
+		}
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
+	if (nb == 0)
+		return -1;
+	cfg->intr_nb_threads = nb;
+
+	return 0;
+}
+
 /* Parse the arguments for --log-level only */
 static void
 eal_log_level_parse(int argc, char **argv)
@@ -694,6 +736,16 @@ eal_parse_args(int argc, char **argv)
 			}
 			break;
 
+		case OPT_INTR_THREADS_NUM:
+			if (eal_parse_intr_threads(optarg) < 0) {
+				RTE_LOG(ERR, EAL, "invalid parameters for --"
+						OPT_INTR_THREADS "\n");
+				eal_usage(prgname);
+				ret = -1;
+				goto out;
+			}
+			break;
+
 		case OPT_CREATE_UIO_DEV_NUM:
 			internal_conf->create_uio_dev = 1;
 			break;
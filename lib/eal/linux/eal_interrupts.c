@@ -15,6 +15,7 @@
 #include <sys/eventfd.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <fcntl.h>
 
 #include <rte_common.h>
 #include <rte_interrupts.h>
@@ -28,8 +29,10 @@
 #include <rte_pause.h>
 #include <rte_vfio.h>
 #include <rte_eal_trace.h>
+#include <rte_string_fns.h>
 
 #include "eal_private.h"
+#include "eal_internal_cfg.h"
 
 #define EAL_INTR_EPOLL_WAIT_FOREVER (-1)
 #define NB_OTHER_INTR               1
@@ -62,7 +65,7 @@ union rte_intr_read_buffer {
 };
 
 TAILQ_HEAD(rte_intr_cb_list, rte_intr_callback);
-TAILQ_HEAD(rte_intr_source_list, rte_intr_source);
+LIST_HEAD(rte_intr_source_list, rte_intr_source);
 
 struct rte_intr_callback {
 	TAILQ_ENTRY(rte_intr_callback) next;
@@ -72,24 +75,46 @@ struct rte_intr_callback {
 	rte_intr_unregister_callback_fn ucb_fn; /**< fn to call before cb is deleted */
 };
 
+struct eal_intr_thread;
+
 struct rte_intr_source {
-	TAILQ_ENTRY(rte_intr_source) next;
+	LIST_ENTRY(rte_intr_source) next;   /**< fd index, then zombie list */
 	struct rte_intr_handle *intr_handle; /**< interrupt handle */
 	struct rte_intr_cb_list callbacks;  /**< user callbacks */
 	uint32_t active;
+	int fd;                             /**< fd of the interrupt handle */
+	uint8_t removed;                    /**< out of the index, to be freed */
+	struct eal_intr_thread *thread;     /**< thread waiting on the fd */
+};
+
+/**
+ * Each interrupt thread owns an epoll set, updated in place when sources
+ * come and go, with the source itself as event data. A removed source may
+ * still be reported by an epoll_wait() in flight, so it is freed by its
+ * thread before waiting again.
+ */
+struct eal_intr_thread {
+	pthread_t tid;
+	int epfd;                       /**< epoll set of the thread sources */
+	union intr_pipefds pipe;        /**< wakes the thread up */
+	unsigned int nb_sources;
+	uint8_t rebuild;                /**< epoll set may hold a stale fd */
+	struct rte_intr_source_list zombies; /**< removed sources to free */
 };
 
+#define EAL_INTR_SRC_BUCKETS 256
+#define EAL_INTR_SRC_HASH(fd) ((unsigned int)(fd) & (EAL_INTR_SRC_BUCKETS - 1))
+#define EAL_INTR_EVENTS_MAX  64
+
 /* global spinlock for interrupt data operation */
 static rte_spinlock_t intr_lock = RTE_SPINLOCK_INITIALIZER;
 
-/* union buffer for pipe read/write */
-static union intr_pipefds intr_pipe;
+/* interrupt sources indexed by fd */
+static struct rte_intr_source_list intr_sources[EAL_INTR_SRC_BUCKETS];
 
-/* interrupt sources list */
-static struct rte_intr_source_list intr_sources;
-
-/* interrupt handling thread */
-static pthread_t intr_thread;
+/* interrupt handling threads */
+static struct eal_intr_thread intr_threads[EAL_INTR_MAX_THREADS];
+static unsigned int intr_nb_threads;
 
 /* VFIO interrupts */
 #ifdef VFIO_PRESENT
@@ -480,16 +505,98 @@ uio_intr_enable(const struct rte_intr_handle *intr_handle)
 	return 0;
 }
 
+static struct rte_intr_source *
+eal_intr_source_lookup(int fd)
+{
+	struct rte_intr_source *src;
+
+	LIST_FOREACH(src, &intr_sources[EAL_INTR_SRC_HASH(fd)], next)
+		if (src->fd == fd)
+			break;
+
+	return src;
+}
+
+/* wait on the source fd in the least loaded thread, intr_lock held */
+static int
+eal_intr_source_add(struct rte_intr_source *src)
+{
+	struct eal_intr_thread *thread = &intr_threads[0];
+	struct epoll_event ev;
+	unsigned int i;
+	int ret;
+
+	if (intr_nb_threads == 0) {
+		RTE_LOG(ERR, EAL, "Interrupt thread is not running\n");
+		return -ENOTSUP;
+	}
+
+	for (i = 1; i < intr_nb_threads; i++)
+		if (intr_threads[i].nb_sources < thread->nb_sources)
+			thread = &intr_threads[i];
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLHUP;
+	ev.data.ptr = src;
+	if (epoll_ctl(thread->epfd, EPOLL_CTL_ADD, src->fd, &ev) < 0) {
+		ret = -errno;
+		RTE_LOG(ERR, EAL, "Error adding fd %d epoll_ctl, %s\n",
+			src->fd, strerror(errno));
+		return ret;
+	}
+
+	src->thread = thread;
+	thread->nb_sources++;
+	LIST_INSERT_HEAD(&intr_sources[EAL_INTR_SRC_HASH(src->fd)], src, next);
+
+	return 0;
+}
+
+/* stop waiting on the source fd and hand it to its thread, intr_lock held */
+static void
+eal_intr_source_del(struct rte_intr_source *src)
+{
+	struct eal_intr_thread *thread = src->thread;
+
+	LIST_REMOVE(src, next);
+	/**
+	 * if the fd was closed first while its file stays open elsewhere, or
+	 * it was reused, the old entry remains in the set, start a new one.
+	 */
+	if (epoll_ctl(thread->epfd, EPOLL_CTL_DEL, src->fd, NULL) < 0)
+		thread->rebuild = 1;
+	src->removed = 1;
+	thread->nb_sources--;
+	LIST_INSERT_HEAD(&thread->zombies, src, next);
+
+	/* the pipe is non-blocking, a full one will wake the thread anyway */
+	if (!pthread_equal(thread->tid, pthread_self()) &&
+			write(thread->pipe.writefd, "1", 1) < 0 && errno != EAGAIN)
+		RTE_LOG(ERR, EAL, "Error writing to interrupt thread pipe, %s\n",
+			strerror(errno));
+}
+
+static void
+eal_intr_source_free(struct rte_intr_source *src)
+{
+	struct rte_intr_callback *cb;
+
+	while ((cb = TAILQ_FIRST(&src->callbacks)) != NULL) {
+		TAILQ_REMOVE(&src->callbacks, cb, next);
+		free(cb);
+	}
+	rte_intr_instance_free(src->intr_handle);
+	free(src);
+}
+
 int
 rte_intr_callback_register(const struct rte_intr_handle *intr_handle,
 			rte_intr_callback_fn cb, void *cb_arg)
 {
-	int ret, wake_thread;
+	int ret;
 	struct rte_intr_source *src;
 	struct rte_intr_callback *callback;
 
-	wake_thread = 0;
-
 	/* first do parameter checking */
 	if (rte_intr_fd_get(intr_handle) < 0 || cb == NULL) {
 		RTE_LOG(ERR, EAL, "Registering with invalid input parameter\n");
@@ -510,20 +617,13 @@ rte_intr_callback_register(const struct rte_intr_handle *intr_handle,
 	rte_spinlock_lock(&intr_lock);
 
 	/* check if there is at least one callback registered for the fd */
-	TAILQ_FOREACH(src, &intr_sources, next) {
-		if (rte_intr_fd_get(src->intr_handle) == rte_intr_fd_get(intr_handle)) {
-			/* we had no interrupts for this */
-			if (TAILQ_EMPTY(&src->callbacks))
-				wake_thread = 1;
-
-			TAILQ_INSERT_TAIL(&(src->callbacks), callback, next);
-			ret = 0;
-			break;
-		}
-	}
+	src = eal_intr_source_lookup(rte_intr_fd_get(intr_handle));
+	if (src != NULL) {
+		TAILQ_INSERT_TAIL(&(src->callbacks), callback, next);
+		ret = 0;
 
 	/* no existing callbacks for this - add new source */
-	if (src == NULL) {
+	} else {
 		src = calloc(1, sizeof(*src));
 		if (src == NULL) {
 			RTE_LOG(ERR, EAL, "Can not allocate memory\n");
@@ -543,23 +643,21 @@ rte_intr_callback_register(const struct rte_intr_handle *intr_handle,
 				TAILQ_INIT(&src->callbacks);
 				TAILQ_INSERT_TAIL(&(src->callbacks), callback,
 						  next);
-				TAILQ_INSERT_TAIL(&intr_sources, src, next);
-				wake_thread = 1;
-				ret = 0;
+				src->fd = rte_intr_fd_get(intr_handle);
+				ret = eal_intr_source_add(src);
+				if (ret < 0) {
+					rte_intr_instance_free(src->intr_handle);
+					free(callback);
+					callback = NULL;
+					free(src);
+					src = NULL;
+				}
 			}
 		}
 	}
 
 	rte_spinlock_unlock(&intr_lock);
 
-	/**
-	 * check if need to notify the pipe fd waited by epoll_wait to
-	 * rebuild the wait list.
-	 */
-	if (wake_thread)
-		if (write(intr_pipe.writefd, "1", 1) < 0)
-			ret = -EPIPE;
-
 	rte_eal_trace_intr_callback_register(intr_handle, cb, cb_arg, ret);
 	return ret;
 }
@@ -582,10 +680,7 @@ rte_intr_callback_unregister_pending(const struct rte_intr_handle *intr_handle,
 	rte_spinlock_lock(&intr_lock);
 
 	/* check if the interrupt source for the fd is existent */
-	TAILQ_FOREACH(src, &intr_sources, next) {
-		if (rte_intr_fd_get(src->intr_handle) == rte_intr_fd_get(intr_handle))
-			break;
-	}
+	src = eal_intr_source_lookup(rte_intr_fd_get(intr_handle));
 
 	/* No interrupt source registered for the fd */
 	if (src == NULL) {
@@ -632,9 +727,7 @@ rte_intr_callback_unregister(const struct rte_intr_handle *intr_handle,
 	rte_spinlock_lock(&intr_lock);
 
 	/* check if the interrupt source for the fd is existent */
-	TAILQ_FOREACH(src, &intr_sources, next)
-		if (rte_intr_fd_get(src->intr_handle) == rte_intr_fd_get(intr_handle))
-			break;
+	src = eal_intr_source_lookup(rte_intr_fd_get(intr_handle));
 
 	/* No interrupt source registered for the fd */
 	if (src == NULL) {
@@ -662,20 +755,12 @@ rte_intr_callback_unregister(const struct rte_intr_handle *intr_handle,
 		}
 
 		/* all callbacks for that source are removed. */
-		if (TAILQ_EMPTY(&src->callbacks)) {
-			TAILQ_REMOVE(&intr_sources, src, next);
-			rte_intr_instance_free(src->intr_handle);
-			free(src);
-		}
+		if (TAILQ_EMPTY(&src->callbacks))
+			eal_intr_source_del(src);
 	}
 
 	rte_spinlock_unlock(&intr_lock);
 
-	/* notify the pipe fd waited by epoll_wait to rebuild the wait list */
-	if (ret >= 0 && write(intr_pipe.writefd, "1", 1) < 0) {
-		ret = -EPIPE;
-	}
-
 	rte_eal_trace_intr_callback_unregister(intr_handle, cb_fn, cb_arg,
 		ret);
 	return ret;
@@ -894,11 +979,12 @@ rte_intr_disable(const struct rte_intr_handle *intr_handle)
 	return rc;
 }
 
-static int
-eal_intr_process_interrupts(struct epoll_event *events, int nfds)
+static void
+eal_intr_process_interrupts(struct eal_intr_thread *thread,
+		struct epoll_event *events, int nfds)
 {
 	bool call = false;
-	int n, bytes_read, rv;
+	int n, bytes_read;
 	struct rte_intr_source *src;
 	struct rte_intr_callback *cb, *next;
 	union rte_intr_read_buffer buf;
@@ -906,21 +992,19 @@ eal_intr_process_interrupts(struct epoll_event *events, int nfds)
 
 	for (n = 0; n < nfds; n++) {
 
+		src = events[n].data.ptr;
 		/**
-		 * if the pipe fd is ready to read, return out to
-		 * rebuild the wait list.
+		 * the pipe only wakes us up to release removed sources,
+		 * drain it and go on.
 		 */
-		if (events[n].data.fd == intr_pipe.readfd){
-			int r = read(intr_pipe.readfd, buf.charbuf,
-					sizeof(buf.charbuf));
-			RTE_SET_USED(r);
-			return -1;
+		if (src == NULL) {
+			while (read(thread->pipe.readfd, buf.charbuf,
+					sizeof(buf.charbuf)) > 0)
+				;
+			continue;
 		}
 		rte_spinlock_lock(&intr_lock);
-		TAILQ_FOREACH(src, &intr_sources, next)
-			if (rte_intr_fd_get(src->intr_handle) == events[n].data.fd)
-				break;
-		if (src == NULL){
+		if (src->removed) {
 			rte_spinlock_unlock(&intr_lock);
 			continue;
 		}
@@ -967,36 +1051,31 @@ eal_intr_process_interrupts(struct epoll_event *events, int nfds)
 			 * read out to clear the ready-to-be-read flag
 			 * for epoll_wait.
 			 */
-			bytes_read = read(events[n].data.fd, &buf, bytes_read);
+			bytes_read = read(src->fd, &buf, bytes_read);
 			if (bytes_read < 0) {
-				if (errno == EINTR || errno == EWOULDBLOCK)
+				if (errno == EINTR || errno == EWOULDBLOCK) {
+					rte_spinlock_lock(&intr_lock);
+					src->active = 0;
+					rte_spinlock_unlock(&intr_lock);
 					continue;
+				}
 
 				RTE_LOG(ERR, EAL, "Error reading from file "
 					"descriptor %d: %s\n",
-					events[n].data.fd,
+					src->fd,
 					strerror(errno));
 				/*
 				 * The device is unplugged or buggy, remove
-				 * it as an interrupt source and return to
-				 * force the wait list to be rebuilt.
+				 * it as an interrupt source.
 				 */
 				rte_spinlock_lock(&intr_lock);
-				TAILQ_REMOVE(&intr_sources, src, next);
+				src->active = 0;
+				eal_intr_source_del(src);
 				rte_spinlock_unlock(&intr_lock);
-
-				for (cb = TAILQ_FIRST(&src->callbacks); cb;
-							cb = next) {
-					next = TAILQ_NEXT(cb, next);
-					TAILQ_REMOVE(&src->callbacks, cb, next);
-					free(cb);
-				}
-				rte_intr_instance_free(src->intr_handle);
-				free(src);
-				return -1;
+				continue;
 			} else if (bytes_read == 0)
 				RTE_LOG(ERR, EAL, "Read nothing from file "
-					"descriptor %d\n", events[n].data.fd);
+					"descriptor %d\n", src->fd);
 			else
 				call = true;
 		}
@@ -1023,8 +1102,6 @@ eal_intr_process_interrupts(struct epoll_event *events, int nfds)
 		/* we done with that interrupt source, release it. */
 		src->active = 0;
 
-		rv = 0;
-
 		/* check if any callback are supposed to be removed */
 		for (cb = TAILQ_FIRST(&src->callbacks); cb != NULL; cb = next) {
 			next = TAILQ_NEXT(cb, next);
@@ -1033,167 +1110,220 @@ eal_intr_process_interrupts(struct epoll_event *events, int nfds)
 				if (cb->ucb_fn)
 					cb->ucb_fn(src->intr_handle, cb->cb_arg);
 				free(cb);
-				rv++;
 			}
 		}
 
 		/* all callbacks for that source are removed. */
-		if (TAILQ_EMPTY(&src->callbacks)) {
-			TAILQ_REMOVE(&intr_sources, src, next);
-			rte_intr_instance_free(src->intr_handle);
-			free(src);
-		}
-
-		/* notify the pipe fd waited by epoll_wait to rebuild the wait list */
-		if (rv > 0 && write(intr_pipe.writefd, "1", 1) < 0) {
-			rte_spinlock_unlock(&intr_lock);
-			return -EPIPE;
-		}
+		if (TAILQ_EMPTY(&src->callbacks))
+			eal_intr_source_del(src);
 
 		rte_spinlock_unlock(&intr_lock);
 	}
+}
+
+/**
+ * It creates the epoll file descriptor of an interrupt thread, with only the
+ * wake up pipe in it, and replaces the previous one.
+ *
+ * @param thread
+ *  interrupt thread.
+ *
+ * @return
+ *  0 on success, -1 otherwise.
+ */
+static int
+eal_intr_thread_epoll_init(struct eal_intr_thread *thread)
+{
+	struct epoll_event pipe_event = {
+		.events = EPOLLIN | EPOLLPRI,
+		.data.ptr = NULL,
+	};
+	int pfd;
+
+	pfd = epoll_create(1);
+	if (pfd < 0) {
+		RTE_LOG(ERR, EAL, "Cannot create epoll instance\n");
+		return -1;
+	}
+
+	/**
+	 * add pipe fd into wait list, this pipe is used to wake the thread
+	 * up to release removed sources.
+	 */
+	if (epoll_ctl(pfd, EPOLL_CTL_ADD, thread->pipe.readfd,
+			&pipe_event) < 0) {
+		RTE_LOG(ERR, EAL, "Error adding fd to %d epoll_ctl, %s\n",
+			thread->pipe.readfd, strerror(errno));
+		close(pfd);
+		return -1;
+	}
+
+	if (thread->epfd >= 0)
+		close(thread->epfd);
+	thread->epfd = pfd;
 
 	return 0;
 }
 
 /**
- * It handles all the interrupts.
+ * It rebuilds the epoll set if it may hold a stale fd, then frees the
+ * sources removed since the last wait, which can not be reported anymore.
  *
- * @param pfd
- *  epoll file descriptor.
- * @param totalfds
- *  The number of file descriptors added in epoll.
+ * @param thread
+ *  interrupt thread.
  *
  * @return
  *  void
  */
 static void
-eal_intr_handle_interrupts(int pfd, unsigned totalfds)
+eal_intr_thread_cleanup(struct eal_intr_thread *thread)
 {
-	struct epoll_event events[totalfds];
-	int nfds = 0;
+	struct rte_intr_source *src, *next;
+	struct epoll_event ev;
+	unsigned int i;
 
-	for(;;) {
-		nfds = epoll_wait(pfd, events, totalfds,
-			EAL_INTR_EPOLL_WAIT_FOREVER);
-		/* epoll_wait fail */
-		if (nfds < 0) {
-			if (errno == EINTR)
-				continue;
-			RTE_LOG(ERR, EAL,
-				"epoll_wait returns with fail\n");
-			return;
+	rte_spinlock_lock(&intr_lock);
+
+	if (thread->rebuild) {
+		thread->rebuild = 0;
+		if (eal_intr_thread_epoll_init(thread) < 0)
+			rte_panic("Cannot rebuild interrupt epoll set\n");
+
+		for (i = 0; i < EAL_INTR_SRC_BUCKETS; i++) {
+			LIST_FOREACH(src, &intr_sources[i], next) {
+				if (src->thread != thread)
+					continue;
+				memset(&ev, 0, sizeof(ev));
+				ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP |
+					EPOLLHUP;
+				ev.data.ptr = src;
+				if (epoll_ctl(thread->epfd, EPOLL_CTL_ADD,
+						src->fd, &ev) < 0)
+					rte_panic("Error adding fd %d epoll_ctl, %s\n",
+						src->fd, strerror(errno));
+			}
 		}
-		/* epoll_wait timeout, will never happens here */
-		else if (nfds == 0)
-			continue;
-		/* epoll_wait has at least one fd ready to read */
-		if (eal_intr_process_interrupts(events, nfds) < 0)
-			return;
+	}
+
+	src = LIST_FIRST(&thread->zombies);
+	LIST_INIT(&thread->zombies);
+
+	rte_spinlock_unlock(&intr_lock);
+
+	for (; src != NULL; src = next) {
+		next = LIST_NEXT(src, next);
+		eal_intr_source_free(src);
 	}
 }
 
 /**
- * It builds/rebuilds up the epoll file descriptor with all the
- * file descriptors being waited on. Then handles the interrupts.
+ * It waits on the epoll set of an interrupt thread and handles the
+ * interrupts.
  *
  * @param arg
- *  pointer. (unused)
+ *  interrupt thread.
  *
  * @return
  *  never return;
  */
 static __rte_noreturn void *
-eal_intr_thread_main(__rte_unused void *arg)
+eal_intr_thread_main(void *arg)
 {
+	struct eal_intr_thread *thread = arg;
+	struct epoll_event events[EAL_INTR_EVENTS_MAX];
+	int nfds;
+
 	/* host thread, never break out */
 	for (;;) {
-		/* build up the epoll fd with all descriptors we are to
-		 * wait on then pass it to the handle_interrupts function
-		 */
-		static struct epoll_event pipe_event = {
-			.events = EPOLLIN | EPOLLPRI,
-		};
-		struct rte_intr_source *src;
-		unsigned numfds = 0;
-
-		/* create epoll fd */
-		int pfd = epoll_create(1);
-		if (pfd < 0)
-			rte_panic("Cannot create epoll instance\n");
-
-		pipe_event.data.fd = intr_pipe.readfd;
-		/**
-		 * add pipe fd into wait list, this pipe is used to
-		 * rebuild the wait list.
-		 */
-		if (epoll_ctl(pfd, EPOLL_CTL_ADD, intr_pipe.readfd,
-						&pipe_event) < 0) {
-			rte_panic("Error adding fd to %d epoll_ctl, %s\n",
-					intr_pipe.readfd, strerror(errno));
-		}
-		numfds++;
-
-		rte_spinlock_lock(&intr_lock);
-
-		TAILQ_FOREACH(src, &intr_sources, next) {
-			struct epoll_event ev;
-
-			if (src->callbacks.tqh_first == NULL)
-				continue; /* skip those with no callbacks */
-			memset(&ev, 0, sizeof(ev));
-			ev.events = EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLHUP;
-			ev.data.fd = rte_intr_fd_get(src->intr_handle);
+		eal_intr_thread_cleanup(thread);
 
-			/**
-			 * add all the uio device file descriptor
-			 * into wait list.
-			 */
-			if (epoll_ctl(pfd, EPOLL_CTL_ADD,
-					rte_intr_fd_get(src->intr_handle), &ev) < 0) {
-				rte_panic("Error adding fd %d epoll_ctl, %s\n",
-					rte_intr_fd_get(src->intr_handle),
-					strerror(errno));
-			}
-			else
-				numfds++;
+		nfds = epoll_wait(thread->epfd, events, RTE_DIM(events),
+			EAL_INTR_EPOLL_WAIT_FOREVER);
+		/* epoll_wait fail */
+		if (nfds < 0) {
+			if (errno == EINTR)
+				continue;
+			RTE_LOG(ERR, EAL,
+				"epoll_wait returns with fail\n");
+			/* start over with a new epoll set */
+			rte_spinlock_lock(&intr_lock);
+			thread->rebuild = 1;
+			rte_spinlock_unlock(&intr_lock);
+			continue;
 		}
-		rte_spinlock_unlock(&intr_lock);
-		/* serve the interrupt */
-		eal_intr_handle_interrupts(pfd, numfds);
-
-		/**
-		 * when we return, we need to rebuild the
-		 * list of fds to monitor.
-		 */
-		close(pfd);
+		/* epoll_wait has at least one fd ready to read */
+		eal_intr_process_interrupts(thread, events, nfds);
 	}
 }
 
 int
 rte_eal_intr_init(void)
 {
+	const struct internal_config *internal_conf =
+		eal_get_internal_configuration();
+	struct eal_intr_thread *thread;
+	char name[RTE_MAX_THREAD_NAME_LEN];
+	rte_cpuset_t cpuset;
+	unsigned int i, nb_threads;
 	int ret = 0;
 
-	/* init the global interrupt source head */
-	TAILQ_INIT(&intr_sources);
+	/* init the global interrupt source index */
+	for (i = 0; i < EAL_INTR_SRC_BUCKETS; i++)
+		LIST_INIT(&intr_sources[i]);
 
-	/**
-	 * create a pipe which will be waited by epoll and notified to
-	 * rebuild the wait list of epoll.
-	 */
-	if (pipe(intr_pipe.pipefd) < 0) {
-		rte_errno = errno;
-		return -1;
+	nb_threads = RTE_MAX(internal_conf->intr_nb_threads, 1U);
+	for (i = 0; i < nb_threads; i++) {
+		thread = &intr_threads[i];
+		thread->epfd = -1;
+		LIST_INIT(&thread->zombies);
+
+		/**
+		 * create a pipe which will be waited by epoll and notified to
+		 * release removed sources.
+		 */
+		if (pipe2(thread->pipe.pipefd, O_NONBLOCK) < 0) {
+			rte_errno = errno;
+			return -1;
+		}
+		if (eal_intr_thread_epoll_init(thread) < 0) {
+			rte_errno = errno;
+			return -1;
+		}
 	}
+	intr_nb_threads = nb_threads;
 
-	/* create the host thread to wait/handle the interrupt */
-	ret = rte_ctrl_thread_create(&intr_thread, "eal-intr-thread", NULL,
-			eal_intr_thread_main, NULL);
-	if (ret != 0) {
-		rte_errno = -ret;
-		RTE_LOG(ERR, EAL,
-			"Failed to create thread for interrupt handling\n");
+	for (i = 0; i < nb_threads; i++) {
+		thread = &intr_threads[i];
+		if (internal_conf->intr_nb_threads == 0)
+			strlcpy(name, "eal-intr-thread", sizeof(name));
+		else
+			snprintf(name, sizeof(name), "eal-intr-%u", i);
+
+		/* create the host thread to wait/handle the interrupt */
+		ret = rte_ctrl_thread_create(&thread->tid, name, NULL,
+				eal_intr_thread_main, thread);
+		if (ret != 0) {
+			rte_errno = -ret;
+			RTE_LOG(ERR, EAL,
+				"Failed to create thread for interrupt handling\n");
+			return ret;
+		}
+
+		/* default single thread follows the control threads cpuset */
+		if (internal_conf->intr_nb_threads == 0)
+			continue;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(internal_conf->intr_thread_cpu[i], &cpuset);
+		ret = pthread_setaffinity_np(thread->tid, sizeof(cpuset),
+				&cpuset);
+		if (ret != 0) {
+			rte_errno = ret;
+			RTE_LOG(ERR, EAL,
+				"Failed to pin interrupt thread on CPU %u\n",
+				internal_conf->intr_thread_cpu[i]);
+			return -ret;
+		}
 	}
 
 	return ret;
@@ -1601,5 +1731,11 @@ rte_intr_cap_multiple(struct rte_intr_handle *intr_handle)
 
 int rte_thread_is_intr(void)
 {
-	return pthread_equal(intr_thread, pthread_self());
+	unsigned int i;
+
+	for (i = 0; i < intr_nb_threads; i++)
+		if (pthread_equal(intr_threads[i].tid, pthread_self()))
+			return 1;
+
+	return 0;
 }
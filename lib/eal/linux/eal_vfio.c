@@ -12,6 +12,7 @@
 #include <rte_log.h>
 #include <rte_memory.h>
 #include <rte_eal_memconfig.h>
+#include <rte_rwlock.h>
 #include <rte_vfio.h>
 
 #include "eal_filesystem.h"
@@ -27,7 +28,7 @@
  * was registered by the user themselves, so we need to store the user mappings
  * somewhere, to recreate them later.
  */
-#define VFIO_MAX_USER_MEM_MAPS 256
+#define VFIO_USER_MEM_MAPS_INIT 16
 struct user_mem_map {
 	uint64_t addr;  /**< start VA */
 	uint64_t iova;  /**< start IOVA */
@@ -35,13 +36,16 @@ struct user_mem_map {
 	uint64_t chunk; /**< this mapping can be split in chunks of this size */
 };
 
+/* maps are kept sorted and compacted, the array grows on demand */
 struct user_mem_maps {
 	rte_spinlock_recursive_t lock;
 	int n_maps;
-	struct user_mem_map maps[VFIO_MAX_USER_MEM_MAPS];
+	int max_maps;
+	struct user_mem_map *maps;
 };
 
 struct vfio_config {
+	LIST_ENTRY(vfio_config) fd_next; /* container fd index */
 	int vfio_enabled;
 	int vfio_container_fd;
 	int vfio_active_groups;
@@ -50,9 +54,20 @@ struct vfio_config {
 	struct user_mem_maps mem_maps;
 };
 
-/* per-process VFIO config */
-static struct vfio_config vfio_cfgs[VFIO_MAX_CONTAINERS];
-static struct vfio_config *default_vfio_cfg = &vfio_cfgs[0];
+/* per-process VFIO config, the others are allocated on container create */
+static struct vfio_config default_config;
+static struct vfio_config *default_vfio_cfg = &default_config;
+static unsigned int vfio_nb_containers;
+
+/* containers and groups are looked up by fd and group number on every device
+ * setup and DMA map, index them so it does not depend on the container count.
+ */
+#define VFIO_INDEX_BUCKETS 1024
+#define VFIO_INDEX_HASH(key) ((unsigned int)(key) & (VFIO_INDEX_BUCKETS - 1))
+static LIST_HEAD(, vfio_config) vfio_cfg_fd_index[VFIO_INDEX_BUCKETS];
+static LIST_HEAD(, vfio_group) vfio_group_num_index[VFIO_INDEX_BUCKETS];
+static LIST_HEAD(, vfio_group) vfio_group_fd_index[VFIO_INDEX_BUCKETS];
+static rte_rwlock_t vfio_index_lock = RTE_RWLOCK_INITIALIZER;
 
 static int vfio_type1_dma_map(int);
 static int vfio_type1_dma_mem_map(int, uint64_t, uint64_t, uint64_t, int);
@@ -94,13 +109,6 @@ static const struct vfio_iommu_type iommu_types[] = {
 	},
 };
 
-static int
-is_null_map(const struct user_mem_map *map)
-{
-	return map->addr == 0 && map->iova == 0 &&
-			map->len == 0 && map->chunk == 0;
-}
-
 /* we may need to merge user mem maps together in case of user mapping/unmapping
  * chunks of memory, so we'll need a comparator function to sort segments.
  */
@@ -110,12 +118,6 @@ user_mem_map_cmp(const void *a, const void *b)
 	const struct user_mem_map *umm_a = a;
 	const struct user_mem_map *umm_b = b;
 
-	/* move null entries to end */
-	if (is_null_map(umm_a))
-		return 1;
-	if (is_null_map(umm_b))
-		return -1;
-
 	/* sort by iova first */
 	if (umm_a->iova < umm_b->iova)
 		return -1;
@@ -179,44 +181,15 @@ process_maps(struct user_mem_map *src, size_t src_len,
 	return newmap_len;
 }
 
-/* erase certain maps from the list */
+/* erase a run of maps from the list */
 static void
-delete_maps(struct user_mem_maps *user_mem_maps, struct user_mem_map *del_maps,
-		size_t n_del)
+delete_maps(struct user_mem_maps *user_mem_maps, int first, int n_del)
 {
-	int i;
-	size_t j;
+	struct user_mem_map *maps = user_mem_maps->maps;
 
-	for (i = 0, j = 0; i < VFIO_MAX_USER_MEM_MAPS && j < n_del; i++) {
-		struct user_mem_map *left = &user_mem_maps->maps[i];
-		struct user_mem_map *right = &del_maps[j];
-
-		if (user_mem_map_cmp(left, right) == 0) {
-			memset(left, 0, sizeof(*left));
-			j++;
-			user_mem_maps->n_maps--;
-		}
-	}
-}
-
-static void
-copy_maps(struct user_mem_maps *user_mem_maps, struct user_mem_map *add_maps,
-		size_t n_add)
-{
-	int i;
-	size_t j;
-
-	for (i = 0, j = 0; i < VFIO_MAX_USER_MEM_MAPS && j < n_add; i++) {
-		struct user_mem_map *left = &user_mem_maps->maps[i];
-		struct user_mem_map *right = &add_maps[j];
-
-		/* insert into empty space */
-		if (is_null_map(left)) {
-			memcpy(left, right, sizeof(*left));
-			j++;
-			user_mem_maps->n_maps++;
-		}
-	}
+	memmove(&maps[first], &maps[first + n_del],
+			(user_mem_maps->n_maps - first - n_del) * sizeof(maps[0]));
+	user_mem_maps->n_maps -= n_del;
 }
 
 /* try merging two maps into one, return 1 if succeeded */
@@ -225,7 +198,7 @@ merge_map(struct user_mem_map *left, struct user_mem_map *right)
 {
 	/* merge the same maps into one */
 	if (memcmp(left, right, sizeof(struct user_mem_map)) == 0)
-		goto out;
+		return 1;
 
 	if (left->addr + left->len != right->addr)
 		return 0;
@@ -235,12 +208,66 @@ merge_map(struct user_mem_map *left, struct user_mem_map *right)
 		return 0;
 	left->len += right->len;
 
-out:
-	memset(right, 0, sizeof(*right));
-
 	return 1;
 }
 
+/* make room for one more map, the caller holds the lock */
+static int
+reserve_user_mem_map(struct user_mem_maps *user_mem_maps)
+{
+	struct user_mem_map *maps;
+	int max_maps;
+
+	if (user_mem_maps->n_maps < user_mem_maps->max_maps)
+		return 0;
+
+	max_maps = user_mem_maps->max_maps ?
+			user_mem_maps->max_maps * 2 : VFIO_USER_MEM_MAPS_INIT;
+	maps = realloc(user_mem_maps->maps, max_maps * sizeof(*maps));
+	if (maps == NULL) {
+		RTE_LOG(ERR, EAL, "No more space for user mem maps\n");
+		rte_errno = ENOMEM;
+		return -1;
+	}
+	user_mem_maps->maps = maps;
+	user_mem_maps->max_maps = max_maps;
+	return 0;
+}
+
+/* insert a map at its sorted place and merge it with its neighbours. the list
+ * is always compacted, so only the new map may merge, with the maps next to it.
+ */
+static int
+insert_user_mem_map(struct user_mem_maps *user_mem_maps,
+		const struct user_mem_map *new_map)
+{
+	struct user_mem_map *maps;
+	int lo = 0, hi = user_mem_maps->n_maps, mid;
+
+	if (reserve_user_mem_map(user_mem_maps))
+		return -1;
+	maps = user_mem_maps->maps;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (user_mem_map_cmp(&maps[mid], new_map) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	memmove(&maps[lo + 1], &maps[lo],
+			(user_mem_maps->n_maps - lo) * sizeof(maps[0]));
+	maps[lo] = *new_map;
+	user_mem_maps->n_maps++;
+
+	if (lo + 1 < user_mem_maps->n_maps && merge_map(&maps[lo], &maps[lo + 1]))
+		delete_maps(user_mem_maps, lo + 1, 1);
+	if (lo > 0 && merge_map(&maps[lo - 1], &maps[lo]))
+		delete_maps(user_mem_maps, lo, 1);
+
+	return 0;
+}
+
 static bool
 addr_is_chunk_aligned(struct user_mem_map *maps, size_t n_maps,
 		uint64_t vaddr, uint64_t iova)
@@ -268,19 +295,29 @@ addr_is_chunk_aligned(struct user_mem_map *maps, size_t n_maps,
 	return false;
 }
 
+/* find the run of maps covering the region, return its length and first index */
 static int
 find_user_mem_maps(struct user_mem_maps *user_mem_maps, uint64_t addr,
-		uint64_t iova, uint64_t len, struct user_mem_map *dst,
-		size_t dst_len)
+		uint64_t iova, uint64_t len, int *first)
 {
 	uint64_t va_end = addr + len;
 	uint64_t iova_end = iova + len;
+	struct user_mem_map *maps = user_mem_maps->maps;
+	int lo = 0, hi = user_mem_maps->n_maps, mid;
 	bool found = false;
-	size_t j;
-	int i, ret;
+	int i;
 
-	for (i = 0, j = 0; i < user_mem_maps->n_maps; i++) {
-		struct user_mem_map *map = &user_mem_maps->maps[i];
+	/* IOVA ranges of one container never overlap, skip maps ending before us */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (maps[mid].iova + maps[mid].len <= iova)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = lo; i < user_mem_maps->n_maps; i++) {
+		struct user_mem_map *map = &maps[i];
 		uint64_t map_va_end = map->addr + map->len;
 		uint64_t map_iova_end = map->iova + map->len;
 
@@ -293,60 +330,137 @@ find_user_mem_maps(struct user_mem_maps *user_mem_maps, uint64_t addr,
 		bool end_iova_in_map = (iova_end > map->iova) &&
 				(iova_end <= map_iova_end);
 
-		/* do we have space in temporary map? */
-		if (j == dst_len) {
-			ret = -ENOSPC;
-			goto err;
-		}
 		/* check if current map is start of our segment */
-		if (!found && start_addr_in_map && start_iova_in_map)
+		if (!found && start_addr_in_map && start_iova_in_map) {
 			found = true;
-		/* if we have previously found a segment, add it to the map */
-		if (found) {
-			/* copy the segment into our temporary map */
-			memcpy(&dst[j++], map, sizeof(*map));
-
-			/* if we match end of segment, quit */
-			if (end_addr_in_map && end_iova_in_map)
-				return j;
+			*first = i;
 		}
+		/* if we match end of segment, quit */
+		if (found && end_addr_in_map && end_iova_in_map)
+			return i - *first + 1;
 	}
 	/* we didn't find anything */
-	ret = -ENOENT;
-err:
-	memset(dst, 0, sizeof(*dst) * dst_len);
-	return ret;
+	return -ENOENT;
 }
 
-/* this will sort all user maps, and merge/compact any adjacent maps */
 static void
-compact_user_maps(struct user_mem_maps *user_mem_maps)
+vfio_cfg_init(struct vfio_config *vfio_cfg)
 {
+	rte_spinlock_recursive_t lock = RTE_SPINLOCK_RECURSIVE_INITIALIZER;
 	int i;
 
-	qsort(user_mem_maps->maps, VFIO_MAX_USER_MEM_MAPS,
-			sizeof(user_mem_maps->maps[0]), user_mem_map_cmp);
+	vfio_cfg->vfio_active_groups = 0;
+	vfio_cfg->vfio_iommu_type = NULL;
+	vfio_cfg->mem_maps.lock = lock;
 
-	/* we'll go over the list backwards when merging */
-	for (i = VFIO_MAX_USER_MEM_MAPS - 2; i >= 0; i--) {
-		struct user_mem_map *l, *r;
+	for (i = 0; i < VFIO_MAX_GROUPS; i++) {
+		vfio_cfg->vfio_groups[i].fd = -1;
+		vfio_cfg->vfio_groups[i].group_num = -1;
+		vfio_cfg->vfio_groups[i].devices = 0;
+	}
+}
 
-		l = &user_mem_maps->maps[i];
-		r = &user_mem_maps->maps[i + 1];
+static struct vfio_config *
+vfio_cfg_alloc(void)
+{
+	struct vfio_config *vfio_cfg;
 
-		if (is_null_map(l) || is_null_map(r))
-			continue;
+	/* default container is not counted */
+	if (vfio_nb_containers >= VFIO_MAX_CONTAINERS - 1) {
+		RTE_LOG(ERR, EAL, "Exceed max VFIO container limit\n");
+		return NULL;
+	}
 
-		/* try and merge the maps */
-		if (merge_map(l, r))
-			user_mem_maps->n_maps--;
+	vfio_cfg = calloc(1, sizeof(*vfio_cfg));
+	if (vfio_cfg == NULL) {
+		RTE_LOG(ERR, EAL, "Cannot allocate VFIO container config\n");
+		return NULL;
 	}
+	vfio_cfg_init(vfio_cfg);
+	vfio_cfg->vfio_container_fd = -1;
+	vfio_nb_containers++;
 
-	/* the entries are still sorted, but now they have holes in them, so
-	 * sort the list again.
-	 */
-	qsort(user_mem_maps->maps, VFIO_MAX_USER_MEM_MAPS,
-			sizeof(user_mem_maps->maps[0]), user_mem_map_cmp);
+	return vfio_cfg;
+}
+
+static void
+vfio_cfg_free(struct vfio_config *vfio_cfg)
+{
+	free(vfio_cfg->mem_maps.maps);
+	free(vfio_cfg);
+	vfio_nb_containers--;
+}
+
+static void
+vfio_cfg_index_add(struct vfio_config *vfio_cfg)
+{
+	rte_rwlock_write_lock(&vfio_index_lock);
+	LIST_INSERT_HEAD(&vfio_cfg_fd_index[VFIO_INDEX_HASH(vfio_cfg->vfio_container_fd)],
+			vfio_cfg, fd_next);
+	rte_rwlock_write_unlock(&vfio_index_lock);
+}
+
+static void
+vfio_cfg_index_del(struct vfio_config *vfio_cfg)
+{
+	rte_rwlock_write_lock(&vfio_index_lock);
+	LIST_REMOVE(vfio_cfg, fd_next);
+	rte_rwlock_write_unlock(&vfio_index_lock);
+}
+
+static void
+vfio_group_index_add(struct vfio_config *vfio_cfg, struct vfio_group *grp)
+{
+	grp->cfg = vfio_cfg;
+	rte_rwlock_write_lock(&vfio_index_lock);
+	LIST_INSERT_HEAD(&vfio_group_num_index[VFIO_INDEX_HASH(grp->group_num)],
+			grp, num_next);
+	LIST_INSERT_HEAD(&vfio_group_fd_index[VFIO_INDEX_HASH(grp->fd)],
+			grp, fd_next);
+	rte_rwlock_write_unlock(&vfio_index_lock);
+}
+
+static void
+vfio_group_index_del(struct vfio_group *grp)
+{
+	rte_rwlock_write_lock(&vfio_index_lock);
+	LIST_REMOVE(grp, num_next);
+	LIST_REMOVE(grp, fd_next);
+	rte_rwlock_write_unlock(&vfio_index_lock);
+	grp->cfg = NULL;
+}
+
+static struct vfio_group *
+vfio_group_find_by_num(struct vfio_config *vfio_cfg, int iommu_group_num)
+{
+	struct vfio_group *grp;
+
+	rte_rwlock_read_lock(&vfio_index_lock);
+	LIST_FOREACH(grp, &vfio_group_num_index[VFIO_INDEX_HASH(iommu_group_num)],
+			num_next) {
+		if (grp->group_num == iommu_group_num &&
+				(vfio_cfg == NULL || grp->cfg == vfio_cfg))
+			break;
+	}
+	rte_rwlock_read_unlock(&vfio_index_lock);
+
+	return grp;
+}
+
+static struct vfio_group *
+vfio_group_find_by_fd(int vfio_group_fd)
+{
+	struct vfio_group *grp;
+
+	rte_rwlock_read_lock(&vfio_index_lock);
+	LIST_FOREACH(grp, &vfio_group_fd_index[VFIO_INDEX_HASH(vfio_group_fd)],
+			fd_next) {
+		if (grp->fd == vfio_group_fd)
+			break;
+	}
+	rte_rwlock_read_unlock(&vfio_index_lock);
+
+	return grp;
 }
 
 static int
@@ -425,52 +539,49 @@ vfio_open_group_fd(int iommu_group_num)
 static struct vfio_config *
 get_vfio_cfg_by_group_num(int iommu_group_num)
 {
-	struct vfio_config *vfio_cfg;
-	int i, j;
-
-	for (i = 0; i < VFIO_MAX_CONTAINERS; i++) {
-		vfio_cfg = &vfio_cfgs[i];
-		for (j = 0; j < VFIO_MAX_GROUPS; j++) {
-			if (vfio_cfg->vfio_groups[j].group_num ==
-					iommu_group_num)
-				return vfio_cfg;
-		}
-	}
+	struct vfio_group *grp;
 
-	return NULL;
+	grp = vfio_group_find_by_num(NULL, iommu_group_num);
+
+	return grp ? grp->cfg : NULL;
 }
 
-static int
-vfio_get_group_fd(struct vfio_config *vfio_cfg,
-		int iommu_group_num)
+static struct vfio_group *
+vfio_group_slot_get(struct vfio_config *vfio_cfg)
 {
 	int i;
-	int vfio_group_fd;
-	struct vfio_group *cur_grp;
-
-	/* check if we already have the group descriptor open */
-	for (i = 0; i < VFIO_MAX_GROUPS; i++)
-		if (vfio_cfg->vfio_groups[i].group_num == iommu_group_num)
-			return vfio_cfg->vfio_groups[i].fd;
 
 	/* Lets see first if there is room for a new group */
 	if (vfio_cfg->vfio_active_groups == VFIO_MAX_GROUPS) {
 		RTE_LOG(ERR, EAL, "Maximum number of VFIO groups reached!\n");
-		return -1;
+		return NULL;
 	}
 
 	/* Now lets get an index for the new group */
 	for (i = 0; i < VFIO_MAX_GROUPS; i++)
-		if (vfio_cfg->vfio_groups[i].group_num == -1) {
-			cur_grp = &vfio_cfg->vfio_groups[i];
-			break;
-		}
+		if (vfio_cfg->vfio_groups[i].group_num == -1)
+			return &vfio_cfg->vfio_groups[i];
 
 	/* This should not happen */
-	if (i == VFIO_MAX_GROUPS) {
-		RTE_LOG(ERR, EAL, "No VFIO group free slot found\n");
+	RTE_LOG(ERR, EAL, "No VFIO group free slot found\n");
+	return NULL;
+}
+
+static int
+vfio_get_group_fd(struct vfio_config *vfio_cfg,
+		int iommu_group_num)
+{
+	int vfio_group_fd;
+	struct vfio_group *cur_grp;
+
+	/* check if we already have the group descriptor open */
+	cur_grp = vfio_group_find_by_num(vfio_cfg, iommu_group_num);
+	if (cur_grp != NULL)
+		return cur_grp->fd;
+
+	cur_grp = vfio_group_slot_get(vfio_cfg);
+	if (cur_grp == NULL)
 		return -1;
-	}
 
 	vfio_group_fd = vfio_open_group_fd(iommu_group_num);
 	if (vfio_group_fd < 0) {
@@ -481,6 +592,7 @@ vfio_get_group_fd(struct vfio_config *vfio_cfg,
 
 	cur_grp->group_num = iommu_group_num;
 	cur_grp->fd = vfio_group_fd;
+	vfio_group_index_add(vfio_cfg, cur_grp);
 	vfio_cfg->vfio_active_groups++;
 
 	return vfio_group_fd;
@@ -490,73 +602,42 @@ static int
 vfio_set_group_fd(struct vfio_config *vfio_cfg,
 		int iommu_group_num, int group_fd)
 {
-	int i;
-	int vfio_group_fd;
 	struct vfio_group *cur_grp;
 
 	/* check if we already have the group descriptor open */
-	for (i = 0; i < VFIO_MAX_GROUPS; i++)
-		if (vfio_cfg->vfio_groups[i].group_num == iommu_group_num)
-			return 0;
-
-	/* Lets see first if there is room for a new group */
-	if (vfio_cfg->vfio_active_groups == VFIO_MAX_GROUPS) {
-		RTE_LOG(ERR, EAL, "Maximum number of VFIO groups reached!\n");
-		return -1;
-	}
-
-	/* Now lets get an index for the new group */
-	for (i = 0; i < VFIO_MAX_GROUPS; i++)
-		if (vfio_cfg->vfio_groups[i].group_num == -1) {
-			cur_grp = &vfio_cfg->vfio_groups[i];
-			break;
-		}
+	if (vfio_group_find_by_num(vfio_cfg, iommu_group_num) != NULL)
+		return 0;
 
-	/* This should not happen */
-	if (i == VFIO_MAX_GROUPS) {
-		RTE_LOG(ERR, EAL, "No VFIO group free slot found\n");
+	cur_grp = vfio_group_slot_get(vfio_cfg);
+	if (cur_grp == NULL)
 		return -1;
-	}
-
-	vfio_group_fd = group_fd;
 
 	cur_grp->group_num = iommu_group_num;
-	cur_grp->fd = vfio_group_fd;
+	cur_grp->fd = group_fd;
+	vfio_group_index_add(vfio_cfg, cur_grp);
 	vfio_cfg->vfio_active_groups++;
 
 	return 0;
 }
 
-static struct vfio_config *
-get_vfio_cfg_by_group_fd(int vfio_group_fd)
-{
-	struct vfio_config *vfio_cfg;
-	int i, j;
-
-	for (i = 0; i < VFIO_MAX_CONTAINERS; i++) {
-		vfio_cfg = &vfio_cfgs[i];
-		for (j = 0; j < VFIO_MAX_GROUPS; j++)
-			if (vfio_cfg->vfio_groups[j].fd == vfio_group_fd)
-				return vfio_cfg;
-	}
-
-	return NULL;
-}
-
 static struct vfio_config *
 get_vfio_cfg_by_container_fd(int container_fd)
 {
-	int i;
+	struct vfio_config *vfio_cfg;
 
-	if (container_fd == RTE_VFIO_DEFAULT_CONTAINER_FD)
+	if (container_fd == RTE_VFIO_DEFAULT_CONTAINER_FD ||
+			container_fd == default_vfio_cfg->vfio_container_fd)
 		return default_vfio_cfg;
 
-	for (i = 0; i < VFIO_MAX_CONTAINERS; i++) {
-		if (vfio_cfgs[i].vfio_container_fd == container_fd)
-			return &vfio_cfgs[i];
+	rte_rwlock_read_lock(&vfio_index_lock);
+	LIST_FOREACH(vfio_cfg, &vfio_cfg_fd_index[VFIO_INDEX_HASH(container_fd)],
+			fd_next) {
+		if (vfio_cfg->vfio_container_fd == container_fd)
+			break;
 	}
+	rte_rwlock_read_unlock(&vfio_index_lock);
 
-	return NULL;
+	return vfio_cfg;
 }
 
 int
@@ -571,79 +652,46 @@ rte_vfio_get_group_fd(int iommu_group_num)
 	return vfio_get_group_fd(vfio_cfg, iommu_group_num);
 }
 
-static int
-get_vfio_group_idx(int vfio_group_fd)
-{
-	struct vfio_config *vfio_cfg;
-	int i, j;
-
-	for (i = 0; i < VFIO_MAX_CONTAINERS; i++) {
-		vfio_cfg = &vfio_cfgs[i];
-		for (j = 0; j < VFIO_MAX_GROUPS; j++)
-			if (vfio_cfg->vfio_groups[j].fd == vfio_group_fd)
-				return j;
-	}
-
-	return -1;
-}
-
 static void
 vfio_group_device_get(int vfio_group_fd)
 {
-	struct vfio_config *vfio_cfg;
-	int i;
+	struct vfio_group *grp;
 
-	vfio_cfg = get_vfio_cfg_by_group_fd(vfio_group_fd);
-	if (vfio_cfg == NULL) {
+	grp = vfio_group_find_by_fd(vfio_group_fd);
+	if (grp == NULL) {
 		RTE_LOG(ERR, EAL, "Invalid VFIO group fd!\n");
 		return;
 	}
 
-	i = get_vfio_group_idx(vfio_group_fd);
-	if (i < 0 || i > (VFIO_MAX_GROUPS - 1))
-		RTE_LOG(ERR, EAL, "Wrong VFIO group index (%d)\n", i);
-	else
-		vfio_cfg->vfio_groups[i].devices++;
+	grp->devices++;
 }
 
 static void
 vfio_group_device_put(int vfio_group_fd)
 {
-	struct vfio_config *vfio_cfg;
-	int i;
+	struct vfio_group *grp;
 
-	vfio_cfg = get_vfio_cfg_by_group_fd(vfio_group_fd);
-	if (vfio_cfg == NULL) {
+	grp = vfio_group_find_by_fd(vfio_group_fd);
+	if (grp == NULL) {
 		RTE_LOG(ERR, EAL, "Invalid VFIO group fd!\n");
 		return;
 	}
 
-	i = get_vfio_group_idx(vfio_group_fd);
-	if (i < 0 || i > (VFIO_MAX_GROUPS - 1))
-		RTE_LOG(ERR, EAL, "Wrong VFIO group index (%d)\n", i);
-	else
-		vfio_cfg->vfio_groups[i].devices--;
+	grp->devices--;
 }
 
 static int
 vfio_group_device_count(int vfio_group_fd)
 {
-	struct vfio_config *vfio_cfg;
-	int i;
+	struct vfio_group *grp;
 
-	vfio_cfg = get_vfio_cfg_by_group_fd(vfio_group_fd);
-	if (vfio_cfg == NULL) {
+	grp = vfio_group_find_by_fd(vfio_group_fd);
+	if (grp == NULL) {
 		RTE_LOG(ERR, EAL, "Invalid VFIO group fd!\n");
 		return -1;
 	}
 
-	i = get_vfio_group_idx(vfio_group_fd);
-	if (i < 0 || i > (VFIO_MAX_GROUPS - 1)) {
-		RTE_LOG(ERR, EAL, "Wrong VFIO group index (%d)\n", i);
-		return -1;
-	}
-
-	return vfio_cfg->vfio_groups[i].devices;
+	return grp->devices;
 }
 
 static void
@@ -760,21 +808,20 @@ vfio_sync_default_container(void)
 int
 rte_vfio_clear_group(int vfio_group_fd)
 {
-	int i;
 	struct vfio_config *vfio_cfg;
+	struct vfio_group *grp;
 
-	vfio_cfg = get_vfio_cfg_by_group_fd(vfio_group_fd);
-	if (vfio_cfg == NULL) {
+	grp = vfio_group_find_by_fd(vfio_group_fd);
+	if (grp == NULL) {
 		RTE_LOG(ERR, EAL, "Invalid VFIO group fd!\n");
 		return -1;
 	}
 
-	i = get_vfio_group_idx(vfio_group_fd);
-	if (i < 0)
-		return -1;
-	vfio_cfg->vfio_groups[i].group_num = -1;
-	vfio_cfg->vfio_groups[i].fd = -1;
-	vfio_cfg->vfio_groups[i].devices = 0;
+	vfio_cfg = grp->cfg;
+	vfio_group_index_del(grp);
+	grp->group_num = -1;
+	grp->fd = -1;
+	grp->devices = 0;
 	vfio_cfg->vfio_active_groups--;
 
 	return 0;
@@ -1286,27 +1333,12 @@ rte_vfio_release_device(const char *sysfs_base, const char *dev_addr,
 int
 rte_vfio_enable(const char *modname)
 {
-	/* initialize group list */
-	int i, j;
 	int vfio_available;
 	const struct internal_config *internal_conf =
 		eal_get_internal_configuration();
 
-	rte_spinlock_recursive_t lock = RTE_SPINLOCK_RECURSIVE_INITIALIZER;
-
-	for (i = 0; i < VFIO_MAX_CONTAINERS; i++) {
-		if (i > 0)
-			vfio_cfgs[i].vfio_container_fd = -1;
-		vfio_cfgs[i].vfio_active_groups = 0;
-		vfio_cfgs[i].vfio_iommu_type = NULL;
-		vfio_cfgs[i].mem_maps.lock = lock;
-
-		for (j = 0; j < VFIO_MAX_GROUPS; j++) {
-			vfio_cfgs[i].vfio_groups[j].fd = -1;
-			vfio_cfgs[i].vfio_groups[j].group_num = -1;
-			vfio_cfgs[i].vfio_groups[j].devices = 0;
-		}
-	}
+	/* initialize group list, container fd may be restored already */
+	vfio_cfg_init(default_vfio_cfg);
 
 	RTE_LOG(DEBUG, EAL, "Probing VFIO support...\n");
 
@@ -2104,16 +2136,15 @@ static int
 container_dma_map(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 		uint64_t len)
 {
-	struct user_mem_map *new_map;
+	struct user_mem_map new_map;
 	struct user_mem_maps *user_mem_maps;
 	bool has_partial_unmap;
 	int ret = 0;
 
 	user_mem_maps = &vfio_cfg->mem_maps;
 	rte_spinlock_recursive_lock(&user_mem_maps->lock);
-	if (user_mem_maps->n_maps == VFIO_MAX_USER_MEM_MAPS) {
-		RTE_LOG(ERR, EAL, "No more space for user mem maps\n");
-		rte_errno = ENOMEM;
+	/* make sure the map can be stored before mapping it */
+	if (reserve_user_mem_map(user_mem_maps)) {
 		ret = -1;
 		goto out;
 	}
@@ -2134,14 +2165,13 @@ container_dma_map(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 	has_partial_unmap = vfio_cfg->vfio_iommu_type->partial_unmap;
 
 	/* create new user mem map entry */
-	new_map = &user_mem_maps->maps[user_mem_maps->n_maps++];
-	new_map->addr = vaddr;
-	new_map->iova = iova;
-	new_map->len = len;
+	new_map.addr = vaddr;
+	new_map.iova = iova;
+	new_map.len = len;
 	/* for IOMMU types supporting partial unmap, we don't need chunking */
-	new_map->chunk = has_partial_unmap ? 0 : len;
+	new_map.chunk = has_partial_unmap ? 0 : len;
 
-	compact_user_maps(user_mem_maps);
+	ret = insert_user_mem_map(user_mem_maps, &new_map);
 out:
 	rte_spinlock_recursive_unlock(&user_mem_maps->lock);
 	return ret;
@@ -2151,33 +2181,25 @@ static int
 container_set_dma_map(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 		uint64_t len)
 {
-	struct user_mem_map *new_map;
+	struct user_mem_map new_map;
 	struct user_mem_maps *user_mem_maps;
 	bool has_partial_unmap;
 	int ret = 0;
 
 	user_mem_maps = &vfio_cfg->mem_maps;
 	rte_spinlock_recursive_lock(&user_mem_maps->lock);
-	if (user_mem_maps->n_maps == VFIO_MAX_USER_MEM_MAPS) {
-		RTE_LOG(ERR, EAL, "No more space for user mem maps\n");
-		rte_errno = ENOMEM;
-		ret = -1;
-		goto out;
-	}
 
 	/* do we have partial unmap support? */
 	has_partial_unmap = vfio_cfg->vfio_iommu_type->partial_unmap;
 
 	/* create new user mem map entry */
-	new_map = &user_mem_maps->maps[user_mem_maps->n_maps++];
-	new_map->addr = vaddr;
-	new_map->iova = iova;
-	new_map->len = len;
+	new_map.addr = vaddr;
+	new_map.iova = iova;
+	new_map.len = len;
 	/* for IOMMU types supporting partial unmap, we don't need chunking */
-	new_map->chunk = has_partial_unmap ? 0 : len;
+	new_map.chunk = has_partial_unmap ? 0 : len;
 
-	compact_user_maps(user_mem_maps);
-out:
+	ret = insert_user_mem_map(user_mem_maps, &new_map);
 	rte_spinlock_recursive_unlock(&user_mem_maps->lock);
 	return ret;
 }
@@ -2186,10 +2208,10 @@ static int
 container_dma_unmap(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 		uint64_t len)
 {
-	struct user_mem_map orig_maps[VFIO_MAX_USER_MEM_MAPS];
+	struct user_mem_map *orig_maps;
 	struct user_mem_map new_maps[2]; /* can be at most 2 */
 	struct user_mem_maps *user_mem_maps;
-	int n_orig, n_new, newlen, ret = 0;
+	int first = 0, n_orig, n_new, i, ret = 0;
 	bool has_partial_unmap;
 
 	user_mem_maps = &vfio_cfg->mem_maps;
@@ -2213,8 +2235,7 @@ container_dma_unmap(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 	 * the start and the end of our requested unmap. We need to collect all
 	 * maps that include our unmapped region.
 	 */
-	n_orig = find_user_mem_maps(user_mem_maps, vaddr, iova, len,
-			orig_maps, RTE_DIM(orig_maps));
+	n_orig = find_user_mem_maps(user_mem_maps, vaddr, iova, len, &first);
 	/* did we find anything? */
 	if (n_orig < 0) {
 		RTE_LOG(ERR, EAL, "Couldn't find previously mapped region\n");
@@ -2223,6 +2244,8 @@ container_dma_unmap(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 		goto out;
 	}
 
+	orig_maps = &user_mem_maps->maps[first];
+
 	/* do we have partial unmap capability? */
 	has_partial_unmap = vfio_cfg->vfio_iommu_type->partial_unmap;
 
@@ -2247,18 +2270,13 @@ container_dma_unmap(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 	}
 
 	/*
-	 * now we know we can potentially unmap the region, but we still have to
-	 * figure out if there is enough space in our list to store remaining
-	 * maps. for this, we will figure out how many segments we are going to
-	 * remove, and how many new segments we are going to create.
+	 * now we know we can potentially unmap the region. figure out which
+	 * segments of the maps we remove are kept. splitting a single map
+	 * needs one more slot, make sure we have it before unmapping.
 	 */
 	n_new = process_maps(orig_maps, n_orig, new_maps, vaddr, len);
-
-	/* can we store the new maps in our list? */
-	newlen = (user_mem_maps->n_maps - n_orig) + n_new;
-	if (newlen >= VFIO_MAX_USER_MEM_MAPS) {
+	if (n_new > n_orig && reserve_user_mem_map(user_mem_maps)) {
 		RTE_LOG(ERR, EAL, "Not enough space to store partial mapping\n");
-		rte_errno = ENOMEM;
 		ret = -1;
 		goto out;
 	}
@@ -2282,10 +2300,12 @@ container_dma_unmap(struct vfio_config *vfio_cfg, uint64_t vaddr, uint64_t iova,
 		}
 	}
 
-	/* we have unmapped the region, so now update the maps */
-	delete_maps(user_mem_maps, orig_maps, n_orig);
-	copy_maps(user_mem_maps, new_maps, n_new);
-	compact_user_maps(user_mem_maps);
+	/* we have unmapped the region, so now update the maps. room for the
+	 * kept segments is already there, insert cannot fail.
+	 */
+	delete_maps(user_mem_maps, first, n_orig);
+	for (i = 0; i < n_new; i++)
+		insert_user_mem_map(user_mem_maps, &new_maps[i]);
 out:
 	rte_spinlock_recursive_unlock(&user_mem_maps->lock);
 	return ret;
@@ -2326,49 +2346,39 @@ rte_vfio_noiommu_is_enabled(void)
 int
 rte_vfio_container_create(void)
 {
-	int i;
-
-	/* Find an empty slot to store new vfio config */
-	for (i = 1; i < VFIO_MAX_CONTAINERS; i++) {
-		if (vfio_cfgs[i].vfio_container_fd == -1)
-			break;
-	}
+	struct vfio_config *vfio_cfg;
 
-	if (i == VFIO_MAX_CONTAINERS) {
-		RTE_LOG(ERR, EAL, "Exceed max VFIO container limit\n");
+	vfio_cfg = vfio_cfg_alloc();
+	if (vfio_cfg == NULL)
 		return -1;
-	}
 
-	vfio_cfgs[i].vfio_container_fd = rte_vfio_get_container_fd();
-	if (vfio_cfgs[i].vfio_container_fd < 0) {
+	vfio_cfg->vfio_container_fd = rte_vfio_get_container_fd();
+	if (vfio_cfg->vfio_container_fd < 0) {
 		RTE_LOG(NOTICE, EAL, "Fail to create a new VFIO container\n");
+		vfio_cfg_free(vfio_cfg);
 		return -1;
 	}
+	vfio_cfg_index_add(vfio_cfg);
 
-	return vfio_cfgs[i].vfio_container_fd;
+	return vfio_cfg->vfio_container_fd;
 }
 
 int
 rte_vfio_container_set(int container_fd)
 {
-	int i;
-
-	/* Find an empty slot to store new vfio config */
-	for (i = 1; i < VFIO_MAX_CONTAINERS; i++) {
-		if (vfio_cfgs[i].vfio_container_fd == -1)
-			break;
-	}
+	struct vfio_config *vfio_cfg;
 
-	if (i == VFIO_MAX_CONTAINERS) {
-		RTE_LOG(ERR, EAL, "Exceed max VFIO container limit\n");
+	if (container_fd < 0) {
+		RTE_LOG(NOTICE, EAL, "Fail to set a new VFIO container\n");
 		return -1;
 	}
 
-	vfio_cfgs[i].vfio_container_fd = container_fd;
-	if (vfio_cfgs[i].vfio_container_fd < 0) {
-		RTE_LOG(NOTICE, EAL, "Fail to set a new VFIO container\n");
+	vfio_cfg = vfio_cfg_alloc();
+	if (vfio_cfg == NULL)
 		return -1;
-	}
+
+	vfio_cfg->vfio_container_fd = container_fd;
+	vfio_cfg_index_add(vfio_cfg);
 
 	return 0;
 }
@@ -2377,6 +2387,7 @@ int
 rte_vfio_container_destroy(int container_fd)
 {
 	struct vfio_config *vfio_cfg;
+	struct vfio_group *grp;
 	int i;
 
 	vfio_cfg = get_vfio_cfg_by_container_fd(container_fd);
@@ -2388,12 +2399,28 @@ rte_vfio_container_destroy(int container_fd)
 	if (container_fd == RTE_VFIO_DEFAULT_CONTAINER_FD)
 		container_fd = vfio_cfg->vfio_container_fd;
 
-	for (i = 0; i < VFIO_MAX_GROUPS; i++)
-		if (vfio_cfg->vfio_groups[i].group_num != -1)
-			rte_vfio_container_group_unbind(container_fd,
-				vfio_cfg->vfio_groups[i].group_num);
+	for (i = 0; i < VFIO_MAX_GROUPS; i++) {
+		grp = &vfio_cfg->vfio_groups[i];
+		if (grp->group_num == -1)
+			continue;
+		if (rte_vfio_container_group_unbind(container_fd, grp->group_num) == 0)
+			continue;
+		/* Group must not be found through the index once its config is gone */
+		if (grp->cfg != NULL)
+			vfio_group_index_del(grp);
+		grp->group_num = -1;
+		grp->fd = -1;
+		grp->devices = 0;
+	}
 
 	close(container_fd);
+
+	if (vfio_cfg != default_vfio_cfg) {
+		vfio_cfg_index_del(vfio_cfg);
+		vfio_cfg_free(vfio_cfg);
+		return 0;
+	}
+
 	vfio_cfg->vfio_container_fd = -1;
 	vfio_cfg->vfio_active_groups = 0;
 	vfio_cfg->vfio_iommu_type = NULL;
@@ -2433,8 +2460,7 @@ int
 rte_vfio_container_group_unbind(int container_fd, int iommu_group_num)
 {
 	struct vfio_config *vfio_cfg;
-	struct vfio_group *cur_grp = NULL;
-	int i;
+	struct vfio_group *cur_grp;
 
 	vfio_cfg = get_vfio_cfg_by_container_fd(container_fd);
 	if (vfio_cfg == NULL) {
@@ -2442,15 +2468,9 @@ rte_vfio_container_group_unbind(int container_fd, int iommu_group_num)
 		return -1;
 	}
 
-	for (i = 0; i < VFIO_MAX_GROUPS; i++) {
-		if (vfio_cfg->vfio_groups[i].group_num == iommu_group_num) {
-			cur_grp = &vfio_cfg->vfio_groups[i];
-			break;
-		}
-	}
-
+	cur_grp = vfio_group_find_by_num(vfio_cfg, iommu_group_num);
 	/* This should not happen */
-	if (i == VFIO_MAX_GROUPS || cur_grp == NULL) {
+	if (cur_grp == NULL) {
 		RTE_LOG(ERR, EAL, "Specified VFIO group number not found\n");
 		return -1;
 	}
@@ -2461,6 +2481,7 @@ rte_vfio_container_group_unbind(int container_fd, int iommu_group_num)
 			"%d\n", iommu_group_num);
 		return -1;
 	}
+	vfio_group_index_del(cur_grp);
 	cur_grp->group_num = -1;
 	cur_grp->fd = -1;
 	cur_grp->devices = 0;
@@ -22,6 +22,7 @@
 #ifdef VFIO_PRESENT
 
 #include <stdint.h>
+#include <sys/queue.h>
 #include <linux/vfio.h>
 
 #define RTE_VFIO_TYPE1 VFIO_TYPE1_IOMMU
@@ -86,6 +87,8 @@ struct vfio_iommu_spapr_tce_info {
 #define VFIO_MAX_GROUPS RTE_MAX_VFIO_GROUPS
 #define VFIO_MAX_CONTAINERS RTE_MAX_VFIO_CONTAINERS
 
+struct vfio_config;
+
 /*
  * we don't need to store device fd's anywhere since they can be obtained from
  * the group fd via an ioctl() call.
@@ -94,6 +97,9 @@ struct vfio_group {
 	int group_num;
 	int fd;
 	int devices;
+	struct vfio_config *cfg; /* container the group is bound to */
+	LIST_ENTRY(vfio_group) num_next; /* group number index */
+	LIST_ENTRY(vfio_group) fd_next; /* group fd index */
 };
 
 /* DMA mapping function prototype.
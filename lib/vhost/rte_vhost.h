@@ -983,6 +983,159 @@ rte_vhost_get_monitor_addr(int vid, uint16_t queue_id,
 int
 rte_vhost_get_log_base(int vid, uint64_t *log_base, uint64_t *log_size);
 
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Enable or disable vhost-user message handling latency tracking. When
+ * enabled, per device and per message type latency histograms are exposed
+ * by the /vhost/msg_latency telemetry command, and messages slower than
+ * the given threshold are recorded for the /vhost/slow_msgs command.
+ *
+ * @param enable
+ *  true to enable latency tracking, false to disable it
+ * @param slow_msg_usecs
+ *  Handling time above which a message is recorded as slow, 0 disables
+ *  slow message recording
+ * @return
+ *  0 on success, -1 on failure
+ */
+__rte_experimental
+int
+rte_vhost_msg_latency_enable(bool enable, uint32_t slow_msg_usecs);
+
+/**
+ * Guest notification coalescing parameters of a vhost device.
+ */
+struct rte_vhost_notify_coalesce_conf {
+	/** Deliver after this many coalesced calls, 0 disables coalescing */
+	uint32_t max_calls;
+	/** Deliver at most this long after the first coalesced call */
+	uint32_t max_usecs;
+	/** Adapt the call threshold to the per-queue notification rate */
+	uint32_t adaptive;
+};
+
+/**
+ * Guest notification statistics of a vhost virtqueue.
+ */
+struct rte_vhost_notify_stats {
+	/** Number of guest notifications written to the call eventfd */
+	uint64_t delivered;
+	/** Number of guest notifications merged by coalescing */
+	uint64_t suppressed;
+};
+
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Configure guest notification coalescing of a vhost device. When enabled,
+ * notifications are deferred until max_calls of them are pending on a
+ * virtqueue or max_usecs elapsed since the first one, and the application
+ * must call rte_vhost_notify_flush() periodically on every thread that
+ * notifies the guest, so that expired notifications get delivered. Only
+ * lcores can defer notifications, other threads deliver them immediately.
+ * Notifications of a device attached to a vDPA device, raised by the driver
+ * control threads, are delivered by an EAL alarm instead and need no flush.
+ *
+ * @param vid
+ *  vhost device ID
+ * @param conf
+ *  Coalescing parameters
+ * @return
+ *  0 on success, -1 on failure
+ */
+__rte_experimental
+int
+rte_vhost_notify_coalesce_set(int vid,
+		const struct rte_vhost_notify_coalesce_conf *conf);
+
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Deliver the guest notifications deferred by the calling lcore whose
+ * coalescing window expired.
+ *
+ * @return
+ *  Number of notifications delivered
+ */
+__rte_experimental
+uint16_t
+rte_vhost_notify_flush(void);
+
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Get the guest notification statistics of a vhost virtqueue
+ *
+ * @param vid
+ *  vhost device ID
+ * @param queue_id
+ *  vhost queue index
+ * @param stats
+ *  A pointer to store the notification statistics
+ * @return
+ *  0 on success, -1 on failure
+ */
+__rte_experimental
+int
+rte_vhost_notify_stats_get(int vid, uint16_t queue_id,
+		struct rte_vhost_notify_stats *stats);
+
+/**
+ * Dirty page logging statistics of a vhost virtqueue.
+ */
+struct rte_vhost_log_stats {
+	/** Number of log cache syncs to the dirty log bitmap */
+	uint64_t flushes;
+	/** Number of dirty pages written through the log cache */
+	uint64_t pages;
+	/** Number of log cache lines evicted before a sync */
+	uint64_t evictions;
+	/** Number of dirty pages written without log cache */
+	uint64_t direct_pages;
+};
+
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Get the dirty page logging statistics of a vhost virtqueue
+ *
+ * @param vid
+ *  vhost device ID
+ * @param queue_id
+ *  vhost queue index
+ * @param stats
+ *  A pointer to store the logging statistics
+ * @return
+ *  0 on success, -1 on failure
+ */
+__rte_experimental
+int
+rte_vhost_vring_log_stats_get(int vid, uint16_t queue_id,
+		struct rte_vhost_log_stats *stats);
+
+/**
+ * @warning
+ * @b EXPERIMENTAL: this API may change, or be removed, without prior notice.
+ *
+ * Reset the dirty page logging statistics of a vhost virtqueue
+ *
+ * @param vid
+ *  vhost device ID
+ * @param queue_id
+ *  vhost queue index
+ * @return
+ *  0 on success, -1 on failure
+ */
+__rte_experimental
+int
+rte_vhost_vring_log_stats_reset(int vid, uint16_t queue_id);
+
 /**
  * Get last_avail/used_idx of the vhost virtqueue
  *
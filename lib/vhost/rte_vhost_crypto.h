@@ -118,6 +118,8 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
  * Finalize the dequeued crypto ops. After the translated crypto ops are
  * dequeued from the cryptodev, this function shall be called to write the
  * processed data back to the vring descriptor (if no-copy is turned off).
+ * The ops of a virt-queue must be given in the order they were fetched, the
+ * guest may have negotiated in-order completion.
  *
  * @param ops
  *  The address of an array of *rte_crypto_op* structure that was dequeued
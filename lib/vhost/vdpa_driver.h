@@ -84,8 +84,8 @@ struct rte_vdpa_dev_ops {
 	/** Memory table cleanup */
 	void (*mem_tbl_cleanup)(struct rte_vdpa_device *dev);
 
-	/** Reserved for future extension */
-	void *reserved[1];
+	/** Vhost log moved, called before the old log is unmapped */
+	int (*set_log_base)(int vid);
 };
 
 /**
@@ -11,10 +11,13 @@
 #include <numaif.h>
 #endif
 
+#include <rte_alarm.h>
+#include <rte_cycles.h>
 #include <rte_errno.h>
 #include <rte_log.h>
 #include <rte_memory.h>
 #include <rte_malloc.h>
+#include <rte_spinlock.h>
 #include <rte_vhost.h>
 
 #include "iotlb.h"
@@ -131,9 +134,53 @@ __vhost_log_write_iova(struct virtio_net *dev, struct vhost_virtqueue *vq,
 		__vhost_log_write(dev, gpa, len);
 }
 
+static __rte_always_inline void
+vhost_log_cache_flush_entry(unsigned long *log_base, struct vhost_virtqueue *vq,
+		struct log_cache_entry *elem)
+{
+	unsigned long *dst = log_base + elem->line * VHOST_LOG_CACHE_WORDS;
+	uint32_t i;
+
+	for (i = 0; i < VHOST_LOG_CACHE_WORDS; i++) {
+		unsigned long val = elem->val[i];
+
+		if (!val)
+			continue;
+
+		vq->log_stats.pages += __builtin_popcountl(val);
+#if defined(RTE_TOOLCHAIN_GCC) && (GCC_VERSION < 70100)
+		/*
+		 * '__sync' builtins are deprecated, but '__atomic' ones
+		 * are sub-optimized in older GCC versions.
+		 */
+		__sync_fetch_and_or(dst + i, val);
+#else
+		__atomic_fetch_or(dst + i, val, __ATOMIC_RELAXED);
+#endif
+		elem->val[i] = 0;
+	}
+}
+
+struct vhost_log_cache *
+vhost_log_cache_alloc(int numa_node)
+{
+	struct vhost_log_cache *cache;
+	int i;
+
+	cache = rte_zmalloc_socket("vq log cache", sizeof(*cache), 0, numa_node);
+	if (!cache)
+		return NULL;
+
+	for (i = 0; i < VHOST_LOG_CACHE_NR; i++)
+		cache->entries[i].line = VHOST_LOG_CACHE_LINE_FREE;
+
+	return cache;
+}
+
 void
 __vhost_log_cache_sync(struct virtio_net *dev, struct vhost_virtqueue *vq)
 {
+	struct vhost_log_cache *cache = vq->log_cache;
 	unsigned long *log_base;
 	int i;
 
@@ -141,7 +188,10 @@ __vhost_log_cache_sync(struct virtio_net *dev, struct vhost_virtqueue *vq)
 		return;
 
 	/* No cache, nothing to sync */
-	if (unlikely(!vq->log_cache))
+	if (unlikely(!cache))
+		return;
+
+	if (!vq->log_cache_nb_elem)
 		return;
 
 	rte_atomic_thread_fence(__ATOMIC_RELEASE);
@@ -149,64 +199,59 @@ __vhost_log_cache_sync(struct virtio_net *dev, struct vhost_virtqueue *vq)
 	log_base = (unsigned long *)(uintptr_t)dev->log_base;
 
 	for (i = 0; i < vq->log_cache_nb_elem; i++) {
-		struct log_cache_entry *elem = vq->log_cache + i;
+		struct log_cache_entry *elem = &cache->entries[cache->used[i]];
 
-#if defined(RTE_TOOLCHAIN_GCC) && (GCC_VERSION < 70100)
-		/*
-		 * '__sync' builtins are deprecated, but '__atomic' ones
-		 * are sub-optimized in older GCC versions.
-		 */
-		__sync_fetch_and_or(log_base + elem->offset, elem->val);
-#else
-		__atomic_fetch_or(log_base + elem->offset, elem->val,
-				__ATOMIC_RELAXED);
-#endif
+		vhost_log_cache_flush_entry(log_base, vq, elem);
+		elem->line = VHOST_LOG_CACHE_LINE_FREE;
 	}
 
 	rte_atomic_thread_fence(__ATOMIC_RELEASE);
 
 	vq->log_cache_nb_elem = 0;
+	vq->log_stats.flushes++;
 }
 
 static __rte_always_inline void
 vhost_log_cache_page(struct virtio_net *dev, struct vhost_virtqueue *vq,
 			uint64_t page)
 {
-	uint32_t bit_nr = page % (sizeof(unsigned long) << 3);
-	uint32_t offset = page / (sizeof(unsigned long) << 3);
-	int i;
+	const uint32_t word_bits = sizeof(unsigned long) << 3;
+	uint64_t line = page / (word_bits * VHOST_LOG_CACHE_WORDS);
+	uint32_t word = (page / word_bits) % VHOST_LOG_CACHE_WORDS;
+	uint32_t bit_nr = page % word_bits;
+	struct vhost_log_cache *cache = vq->log_cache;
+	struct log_cache_entry *elem;
+	uint16_t slot;
 
-	if (unlikely(!vq->log_cache)) {
+	if (unlikely(!cache)) {
 		/* No logging cache allocated, write dirty log map directly */
 		rte_atomic_thread_fence(__ATOMIC_RELEASE);
 		vhost_log_page((uint8_t *)(uintptr_t)dev->log_base, page);
+		vq->log_stats.direct_pages++;
 
 		return;
 	}
 
-	for (i = 0; i < vq->log_cache_nb_elem; i++) {
-		struct log_cache_entry *elem = vq->log_cache + i;
-
-		if (elem->offset == offset) {
-			elem->val |= (1UL << bit_nr);
-			return;
+	slot = line & (VHOST_LOG_CACHE_NR - 1);
+	elem = &cache->entries[slot];
+
+	if (unlikely(elem->line != line)) {
+		if (elem->line == VHOST_LOG_CACHE_LINE_FREE) {
+			cache->used[vq->log_cache_nb_elem++] = slot;
+		} else {
+			/*
+			 * Slot already shadows another log line,
+			 * evict it to the dirty log map first.
+			 */
+			rte_atomic_thread_fence(__ATOMIC_RELEASE);
+			vhost_log_cache_flush_entry((unsigned long *)(uintptr_t)dev->log_base,
+					vq, elem);
+			vq->log_stats.evictions++;
 		}
+		elem->line = line;
 	}
 
-	if (unlikely(i >= VHOST_LOG_CACHE_NR)) {
-		/*
-		 * No more room for a new log cache entry,
-		 * so write the dirty log map directly.
-		 */
-		rte_atomic_thread_fence(__ATOMIC_RELEASE);
-		vhost_log_page((uint8_t *)(uintptr_t)dev->log_base, page);
-
-		return;
-	}
-
-	vq->log_cache[i].offset = offset;
-	vq->log_cache[i].val = (1UL << bit_nr);
-	vq->log_cache_nb_elem++;
+	elem->val[word] |= (1UL << bit_nr);
 }
 
 void
@@ -376,6 +421,7 @@ free_device(struct virtio_net *dev)
 	for (i = 0; i < dev->nr_vring; i++)
 		free_vq(dev, dev->virtqueue[i]);
 
+	rte_free(dev->msg_latency);
 	rte_free(dev);
 }
 
@@ -564,6 +610,8 @@ init_vring_queue(struct virtio_net *dev, uint32_t vring_idx)
 	vq->kickfd = VIRTIO_UNINITIALIZED_EVENTFD;
 	vq->callfd = VIRTIO_UNINITIALIZED_EVENTFD;
 	vq->notif_enable = VIRTIO_UNINITIALIZED_NOTIF;
+	vq->vring_idx = vring_idx;
+	vq->notify_thresh = dev->notify_coalesce.max_calls;
 
 #ifdef RTE_LIBRTE_VHOST_NUMA
 	if (get_mempolicy(&numa_node, NULL, 0, vq, MPOL_F_NODE | MPOL_F_ADDR)) {
@@ -721,10 +769,15 @@ vhost_destroy_device(int vid)
 
 	vhost_destroy_device_notify(dev);
 
+	vhost_notify_purge(dev);
+
 	cleanup_device(dev, 1);
-	free_device(dev);
 
+	/* Serialize with telemetry readers of the device */
+	pthread_mutex_lock(&vhost_dev_lock);
+	free_device(dev);
 	vhost_devices[vid] = NULL;
+	pthread_mutex_unlock(&vhost_dev_lock);
 }
 
 void
@@ -1289,6 +1342,320 @@ rte_vhost_set_last_inflight_io_packed(int vid, uint16_t vring_idx,
 	return 0;
 }
 
+/*
+ * Virtqueues with a deferred guest notification, per lcore. They are
+ * delivered by rte_vhost_notify_flush() on the lcore, the lock only
+ * serializes with the purge done on device destruction.
+ */
+#define VHOST_NOTIFY_PENDING_MAX 256
+
+struct vhost_notify_pending {
+	rte_spinlock_t lock;
+	uint16_t nb;
+	struct {
+		int vid;
+		uint16_t vring_idx;
+	} entries[VHOST_NOTIFY_PENDING_MAX];
+} __rte_cache_aligned;
+
+static struct vhost_notify_pending vhost_notify_pending[RTE_MAX_LCORE];
+
+/*
+ * Adaptive moderation: grow the call threshold when it is reached before
+ * the time window expires (high rate), shrink it when the window expires
+ * with few calls accumulated (low rate, favour latency).
+ */
+static __rte_always_inline void
+vhost_notify_adapt(struct virtio_net *dev, struct vhost_virtqueue *vq,
+		bool timeout)
+{
+	if (!dev->notify_coalesce.adaptive)
+		return;
+
+	if (!timeout)
+		vq->notify_thresh = RTE_MIN((uint32_t)vq->notify_thresh * 2,
+				dev->notify_coalesce.max_calls);
+	else if (vq->notify_pending < vq->notify_thresh / 4)
+		vq->notify_thresh = RTE_MAX(vq->notify_thresh / 2, 1);
+}
+
+/* Called with vq->access_lock held */
+static uint16_t
+vhost_notify_deliver(struct virtio_net *dev, struct vhost_virtqueue *vq)
+{
+	vhost_notify_adapt(dev, vq, true);
+	vq->notify_pending = 0;
+	if (!vq->access_ok || vq->callfd < 0)
+		return 0;
+
+	eventfd_write(vq->callfd, (eventfd_t)1);
+	vq->notify_stats.delivered++;
+	if (dev->notify_ops->guest_notified)
+		dev->notify_ops->guest_notified(dev->vid);
+
+	return 1;
+}
+
+/*
+ * The vDPA drivers notify the guest from their control threads, which do
+ * not poll: the deferred notifications of a vDPA device are delivered by
+ * an alarm armed on the first of them, at most max_usecs later.
+ */
+static void
+vhost_notify_alarm(void *arg)
+{
+	int vid = (int)(uintptr_t)arg;
+	struct virtio_net *dev = get_device(vid);
+	uint32_t i;
+
+	if (dev == NULL)
+		return;
+
+	/* Calls deferred from now on arm a new alarm */
+	__atomic_store_n(&dev->notify_alarm_armed, 0, __ATOMIC_RELEASE);
+
+	for (i = 0; i < dev->nr_vring; i++) {
+		struct vhost_virtqueue *vq = dev->virtqueue[i];
+
+		if (!vq)
+			continue;
+
+		rte_spinlock_lock(&vq->access_lock);
+		if (vq->notify_pending)
+			vhost_notify_deliver(dev, vq);
+		rte_spinlock_unlock(&vq->access_lock);
+	}
+}
+
+static bool
+vhost_notify_defer_vdpa(struct virtio_net *dev)
+{
+	uint32_t armed = 0;
+
+	if (!__atomic_compare_exchange_n(&dev->notify_alarm_armed, &armed, 1,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return true;
+
+	if (rte_eal_alarm_set(RTE_MAX(dev->notify_coalesce.max_usecs, 1U),
+			vhost_notify_alarm, (void *)(uintptr_t)dev->vid) < 0) {
+		__atomic_store_n(&dev->notify_alarm_armed, 0, __ATOMIC_RELEASE);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+vhost_notify_defer_lcore(struct virtio_net *dev, struct vhost_virtqueue *vq)
+{
+	struct vhost_notify_pending *pending;
+	unsigned int lcore_id = rte_lcore_id();
+	bool queued = false;
+
+	if (vq->notify_queued)
+		return true;
+
+	/* Threads without lcore id cannot flush, do not defer */
+	if (unlikely(lcore_id >= RTE_MAX_LCORE))
+		return false;
+
+	pending = &vhost_notify_pending[lcore_id];
+	rte_spinlock_lock(&pending->lock);
+	/* No room to track it, do not risk losing the notification */
+	if (likely(pending->nb < VHOST_NOTIFY_PENDING_MAX)) {
+		pending->entries[pending->nb].vid = dev->vid;
+		pending->entries[pending->nb].vring_idx = vq->vring_idx;
+		pending->nb++;
+		vq->notify_queued = true;
+		queued = true;
+	}
+	rte_spinlock_unlock(&pending->lock);
+
+	return queued;
+}
+
+/* Called with vq->access_lock held */
+bool
+vhost_vring_notify_defer(struct virtio_net *dev, struct vhost_virtqueue *vq)
+{
+	uint64_t now = rte_get_timer_cycles();
+	bool deferred;
+
+	if (vq->notify_pending == 0)
+		vq->notify_first_tsc = now;
+
+	vq->notify_pending++;
+
+	if (vq->notify_pending >= vq->notify_thresh) {
+		vhost_notify_adapt(dev, vq, false);
+		goto deliver;
+	}
+
+	if (now - vq->notify_first_tsc >= dev->notify_coalesce_cycles) {
+		vhost_notify_adapt(dev, vq, true);
+		goto deliver;
+	}
+
+	if (dev->vdpa_dev)
+		deferred = vhost_notify_defer_vdpa(dev);
+	else
+		deferred = vhost_notify_defer_lcore(dev, vq);
+	if (!deferred)
+		goto deliver;
+
+	vq->notify_stats.suppressed++;
+
+	return true;
+
+deliver:
+	vq->notify_pending = 0;
+
+	return false;
+}
+
+/* Drop the deferred notifications of a device being destroyed */
+void
+vhost_notify_purge(struct virtio_net *dev)
+{
+	unsigned int lcore_id;
+	uint16_t i, nb;
+
+	rte_eal_alarm_cancel(vhost_notify_alarm, (void *)(uintptr_t)dev->vid);
+	__atomic_store_n(&dev->notify_alarm_armed, 0, __ATOMIC_RELEASE);
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		struct vhost_notify_pending *pending = &vhost_notify_pending[lcore_id];
+
+		if (__atomic_load_n(&pending->nb, __ATOMIC_RELAXED) == 0)
+			continue;
+
+		rte_spinlock_lock(&pending->lock);
+		for (i = 0, nb = 0; i < pending->nb; i++) {
+			if (pending->entries[i].vid != dev->vid)
+				pending->entries[nb++] = pending->entries[i];
+		}
+		pending->nb = nb;
+		rte_spinlock_unlock(&pending->lock);
+	}
+}
+
+uint16_t
+rte_vhost_notify_flush(void)
+{
+	struct vhost_notify_pending *pending;
+	unsigned int lcore_id = rte_lcore_id();
+	uint64_t now = rte_get_timer_cycles();
+	uint16_t i, nb = 0, delivered = 0;
+
+	if (lcore_id >= RTE_MAX_LCORE)
+		return 0;
+
+	pending = &vhost_notify_pending[lcore_id];
+	if (__atomic_load_n(&pending->nb, __ATOMIC_RELAXED) == 0)
+		return 0;
+
+	rte_spinlock_lock(&pending->lock);
+
+	for (i = 0; i < pending->nb; i++) {
+		struct virtio_net *dev;
+		struct vhost_virtqueue *vq;
+		uint16_t vring_idx = pending->entries[i].vring_idx;
+		bool keep = false;
+
+		dev = vhost_devices[pending->entries[i].vid];
+		if (!dev || vring_idx >= VHOST_MAX_VRING)
+			continue;
+
+		vq = dev->virtqueue[vring_idx];
+		if (!vq)
+			continue;
+
+		rte_spinlock_lock(&vq->access_lock);
+
+		if (vq->notify_pending) {
+			if (dev->notify_coalesce.max_calls &&
+					now - vq->notify_first_tsc <
+					dev->notify_coalesce_cycles)
+				keep = true;
+			else
+				delivered += vhost_notify_deliver(dev, vq);
+		}
+
+		if (keep)
+			pending->entries[nb++] = pending->entries[i];
+		else
+			vq->notify_queued = false;
+
+		rte_spinlock_unlock(&vq->access_lock);
+	}
+
+	pending->nb = nb;
+
+	rte_spinlock_unlock(&pending->lock);
+
+	return delivered;
+}
+
+int
+rte_vhost_notify_coalesce_set(int vid,
+		const struct rte_vhost_notify_coalesce_conf *conf)
+{
+	struct virtio_net *dev = get_device(vid);
+	uint32_t i;
+
+	if (dev == NULL || conf == NULL)
+		return -1;
+
+	if (conf->max_calls > UINT16_MAX || (conf->max_calls && !conf->max_usecs)) {
+		VHOST_LOG_CONFIG(ERR, "(%s) invalid notification coalescing parameters\n",
+				dev->ifname);
+		return -1;
+	}
+
+	dev->notify_coalesce = *conf;
+	dev->notify_coalesce_cycles = rte_get_timer_hz() * conf->max_usecs / 1E6;
+
+	for (i = 0; i < dev->nr_vring; i++) {
+		struct vhost_virtqueue *vq = dev->virtqueue[i];
+
+		if (!vq)
+			continue;
+
+		rte_spinlock_lock(&vq->access_lock);
+		vq->notify_thresh = conf->max_calls;
+		rte_spinlock_unlock(&vq->access_lock);
+	}
+
+	VHOST_LOG_CONFIG(INFO, "(%s) notification coalescing: max_calls %u max_usecs %u adaptive %u\n",
+			dev->ifname, conf->max_calls, conf->max_usecs, conf->adaptive);
+
+	return 0;
+}
+
+int
+rte_vhost_notify_stats_get(int vid, uint16_t queue_id,
+		struct rte_vhost_notify_stats *stats)
+{
+	struct vhost_virtqueue *vq;
+	struct virtio_net *dev = get_device(vid);
+
+	if (dev == NULL || stats == NULL)
+		return -1;
+
+	if (queue_id >= VHOST_MAX_VRING)
+		return -1;
+
+	vq = dev->virtqueue[queue_id];
+	if (!vq)
+		return -1;
+
+	rte_spinlock_lock(&vq->access_lock);
+	*stats = vq->notify_stats;
+	rte_spinlock_unlock(&vq->access_lock);
+
+	return 0;
+}
+
 int
 rte_vhost_vring_call(int vid, uint16_t vring_idx)
 {
@@ -1535,6 +1902,53 @@ rte_vhost_get_log_base(int vid, uint64_t *log_base,
 	return 0;
 }
 
+int
+rte_vhost_vring_log_stats_get(int vid, uint16_t queue_id,
+		struct rte_vhost_log_stats *stats)
+{
+	struct vhost_virtqueue *vq;
+	struct virtio_net *dev = get_device(vid);
+
+	if (dev == NULL || stats == NULL)
+		return -1;
+
+	if (queue_id >= VHOST_MAX_VRING)
+		return -1;
+
+	vq = dev->virtqueue[queue_id];
+	if (!vq)
+		return -1;
+
+	rte_spinlock_lock(&vq->access_lock);
+	*stats = vq->log_stats;
+	rte_spinlock_unlock(&vq->access_lock);
+
+	return 0;
+}
+
+int
+rte_vhost_vring_log_stats_reset(int vid, uint16_t queue_id)
+{
+	struct vhost_virtqueue *vq;
+	struct virtio_net *dev = get_device(vid);
+
+	if (dev == NULL)
+		return -1;
+
+	if (queue_id >= VHOST_MAX_VRING)
+		return -1;
+
+	vq = dev->virtqueue[queue_id];
+	if (!vq)
+		return -1;
+
+	rte_spinlock_lock(&vq->access_lock);
+	memset(&vq->log_stats, 0, sizeof(vq->log_stats));
+	rte_spinlock_unlock(&vq->access_lock);
+
+	return 0;
+}
+
 int
 rte_vhost_get_vring_base(int vid, uint16_t queue_id,
 		uint16_t *last_avail_idx, uint16_t *last_used_idx)
@@ -49,7 +49,11 @@
 
 #define BUF_VECTOR_MAX 256
 
-#define VHOST_LOG_CACHE_NR 32
+/* Number of dirty log cache entries per virtqueue, must be a power of 2 */
+#define VHOST_LOG_CACHE_NR 64
+/* Dirty log bitmap words shadowed by one log cache entry */
+#define VHOST_LOG_CACHE_WORDS (RTE_CACHE_LINE_SIZE / sizeof(unsigned long))
+#define VHOST_LOG_CACHE_LINE_FREE UINT64_MAX
 
 #define MAX_PKT_BURST 32
 
@@ -159,10 +163,22 @@ struct batch_copy_elem {
 
 /*
  * Structure that contains the info for batched dirty logging.
+ * Each entry shadows one cache line of the shared dirty log bitmap,
+ * i.e. VHOST_LOG_CACHE_WORDS * 64 contiguous guest pages.
  */
 struct log_cache_entry {
-	uint32_t offset;
-	unsigned long val;
+	unsigned long val[VHOST_LOG_CACHE_WORDS];
+	/* Cache line index in the dirty log bitmap */
+	uint64_t line;
+};
+
+/*
+ * Direct-mapped dirty log cache, indexed by log bitmap cache line.
+ * Slots in use are tracked so that a sync only visits dirty lines.
+ */
+struct vhost_log_cache {
+	struct log_cache_entry entries[VHOST_LOG_CACHE_NR];
+	uint16_t used[VHOST_LOG_CACHE_NR];
 };
 
 struct vring_used_elem_packed {
@@ -328,7 +344,8 @@ struct vhost_virtqueue {
 	/* Physical address of used ring, for logging */
 	uint16_t		log_cache_nb_elem;
 	uint64_t		log_guest_addr;
-	struct log_cache_entry	*log_cache;
+	struct vhost_log_cache	*log_cache;
+	struct rte_vhost_log_stats log_stats;
 
 	rte_rwlock_t	iotlb_lock;
 	rte_rwlock_t	iotlb_pending_lock;
@@ -356,6 +373,14 @@ struct vhost_virtqueue {
 #define VIRTIO_UNINITIALIZED_NOTIF	(-1)
 
 	struct vhost_vring_addr ring_addrs;
+
+	/* Guest notification coalescing state */
+	uint16_t		vring_idx;
+	uint16_t		notify_pending;
+	uint16_t		notify_thresh;
+	bool			notify_queued;
+	uint64_t		notify_first_tsc;
+	struct rte_vhost_notify_stats notify_stats;
 } __rte_cache_aligned;
 
 /* Virtio device status as per Virtio specification */
@@ -541,6 +566,15 @@ struct virtio_net {
 	struct rte_vhost_user_extern_ops extern_ops;
 
 	int conn_fd;
+
+	/* vhost-user message handling latency, NULL when not enabled */
+	struct vhost_msg_latency *msg_latency;
+
+	/* Guest notification coalescing, disabled when max_calls is 0 */
+	struct rte_vhost_notify_coalesce_conf notify_coalesce;
+	uint64_t		notify_coalesce_cycles;
+	/* A vDPA device has an alarm pending to deliver deferred calls */
+	uint32_t		notify_alarm_armed;
 } __rte_cache_aligned;
 
 static __rte_always_inline bool
@@ -587,6 +621,7 @@ void __vhost_log_cache_write_iova(struct virtio_net *dev,
 void __vhost_log_cache_sync(struct virtio_net *dev,
 		struct vhost_virtqueue *vq);
 void __vhost_log_write(struct virtio_net *dev, uint64_t addr, uint64_t len);
+struct vhost_log_cache *vhost_log_cache_alloc(int numa_node);
 void __vhost_log_write_iova(struct virtio_net *dev, struct vhost_virtqueue *vq,
 			    uint64_t iova, uint64_t len);
 
@@ -698,6 +733,7 @@ extern int vhost_data_log_level;
 #endif
 
 extern struct virtio_net *vhost_devices[RTE_MAX_VHOST_DEVICE];
+extern pthread_mutex_t vhost_dev_lock;
 
 #define VHOST_BINARY_SEARCH_THRESH 256
 
@@ -890,6 +926,23 @@ vhost_need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old)
 	return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old);
 }
 
+bool vhost_vring_notify_defer(struct virtio_net *dev,
+		struct vhost_virtqueue *vq);
+void vhost_notify_purge(struct virtio_net *dev);
+
+static __rte_always_inline void
+vhost_vring_notify_guest(struct virtio_net *dev, struct vhost_virtqueue *vq)
+{
+	if (unlikely(dev->notify_coalesce.max_calls) &&
+			vhost_vring_notify_defer(dev, vq))
+		return;
+
+	eventfd_write(vq->callfd, (eventfd_t)1);
+	vq->notify_stats.delivered++;
+	if (dev->notify_ops->guest_notified)
+		dev->notify_ops->guest_notified(dev->vid);
+}
+
 static __rte_always_inline void
 vhost_vring_call_split(struct virtio_net *dev, struct vhost_virtqueue *vq)
 {
@@ -912,19 +965,13 @@ vhost_vring_call_split(struct virtio_net *dev, struct vhost_virtqueue *vq)
 
 		if ((vhost_need_event(vhost_used_event(vq), new, old) &&
 					(vq->callfd >= 0)) ||
-				unlikely(!signalled_used_valid)) {
-			eventfd_write(vq->callfd, (eventfd_t) 1);
-			if (dev->notify_ops->guest_notified)
-				dev->notify_ops->guest_notified(dev->vid);
-		}
+				unlikely(!signalled_used_valid))
+			vhost_vring_notify_guest(dev, vq);
 	} else {
 		/* Kick the guest if necessary. */
 		if (!(vq->avail->flags & VRING_AVAIL_F_NO_INTERRUPT)
-				&& (vq->callfd >= 0)) {
-			eventfd_write(vq->callfd, (eventfd_t)1);
-			if (dev->notify_ops->guest_notified)
-				dev->notify_ops->guest_notified(dev->vid);
-		}
+				&& (vq->callfd >= 0))
+			vhost_vring_notify_guest(dev, vq);
 	}
 }
 
@@ -975,11 +1022,8 @@ vhost_vring_call_packed(struct virtio_net *dev, struct vhost_virtqueue *vq)
 	if (vhost_need_event(off, new, old))
 		kick = true;
 kick:
-	if (kick) {
-		eventfd_write(vq->callfd, (eventfd_t)1);
-		if (dev->notify_ops->guest_notified)
-			dev->notify_ops->guest_notified(dev->vid);
-	}
+	if (kick)
+		vhost_vring_notify_guest(dev, vq);
 }
 
 static __rte_always_inline void
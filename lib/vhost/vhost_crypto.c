@@ -40,6 +40,8 @@
 		(1ULL << VIRTIO_RING_F_EVENT_IDX) |			\
 		(1ULL << VIRTIO_NET_F_CTRL_VQ) |			\
 		(1ULL << VIRTIO_F_VERSION_1) |				\
+		(1ULL << VIRTIO_F_RING_PACKED) |			\
+		(1ULL << VIRTIO_F_IN_ORDER) |				\
 		(1ULL << VHOST_USER_F_PROTOCOL_FEATURES))
 
 #define IOVA_TO_VVA(t, r, a, l, p)					\
@@ -185,6 +187,23 @@ static int get_iv_len(enum rte_crypto_cipher_algorithm algo)
 	return len;
 }
 
+/**
+ * Data path state of one queue, each queue being polled by one lcore.
+ */
+struct vhost_crypto_queue {
+	/** Last session used on the queue, to skip the table lookup */
+	uint64_t cache_session_id;
+	struct rte_cryptodev_sym_session *cache_session;
+} __rte_cache_aligned;
+
+/**
+ * Session of a request resolved while pre-parsing its burst.
+ */
+struct vhost_crypto_session_hint {
+	uint64_t session_id;
+	struct rte_cryptodev_sym_session *session;
+};
+
 /**
  * vhost_crypto struct is used to maintain a number of virtio_cryptos and
  * one DPDK crypto device that deals with all crypto workloads. It is declared
@@ -206,14 +225,14 @@ struct vhost_crypto {
 
 	uint64_t last_session_id;
 
-	uint64_t cache_session_id;
-	struct rte_cryptodev_sym_session *cache_session;
 	/** socket id for the device */
 	int socket_id;
 
 	struct virtio_net *dev;
 
 	uint8_t option;
+
+	struct vhost_crypto_queue queues[VHOST_MAX_QUEUE_PAIRS];
 } __rte_cache_aligned;
 
 struct vhost_crypto_writeback_data {
@@ -417,6 +436,7 @@ vhost_crypto_close_sess(struct vhost_crypto *vcrypto, uint64_t session_id)
 {
 	struct rte_cryptodev_sym_session *session;
 	uint64_t sess_id = session_id;
+	unsigned int i;
 	int ret;
 
 	ret = rte_hash_lookup_data(vcrypto->session_map, &sess_id,
@@ -442,6 +462,11 @@ vhost_crypto_close_sess(struct vhost_crypto *vcrypto, uint64_t session_id)
 		return -VIRTIO_CRYPTO_ERR;
 	}
 
+	/* don't let the data path pick the freed session from a cache */
+	for (i = 0; i < VHOST_MAX_QUEUE_PAIRS; i++)
+		if (vcrypto->queues[i].cache_session_id == sess_id)
+			vcrypto->queues[i].cache_session_id = UINT64_MAX;
+
 	VC_LOG_INFO("Session %"PRIu64" deleted for vdev %i.", sess_id,
 			vcrypto->dev->vid);
 
@@ -1165,28 +1190,20 @@ prepare_sym_chain_op(struct vhost_crypto *vcrypto, struct rte_crypto_op *op,
 }
 
 /**
- * Process on descriptor
+ * Copy the descriptor chain of a split ring indirect table to descs.
+ * Return 0 on success, -1 if the request can't be answered or a virtio
+ * crypto status to report in its in header.
  */
 static __rte_always_inline int
-vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
-		struct vhost_virtqueue *vq, struct rte_crypto_op *op,
+vhost_crypto_copy_descs_split(struct vhost_crypto_data_req *vc_req,
 		struct vring_desc *head, struct vhost_crypto_desc *descs,
-		uint16_t desc_idx)
+		uint32_t *max_n_descs)
 {
-	struct vhost_crypto_data_req *vc_req = rte_mbuf_to_priv(op->sym->m_src);
-	struct rte_cryptodev_sym_session *session;
-	struct virtio_crypto_op_data_req req;
 	struct virtio_crypto_inhdr *inhdr;
 	struct vhost_crypto_desc *desc = descs;
 	struct vring_desc *src_desc;
-	uint64_t session_id;
+	uint32_t nb_descs, i;
 	uint64_t dlen;
-	uint32_t nb_descs = 0, max_n_descs, i;
-	int err;
-
-	vc_req->desc_idx = desc_idx;
-	vc_req->dev = vcrypto->dev;
-	vc_req->vq = vq;
 
 	if (unlikely((head->flags & VRING_DESC_F_INDIRECT) == 0)) {
 		VC_LOG_ERR("Invalid descriptor");
@@ -1202,14 +1219,13 @@ vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
 	}
 	head = src_desc;
 
-	nb_descs = max_n_descs = dlen / sizeof(struct vring_desc);
+	nb_descs = dlen / sizeof(struct vring_desc);
 	if (unlikely(nb_descs > VHOST_CRYPTO_MAX_N_DESC || nb_descs == 0)) {
-		err = VIRTIO_CRYPTO_ERR;
 		VC_LOG_ERR("Cannot process num of descriptors %u", nb_descs);
 		if (nb_descs > 0) {
 			struct vring_desc *inhdr_desc = head;
 			while (inhdr_desc->flags & VRING_DESC_F_NEXT) {
-				if (inhdr_desc->next >= max_n_descs)
+				if (inhdr_desc->next >= nb_descs)
 					return -1;
 				inhdr_desc = &head[inhdr_desc->next];
 			}
@@ -1221,31 +1237,125 @@ vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
 			if (unlikely(!inhdr || dlen != inhdr_desc->len))
 				return -1;
 			inhdr->status = VIRTIO_CRYPTO_ERR;
-			return -1;
 		}
+		return -1;
 	}
+	*max_n_descs = nb_descs;
 
 	/* copy descriptors to local variable */
-	for (i = 0; i < max_n_descs; i++) {
+	for (i = 0; i < nb_descs; i++) {
 		desc->addr = src_desc->addr;
 		desc->len = src_desc->len;
 		desc->flags = src_desc->flags;
 		desc++;
 		if (unlikely((src_desc->flags & VRING_DESC_F_NEXT) == 0))
 			break;
-		if (unlikely(src_desc->next >= max_n_descs)) {
-			err = VIRTIO_CRYPTO_BADMSG;
+		if (unlikely(src_desc->next >= nb_descs)) {
 			VC_LOG_ERR("Invalid descriptor");
-			goto error_exit;
+			return VIRTIO_CRYPTO_BADMSG;
 		}
 		src_desc = &head[src_desc->next];
 	}
 
 	vc_req->head = head;
-	vc_req->zero_copy = vcrypto->option;
 
-	nb_descs = desc - descs;
-	desc = descs;
+	return 0;
+}
+
+/**
+ * Copy the descriptors of a packed ring indirect table to descs, they are
+ * laid out in chain order with no next field.
+ */
+static __rte_always_inline int
+vhost_crypto_copy_descs_packed(struct vhost_crypto_data_req *vc_req,
+		struct vring_packed_desc *head, struct vhost_crypto_desc *descs,
+		uint32_t *max_n_descs)
+{
+	struct virtio_crypto_inhdr *inhdr;
+	struct vring_packed_desc *src_desc, *last;
+	uint32_t nb_descs, i;
+	uint64_t dlen;
+
+	if (unlikely((head->flags & VRING_DESC_F_INDIRECT) == 0)) {
+		VC_LOG_ERR("Invalid descriptor");
+		return -1;
+	}
+
+	dlen = head->len;
+	src_desc = IOVA_TO_VVA(struct vring_packed_desc *, vc_req, head->addr,
+			&dlen, VHOST_ACCESS_RO);
+	if (unlikely(!src_desc || dlen != head->len)) {
+		VC_LOG_ERR("Invalid descriptor");
+		return -1;
+	}
+
+	nb_descs = dlen / sizeof(struct vring_packed_desc);
+	if (unlikely(nb_descs > VHOST_CRYPTO_MAX_N_DESC || nb_descs == 0)) {
+		VC_LOG_ERR("Cannot process num of descriptors %u", nb_descs);
+		if (nb_descs > 0) {
+			last = &src_desc[nb_descs - 1];
+			if (last->len != sizeof(*inhdr))
+				return -1;
+			dlen = last->len;
+			inhdr = IOVA_TO_VVA(struct virtio_crypto_inhdr *,
+					vc_req, last->addr, &dlen,
+					VHOST_ACCESS_WO);
+			if (unlikely(!inhdr || dlen != last->len))
+				return -1;
+			inhdr->status = VIRTIO_CRYPTO_ERR;
+		}
+		return -1;
+	}
+	*max_n_descs = nb_descs;
+
+	for (i = 0; i < nb_descs; i++) {
+		descs[i].addr = src_desc[i].addr;
+		descs[i].len = src_desc[i].len;
+		descs[i].flags = src_desc[i].flags & VRING_DESC_F_WRITE;
+		if (i + 1 < nb_descs)
+			descs[i].flags |= VRING_DESC_F_NEXT;
+	}
+
+	vc_req->head = (struct vring_desc *)src_desc;
+
+	return 0;
+}
+
+/**
+ * Process on descriptor
+ */
+static __rte_always_inline int
+vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
+		struct vhost_virtqueue *vq, struct vhost_crypto_queue *q,
+		struct rte_crypto_op *op, void *head,
+		struct vhost_crypto_desc *descs, uint16_t desc_idx,
+		const struct vhost_crypto_session_hint *hint, bool packed)
+{
+	struct vhost_crypto_data_req *vc_req = rte_mbuf_to_priv(op->sym->m_src);
+	struct rte_cryptodev_sym_session *session;
+	struct virtio_crypto_op_data_req req;
+	struct virtio_crypto_inhdr *inhdr;
+	struct vhost_crypto_desc *desc = descs;
+	uint64_t session_id;
+	uint32_t max_n_descs = 0;
+	int err;
+
+	vc_req->desc_idx = desc_idx;
+	vc_req->dev = vcrypto->dev;
+	vc_req->vq = vq;
+
+	if (packed)
+		err = vhost_crypto_copy_descs_packed(vc_req, head, descs,
+				&max_n_descs);
+	else
+		err = vhost_crypto_copy_descs_split(vc_req, head, descs,
+				&max_n_descs);
+	if (unlikely(err < 0))
+		return -1;
+	if (unlikely(err > 0))
+		goto error_exit;
+
+	vc_req->zero_copy = vcrypto->option;
 
 	if (unlikely(desc->len < sizeof(req))) {
 		err = VIRTIO_CRYPTO_BADMSG;
@@ -1268,8 +1378,14 @@ vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
 	case VIRTIO_CRYPTO_CIPHER_DECRYPT:
 		session_id = req.header.session_id;
 
+		/* resolved for the whole burst, the guest may have changed the
+		 * request since, so check it is still the same session.
+		 */
+		if (likely(hint->session != NULL &&
+				hint->session_id == session_id)) {
+			session = hint->session;
 		/* one branch to avoid unnecessary table lookup */
-		if (vcrypto->cache_session_id != session_id) {
+		} else if (q->cache_session_id != session_id) {
 			err = rte_hash_lookup_data(vcrypto->session_map,
 					&session_id, (void **)&session);
 			if (unlikely(err < 0)) {
@@ -1279,12 +1395,12 @@ vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
 				goto error_exit;
 			}
 
-			vcrypto->cache_session = session;
-			vcrypto->cache_session_id = session_id;
+			q->cache_session = session;
+			q->cache_session_id = session_id;
+		} else {
+			session = q->cache_session;
 		}
 
-		session = vcrypto->cache_session;
-
 		err = rte_crypto_op_attach_sym_session(op, session);
 		if (unlikely(err < 0)) {
 			err = VIRTIO_CRYPTO_ERR;
@@ -1332,20 +1448,18 @@ vhost_crypto_process_one_req(struct vhost_crypto *vcrypto,
 
 static __rte_always_inline struct vhost_virtqueue *
 vhost_crypto_finalize_one_request(struct rte_crypto_op *op,
-		struct vhost_virtqueue *old_vq)
+		struct vhost_virtqueue *old_vq, uint16_t *id, uint32_t *len)
 {
 	struct rte_mbuf *m_src = op->sym->m_src;
 	struct rte_mbuf *m_dst = op->sym->m_dst;
 	struct vhost_crypto_data_req *vc_req = rte_mbuf_to_priv(m_src);
 	struct vhost_virtqueue *vq;
-	uint16_t used_idx, desc_idx;
 
 	if (unlikely(!vc_req)) {
 		VC_LOG_ERR("Failed to retrieve vc_req");
 		return NULL;
 	}
 	vq = vc_req->vq;
-	used_idx = vc_req->desc_idx;
 
 	if (old_vq && (vq != old_vq))
 		return vq;
@@ -1357,9 +1471,8 @@ vhost_crypto_finalize_one_request(struct rte_crypto_op *op,
 			write_back_data(vc_req);
 	}
 
-	desc_idx = vq->avail->ring[used_idx];
-	vq->used->ring[desc_idx].id = vq->avail->ring[desc_idx];
-	vq->used->ring[desc_idx].len = vc_req->len;
+	*id = vc_req->desc_idx;
+	*len = vc_req->len;
 
 	rte_mempool_put(m_src->pool, (void *)m_src);
 
@@ -1369,24 +1482,93 @@ vhost_crypto_finalize_one_request(struct rte_crypto_op *op,
 	return vc_req->vq;
 }
 
+/**
+ * Return a burst of completed requests of one queue to the guest. The
+ * entries go first and the guest is shown the whole burst with a single
+ * used index or head descriptor flags store. With in-order, a packed ring
+ * gets one used descriptor for the burst.
+ */
+static __rte_always_inline void
+vhost_crypto_flush_used(struct virtio_net *dev, struct vhost_virtqueue *vq,
+		uint16_t *ids, uint32_t *lens, uint16_t count)
+{
+	struct vring_packed_desc *descs;
+	uint16_t i, idx, head_idx, head_flags;
+	bool wrap;
+
+	if (!vq_is_packed(dev)) {
+		for (i = 0; i < count; i++) {
+			idx = (vq->last_used_idx + i) & (vq->size - 1);
+			vq->used->ring[idx].id = ids[i];
+			vq->used->ring[idx].len = lens[i];
+		}
+		vq->last_used_idx += count;
+		__atomic_store_n(&vq->used->idx, vq->last_used_idx,
+				__ATOMIC_RELEASE);
+		return;
+	}
+
+	/* each request is a single indirect descriptor */
+	descs = vq->desc_packed;
+	head_idx = vq->last_used_idx;
+	wrap = vq->used_wrap_counter;
+	head_flags = PACKED_DESC_ENQUEUE_USED_FLAG(wrap);
+
+	if (dev->features & (1ULL << VIRTIO_F_IN_ORDER)) {
+		descs[head_idx].id = ids[count - 1];
+		descs[head_idx].len = lens[count - 1];
+		vq_inc_last_used_packed(vq, count);
+	} else {
+		for (i = 0; i < count; i++) {
+			descs[vq->last_used_idx].id = ids[i];
+			descs[vq->last_used_idx].len = lens[i];
+			vq_inc_last_used_packed(vq, 1);
+		}
+
+		rte_atomic_thread_fence(__ATOMIC_RELEASE);
+
+		/* the guest walks used descriptors in order from the head */
+		idx = head_idx;
+		for (i = 1; i < count; i++) {
+			if (++idx >= vq->size) {
+				idx = 0;
+				wrap ^= 1;
+			}
+			descs[idx].flags = PACKED_DESC_ENQUEUE_USED_FLAG(wrap);
+		}
+	}
+
+	/* desc flags is the synchronization point for virtio packed vring */
+	__atomic_store_n(&descs[head_idx].flags, head_flags, __ATOMIC_RELEASE);
+}
+
 static __rte_always_inline uint16_t
 vhost_crypto_complete_one_vm_requests(struct rte_crypto_op **ops,
 		uint16_t nb_ops, int *callfd)
 {
+	uint16_t ids[VHOST_CRYPTO_MAX_BURST_SIZE];
+	uint32_t lens[VHOST_CRYPTO_MAX_BURST_SIZE];
 	uint16_t processed = 1;
 	struct vhost_virtqueue *vq, *tmp_vq;
+	struct vhost_crypto_data_req *vc_req;
+	struct virtio_net *dev;
 
 	if (unlikely(nb_ops == 0))
 		return 0;
 
-	vq = vhost_crypto_finalize_one_request(ops[0], NULL);
+	/* the request is released with its mbuf */
+	vc_req = rte_mbuf_to_priv(ops[0]->sym->m_src);
+	dev = vc_req->dev;
+	vq = vhost_crypto_finalize_one_request(ops[0], NULL, &ids[0],
+			&lens[0]);
 	if (unlikely(vq == NULL))
 		return 0;
 	tmp_vq = vq;
 
+	nb_ops = RTE_MIN(nb_ops, VHOST_CRYPTO_MAX_BURST_SIZE);
 	while ((processed < nb_ops)) {
 		tmp_vq = vhost_crypto_finalize_one_request(ops[processed],
-				tmp_vq);
+				tmp_vq, &ids[processed], &lens[processed]);
 
 		if (unlikely(vq != tmp_vq))
 			break;
@@ -1396,7 +1578,7 @@ vhost_crypto_complete_one_vm_requests(struct rte_crypto_op **ops,
 
 	*callfd = vq->callfd;
 
-	*(volatile uint16_t *)&vq->used->idx += processed;
+	vhost_crypto_flush_used(dev, vq, ids, lens, processed);
 
 	return processed;
 }
@@ -1432,6 +1614,7 @@ rte_vhost_crypto_create(int vid, uint8_t cryptodev_id,
 	struct rte_hash_parameters params = {0};
 	struct vhost_crypto *vcrypto;
 	char name[128];
+	unsigned int i;
 	int ret;
 
 	if (!dev) {
@@ -1449,7 +1632,8 @@ rte_vhost_crypto_create(int vid, uint8_t cryptodev_id,
 	vcrypto->sess_pool = sess_pool;
 	vcrypto->sess_priv_pool = sess_priv_pool;
 	vcrypto->cid = cryptodev_id;
-	vcrypto->cache_session_id = UINT64_MAX;
+	for (i = 0; i < VHOST_MAX_QUEUE_PAIRS; i++)
+		vcrypto->queues[i].cache_session_id = UINT64_MAX;
 	vcrypto->last_session_id = 1;
 	vcrypto->dev = dev;
 	vcrypto->option = RTE_VHOST_CRYPTO_ZERO_COPY_DISABLE;
@@ -1590,19 +1774,172 @@ rte_vhost_crypto_set_zero_copy(int vid, enum rte_vhost_crypto_zero_copy option)
 	return 0;
 }
 
+/**
+ * Gather the head descriptors of up to count available requests.
+ */
+static __rte_always_inline uint16_t
+vhost_crypto_avail_heads(struct virtio_net *dev, struct vhost_virtqueue *vq,
+		uint16_t count, void **heads, uint16_t *ids)
+{
+	struct vring_packed_desc *desc;
+	uint16_t avail_idx, idx, i;
+	bool wrap;
+
+	if (vq_is_packed(dev)) {
+		idx = vq->last_avail_idx;
+		wrap = vq->avail_wrap_counter;
+		for (i = 0; i < count; i++) {
+			desc = &vq->desc_packed[idx];
+			if (!desc_is_avail(desc, wrap))
+				break;
+			heads[i] = desc;
+			ids[i] = desc->id;
+			if (++idx >= vq->size) {
+				idx = 0;
+				wrap ^= 1;
+			}
+		}
+		return i;
+	}
+
+	avail_idx = __atomic_load_n(&vq->avail->idx, __ATOMIC_ACQUIRE);
+	count = RTE_MIN(count, (uint16_t)(avail_idx - vq->last_avail_idx));
+	for (i = 0; i < count; i++) {
+		ids[i] = vq->avail->ring[(vq->last_avail_idx + i) &
+				(vq->size - 1)];
+		if (unlikely(ids[i] >= vq->size)) {
+			VC_LOG_ERR("Invalid descriptor index %u", ids[i]);
+			break;
+		}
+		heads[i] = &vq->desc[ids[i]];
+	}
+	return i;
+}
+
+/**
+ * Pre-parse a burst of requests: reach and prefetch the request header of
+ * each chain, then look the sessions missing from the queue cache up at
+ * once. Requests that can't be pre-parsed get no hint and are fully checked
+ * when processed.
+ */
+static __rte_always_inline void
+vhost_crypto_preparse_burst(struct vhost_crypto *vcrypto,
+		struct vhost_virtqueue *vq, struct vhost_crypto_queue *q,
+		void **heads, uint16_t count,
+		struct vhost_crypto_session_hint *hints, bool packed)
+{
+	struct virtio_crypto_op_header *hdrs[VHOST_CRYPTO_MAX_BURST_SIZE];
+	struct vring_desc *tables[VHOST_CRYPTO_MAX_BURST_SIZE];
+	uint64_t keys[VHOST_CRYPTO_MAX_BURST_SIZE];
+	const void *key_ptrs[VHOST_CRYPTO_MAX_BURST_SIZE];
+	void *sessions[VHOST_CRYPTO_MAX_BURST_SIZE];
+	uint8_t key_idx[VHOST_CRYPTO_MAX_BURST_SIZE];
+	struct virtio_net *dev = vcrypto->dev;
+	struct vring_desc *head;
+	uint64_t hit_mask = 0;
+	uint64_t dlen, session_id;
+	uint16_t i, flags, nb_keys = 0;
+
+	/**
+	 * indirect descriptor tables, the request header comes first. split
+	 * and packed descriptors only differ after the address and length.
+	 */
+	for (i = 0; i < count; i++) {
+		head = heads[i];
+		if (packed)
+			flags = ((struct vring_packed_desc *)heads[i])->flags;
+		else
+			flags = head->flags;
+
+		tables[i] = NULL;
+		if (unlikely((flags & VRING_DESC_F_INDIRECT) == 0 ||
+				head->len < sizeof(struct vring_desc)))
+			continue;
+		dlen = sizeof(struct vring_desc);
+		tables[i] = (struct vring_desc *)(uintptr_t)vhost_iova_to_vva(
+				dev, vq, head->addr, &dlen, VHOST_ACCESS_RO);
+		if (unlikely(dlen != sizeof(struct vring_desc)))
+			tables[i] = NULL;
+		else
+			rte_prefetch0(tables[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		hdrs[i] = NULL;
+		if (tables[i] == NULL || unlikely(tables[i]->len <
+				sizeof(struct virtio_crypto_op_data_req)))
+			continue;
+		dlen = sizeof(struct virtio_crypto_op_header);
+		hdrs[i] = (struct virtio_crypto_op_header *)(uintptr_t)
+				vhost_iova_to_vva(dev, vq, tables[i]->addr,
+				&dlen, VHOST_ACCESS_RO);
+		if (unlikely(dlen != sizeof(struct virtio_crypto_op_header)))
+			hdrs[i] = NULL;
+		else
+			rte_prefetch0(hdrs[i]);
+	}
+
+	/* consecutive requests mostly share a session, look it up once */
+	for (i = 0; i < count; i++) {
+		hints[i].session = NULL;
+		key_idx[i] = UINT8_MAX;
+		if (hdrs[i] == NULL || (hdrs[i]->opcode !=
+				VIRTIO_CRYPTO_CIPHER_ENCRYPT && hdrs[i]->opcode !=
+				VIRTIO_CRYPTO_CIPHER_DECRYPT))
+			continue;
+
+		session_id = hdrs[i]->session_id;
+		hints[i].session_id = session_id;
+		if (session_id == q->cache_session_id) {
+			hints[i].session = q->cache_session;
+			continue;
+		}
+
+		if (nb_keys == 0 || keys[nb_keys - 1] != session_id) {
+			keys[nb_keys] = session_id;
+			key_ptrs[nb_keys] = &keys[nb_keys];
+			nb_keys++;
+		}
+		key_idx[i] = nb_keys - 1;
+	}
+
+	if (nb_keys == 0)
+		return;
+
+	if (unlikely(rte_hash_lookup_bulk_data(vcrypto->session_map, key_ptrs,
+			nb_keys, &hit_mask, sessions) < 0))
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (key_idx[i] == UINT8_MAX)
+			continue;
+		if (hit_mask & (1ULL << key_idx[i]))
+			hints[i].session = sessions[key_idx[i]];
+	}
+
+	/* next burst likely continues with the last session */
+	if (hit_mask & (1ULL << (nb_keys - 1))) {
+		q->cache_session = sessions[nb_keys - 1];
+		q->cache_session_id = keys[nb_keys - 1];
+	}
+}
+
 uint16_t
 rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 		struct rte_crypto_op **ops, uint16_t nb_ops)
 {
 	struct rte_mbuf *mbufs[VHOST_CRYPTO_MAX_BURST_SIZE * 2];
+	struct vhost_crypto_session_hint hints[VHOST_CRYPTO_MAX_BURST_SIZE];
 	struct vhost_crypto_desc descs[VHOST_CRYPTO_MAX_N_DESC];
+	void *heads[VHOST_CRYPTO_MAX_BURST_SIZE];
+	uint16_t ids[VHOST_CRYPTO_MAX_BURST_SIZE];
 	struct virtio_net *dev = get_device(vid);
 	struct vhost_crypto *vcrypto;
+	struct vhost_crypto_queue *q;
 	struct vhost_virtqueue *vq;
-	uint16_t avail_idx;
-	uint16_t start_idx;
 	uint16_t count;
 	uint16_t i = 0;
+	bool packed;
 
 	if (unlikely(dev == NULL)) {
 		VC_LOG_ERR("Invalid vid %i", vid);
@@ -1621,16 +1958,18 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 	}
 
 	vq = dev->virtqueue[qid];
+	q = &vcrypto->queues[qid];
 
-	avail_idx = *((volatile uint16_t *)&vq->avail->idx);
-	start_idx = vq->last_used_idx;
-	count = avail_idx - start_idx;
-	count = RTE_MIN(count, VHOST_CRYPTO_MAX_BURST_SIZE);
-	count = RTE_MIN(count, nb_ops);
+	packed = vq_is_packed(dev);
 
+	count = RTE_MIN(nb_ops, VHOST_CRYPTO_MAX_BURST_SIZE);
+	count = vhost_crypto_avail_heads(dev, vq, count, heads, ids);
 	if (unlikely(count == 0))
 		return 0;
 
+	vhost_crypto_preparse_burst(vcrypto, vq, q, heads, count, hints,
+			packed);
+
 	/* for zero copy, we need 2 empty mbufs for src and dst, otherwise
 	 * we need only 1 mbuf as src and dst
 	 */
@@ -1643,9 +1982,6 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 		}
 
 		for (i = 0; i < count; i++) {
-			uint16_t used_idx = (start_idx + i) & (vq->size - 1);
-			uint16_t desc_idx = vq->avail->ring[used_idx];
-			struct vring_desc *head = &vq->desc[desc_idx];
 			struct rte_crypto_op *op = ops[i];
 
 			op->sym->m_src = mbufs[i * 2];
@@ -1654,7 +1990,8 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 			op->sym->m_dst->data_off = 0;
 
 			if (unlikely(vhost_crypto_process_one_req(vcrypto, vq,
-					op, head, descs, used_idx) < 0))
+					q, op, heads[i], descs, ids[i],
+					&hints[i], packed) < 0))
 				break;
 		}
 
@@ -1673,9 +2010,6 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 		}
 
 		for (i = 0; i < count; i++) {
-			uint16_t used_idx = (start_idx + i) & (vq->size - 1);
-			uint16_t desc_idx = vq->avail->ring[used_idx];
-			struct vring_desc *head = &vq->desc[desc_idx];
 			struct rte_crypto_op *op = ops[i];
 
 			op->sym->m_src = mbufs[i];
@@ -1683,7 +2017,8 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 			op->sym->m_src->data_off = 0;
 
 			if (unlikely(vhost_crypto_process_one_req(vcrypto, vq,
-					op, head, descs, desc_idx) < 0))
+					q, op, heads[i], descs, ids[i],
+					&hints[i], packed) < 0))
 				break;
 		}
 
@@ -1696,7 +2031,11 @@ rte_vhost_crypto_fetch_requests(int vid, uint32_t qid,
 
 	}
 
-	vq->last_used_idx += i;
+	/* each request takes a single indirect descriptor */
+	if (packed)
+		vq_inc_last_avail_packed(vq, i);
+	else
+		vq->last_avail_idx += i;
 
 	return i;
 }
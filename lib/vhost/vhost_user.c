@@ -19,6 +19,7 @@
  * Do not assume received VhostUserMsg fields contain sensible values!
  */
 
+#include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,8 +42,11 @@
 #endif
 
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_malloc.h>
 #include <rte_log.h>
+#include <rte_spinlock.h>
+#include <rte_telemetry.h>
 #include <rte_vfio.h>
 #include <rte_errno.h>
 
@@ -1743,6 +1747,12 @@ vhost_check_queue_inflights_split(struct virtio_net *dev,
 		return RTE_VHOST_MSG_RESULT_OK;
 	}
 
+	/* The rings of a vDPA device are processed by the hardware, the
+	 * driver reconciles the inflight region against them itself.
+	 */
+	if (dev->vdpa_dev)
+		return RTE_VHOST_MSG_RESULT_OK;
+
 	if (vq->resubmit_inflight)
 		return RTE_VHOST_MSG_RESULT_OK;
 
@@ -2145,7 +2155,7 @@ vhost_user_set_log_base(struct virtio_net **pdev,
 {
 	struct virtio_net *dev = *pdev;
 	int fd = ctx->fds[0];
-	uint64_t size, off;
+	uint64_t size, off, old_addr, old_size;
 	void *addr;
 	uint32_t i;
 
@@ -2188,16 +2198,24 @@ vhost_user_set_log_base(struct virtio_net **pdev,
 		return RTE_VHOST_MSG_RESULT_ERR;
 	}
 
+	old_addr = dev->log_addr;
+	old_size = dev->log_size;
+	dev->log_addr = (uint64_t)(uintptr_t)addr;
+	dev->log_base = dev->log_addr + off;
+	dev->log_size = size;
+
+	/* vDPA device may write to the old log, let it move first */
+	if (dev->vdpa_dev && dev->vdpa_dev->ops->set_log_base &&
+			dev->vdpa_dev->ops->set_log_base(dev->vid))
+		VHOST_LOG_CONFIG(ERR, "(%s) vDPA device failed to switch log base\n",
+				dev->ifname);
+
 	/*
 	 * Free previously mapped log memory on occasionally
 	 * multiple VHOST_USER_SET_LOG_BASE.
 	 */
-	if (dev->log_addr) {
-		munmap((void *)(uintptr_t)dev->log_addr, dev->log_size);
-	}
-	dev->log_addr = (uint64_t)(uintptr_t)addr;
-	dev->log_base = dev->log_addr + off;
-	dev->log_size = size;
+	if (old_addr)
+		munmap((void *)(uintptr_t)old_addr, old_size);
 
 	for (i = 0; i < dev->nr_vring; i++) {
 		struct vhost_virtqueue *vq = dev->virtqueue[i];
@@ -2205,9 +2223,7 @@ vhost_user_set_log_base(struct virtio_net **pdev,
 		rte_free(vq->log_cache);
 		vq->log_cache = NULL;
 		vq->log_cache_nb_elem = 0;
-		vq->log_cache = rte_malloc_socket("vq log cache",
-				sizeof(struct log_cache_entry) * VHOST_LOG_CACHE_NR,
-				0, vq->numa_node);
+		vq->log_cache = vhost_log_cache_alloc(vq->numa_node);
 		/*
 		 * If log cache alloc fail, don't fail migration, but no
 		 * caching will be done, which will impact performance
@@ -2837,6 +2853,145 @@ vhost_user_unlock_all_queue_pairs(struct virtio_net *dev)
 	}
 }
 
+/*
+ * vhost-user message handling latency. Disabled by default, the message
+ * handler then only pays for a flag check.
+ */
+#define VHOST_SLOW_MSG_NR	64
+#define VHOST_SLOW_MSG_SUMMARY_LEN	64
+
+struct vhost_slow_msg {
+	struct timespec ts;
+	int vid;
+	int request;
+	uint64_t latency_us;
+	char ifname[RTE_TEL_MAX_STRING_LEN];
+	char summary[VHOST_SLOW_MSG_SUMMARY_LEN];
+};
+
+static struct {
+	bool enabled;
+	uint64_t slow_cycles;
+	rte_spinlock_t lock;
+	uint32_t head;
+	uint32_t count;
+	struct vhost_slow_msg msgs[VHOST_SLOW_MSG_NR];
+} vhost_msg_stats = {
+	.lock = RTE_SPINLOCK_INITIALIZER,
+};
+
+int
+rte_vhost_msg_latency_enable(bool enable, uint32_t slow_msg_usecs)
+{
+	vhost_msg_stats.slow_cycles = slow_msg_usecs ?
+		rte_get_tsc_hz() * slow_msg_usecs / 1E6 : UINT64_MAX;
+	__atomic_store_n(&vhost_msg_stats.enabled, enable, __ATOMIC_RELEASE);
+
+	VHOST_LOG_CONFIG(INFO, "vhost-user message latency tracking %s, slow threshold %u us\n",
+			enable ? "enabled" : "disabled", slow_msg_usecs);
+
+	return 0;
+}
+
+static const char *
+vhost_msg_latency_name(int request)
+{
+	if (request == VHOST_MSG_LAT_VDPA_DEV_CONF)
+		return "VDPA_DEV_CONF";
+
+	return vhost_message_str[request];
+}
+
+static void
+vhost_user_msg_summary(int request, struct vhu_msg_context *ctx,
+		char *buf, size_t len)
+{
+	VhostUserMsg *msg = &ctx->msg;
+
+	switch (request) {
+	case VHOST_USER_SET_MEM_TABLE:
+		snprintf(buf, len, "nregions=%u", msg->payload.memory.nregions);
+		break;
+	case VHOST_USER_SET_VRING_NUM:
+	case VHOST_USER_SET_VRING_BASE:
+	case VHOST_USER_GET_VRING_BASE:
+	case VHOST_USER_SET_VRING_ENABLE:
+		snprintf(buf, len, "index=%u num=%u",
+				msg->payload.state.index, msg->payload.state.num);
+		break;
+	case VHOST_USER_SET_VRING_ADDR:
+		snprintf(buf, len, "index=%u flags=0x%x",
+				msg->payload.addr.index, msg->payload.addr.flags);
+		break;
+	case VHOST_USER_SET_VRING_KICK:
+	case VHOST_USER_SET_VRING_CALL:
+	case VHOST_USER_SET_VRING_ERR:
+		snprintf(buf, len, "index=%" PRIu64 " nofd=%d",
+				msg->payload.u64 & VHOST_USER_VRING_IDX_MASK,
+				!!(msg->payload.u64 & VHOST_USER_VRING_NOFD_MASK));
+		break;
+	case VHOST_USER_SET_FEATURES:
+	case VHOST_USER_SET_PROTOCOL_FEATURES:
+	case VHOST_USER_SET_STATUS:
+		snprintf(buf, len, "u64=0x%" PRIx64, msg->payload.u64);
+		break;
+	default:
+		snprintf(buf, len, "size=%u fds=%d", msg->size, ctx->fd_num);
+		break;
+	}
+}
+
+static void
+vhost_user_msg_latency_record(struct virtio_net *dev, int request,
+		struct vhu_msg_context *ctx, uint64_t start)
+{
+	uint64_t cycles = rte_get_tsc_cycles() - start;
+	uint64_t us = cycles * 1E6 / rte_get_tsc_hz();
+	struct vhost_msg_latency *lat;
+	struct vhost_slow_msg *slow;
+	uint32_t bucket;
+
+	if (request <= VHOST_USER_NONE || request >= VHOST_MSG_LAT_NB ||
+			!vhost_msg_latency_name(request))
+		return;
+
+	if (!dev->msg_latency) {
+		dev->msg_latency = rte_zmalloc(NULL,
+				sizeof(*dev->msg_latency) * VHOST_MSG_LAT_NB, 0);
+		if (!dev->msg_latency)
+			return;
+	}
+
+	lat = &dev->msg_latency[request];
+	bucket = us ? RTE_MIN(rte_fls_u64(us), VHOST_MSG_LAT_BUCKETS - 1U) : 0;
+	lat->count++;
+	lat->total_us += us;
+	lat->max_us = RTE_MAX(lat->max_us, us);
+	lat->hist[bucket]++;
+
+	if (cycles < vhost_msg_stats.slow_cycles)
+		return;
+
+	rte_spinlock_lock(&vhost_msg_stats.lock);
+	slow = &vhost_msg_stats.msgs[vhost_msg_stats.head];
+	vhost_msg_stats.head = (vhost_msg_stats.head + 1) % VHOST_SLOW_MSG_NR;
+	vhost_msg_stats.count = RTE_MIN(vhost_msg_stats.count + 1, VHOST_SLOW_MSG_NR);
+	clock_gettime(CLOCK_REALTIME, &slow->ts);
+	slow->vid = dev->vid;
+	slow->request = request;
+	slow->latency_us = us;
+	strlcpy(slow->ifname, dev->ifname, sizeof(slow->ifname));
+	if (ctx)
+		vhost_user_msg_summary(request, ctx, slow->summary,
+				sizeof(slow->summary));
+	else
+		slow->summary[0] = '\0';
+	rte_spinlock_unlock(&vhost_msg_stats.lock);
+
+	VHOST_LOG_CONFIG(INFO, "(%s) slow %s handling: %" PRIu64 " us\n",
+			dev->ifname, vhost_msg_latency_name(request), us);
+}
+
 int
 vhost_user_msg_handler(int vid, int fd)
 {
@@ -2848,6 +3003,7 @@ vhost_user_msg_handler(int vid, int fd)
 	bool handled;
 	int request;
 	uint32_t i;
+	uint64_t start_tsc = 0;
 
 	dev = get_device(vid);
 	if (dev == NULL)
@@ -2872,6 +3028,9 @@ vhost_user_msg_handler(int vid, int fd)
 		return -1;
 	}
 
+	if (unlikely(__atomic_load_n(&vhost_msg_stats.enabled, __ATOMIC_ACQUIRE)))
+		start_tsc = rte_get_tsc_cycles();
+
 	ret = 0;
 	request = ctx.msg.request.master;
 	if (request > VHOST_USER_NONE && request < VHOST_USER_MAX &&
@@ -3005,6 +3164,8 @@ vhost_user_msg_handler(int vid, int fd)
 		send_vhost_reply(dev, fd, &ctx);
 	} else if (ret == RTE_VHOST_MSG_RESULT_ERR) {
 		VHOST_LOG_CONFIG(ERR, "(%s) vhost message handling failed.\n", dev->ifname);
+		if (unlikely(start_tsc))
+			vhost_user_msg_latency_record(dev, request, &ctx, start_tsc);
 		return -1;
 	}
 
@@ -3021,6 +3182,9 @@ vhost_user_msg_handler(int vid, int fd)
 	if (unlock_required)
 		vhost_user_unlock_all_queue_pairs(dev);
 
+	if (unlikely(start_tsc))
+		vhost_user_msg_latency_record(dev, request, &ctx, start_tsc);
+
 	if (!virtio_is_ready(dev))
 		goto out;
 
@@ -3040,11 +3204,16 @@ vhost_user_msg_handler(int vid, int fd)
 		goto out;
 
 	if (!(dev->flags & VIRTIO_DEV_VDPA_CONFIGURED)) {
+		if (unlikely(start_tsc))
+			start_tsc = rte_get_tsc_cycles();
 		if (vdpa_dev->ops->dev_conf(dev->vid))
 			VHOST_LOG_CONFIG(ERR, "(%s) failed to configure vDPA device\n",
 					dev->ifname);
 		else
 			dev->flags |= VIRTIO_DEV_VDPA_CONFIGURED;
+		if (unlikely(start_tsc))
+			vhost_user_msg_latency_record(dev,
+					VHOST_MSG_LAT_VDPA_DEV_CONF, NULL, start_tsc);
 	}
 
 out:
@@ -3269,3 +3438,105 @@ int rte_vhost_host_notifier_ctrl(int vid, uint16_t qid, bool enable)
 
 	return ret;
 }
+
+static int
+vhost_user_handle_msg_latency(const char *cmd __rte_unused,
+		const char *params, struct rte_tel_data *d)
+{
+	struct virtio_net *dev;
+	char *end_param;
+	unsigned long vid;
+	int i, j;
+
+	if (params == NULL || strlen(params) == 0 || !isdigit(*params))
+		return -EINVAL;
+
+	vid = strtoul(params, &end_param, 0);
+	if (*end_param != '\0' || vid >= RTE_MAX_VHOST_DEVICE)
+		return -EINVAL;
+
+	rte_tel_data_start_dict(d);
+
+	pthread_mutex_lock(&vhost_dev_lock);
+	dev = vhost_devices[vid];
+	if (dev == NULL) {
+		pthread_mutex_unlock(&vhost_dev_lock);
+		return -EINVAL;
+	}
+
+	rte_tel_data_add_dict_string(d, "ifname", dev->ifname);
+	for (i = VHOST_USER_NONE + 1; dev->msg_latency && i < VHOST_MSG_LAT_NB; i++) {
+		struct vhost_msg_latency *lat = &dev->msg_latency[i];
+		struct rte_tel_data *hist;
+
+		if (!lat->count || !vhost_msg_latency_name(i))
+			continue;
+
+		hist = rte_tel_data_alloc();
+		if (hist == NULL)
+			break;
+
+		rte_tel_data_start_array(hist, RTE_TEL_U64_VAL);
+		rte_tel_data_add_array_u64(hist, lat->count);
+		rte_tel_data_add_array_u64(hist, lat->total_us);
+		rte_tel_data_add_array_u64(hist, lat->max_us);
+		for (j = 0; j < VHOST_MSG_LAT_BUCKETS; j++)
+			rte_tel_data_add_array_u64(hist, lat->hist[j]);
+		rte_tel_data_add_dict_container(d, vhost_msg_latency_name(i),
+				hist, 0);
+	}
+	pthread_mutex_unlock(&vhost_dev_lock);
+
+	return 0;
+}
+
+static int
+vhost_user_handle_slow_msgs(const char *cmd __rte_unused,
+		const char *params __rte_unused, struct rte_tel_data *d)
+{
+	char buf[RTE_TEL_MAX_STRING_LEN];
+	uint32_t i, idx;
+
+	rte_tel_data_start_array(d, RTE_TEL_CONTAINER);
+
+	rte_spinlock_lock(&vhost_msg_stats.lock);
+	/* Oldest first */
+	idx = (vhost_msg_stats.head + VHOST_SLOW_MSG_NR - vhost_msg_stats.count) %
+		VHOST_SLOW_MSG_NR;
+	for (i = 0; i < vhost_msg_stats.count; i++) {
+		struct vhost_slow_msg *slow = &vhost_msg_stats.msgs[idx];
+		struct rte_tel_data *entry = rte_tel_data_alloc();
+
+		if (entry == NULL)
+			break;
+
+		rte_tel_data_start_array(entry, RTE_TEL_STRING_VAL);
+		snprintf(buf, sizeof(buf), "%ld.%06ld", (long)slow->ts.tv_sec,
+				slow->ts.tv_nsec / 1000);
+		rte_tel_data_add_array_string(entry, buf);
+		snprintf(buf, sizeof(buf), "%d", slow->vid);
+		rte_tel_data_add_array_string(entry, buf);
+		rte_tel_data_add_array_string(entry, slow->ifname);
+		rte_tel_data_add_array_string(entry,
+				vhost_msg_latency_name(slow->request));
+		snprintf(buf, sizeof(buf), "%" PRIu64, slow->latency_us);
+		rte_tel_data_add_array_string(entry, buf);
+		rte_tel_data_add_array_string(entry, slow->summary);
+		rte_tel_data_add_array_container(d, entry, 0);
+
+		idx = (idx + 1) % VHOST_SLOW_MSG_NR;
+	}
+	rte_spinlock_unlock(&vhost_msg_stats.lock);
+
+	return 0;
+}
+
+RTE_INIT(vhost_user_telemetry_init)
+{
+	rte_telemetry_register_cmd("/vhost/msg_latency",
+			vhost_user_handle_msg_latency,
+			"Returns vhost-user message latency histograms. Parameters: int vid");
+	rte_telemetry_register_cmd("/vhost/slow_msgs",
+			vhost_user_handle_slow_msgs,
+			"Returns the last slow vhost-user messages. Takes no parameters");
+}
@@ -182,6 +182,19 @@ struct __rte_packed vhu_msg_context {
 
 #define VHOST_USER_HDR_SIZE offsetof(VhostUserMsg, payload.u64)
 
+/* Latency histogram buckets, bucket n counts handling times below 2^n us */
+#define VHOST_MSG_LAT_BUCKETS	16
+/* Latency slot accounting the vDPA device configuration step */
+#define VHOST_MSG_LAT_VDPA_DEV_CONF	VHOST_USER_MAX
+#define VHOST_MSG_LAT_NB	(VHOST_USER_MAX + 1)
+
+struct vhost_msg_latency {
+	uint64_t count;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint64_t hist[VHOST_MSG_LAT_BUCKETS];
+};
+
 /* The version of the protocol we support */
 #define VHOST_USER_VERSION    0x1
 